@@ -165,6 +165,11 @@ class RTP_JitterBuffer : public PObject
     PDECLARE_NOTIFIER(PThread, RTP_JitterBuffer, JitterThreadMain);
 
   protected:
+    /**Get the time of arrival and playout, a derived buffer may run on
+       another clock than the system tick.
+      */
+    virtual PTimeInterval GetTick() const { return PTimer::Tick(); }
+
     //virtual void Main();
 
     class Entry : public RTP_DataFrame
@@ -218,6 +223,9 @@ class RTP_JitterBuffer : public PObject
     BOOL Init(Entry * & currentReadFrame, BOOL & markerWarning);
     BOOL PreRead(Entry * & currentReadFrame, BOOL & markerWarning);
     BOOL OnRead(Entry * & currentReadFrame, BOOL & markerWarning, BOOL loop);
+    /**Queue a frame just read, returns with bufferMutex locked.
+      */
+    void InsertFrame(Entry * currentReadFrame, BOOL & markerWarning);
     void DeInit(Entry * & currentReadFrame, BOOL & markerWarning);
 };
 
@@ -351,13 +351,14 @@ RTP_JitterBuffer::~RTP_JitterBuffer()
   shuttingDown = TRUE;
 
 #ifdef H323_RTP_AGGREGATE
-  if (jitterThread == NULL) {
+  if (aggregratedHandle != NULL) {
     aggregratedHandle->Remove();
     delete aggregratedHandle;  
     aggregratedHandle = NULL;
   } else 
 #endif
-  {
+  // No thread if the buffer is filled by its reader
+  if (jitterThread != NULL) {
     PTRACE(3, "RTP\tRemoving jitter buffer " << this << ' ' << jitterThread->GetThreadName());
     PAssert(jitterThread->WaitForTermination(10000), "Jitter buffer thread did not terminate");
     delete jitterThread;
@@ -547,7 +548,14 @@ BOOL RTP_JitterBuffer::OnRead(RTP_JitterBuffer::Entry * & currentReadFrame, BOOL
     return FALSE;
   }
 
-  currentReadFrame->tick = PTimer::Tick();
+  InsertFrame(currentReadFrame, markerWarning);
+  return TRUE;
+}
+
+
+void RTP_JitterBuffer::InsertFrame(RTP_JitterBuffer::Entry * currentReadFrame, BOOL & markerWarning)
+{
+  currentReadFrame->tick = GetTick();
 
   if (consecutiveMarkerBits < maxConsecutiveMarkerBits) {
     if (currentReadFrame->GetMarker()) {
@@ -606,8 +614,6 @@ BOOL RTP_JitterBuffer::OnRead(RTP_JitterBuffer::Entry * & currentReadFrame, BOOL
   }
 
   currentDepth++;
-
-  return TRUE;
 }
 
 
@@ -693,7 +699,7 @@ BOOL RTP_JitterBuffer::ReadData(DWORD timestamp, RTP_DataFrame & frame)
     */
 
     // If oldest frame has not been in the buffer long enough, don't return anything yet
-    if ((PTimer::Tick() - oldestFrame->tick).GetInterval() * 8
+    if ((GetTick() - oldestFrame->tick).GetInterval() * 8
          < currentJitterTime / 2) {
 #if PTRACING && !defined(NO_ANALYSER)
       analyser->Out(oldestTimestamp, currentDepth, "PreBuf");
@@ -710,7 +716,7 @@ BOOL RTP_JitterBuffer::ReadData(DWORD timestamp, RTP_DataFrame & frame)
   BOOL shortSilence = FALSE;
   if (consecutiveMarkerBits < maxConsecutiveMarkerBits) {
       if (oldestFrame->GetMarker() &&
-          (PTimer::Tick() - oldestFrame->tick).GetInterval()* 8 < currentJitterTime / 2)
+          (GetTick() - oldestFrame->tick).GetInterval()* 8 < currentJitterTime / 2)
         shortSilence = TRUE;
   }
   else if (timestamp < oldestTimestamp && timestamp > (newestTimestamp - currentJitterTime))
@@ -766,7 +772,7 @@ BOOL RTP_JitterBuffer::ReadData(DWORD timestamp, RTP_DataFrame & frame)
     if (thisJitter > (int) currentJitterTime * LOWER_JITTER_MAX_PCNT / 100) {
       targetJitterTime = currentJitterTime;
       PTRACE(3, "RTP\tJitter buffer target realigned to current jitter buffer");
-      consecutiveEarlyPacketStartTime = PTimer::Tick();
+      consecutiveEarlyPacketStartTime = GetTick();
       jitterCalcPacketCount = 0;
       jitterCalc = 0;
     }
@@ -799,7 +805,7 @@ BOOL RTP_JitterBuffer::ReadData(DWORD timestamp, RTP_DataFrame & frame)
     // If exceeded current jitter buffer time delay:
     if ((newestTimestamp - currentWriteFrame->GetTimestamp()) > currentJitterTime) {
       PTRACE(4, "RTP\tJitter buffer length exceeded");
-      consecutiveEarlyPacketStartTime = PTimer::Tick();
+      consecutiveEarlyPacketStartTime = GetTick();
       jitterCalcPacketCount = 0;
       jitterCalc = 0;
       lastWriteTimestamp = 0;
@@ -875,7 +881,7 @@ BOOL RTP_JitterBuffer::ReadData(DWORD timestamp, RTP_DataFrame & frame)
     }
   }
 
-  if ((PTimer::Tick() - consecutiveEarlyPacketStartTime).GetInterval() > DECREASE_JITTER_PERIOD &&
+  if ((GetTick() - consecutiveEarlyPacketStartTime).GetInterval() > DECREASE_JITTER_PERIOD &&
        jitterCalcPacketCount >= DECREASE_JITTER_MIN_PACKETS){
     jitterCalc = jitterCalc * 100 / LOWER_JITTER_MAX_PCNT;
     if (jitterCalc < targetJitterTime / 2) jitterCalc = targetJitterTime / 2;
@@ -885,7 +891,7 @@ BOOL RTP_JitterBuffer::ReadData(DWORD timestamp, RTP_DataFrame & frame)
                << targetJitterTime << " (" << (targetJitterTime/8) << "ms)");
     jitterCalc = 0;
     jitterCalcPacketCount = 0;
-    consecutiveEarlyPacketStartTime = PTimer::Tick();
+    consecutiveEarlyPacketStartTime = GetTick();
   }
 
   /* If using immediate jitter reduction (rather than waiting for silence opportunities)
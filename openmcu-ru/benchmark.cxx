@@ -0,0 +1,3942 @@
+/*
+ * benchmark.cxx
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+#include "mcu.h"
+#include "benchmark.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <poll.h>
+#endif
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t GetThreadCPUTime()
+{
+#ifdef _WIN32
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if(!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+    return 0;
+  return ((((uint64_t)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime)
+        + (((uint64_t)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime)) / 10;
+#else
+  struct timespec ts;
+  if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ConferenceSyntheticMember::ConferenceSyntheticMember(Conference * _conference, MCUBenchmark * _benchmark, unsigned _index, unsigned _width, unsigned _height, unsigned _frameRate, const PString & _cacheName)
+  : ConferenceMember(_conference)
+{
+  memberType = MEMBER_TYPE_CONN;
+  visible = TRUE;
+  benchmark = _benchmark;
+  index = _index;
+  width = _width;
+  height = _height;
+  frameRate = _frameRate;
+  cacheName = _cacheName;
+  name = "synthetic " + PString(index);
+  callToken = "synthetic-" + PString(GetID());
+
+  running = TRUE;
+  audioThread = PThread::Create(PCREATE_NOTIFIER(AudioThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "synthetic_audio:%0x");
+  videoThread = PThread::Create(PCREATE_NOTIFIER(VideoThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "synthetic_video:%0x");
+  cacheThread = NULL;
+  if(cacheName != "")
+    cacheThread = PThread::Create(PCREATE_NOTIFIER(CacheThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "synthetic_cache:%0x");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ConferenceSyntheticMember::~ConferenceSyntheticMember()
+{
+  Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ConferenceSyntheticMember::Close()
+{
+  running = FALSE;
+  if(audioThread)
+  {
+    audioThread->WaitForTermination(10000);
+    delete audioThread;
+    audioThread = NULL;
+  }
+  if(videoThread)
+  {
+    videoThread->WaitForTermination(10000);
+    delete videoThread;
+    videoThread = NULL;
+  }
+  if(cacheThread)
+  {
+    cacheThread->WaitForTermination(10000);
+    delete cacheThread;
+    cacheThread = NULL;
+  }
+  // the conference waits for offline members before deleting them
+  callToken = "";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ConferenceSyntheticMember::FillPattern(BYTE * frame, unsigned frameNumber)
+{
+  // diagonal bars moving by two pixels per frame, a different colour for each member,
+  // the encoders get motion on every frame as from a camera
+  BYTE *y = frame;
+  for(unsigned row = 0; row < height; row++)
+    for(unsigned col = 0; col < width; col++)
+      *y++ = (BYTE)(((col + row + frameNumber * 2) & 0x3f) * 3 + 32);
+
+  unsigned chromaSize = (width / 2) * (height / 2);
+  memset(frame + width * height, (BYTE)(64 + index * 37), chromaSize);
+  memset(frame + width * height + chromaSize, (BYTE)(192 - index * 23), chromaSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ConferenceSyntheticMember::AudioThread(PThread &, INT)
+{
+  // 20 ms of 16 kHz mono, a tone of its own frequency for each member
+  const unsigned sampleRate = 16000;
+  const unsigned samples = sampleRate / 50;
+  const double twoPi = 6.283185307179586;
+  const double step = twoPi * (300 + 50 * (index % 16)) / sampleRate;
+  PShortArray writeBuffer(samples), readBuffer(samples);
+  double phase = 0;
+  uint64_t generatorUsec = 0;
+
+  MCUDelay delay;
+  while(running)
+  {
+    uint64_t cpu = GetThreadCPUTime();
+    for(unsigned i = 0; i < samples; i++)
+    {
+      writeBuffer[i] = (short)(8000 * sin(phase));
+      phase += step;
+    }
+    if(phase > twoPi)
+      phase -= twoPi * (int)(phase / twoPi);
+    generatorUsec += GetThreadCPUTime() - cpu;
+
+    uint64_t timestamp = delay.GetDelayTimestampUsec();
+    WriteAudio(timestamp, writeBuffer.GetPointer(), samples * 2, sampleRate, 1);
+
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    ReadAudio(timestamp, readBuffer.GetPointer(), samples * 2, sampleRate, 1);
+    benchmark->AddSample(MCUBenchmark::STAGE_AUDIO_READ, MCUTime::GetMonoTimestampUsec() - start);
+
+    delay.Delay(20);
+  }
+  benchmark->AddGeneratorTime(generatorUsec);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ConferenceSyntheticMember::VideoThread(PThread &, INT)
+{
+  MCUBuffer buffer(width * height * 3 / 2);
+  unsigned frameNumber = 0;
+  uint64_t generatorUsec = 0;
+
+  MCUDelay delay;
+  while(running)
+  {
+    uint64_t cpu = GetThreadCPUTime();
+    FillPattern(buffer.GetPointer(), frameNumber++);
+    generatorUsec += GetThreadCPUTime() - cpu;
+
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    WriteVideo(MCUPlanesYUV(buffer.GetPointer(), width, height), width, height);
+    benchmark->AddSample(MCUBenchmark::STAGE_VIDEO_WRITE, MCUTime::GetMonoTimestampUsec() - start);
+
+    delay.DelayUsec(1000000 / frameRate);
+  }
+  benchmark->AddGeneratorTime(generatorUsec);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ConferenceSyntheticMember::CacheThread(PThread &, INT)
+{
+  CacheRTP *cache = NULL;
+  unsigned seqN = 0;
+  while(running && !AttachCacheRTP(cache, cacheName, seqN))
+    MCUTime::Sleep(100);
+
+  RTP_DataFrame frame;
+  while(running && cache)
+  {
+    unsigned length = 0, flags = 0;
+    if(!GetCacheRTP(cache, frame, length, seqN, flags))
+      break;
+    // the cache encoder stamps frames with the 90 kHz capture time
+    if(length > 0 && frame.GetMarker())
+    {
+      DWORD now = (DWORD)(MCUTime::GetMonoTimestampUsec() * 9 / 100);
+      benchmark->AddSample(MCUBenchmark::STAGE_ENCODE, (uint64_t)(DWORD)(now - frame.GetTimestamp()) * 100 / 9);
+    }
+  }
+
+  DetachCacheRTP(cache);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PMutex MCUBenchmark::runMutex;
+
+MCUBenchmark::MCUBenchmark()
+{
+  trace_section = "Benchmark: ";
+  generatorUsec = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const char * MCUBenchmark::GetStageName(unsigned stage)
+{
+  switch(stage)
+  {
+    case STAGE_VIDEO_WRITE: return "video_write";
+    case STAGE_AUDIO_READ:  return "audio_read";
+    case STAGE_ENCODE:      return "encode";
+  }
+  return "";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUBenchmark::AddSample(unsigned stage, uint64_t value)
+{
+  PWaitAndSignal m(sampleMutex);
+  if(stage < STAGE_COUNT && samples[stage].size() < BENCHMARK_MAX_SAMPLES)
+    samples[stage].push_back(value);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUBenchmark::AddGeneratorTime(uint64_t usec)
+{
+  PWaitAndSignal m(sampleMutex);
+  generatorUsec += usec;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t MCUBenchmark::GetProcessCPUTime()
+{
+#ifdef _WIN32
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if(!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    return 0;
+  return ((((uint64_t)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime)
+        + (((uint64_t)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime)) / 10;
+#else
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t MCUBenchmark::GetMemoryUsage()
+{
+  // resident set size, bytes
+#ifdef __linux__
+  FILE *f = fopen("/proc/self/statm", "r");
+  if(f == NULL)
+    return 0;
+  unsigned long size = 0, resident = 0;
+  int ret = fscanf(f, "%lu %lu", &size, &resident);
+  fclose(f);
+  if(ret != 2)
+    return 0;
+  return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUBenchmark::GetThreadGroups(ThreadGroupMap & groups)
+{
+  // CPU time of the threads grouped by the name prefix: "cache", "synthetic_video", ...
+#ifdef __linux__
+  long ticks = sysconf(_SC_CLK_TCK);
+  PDirectory dir("/proc/self/task");
+  if(ticks <= 0 || !dir.Open())
+    return;
+  do
+  {
+    PString tid = dir.GetEntryName();
+    if(tid == "." || tid == "..")
+      continue;
+    FILE *f = fopen("/proc/self/task/" + tid + "/stat", "r");
+    if(f == NULL)
+      continue;
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = 0;
+
+    // pid (comm) state ppid ... utime stime, the name can contain spaces and brackets
+    char *open = strchr(buf, '(');
+    char *close = strrchr(buf, ')');
+    if(open == NULL || close == NULL || close < open)
+      continue;
+    PString name(open + 1, close - open - 1);
+    PINDEX colon = name.Find(":");
+    if(colon != P_MAX_INDEX)
+      name = name.Left(colon);
+
+    unsigned long utime = 0, stime = 0;
+    if(sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+      continue;
+    ThreadGroupTime & group = groups[name];
+    group.usec += (uint64_t)(utime + stime) * 1000000 / ticks;
+    group.threads++;
+  } while(dir.Next());
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+double MCUBenchmark::GetMetricUpdateNsec()
+{
+  // the most expensive update: a timed histogram observation, two clock reads and two atomic additions
+  MCUMetric metric(MCUMetric::Histogram, "benchmark", "");
+  const unsigned count = 1000000;
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned i = 0; i < count; i++)
+  {
+    uint64_t observeStart = MCUTime::GetMonoTimestampUsec();
+    metric.Observe(MCUTime::GetMonoTimestampUsec() - observeStart);
+  }
+  return (double)(MCUTime::GetMonoTimestampUsec() - start) * 1000 / count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+unsigned MCUBenchmark::GetEncoderCount(const PString & room)
+{
+  PString suffix = "_" + room + "/";
+  unsigned count = 0;
+  for(MCUCacheRTPList::shared_iterator it = cacheRTPList.begin(); it != cacheRTPList.end(); ++it)
+  {
+    if(it->GetName().Find(suffix) != P_MAX_INDEX)
+      count++;
+  }
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunRegistrar(const PStringToString & params, PString & result)
+{
+  // the timer of a registrar that is not started, visited as its timer thread does, and the scans
+  // of the former account and book threads over the same accounts; the time is virtual, from now,
+  // every account refreshes the registration at a half of the expiration time
+  unsigned accounts = params("registrar").AsUnsigned();
+  unsigned cycles = params.Contains("cycles") ? params("cycles").AsUnsigned() : 10;
+  unsigned expires = params.Contains("expires") ? params("expires").AsUnsigned() : 60;
+
+  accounts = PMAX(1, PMIN(accounts, PMIN(BENCHMARK_MAX_ACCOUNTS, REGISTRAR_MAX_ACCOUNTS)));
+  cycles = PMAX(1, PMIN(cycles, 100));
+  expires = PMAX(1, PMIN(expires, 3600));
+
+  const PInt64 tick = 100; // msec, the period of the account thread
+  const PInt64 bookTick = 1000; // msec, the period of the book thread
+  PInt64 refresh = (PInt64)expires * 500;
+  PInt64 duration = refresh * cycles;
+  PInt64 base = RegistrarTimer::GetTime();
+
+  Registrar registrar(NULL, NULL);
+  MCURegistrarAccountList & accountList = registrar.GetAccountList();
+  MCUAbookList & abookList = registrar.GetAbookList();
+  std::vector<PString> usernames(accounts);
+  for(unsigned i = 0; i < accounts; i++)
+  {
+    usernames[i] = "benchmark" + PString(i);
+    RegistrarAccount *raccount = registrar.InsertAccountWithLock(ACCOUNT_TYPE_SIP, usernames[i]);
+    if(raccount)
+      raccount->Unlock();
+  }
+  // the address book entries are made by the first visits
+  registrar.ProcessTimer(base);
+
+  // the REGISTER sets the account and arms it, the timer thread visits the due accounts
+  uint64_t registrations = 0;
+  uint64_t timerVisits = 0;
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(PInt64 now = 0; now < duration; now += tick)
+  {
+    unsigned first = (unsigned)((now % refresh) * accounts / refresh);
+    unsigned last = (unsigned)PMIN((PInt64)accounts, ((now % refresh) + tick) * accounts / refresh);
+    for(unsigned i = first; i < last; i++)
+    {
+      RegistrarAccount *raccount = registrar.FindAccountWithLock(ACCOUNT_TYPE_SIP, usernames[i]);
+      if(raccount == NULL)
+        continue;
+      raccount->registered = TRUE;
+      raccount->expires = expires;
+      raccount->start_time = PTime((time_t)((base + now) / 1000), (long)((base + now) % 1000) * 1000);
+      registrar.ArmAccount(raccount);
+      raccount->Unlock();
+      registrations++;
+    }
+    timerVisits += registrar.ProcessTimer(base + now);
+  }
+  uint64_t timerUsec = MCUTime::GetMonoTimestampUsec() - start;
+  unsigned timerRegistered = 0;
+  for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+  {
+    if(it->registered)
+      timerRegistered++;
+    it->registered = FALSE;
+  }
+
+  // the account thread checked every account each tick, the book thread looked up
+  // the address book entry of every account each second; the address book updates
+  // are left out here and not in the timer, the scan cost is a lower bound
+  uint64_t scanVisits = 0;
+  start = MCUTime::GetMonoTimestampUsec();
+  for(PInt64 now = 0; now < duration; now += tick)
+  {
+    unsigned first = (unsigned)((now % refresh) * accounts / refresh);
+    unsigned last = (unsigned)PMIN((PInt64)accounts, ((now % refresh) + tick) * accounts / refresh);
+    for(unsigned i = first; i < last; i++)
+    {
+      RegistrarAccount *raccount = registrar.FindAccountWithLock(ACCOUNT_TYPE_SIP, usernames[i]);
+      if(raccount == NULL)
+        continue;
+      raccount->registered = TRUE;
+      raccount->expires = expires;
+      raccount->start_time = PTime((time_t)((base + now) / 1000), (long)((base + now) % 1000) * 1000);
+      raccount->Unlock();
+    }
+    PTime nowTime((time_t)((base + now) / 1000), (long)((base + now) % 1000) * 1000);
+    for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+    {
+      RegistrarAccount *raccount = *it;
+      scanVisits++;
+      if(raccount->registered)
+      {
+        if(nowTime > raccount->start_time + PTimeInterval(raccount->expires*1000))
+          raccount->registered = FALSE;
+      }
+    }
+    if(now % bookTick == 0)
+    {
+      for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+      {
+        scanVisits++;
+        abookList.Find(PString(it->account_type)+":"+it->username);
+      }
+    }
+  }
+  uint64_t scanUsec = MCUTime::GetMonoTimestampUsec() - start;
+  unsigned scanRegistered = 0;
+  for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+  {
+    if(it->registered)
+      scanRegistered++;
+  }
+
+  // the registrar was not started, the lists are cleared here,
+  // the rooms drop the address book entries sent by the visits
+  for(MCUAbookList::shared_iterator it = abookList.begin(); it != abookList.end(); ++it)
+  {
+    AbookAccount *ab = *it;
+    ab->SendRoomControl(2);
+    if(abookList.Erase(it))
+      delete ab;
+  }
+  for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+  {
+    RegistrarAccount *raccount = *it;
+    if(accountList.Erase(it))
+      delete raccount;
+  }
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("accounts", accounts);
+  json.Insert("cycles", cycles);
+  json.Insert("expires", expires);
+  json.Insert("registrations", (long long)registrations);
+  json.Insert("duration_msec", (long long)duration);
+
+  MCUJSON *jsonTimer = MCUJSON::Object("timer");
+  jsonTimer->Insert("visits", (long long)timerVisits);
+  jsonTimer->Insert("registered", timerRegistered);
+  jsonTimer->Insert("usec", (long long)timerUsec);
+  json.Insert(jsonTimer);
+
+  MCUJSON *jsonScan = MCUJSON::Object("scan");
+  jsonScan->Insert("visits", (long long)scanVisits);
+  jsonScan->Insert("registered", scanRegistered);
+  jsonScan->Insert("usec", (long long)scanUsec);
+  json.Insert(jsonScan);
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: registrar " << result);
+  return timerRegistered == scanRegistered;
+}
+
+////////
+
+MCUJSON * MCUBenchmark::RunLookupList(const char * name, MCURegistrarAccountList & accountList, unsigned accounts, unsigned lookups)
+{
+  // FindAccountWithLock() and Unlock() of random accounts,
+  // the gatekeeper admission looks up the source and the destination
+  uint64_t found = 0;
+  unsigned seed = 1;
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned i = 0; i < lookups; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    PString key = PString(ACCOUNT_TYPE_SIP)+":user"+PString((seed >> 8) % accounts);
+    MCURegistrarAccountList::shared_iterator it = accountList.Find(key);
+    if(it == accountList.end())
+      continue;
+    RegistrarAccount *raccount = it.GetCapturedObject();
+    accountList.Release(raccount->GetID());
+    found++;
+  }
+  uint64_t usec = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+
+  MCUJSON *json = MCUJSON::Object(name);
+  json->Insert("lookups", lookups);
+  json->Insert("found", (long long)found);
+  json->Insert("usec", (long long)usec);
+  json->Insert("lookups_per_sec", 1000000.0 * lookups / usec);
+  json->Insert("admissions_per_sec", 500000.0 * lookups / usec);
+  return json;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunLookup(const PStringToString & params, PString & result)
+{
+  PStringArray sizes = params("lookup").Tokenise(",", FALSE);
+  if(sizes.GetSize() == 0 || params("lookup") == "1")
+    sizes = PString("1000,10000,50000").Tokenise(",", FALSE);
+
+  MCUJSON json(MCUJSON::JSON_ARRAY);
+  for(PINDEX s = 0; s < sizes.GetSize(); s++)
+  {
+    unsigned accounts = PMAX(1, PMIN(sizes[s].AsUnsigned(), REGISTRAR_MAX_ACCOUNTS));
+
+    // the same accounts in the indexed list of the registrar and in a list without the index
+    MCURegistrarAccountList indexList(REGISTRAR_MAX_ACCOUNTS, true);
+    MCURegistrarAccountList scanList(accounts, false);
+    for(unsigned i = 0; i < accounts; i++)
+    {
+      RegistrarAccount *raccount = new RegistrarAccount(NULL, i, ACCOUNT_TYPE_SIP, "user"+PString(i));
+      PString key = PString(raccount->account_type)+":"+raccount->username;
+      indexList.Insert(raccount, i, key);
+      scanList.Insert(raccount, i, key);
+    }
+
+    MCUJSON *jsonSize = MCUJSON::Object();
+    jsonSize->Insert("accounts", accounts);
+    jsonSize->Insert(RunLookupList("index", indexList, accounts, 200000));
+    // a scan compares the names of all slots, fewer lookups for the same time
+    jsonSize->Insert(RunLookupList("scan", scanList, accounts, PMAX(100, 20000000 / accounts)));
+    json.Insert(jsonSize);
+
+    for(MCURegistrarAccountList::shared_iterator it = indexList.begin(); it != indexList.end(); ++it)
+    {
+      RegistrarAccount *raccount = *it;
+      scanList.Erase(raccount);
+      if(indexList.Erase(it))
+        delete raccount;
+    }
+  }
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: lookup " << result);
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// a member of the room status document, GetMemberDataJS() with a 2x2 layout
+static void BuildMemberJSON(MCUJSON * a, unsigned i)
+{
+  a->Insert(true);
+  a->Insert((long)i + 1);
+  a->Insert("member"+PString(i)+" [sip:member"+PString(i)+"@192.168.0.1]");
+  a->Insert(0);
+  a->Insert(false);
+  a->Insert(false);
+  a->Insert((int)(i % 100));
+  a->Insert(0);
+  a->Insert("member"+PString(i));
+  a->Insert(15);
+  a->Insert(0);
+  a->Insert(0);
+
+  MCUJSON *c = a->InsertArray();
+  MCUJSON *b = c->InsertArray();
+  b->Insert(704); b->Insert(576); b->Insert(3); b->Insert(0);
+  b = c->InsertArray();
+  for(unsigned n = 0; n < 4; n++)
+  {
+    MCUJSON *p = b->InsertArray();
+    p->Insert((n % 2) * 352); p->Insert((n / 2) * 288); p->Insert(352); p->Insert(288); p->Insert(0);
+  }
+  MCUJSON *v = c->InsertArray();
+  MCUJSON *r = v->InsertObject();
+  MCUJSON *q = v->InsertObject();
+  for(unsigned n = 0; n < 4; n++)
+  {
+    r->Insert(PString(n), (long)n + 1);
+    q->Insert(PString(n), 2);
+  }
+
+  a->Insert(1);
+  a->Insert(false);
+  a->Insert(0);
+}
+
+static void WriteMemberJSON(MCUJSONWriter & a, unsigned i)
+{
+  a.BeginArray();
+  a.Insert(true);
+  a.Insert((long)i + 1);
+  a.Insert("member"+PString(i)+" [sip:member"+PString(i)+"@192.168.0.1]");
+  a.Insert(0);
+  a.Insert(false);
+  a.Insert(false);
+  a.Insert((int)(i % 100));
+  a.Insert(0);
+  a.Insert("member"+PString(i));
+  a.Insert(15);
+  a.Insert(0);
+  a.Insert(0);
+
+  a.BeginArray();
+  a.BeginArray();
+  a.Insert(704); a.Insert(576); a.Insert(3); a.Insert(0);
+  a.End();
+  a.BeginArray();
+  for(unsigned n = 0; n < 4; n++)
+  {
+    a.BeginArray();
+    a.Insert((n % 2) * 352); a.Insert((n / 2) * 288); a.Insert(352); a.Insert(288); a.Insert(0);
+    a.End();
+  }
+  a.End();
+  a.BeginArray();
+  a.BeginObject();
+  for(unsigned n = 0; n < 4; n++)
+    a.Insert(PString(n), (long)n + 1);
+  a.End();
+  a.BeginObject();
+  for(unsigned n = 0; n < 4; n++)
+    a.Insert(PString(n), 2);
+  a.End();
+  a.End();
+  a.End();
+
+  a.Insert(1);
+  a.Insert(false);
+  a.Insert(0);
+  a.End();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunJSON(const PStringToString & params, PString & result)
+{
+  // the room status document of the members, built as a tree and written directly,
+  // the node and block counters of the arenas are shared with the server, run it on an idle server
+  unsigned members = params("json").AsUnsigned();
+  if(members <= 1)
+    members = 200;
+  members = PMIN(members, 10000);
+  unsigned documents = PMAX(10, 2000000 / (members * 50));
+
+  std::string domText;
+  uint64_t nodes = MCUJSON::GetNodeAllocations();
+  uint64_t blocks = MCUJSON::GetBlockAllocations();
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned d = 0; d < documents; d++)
+  {
+    // one arena for the document
+    MCUJSON json(MCUJSON::JSON_ARRAY);
+    for(unsigned i = 0; i < members; i++)
+      BuildMemberJSON(json.InsertArray(), i);
+    domText.clear();
+    json.ToString(domText);
+  }
+  uint64_t domUsec = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+  nodes = MCUJSON::GetNodeAllocations() - nodes;
+  blocks = MCUJSON::GetBlockAllocations() - blocks;
+
+  std::string writerText;
+  uint64_t writerNodes = MCUJSON::GetNodeAllocations();
+  start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned d = 0; d < documents; d++)
+  {
+    writerText.clear();
+    MCUJSONWriter a(writerText);
+    a.BeginArray();
+    for(unsigned i = 0; i < members; i++)
+      WriteMemberJSON(a, i);
+    a.End();
+  }
+  uint64_t writerUsec = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+  writerNodes = MCUJSON::GetNodeAllocations() - writerNodes;
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("members", members);
+  json.Insert("documents", documents);
+  json.Insert("bytes", (unsigned long)writerText.size());
+  json.Insert("equal", domText == writerText);
+
+  MCUJSON *jsonTree = MCUJSON::Object("tree");
+  jsonTree->Insert("usec_per_document", (double)domUsec / documents);
+  jsonTree->Insert("nodes_per_document", (double)nodes / documents);
+  jsonTree->Insert("arena_blocks_per_document", (double)blocks / documents);
+  json.Insert(jsonTree);
+
+  MCUJSON *jsonWriter = MCUJSON::Object("writer");
+  jsonWriter->Insert("usec_per_document", (double)writerUsec / documents);
+  jsonWriter->Insert("nodes_per_document", (double)writerNodes / documents);
+  json.Insert(jsonWriter);
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: json " << result);
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// members_<room>.conf as written before the template store: no version, old mute masks with gains,
+// names with commas, SKIP and "VMP -", a template without the room options; the store writes it
+// back as it is with the VERSION line on top
+static const char BenchmarkLegacyTemplates[] =
+  "TEMPLATE first\n"
+  "{\n"
+  "  GLOBAL_MUTE off\n"
+  "  CONTROL_TYPE manual\n"
+  "  VAD_VALUES 1000, 10000, 100\n"
+  "  MIXER 0\n"
+  "  {\n"
+  "    LAYOUT 3, 2x2\n"
+  "    VMP 1, Alice [sip:alice@10.0.0.1]\n"
+  "    VMP -\n"
+  "    VMP 2\n"
+  "    SKIP 2\n"
+  "  }\n"
+  "  MEMBER 1, 0/20/20, 2, 0, 0, Alice [sip:alice@10.0.0.1]\n"
+  "  MEMBER 0, 3, 1, 1, 0, Smith, John [h323:john@10.0.0.2]\n"
+  "}\n"
+  "\n"
+  "TEMPLATE second one\n"
+  "{\n"
+  "  MIXER 0\n"
+  "  {\n"
+  "    LAYOUT 0, 1x1\n"
+  "    VMP -\n"
+  "  }\n"
+  "}\n"
+  "\n"
+  "LAST_USED second one\n";
+
+static void BuildBenchmarkTemplate(MCUConferenceTemplate & tpl, unsigned index, unsigned members)
+{
+  tpl.name = "template " + PString(index);
+  tpl.globalMute = index & 1;
+  tpl.manualControl = 1;
+  tpl.hasVAD = TRUE;
+  tpl.vadDelay = 1000;
+  tpl.vadTimeout = 10000;
+  tpl.vadLevel = 100;
+  for(unsigned m = 0; m < 2; m++)
+  {
+    MCUTemplateMixer mixer;
+    mixer.number = m;
+    mixer.layoutNumber = 10 + m;
+    mixer.layoutId = "5x5";
+    for(unsigned i = 0; i < 25; i++)
+    {
+      if(i % 4 == 3)
+        mixer.positions.push_back(MCUTemplatePosition());
+      else
+        mixer.positions.push_back(MCUTemplatePosition(1 + i % 3, (i % 5 == 4) ? PString() : "member " + PString(i) + " [sip:" + PString(i) + "@10.0.0.1]"));
+    }
+    tpl.mixers.push_back(mixer);
+  }
+  for(unsigned i = 0; i < members; i++)
+  {
+    MCUTemplateMember member;
+    member.autoDial = i & 1;
+    member.muteMask = PString(i % 16);
+    member.options = i % 4;
+    member.chosenVan = (i % 7 == 0);
+    member.mixerNumber = i % 2;
+    member.name = "member " + PString(i) + ((i % 10 == 5) ? ",, " : " ") + "[sip:" + PString(i) + "@10.0.0.1]";
+    tpl.members.push_back(member);
+  }
+}
+
+// the members of the room that are not system ones
+static unsigned BenchmarkTemplateMembers(Conference * conference)
+{
+  unsigned count = 0;
+  MCUMemberList & memberList = conference->GetMemberList();
+  for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+  {
+    if(!it->IsSystem())
+      count++;
+  }
+  return count;
+}
+
+// the positions and the members of the room are as the template says
+static BOOL BenchmarkTemplateApplied(Conference * conference, const MCUConferenceTemplate & tpl, unsigned members)
+{
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  if(BenchmarkTemplateMembers(conference) != members)
+    return FALSE;
+  MCUSimpleVideoMixer *mixer = manager->FindVideoMixerWithLock(conference, 0);
+  if(mixer == NULL)
+    return FALSE;
+  BOOL ok = TRUE;
+  const std::vector<MCUTemplatePosition> & positions = tpl.mixers[0].positions;
+  for(unsigned i = 0; i < positions.size() && ok; i++)
+  {
+    ConferenceMember *member = manager->FindMemberSimilarWithLock(conference, positions[i].memberName);
+    ok = (member != NULL && mixer->GetPositionId((int)i) == member->GetID() && mixer->GetPositionType((int)i) == positions[i].type);
+    if(member)
+      member->Unlock();
+  }
+  mixer->Unlock();
+  for(unsigned i = 0; i < tpl.members.size() && ok; i++)
+  {
+    ConferenceMember *member = manager->FindMemberSimilarWithLock(conference, tpl.members[i].name);
+    ok = (member != NULL && member->autoDial == tpl.members[i].autoDial && member->muteMask == (unsigned)tpl.members[i].muteMask.AsInteger());
+    if(member)
+      member->Unlock();
+  }
+  return ok;
+}
+
+// Conference::LoadTemplate() on a room with offline members: the members found by similar names,
+// a reload without changes, a position changed by hand and the members dropped by a locked template
+static BOOL BenchmarkTemplateApply(MCUJSON & json)
+{
+  PString room = "benchmark_templates";
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference)
+  {
+    conference->Unlock();
+    json.Insert("apply_error", "room " + room + " exists");
+    return FALSE;
+  }
+  // a layout with three positions at least
+  PString layoutId;
+  unsigned layoutNumber = 0;
+  for(unsigned i = 0; i < OpenMCU::vmcfg.vmconfs && layoutId.IsEmpty(); i++)
+  {
+    if(OpenMCU::vmcfg.vmconf[i].splitcfg.vidnum >= 3)
+    {
+      layoutNumber = i;
+      layoutId = OpenMCU::vmcfg.vmconf[i].splitcfg.Id;
+    }
+  }
+  if(layoutId.IsEmpty())
+  {
+    json.Insert("apply_error", "no layout with three positions");
+    return FALSE;
+  }
+  conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  if(conference == NULL)
+  {
+    json.Insert("apply_error", "could not create room " + room);
+    return FALSE;
+  }
+
+  // bob is in the template by another name, extra is not in the template, carol is not in the room
+  const char * urls[] = { "sip:alice@10.0.0.1", "sip:bob@10.0.0.3", "sip:extra@10.0.0.4" };
+  for(unsigned i = 0; i < 3; i++)
+  {
+    ConferenceMember *member = new MCUConnection_ConferenceMember(conference, urls[i], "");
+    if(conference->AddMemberToList(member) == conference->GetMemberList().end())
+      delete member;
+  }
+
+  MCUConferenceTemplate tpl;
+  tpl.name = "benchmark";
+  MCUTemplateMixer mixer;
+  mixer.number = 0;
+  mixer.layoutNumber = layoutNumber;
+  mixer.layoutId = layoutId;
+  mixer.positions.push_back(MCUTemplatePosition(1, "Alice [sip:alice@10.0.0.1]"));
+  mixer.positions.push_back(MCUTemplatePosition(2, "Robert [sip:bob@10.0.0.3]"));
+  mixer.positions.push_back(MCUTemplatePosition(1, "Carol [sip:carol@10.0.0.5]"));
+  tpl.mixers.push_back(mixer);
+  for(unsigned i = 0; i < mixer.positions.size(); i++)
+  {
+    MCUTemplateMember member;
+    member.muteMask = PString(i);
+    member.name = mixer.positions[i].memberName;
+    tpl.members.push_back(member);
+  }
+
+  BOOL savedLocked = conference->lockedTemplate;
+  conference->lockedTemplate = FALSE;
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  conference->LoadTemplate(tpl);
+  uint64_t applyUsec = MCUTime::GetMonoTimestampUsec() - start;
+  BOOL applied = BenchmarkTemplateApplied(conference, tpl, 4);
+
+  start = MCUTime::GetMonoTimestampUsec();
+  conference->LoadTemplate(tpl);
+  uint64_t reapplyUsec = MCUTime::GetMonoTimestampUsec() - start;
+  BOOL reapplied = BenchmarkTemplateApplied(conference, tpl, 4);
+
+  // the position cleared by hand is set up again
+  MCUSimpleVideoMixer *videoMixer = manager->FindVideoMixerWithLock(conference, 0);
+  if(videoMixer)
+  {
+    videoMixer->MyRemoveVideoSource(1, TRUE);
+    videoMixer->Unlock();
+  }
+  conference->LoadTemplate(tpl);
+  BOOL restored = BenchmarkTemplateApplied(conference, tpl, 4);
+
+  conference->lockedTemplate = TRUE;
+  conference->LoadTemplate(tpl);
+  BOOL locked = BenchmarkTemplateApplied(conference, tpl, 3);
+  conference->lockedTemplate = savedLocked;
+
+  conference->Unlock();
+  manager->RemoveConference(room);
+
+  json.Insert("apply", applied != FALSE);
+  json.Insert("reapply", reapplied != FALSE);
+  json.Insert("restore", restored != FALSE);
+  json.Insert("locked", locked != FALSE);
+  json.Insert("apply_usec", (long long)applyUsec);
+  json.Insert("reapply_usec", (long long)reapplyUsec);
+  return applied && reapplied && restored && locked;
+}
+
+BOOL MCUBenchmark::RunTemplates(const PStringToString & params, PString & result)
+{
+  // round trips of the text format and the cost of the store operations,
+  // the checks are reported with the timings
+  unsigned members = params("templates").AsUnsigned();
+  unsigned count = params.Contains("count") ? params("count").AsUnsigned() : 50;
+  if(members <= 1)
+    members = 100;
+  members = PMIN(members, 10000);
+  count = PMAX(1, PMIN(count, 1000));
+
+  // the old text is read as it was and written in the same form once more
+  MCUTemplateStore legacy;
+  legacy.Parse(BenchmarkLegacyTemplates);
+  PString legacyText = legacy.AsString();
+  PINDEX versionEnd = legacyText.Find("\n\n");
+  BOOL legacyUnchanged = legacyText.Left(8) == "VERSION " && versionEnd != P_MAX_INDEX
+                         && legacyText.Mid(versionEnd + 2) == BenchmarkLegacyTemplates;
+  MCUTemplateStore legacyCopy;
+  legacyCopy.Parse(legacyText);
+  MCUConferenceTemplate first, second, firstCopy, secondCopy;
+  BOOL legacyOk = legacyUnchanged && legacy.GetTemplate("first", first) && legacy.GetTemplate("second one", second)
+                  && legacyCopy.GetTemplate("first", firstCopy) && legacyCopy.GetTemplate("second one", secondCopy)
+                  && first == firstCopy && second == secondCopy && legacyCopy.AsString() == legacyText
+                  && legacy.GetLastUsed() == "second one" && first.members.size() == 2
+                  && first.members[1].name == "Smith, John [h323:john@10.0.0.2]" && first.members[0].muteMask == "0/20/20"
+                  && first.mixers.size() == 1 && first.mixers[0].positions.size() == 5 && second.globalMute == -1;
+
+  // the generated store
+  MCUTemplateStore store;
+  std::vector<MCUConferenceTemplate> templates(count);
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned i = 0; i < count; i++)
+  {
+    BuildBenchmarkTemplate(templates[i], i, members);
+    store.SetTemplate(templates[i]);
+  }
+  store.SetLastUsed(templates[0].name);
+  uint64_t setUsec = MCUTime::GetMonoTimestampUsec() - start;
+
+  start = MCUTime::GetMonoTimestampUsec();
+  PString text = store.AsString();
+  uint64_t printUsec = MCUTime::GetMonoTimestampUsec() - start;
+
+  MCUTemplateStore parsed;
+  start = MCUTime::GetMonoTimestampUsec();
+  parsed.Parse(text);
+  uint64_t parseUsec = MCUTime::GetMonoTimestampUsec() - start;
+
+  BOOL roundTrip = (parsed.AsString() == text) && (parsed.GetNames().GetSize() == (PINDEX)count);
+  start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned i = 0; i < count && roundTrip; i++)
+  {
+    MCUConferenceTemplate tpl;
+    roundTrip = parsed.GetTemplate(templates[i].name, tpl) && tpl == templates[i];
+  }
+  uint64_t getUsec = MCUTime::GetMonoTimestampUsec() - start;
+
+  // a template saved again without changes does not change the version
+  unsigned version = store.GetVersion();
+  store.SetTemplate(templates[count-1]);
+  BOOL unchanged = (store.GetVersion() == version);
+
+  // atomic saves: only the changed store is written
+  PString fileName;
+#ifdef _WIN32
+  fileName = PString(getenv("TEMP")) + PATH_SEPARATOR + "members_benchmark.conf";
+#else
+  fileName = "/tmp/members_benchmark_" + PString(getpid()) + ".conf";
+#endif
+  MCUTemplateStore saved;
+  saved.Load(fileName);
+  saved.Parse(text);
+  start = MCUTime::GetMonoTimestampUsec();
+  BOOL saveOk = saved.Save();
+  uint64_t saveUsec = MCUTime::GetMonoTimestampUsec() - start;
+  start = MCUTime::GetMonoTimestampUsec();
+  saveOk = saveOk && saved.Save();
+  uint64_t unchangedSaveUsec = MCUTime::GetMonoTimestampUsec() - start;
+  MCUTemplateStore reloaded;
+  reloaded.Load(fileName);
+  BOOL reloadOk = saveOk && (reloaded.AsString() == saved.AsString());
+  remove(fileName);
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  BOOL applyOk = BenchmarkTemplateApply(json);
+  json.Insert("members", members);
+  json.Insert("templates", count);
+  json.Insert("bytes", (long long)text.GetLength());
+  json.Insert("legacy_roundtrip", legacyOk != FALSE);
+  json.Insert("roundtrip", roundTrip != FALSE);
+  json.Insert("unchanged_version", unchanged != FALSE);
+  json.Insert("reload", reloadOk != FALSE);
+  json.Insert("set_usec", (long long)setUsec);
+  json.Insert("print_usec", (long long)printUsec);
+  json.Insert("parse_usec", (long long)parseUsec);
+  json.Insert("get_usec_per_template", (double)getUsec / count);
+  json.Insert("save_usec", (long long)saveUsec);
+  json.Insert("unchanged_save_usec", (long long)unchangedSaveUsec);
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: templates " << result);
+  return legacyOk && roundTrip && unchanged && reloadOk && applyOk;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+// the telnet session of the control benchmark: login, lines and JSON responses
+static BOOL BenchmarkControlRecv(int fd, std::string & data)
+{
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  if(poll(&pfd, 1, 5000) <= 0)
+    return FALSE;
+  char buffer[65536];
+  int len = recv(fd, buffer, sizeof(buffer), 0);
+  if(len <= 0)
+    return FALSE;
+  data.append(buffer, len);
+  return TRUE;
+}
+
+static BOOL BenchmarkControlWait(int fd, std::string & data, const char * text)
+{
+  for(;;)
+  {
+    size_t pos = data.find(text);
+    if(pos != std::string::npos)
+    {
+      data.erase(0, pos + strlen(text));
+      return TRUE;
+    }
+    if(!BenchmarkControlRecv(fd, data))
+      return FALSE;
+  }
+}
+
+static BOOL BenchmarkControlSend(int fd, const std::string & text)
+{
+  size_t sent = 0;
+  while(sent < text.size())
+  {
+    int len = send(fd, text.c_str() + sent, text.size() - sent, MSG_NOSIGNAL);
+    if(len <= 0)
+      return FALSE;
+    sent += len;
+  }
+  return TRUE;
+}
+
+// the response lines of the commands, FALSE when the session is lost
+static BOOL BenchmarkControlResponses(int fd, std::string & data, unsigned count, unsigned & failed)
+{
+  failed = 0;
+  for(unsigned i = 0; i < count; i++)
+  {
+    size_t end;
+    while((end = data.find("\r\n")) == std::string::npos)
+    {
+      if(!BenchmarkControlRecv(fd, data))
+        return FALSE;
+    }
+    if(data.substr(0, end).find("\"ok\":1") == std::string::npos)
+      failed++;
+    data.erase(0, end + 2);
+  }
+  return TRUE;
+}
+
+// the muted members of the room, the members that are not found are not counted
+static unsigned BenchmarkControlMuted(Conference * conference, const std::vector<long> & ids)
+{
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  unsigned muted = 0;
+  for(size_t i = 0; i < ids.size(); i++)
+  {
+    ConferenceMember *member = manager->FindMemberWithLock(conference, ids[i]);
+    if(member == NULL)
+      continue;
+    if(member->muteMask & 1)
+      muted++;
+    member->Unlock();
+  }
+  return muted;
+}
+
+static unsigned BenchmarkControlMembers(const PString & room)
+{
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference == NULL)
+    return 0;
+  unsigned count = 0;
+  MCUMemberList & memberList = conference->GetMemberList();
+  for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+  {
+    if(!it->IsSystem())
+      count++;
+  }
+  conference->Unlock();
+  return count;
+}
+
+// the members of the room invited in it, the moved members are dialed by the monitor
+static unsigned BenchmarkControlDialed(const PString & room)
+{
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference == NULL)
+    return 0;
+  unsigned count = 0;
+  MCUMemberList & memberList = conference->GetMemberList();
+  for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+  {
+    PWaitAndSignal m(it->GetDialMutex());
+    if(it->dialToken != "")
+      count++;
+  }
+  conference->Unlock();
+  return count;
+}
+
+// the call of the member is over as OnCleared() leaves it
+static void BenchmarkControlHangUp(Conference * conference, const std::vector<long> & ids)
+{
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  for(size_t i = 0; i < ids.size(); i++)
+  {
+    ConferenceMember *member = manager->FindMemberWithLock(conference, ids[i]);
+    if(member == NULL)
+      continue;
+    member->SetCallToken("");
+    member->Unlock();
+  }
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunControl(const PStringToString & params, PString & result)
+{
+#ifndef _WIN32
+  // the telnet server on the loopback in the script mode: one command per round trip,
+  // pipelined lines, atomic batches, a batch rejected as a whole and moves between rooms;
+  // the members are offline, nothing is dialed, then members with a call token stand for
+  // online members: moved, their calls end and the monitor dials them in the other room
+  // at the discard port
+  unsigned members = params("control").AsUnsigned();
+  if(members <= 1)
+    members = 200;
+  members = PMIN(members, 5000);
+
+  MCUConfig cfg("Telnet Server");
+  if(cfg.GetBoolean(EnableKey, TRUE) == FALSE)
+  {
+    result = "{\"error\":\"telnet server is disabled\"}";
+    return FALSE;
+  }
+  unsigned port = params.Contains("port") ? params("port").AsUnsigned() : 0;
+  if(port == 0)
+  {
+    PStringArray listenerArray = cfg.GetString(TelnetListenerKey, TelnetDefaultListener).Tokenise(",");
+    if(listenerArray.GetSize() != 0)
+      port = MCUURL(listenerArray[0]).GetPort().AsUnsigned();
+  }
+  PString username = cfg.GetString(UserNameKey, "admin");
+  PString password = cfg.GetString(PasswordKey);
+
+  PString room = "benchmark_control";
+  PString room2 = "benchmark_control_2";
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference == NULL)
+    conference = manager->FindConferenceWithLock(room2);
+  if(conference)
+  {
+    conference->Unlock();
+    result = "{\"error\":\"room " + room + " exists\"}";
+    return FALSE;
+  }
+  conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  if(conference == NULL)
+  {
+    result = "{\"error\":\"could not create room " + room + "\"}";
+    return FALSE;
+  }
+  std::vector<long> ids;
+  for(unsigned i = 0; i < members; i++)
+  {
+    ConferenceMember *member = new MCUConnection_ConferenceMember(conference, "sip:control" + PString(i) + "@127.0.0.1", "");
+    MCUMemberList::shared_iterator it = conference->AddMemberToList(member);
+    if(it == conference->GetMemberList().end())
+    {
+      delete member;
+      continue;
+    }
+    ids.push_back((long)member->GetID());
+  }
+  std::vector<long> onlineIds;
+  for(unsigned i = 0; i < PMAX(1, members / 10); i++)
+  {
+    ConferenceMember *member = new MCUConnection_ConferenceMember(conference, "sip:online" + PString(i) + "@127.0.0.1:9", "");
+    MCUMemberList::shared_iterator it = conference->AddMemberToList(member);
+    if(it == conference->GetMemberList().end())
+    {
+      delete member;
+      continue;
+    }
+    member->SetCallToken("benchmark_control_" + PString(i));
+    onlineIds.push_back((long)member->GetID());
+  }
+
+  std::string data;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  BOOL connected = (fd != -1 && connect(fd, (const sockaddr *)&addr, sizeof(addr)) == 0);
+  BOOL login = connected
+               && BenchmarkControlWait(fd, data, "Login: ") && BenchmarkControlSend(fd, (const char *)(username + "\r\n"))
+               && BenchmarkControlWait(fd, data, "Password: ") && BenchmarkControlSend(fd, (const char *)(password + "\r\n"))
+               && BenchmarkControlWait(fd, data, "# ") && BenchmarkControlSend(fd, "script\n")
+               && BenchmarkControlWait(fd, data, "\"ok\":1}\r\n");
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("members", (unsigned long)ids.size());
+  json.Insert("online_members", (unsigned long)onlineIds.size());
+  json.Insert("port", port);
+  json.Insert("login", login != FALSE);
+
+  BOOL ok = login;
+  unsigned failed = 0;
+  if(ok)
+  {
+    // a command, a response
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    for(size_t i = 0; i < ids.size() && ok; i++)
+    {
+      unsigned f = 0;
+      ok = BenchmarkControlSend(fd, (const char *)("room " + room + " mute " + PString(ids[i]) + "\n")) && BenchmarkControlResponses(fd, data, 1, f);
+      failed += f;
+    }
+    uint64_t usec = MCUTime::GetMonoTimestampUsec() - start;
+    MCUJSON *jsonMode = MCUJSON::Object("round_trip");
+    jsonMode->Insert("usec_per_command", (double)usec / PMAX(1, ids.size()));
+    jsonMode->Insert("failed", failed);
+    jsonMode->Insert("muted", BenchmarkControlMuted(conference, ids));
+    json.Insert(jsonMode);
+  }
+  if(ok)
+  {
+    // the lines sent at once run as one batch
+    std::string text;
+    for(size_t i = 0; i < ids.size(); i++)
+      text += (const char *)("room " + room + " unmute " + PString(ids[i]) + "\n");
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    ok = BenchmarkControlSend(fd, text) && BenchmarkControlResponses(fd, data, ids.size(), failed);
+    uint64_t usec = MCUTime::GetMonoTimestampUsec() - start;
+    MCUJSON *jsonMode = MCUJSON::Object("pipelined");
+    jsonMode->Insert("usec_per_command", (double)usec / PMAX(1, ids.size()));
+    jsonMode->Insert("failed", failed);
+    jsonMode->Insert("muted", BenchmarkControlMuted(conference, ids));
+    json.Insert(jsonMode);
+  }
+  if(ok)
+  {
+    std::string text = "begin\n";
+    for(size_t i = 0; i < ids.size(); i++)
+      text += (const char *)("room " + room + " mute " + PString(ids[i]) + "\n");
+    text += "end\n";
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    ok = BenchmarkControlSend(fd, text) && BenchmarkControlResponses(fd, data, ids.size(), failed);
+    uint64_t usec = MCUTime::GetMonoTimestampUsec() - start;
+    MCUJSON *jsonMode = MCUJSON::Object("atomic");
+    jsonMode->Insert("usec_per_command", (double)usec / PMAX(1, ids.size()));
+    jsonMode->Insert("failed", failed);
+    jsonMode->Insert("muted", BenchmarkControlMuted(conference, ids));
+    json.Insert(jsonMode);
+  }
+  if(ok)
+  {
+    // a missing member rejects the whole batch, nothing is unmuted
+    std::string text = "begin\n";
+    for(size_t i = 0; i < ids.size(); i++)
+      text += (const char *)("room " + room + " unmute " + PString(ids[i]) + "\n");
+    text += (const char *)("room " + room + " unmute 2147483647\n");
+    text += "end\n";
+    ok = BenchmarkControlSend(fd, text) && BenchmarkControlResponses(fd, data, ids.size() + 1, failed);
+    MCUJSON *jsonMode = MCUJSON::Object("rejected");
+    jsonMode->Insert("failed", failed);
+    jsonMode->Insert("muted", BenchmarkControlMuted(conference, ids));
+    json.Insert(jsonMode);
+  }
+  if(ok)
+  {
+    // the engine without the socket, as the Control page calls it
+    PString text;
+    for(size_t i = 0; i < ids.size(); i++)
+      text += "room " + room + " unmute " + PString(ids[i]) + "\n";
+    PString response;
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    BOOL engineOk = MCUControlEngine::Execute(text, TRUE, response);
+    uint64_t usec = MCUTime::GetMonoTimestampUsec() - start;
+    MCUJSON *jsonMode = MCUJSON::Object("engine");
+    jsonMode->Insert("usec_per_command", (double)usec / PMAX(1, ids.size()));
+    jsonMode->Insert("ok", engineOk != FALSE);
+    jsonMode->Insert("muted", BenchmarkControlMuted(conference, ids));
+    json.Insert(jsonMode);
+  }
+  if(ok)
+  {
+    // half of the members to the other room
+    std::string text = "begin\n";
+    for(size_t i = 0; i < ids.size() / 2; i++)
+      text += (const char *)("room " + room + " move " + PString(ids[i]) + " " + room2 + "\n");
+    text += "end\n";
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    ok = BenchmarkControlSend(fd, text) && BenchmarkControlResponses(fd, data, ids.size() / 2, failed);
+    uint64_t usec = MCUTime::GetMonoTimestampUsec() - start;
+    MCUJSON *jsonMode = MCUJSON::Object("move");
+    jsonMode->Insert("usec_per_command", (double)usec / PMAX(1, ids.size() / 2));
+    jsonMode->Insert("failed", failed);
+    jsonMode->Insert("source_members", BenchmarkControlMembers(room));
+    jsonMode->Insert("target_members", BenchmarkControlMembers(room2));
+    json.Insert(jsonMode);
+  }
+  if(ok)
+  {
+    // the online members stay in the room until their calls are gone, then the monitor
+    // drops them there and invites them in the other room
+    unsigned sourceBefore = BenchmarkControlMembers(room);
+    unsigned targetBefore = BenchmarkControlMembers(room2);
+    std::string text = "begin\n";
+    for(size_t i = 0; i < onlineIds.size(); i++)
+      text += (const char *)("room " + room + " move " + PString(onlineIds[i]) + " " + room2 + "\n");
+    text += "end\n";
+    unsigned f = 0;
+    ok = BenchmarkControlSend(fd, text) && BenchmarkControlResponses(fd, data, onlineIds.size(), f);
+    failed += f;
+    BOOL kept = (BenchmarkControlMembers(room) == sourceBefore) && (BenchmarkControlDialed(room2) == 0);
+    BenchmarkControlHangUp(conference, onlineIds);
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    unsigned sourceMembers = sourceBefore;
+    for(unsigned n = 0; n < 50 && sourceMembers != sourceBefore - onlineIds.size(); n++)
+    {
+      MCUTime::Sleep(100);
+      sourceMembers = BenchmarkControlMembers(room);
+    }
+    uint64_t usec = MCUTime::GetMonoTimestampUsec() - start;
+    MCUJSON *jsonMode = MCUJSON::Object("move_online");
+    jsonMode->Insert("members", (unsigned long)onlineIds.size());
+    jsonMode->Insert("failed", f);
+    jsonMode->Insert("kept_until_cleared", kept != FALSE);
+    jsonMode->Insert("source_members", sourceMembers);
+    jsonMode->Insert("target_members", BenchmarkControlMembers(room2) - targetBefore);
+    jsonMode->Insert("dialed", BenchmarkControlDialed(room2));
+    jsonMode->Insert("usec_to_dial", (long long)usec);
+    json.Insert(jsonMode);
+    ok = ok && kept && sourceMembers == sourceBefore - onlineIds.size();
+  }
+  json.Insert("session_ok", ok != FALSE);
+
+  if(fd != -1)
+  {
+    if(login)
+      BenchmarkControlSend(fd, "quit\n");
+    close(fd);
+  }
+  // the room waits for the online members when it is removed
+  BenchmarkControlHangUp(conference, onlineIds);
+  conference->Unlock();
+  manager->RemoveConference(room);
+  manager->RemoveConference(room2);
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: control " << result);
+  return ok;
+#else
+  result = "{\"error\":\"not supported\"}";
+  return FALSE;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// operator of the status and room pages, polls without the pause of the pages: the status document
+// and the member list of the room, from the status cache or built for the request as before it
+class BenchmarkStatusWatcher : public PThread
+{
+  PCLASSINFO(BenchmarkStatusWatcher, PThread);
+  public:
+    BenchmarkStatusWatcher(const PString & _room, BOOL _cached)
+      : PThread(10000, NoAutoDeleteThread, NormalPriority, "status_watcher:%0x"),
+        room(_room), cached(_cached), running(TRUE), polls(0), notModified(0), bytes(0)
+    { Resume(); }
+
+    void Stop()
+    {
+      running = FALSE;
+      WaitForTermination(10000);
+    }
+
+    virtual void Main()
+    {
+      OpenMCU & app = OpenMCU::Current();
+      PString tag;
+      while(running)
+      {
+        PString status, members;
+        if(cached)
+        {
+          PString newTag;
+          if(app.GetStatusCache().GetRoomStatus(tag, status, newTag))
+            tag = newTag;
+          else
+            notModified++;
+          members = app.GetStatusCache().GetMemberList(room);
+        }
+        else
+        {
+          status = app.GetEndpoint().GetRoomStatusJS();
+          Conference *conference = app.GetConferenceManager()->FindConferenceWithLock(room);
+          if(conference)
+          {
+            members = app.GetEndpoint().GetMemberListOptsJavascript(*conference);
+            conference->Unlock();
+          }
+        }
+        bytes += status.GetLength() + members.GetLength();
+        polls++;
+      }
+    }
+
+    PString room;
+    BOOL cached;
+    volatile BOOL running;
+    uint64_t polls;
+    uint64_t notModified;
+    uint64_t bytes;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunStatus(const PStringToString & params, PString & result)
+{
+  // the mixer times of a room of synthetic members without watchers, with the documents built
+  // for every request and with the status cache
+  unsigned watchers = params("status").AsUnsigned();
+  unsigned members = params.Contains("members") ? params("members").AsUnsigned() : 20;
+  unsigned width = params.Contains("w") ? params("w").AsUnsigned() : QCIF_WIDTH;
+  unsigned height = params.Contains("h") ? params("h").AsUnsigned() : QCIF_HEIGHT;
+  unsigned frameRate = params.Contains("fps") ? params("fps").AsUnsigned() : 25;
+  unsigned duration = params.Contains("s") ? params("s").AsUnsigned() : 5;
+  if(watchers <= 1)
+    watchers = 20;
+  watchers = PMIN(watchers, 1000);
+  members = PMAX(1, PMIN(members, BENCHMARK_MAX_MEMBERS));
+  width = (PMAX(16, PMIN(width, 1920)) / 2) * 2;
+  height = (PMAX(16, PMIN(height, 1088)) / 2) * 2;
+  frameRate = PMAX(1, PMIN(frameRate, 60));
+  duration = PMAX(1, PMIN(duration, BENCHMARK_MAX_DURATION / 3));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  PString room = "benchmark_status";
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference)
+  {
+    conference->Unlock();
+    runMutex.Signal();
+    result = "{\"error\":\"room " + room + " exists\"}";
+    return FALSE;
+  }
+  conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  if(conference == NULL)
+  {
+    runMutex.Signal();
+    result = "{\"error\":\"could not create room " + room + "\"}";
+    return FALSE;
+  }
+  for(unsigned i = 0; i < members; i++)
+    conference->AddMember(new ConferenceSyntheticMember(conference, this, i, width, height, frameRate, ""));
+  conference->Unlock();
+
+  MCUTRACE(1, trace_section << "start status, " << watchers << " watchers, " << members << " members " << width << "x" << height << "x" << frameRate << ", " << duration << "s");
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("watchers", watchers);
+  json.Insert("members", members);
+  json.Insert("width", width);
+  json.Insert("height", height);
+  json.Insert("fps", frameRate);
+  json.Insert("tick_msec", STATUS_CACHE_TICK);
+
+  // warm up: the mixers change the layout
+  MCUTime::Sleep(1000);
+
+  const char * modes[] = { "idle", "direct", "cached" };
+  for(unsigned mode = 0; mode < PARRAYSIZE(modes); mode++)
+  {
+    {
+      PWaitAndSignal m(sampleMutex);
+      for(unsigned i = 0; i < STAGE_COUNT; i++)
+        samples[i].clear();
+    }
+    int64_t builds = MCUMetrics::statusBuilds.GetCount();
+    uint64_t cpuStart = GetProcessCPUTime();
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+
+    std::vector<BenchmarkStatusWatcher *> threads;
+    if(mode != 0)
+    {
+      for(unsigned i = 0; i < watchers; i++)
+        threads.push_back(new BenchmarkStatusWatcher(room, mode == 2));
+    }
+    MCUTime::Sleep(duration * 1000);
+
+    uint64_t polls = 0, notModified = 0, bytes = 0;
+    for(unsigned i = 0; i < threads.size(); i++)
+    {
+      threads[i]->Stop();
+      polls += threads[i]->polls;
+      notModified += threads[i]->notModified;
+      bytes += threads[i]->bytes;
+      delete threads[i];
+    }
+    uint64_t elapsed = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+    uint64_t cpu = GetProcessCPUTime() - cpuStart;
+    builds = MCUMetrics::statusBuilds.GetCount() - builds;
+
+    MCUJSON *jsonMode = MCUJSON::Object(modes[mode]);
+    jsonMode->Insert("duration_usec", (long long)elapsed);
+    jsonMode->Insert("polls", (long long)polls);
+    jsonMode->Insert("polls_per_sec", 1000000.0 * polls / elapsed);
+    jsonMode->Insert("not_modified", (long long)notModified);
+    jsonMode->Insert("builds", (long long)builds);
+    jsonMode->Insert("bytes", (long long)bytes);
+    jsonMode->Insert("process_percent", 100.0 * cpu / elapsed);
+
+    // the member threads wait for the mixers while the documents are built
+    PWaitAndSignal m(sampleMutex);
+    for(unsigned i = 0; i < STAGE_COUNT; i++)
+    {
+      std::vector<uint64_t> & v = samples[i];
+      if(v.size() == 0)
+        continue;
+      std::sort(v.begin(), v.end());
+      MCUJSON *jsonStage = MCUJSON::Object(GetStageName(i));
+      jsonStage->Insert("count", (unsigned long)v.size());
+      jsonStage->Insert("p50_usec", (long long)v[v.size() * 50 / 100]);
+      jsonStage->Insert("p99_usec", (long long)v[v.size() * 99 / 100]);
+      jsonStage->Insert("max_usec", (long long)v.back());
+      jsonMode->Insert(jsonStage);
+    }
+    json.Insert(jsonMode);
+  }
+
+  manager->RemoveConference(room);
+
+  result = json.AsString();
+  MCUTRACE(1, trace_section << "status " << result);
+
+  runMutex.Signal();
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// preview client of the room list and the MJPEG stream, asks the service for the preview of its
+// size once per quarter of the interval as JpegFrameHTTP::OnStream does
+class BenchmarkSnapshotClient : public PThread
+{
+  PCLASSINFO(BenchmarkSnapshotClient, PThread);
+  public:
+    BenchmarkSnapshotClient(const PString & _room, unsigned _width, unsigned _height)
+      : PThread(10000, NoAutoDeleteThread, NormalPriority, "snapshot_client:%0x"),
+        room(_room), width(_width), height(_height), running(TRUE), requests(0), served(0), failed(0), bytes(0)
+    { Resume(); }
+
+    void Stop()
+    {
+      running = FALSE;
+      WaitForTermination(10000);
+    }
+
+    virtual void Main()
+    {
+      MCUSnapshotService *service = OpenMCU::Current().GetSnapshotService();
+      while(running)
+      {
+        if(service == NULL || !service->Use())
+        {
+          failed++;
+          break;
+        }
+        PBYTEArray jpeg;
+        uint64_t timestamp = 0;
+        uint64_t start = MCUTime::GetMonoTimestampUsec();
+        BOOL ok = service->GetSnapshot(room, 0, width, height, jpeg, timestamp);
+        latency.push_back(MCUTime::GetMonoTimestampUsec() - start);
+        service->Release();
+        requests++;
+        if(ok)
+        {
+          served++;
+          bytes += jpeg.GetSize();
+        }
+        else
+          failed++;
+        MCUTime::Sleep(SNAPSHOT_INTERVAL_MS / 4);
+      }
+    }
+
+    PString room;
+    unsigned width;
+    unsigned height;
+    volatile BOOL running;
+    uint64_t requests;
+    uint64_t served;
+    uint64_t failed;
+    uint64_t bytes;
+    std::vector<uint64_t> latency;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunSnapshots(const PStringToString & params, PString & result)
+{
+  // hundreds of preview clients of one room at the sizes of the pages, the service encodes
+  // each size once per interval whatever the number of clients
+  unsigned clients = params("snapshots").AsUnsigned();
+  unsigned members = params.Contains("members") ? params("members").AsUnsigned() : 4;
+  unsigned width = params.Contains("w") ? params("w").AsUnsigned() : CIF_WIDTH;
+  unsigned height = params.Contains("h") ? params("h").AsUnsigned() : CIF_HEIGHT;
+  unsigned duration = params.Contains("s") ? params("s").AsUnsigned() : 10;
+  if(clients <= 1)
+    clients = 300;
+  clients = PMIN(clients, 2000);
+  members = PMAX(1, PMIN(members, BENCHMARK_MAX_MEMBERS));
+  width = (PMAX(16, PMIN(width, 1920)) / 2) * 2;
+  height = (PMAX(16, PMIN(height, 1088)) / 2) * 2;
+  duration = PMAX(1, PMIN(duration, BENCHMARK_MAX_DURATION));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  PString room = "benchmark_snapshots";
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference)
+  {
+    conference->Unlock();
+    runMutex.Signal();
+    result = "{\"error\":\"room " + room + " exists\"}";
+    return FALSE;
+  }
+  conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  if(conference == NULL)
+  {
+    runMutex.Signal();
+    result = "{\"error\":\"could not create room " + room + "\"}";
+    return FALSE;
+  }
+  for(unsigned i = 0; i < members; i++)
+    conference->AddMember(new ConferenceSyntheticMember(conference, this, i, width, height, 25, ""));
+  conference->Unlock();
+
+  MCUTRACE(1, trace_section << "start snapshots, " << clients << " clients, " << members << " members " << width << "x" << height << ", " << duration << "s");
+
+  // warm up: the mixer has frames
+  MCUTime::Sleep(1000);
+
+  // the thumbnails of the room list, the preview of the room page and the full size
+  const unsigned sizes[][2] = { { 88, 72 }, { 176, 144 }, { 0, 0 } };
+  MCUSnapshotService *service = OpenMCU::Current().GetSnapshotService();
+  unsigned encodes = service ? service->GetEncodes() : 0;
+  uint64_t cpuStart = GetProcessCPUTime();
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+
+  std::vector<BenchmarkSnapshotClient *> threads;
+  for(unsigned i = 0; i < clients; i++)
+  {
+    unsigned size = i % PARRAYSIZE(sizes);
+    threads.push_back(new BenchmarkSnapshotClient(room, sizes[size][0], sizes[size][1]));
+  }
+  MCUTime::Sleep(duration * 1000);
+
+  uint64_t requests = 0, served = 0, failed = 0, bytes = 0;
+  std::vector<uint64_t> latency;
+  for(unsigned i = 0; i < threads.size(); i++)
+  {
+    threads[i]->Stop();
+    requests += threads[i]->requests;
+    served += threads[i]->served;
+    failed += threads[i]->failed;
+    bytes += threads[i]->bytes;
+    latency.insert(latency.end(), threads[i]->latency.begin(), threads[i]->latency.end());
+    delete threads[i];
+  }
+  uint64_t elapsed = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+  uint64_t cpu = GetProcessCPUTime() - cpuStart;
+  if(service)
+    encodes = service->GetEncodes() - encodes;
+
+  manager->RemoveConference(room);
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("clients", clients);
+  json.Insert("members", members);
+  json.Insert("width", width);
+  json.Insert("height", height);
+  json.Insert("interval_msec", SNAPSHOT_INTERVAL_MS);
+  json.Insert("duration_usec", (long long)elapsed);
+  json.Insert("requests", (long long)requests);
+  json.Insert("requests_per_sec", 1000000.0 * requests / elapsed);
+  json.Insert("served", (long long)served);
+  json.Insert("failed", (long long)failed);
+  json.Insert("bytes", (long long)bytes);
+  json.Insert("encodes", encodes);
+  json.Insert("encodes_per_sec", 1000000.0 * encodes / elapsed);
+  json.Insert("process_percent", 100.0 * cpu / elapsed);
+  if(latency.size() > 0)
+  {
+    std::sort(latency.begin(), latency.end());
+    json.Insert("p50_usec", (long long)latency[latency.size() * 50 / 100]);
+    json.Insert("p99_usec", (long long)latency[latency.size() * 99 / 100]);
+    json.Insert("max_usec", (long long)latency.back());
+  }
+
+  result = json.AsString();
+  MCUTRACE(1, trace_section << "snapshots " << result);
+
+  runMutex.Signal();
+  return (service != NULL && served > 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunSRTP(const PStringToString & params, PString & result)
+{
+#if MCUSIP_SRTP
+  // one cache frame fanned out to the members: one packet per stream,
+  // every backend and profile on this thread, the time is the CPU time of the thread
+  unsigned streams = params("srtp").AsUnsigned();
+  unsigned size = params.Contains("size") ? params("size").AsUnsigned() : 1200;
+  unsigned packets = params.Contains("packets") ? params("packets").AsUnsigned() : 200000;
+  if(streams <= 1)
+    streams = 100;
+  streams = PMIN(streams, 10000);
+  size = PMAX(16, PMIN(size, 1400));
+  packets = PMAX(streams, PMIN(packets, 10000000));
+
+  const PString profiles[] = { AES_CM_128_HMAC_SHA1_80, AES_CM_128_HMAC_SHA1_32, AEAD_AES_128_GCM, AEAD_AES_256_GCM };
+  PStringArray backends = SipSRTP::GetBackends();
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("streams", streams);
+  json.Insert("size", size);
+  json.Insert("packets", packets);
+  json.Insert("default_backend", SipSRTP::GetDefaultBackend());
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+  json.Insert("aesni", (ecx & bit_AES) != 0);
+  json.Insert("clmul", (ecx & bit_PCLMUL) != 0);
+#endif
+
+  MCUJSON *jsonResults = MCUJSON::Array("results");
+  for(PINDEX b = 0; b < backends.GetSize(); b++)
+  {
+    for(unsigned p = 0; p < PARRAYSIZE(profiles); p++)
+    {
+      if(!SipSRTP::IsSupported(profiles[p], backends[b]))
+        continue;
+
+      std::vector<SipSRTP *> sessions(streams, (SipSRTP *)NULL);
+      std::vector<BYTE> buffers(streams * (size + SIP_SRTP_MAX_TRAILER_LEN));
+      std::vector<BYTE *> data(streams);
+      PString key = srtp_get_random_keysalt(64);
+      BOOL ok = TRUE;
+      for(unsigned i = 0; i < streams && ok; i++)
+      {
+        sessions[i] = new SipSRTP();
+        ok = sessions[i]->Init(profiles[p], key, backends[b]);
+        BYTE *d = data[i] = &buffers[i * (size + SIP_SRTP_MAX_TRAILER_LEN)];
+        d[0] = 0x80; d[1] = 96;
+        d[8] = (BYTE)(i >> 24); d[9] = (BYTE)(i >> 16); d[10] = (BYTE)(i >> 8); d[11] = (BYTE)i;
+      }
+
+      // the first packet of the first stream for the receivers
+      std::vector<BYTE> sample(data[0], data[0] + size + SIP_SRTP_MAX_TRAILER_LEN);
+      int sampleLen = size;
+      ok = ok && sessions[0]->Protect(&sample[0], sampleLen);
+
+      uint64_t protected_count = 0;
+      uint64_t start = GetThreadCPUTime();
+      for(unsigned n = 0, seq = 1; ok && n < packets; n += streams, seq++)
+      {
+        for(unsigned i = 0; i < streams; i++)
+        {
+          data[i][2] = (BYTE)(seq >> 8);
+          data[i][3] = (BYTE)seq;
+          int len = size;
+          if(sessions[i]->Protect(data[i], len))
+            protected_count++;
+        }
+      }
+      uint64_t usec = PMAX(1, GetThreadCPUTime() - start);
+
+      // the sample through a receiver of every backend
+      MCUJSON *jsonVerified = MCUJSON::Object("verified");
+      for(PINDEX r = 0; ok && r < backends.GetSize(); r++)
+      {
+        if(!SipSRTP::IsSupported(profiles[p], backends[r]))
+          continue;
+        SipSRTP receiver;
+        std::vector<BYTE> packet(sample);
+        int len = sampleLen;
+        BOOL verified = receiver.Init(profiles[p], key, backends[r]) && receiver.Unprotect(&packet[0], len) && len == (int)size;
+        jsonVerified->Insert((const char *)backends[r], verified);
+      }
+
+      MCUJSON *jsonResult = MCUJSON::Object();
+      jsonResult->Insert("backend", backends[b]);
+      jsonResult->Insert("profile", profiles[p]);
+      jsonResult->Insert("init", ok);
+      jsonResult->Insert("protected", (long long)protected_count);
+      jsonResult->Insert("cpu_usec", (long long)usec);
+      jsonResult->Insert("packets_per_sec_per_core", 1000000.0 * protected_count / usec);
+      jsonResult->Insert("mbit_per_sec_per_core", 8.0 * protected_count * size / usec);
+      jsonResult->Insert(jsonVerified);
+      jsonResults->Insert(jsonResult);
+
+      for(unsigned i = 0; i < streams; i++)
+        delete sessions[i];
+    }
+  }
+  json.Insert(jsonResults);
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: srtp " << result);
+  return TRUE;
+#else
+  result = "{\"error\":\"SRTP is disabled\"}";
+  return FALSE;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+struct BenchmarkSocketServer
+{
+  BenchmarkSocketServer() : accepted(0) { }
+  PMutex mutex;
+  std::vector<MCUListener *> listeners;
+  unsigned accepted;
+};
+
+static int BenchmarkEchoCallback(void *, MCUSocket *socket, PString data)
+{
+  // closed by the client, the listener is deleted by the benchmark
+  if(socket == NULL)
+    return 0;
+  return socket->SendData(data) ? 1 : 0;
+}
+
+static int BenchmarkAcceptCallback(void *context, MCUSocket *socket, PString)
+{
+  BenchmarkSocketServer *server = (BenchmarkSocketServer *)context;
+  MCUListener *listener = MCUListener::Create(MCU_LISTENER_TCP_CLIENT, socket, BenchmarkEchoCallback, NULL);
+  PWaitAndSignal m(server->mutex);
+  server->listeners.push_back(listener);
+  server->accepted++;
+  return 1;
+}
+
+static unsigned BenchmarkAcceptedCount(BenchmarkSocketServer & server, unsigned count, unsigned timeout_msec)
+{
+  for(unsigned msec = 0; ; msec += 10)
+  {
+    unsigned accepted;
+    {
+      PWaitAndSignal m(server.mutex);
+      accepted = server.accepted;
+    }
+    if(accepted >= count || msec >= timeout_msec)
+      return accepted;
+    MCUTime::Sleep(10);
+  }
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunSockets(const PStringToString & params, PString & result)
+{
+#ifndef _WIN32
+  // idle and active connections to an echo server of listeners on the loopback,
+  // the threads and their CPU time show the cost of the idle connections
+  unsigned idle = params("sockets").AsUnsigned();
+  unsigned active = params.Contains("active") ? params("active").AsUnsigned() : 500;
+  unsigned rounds = params.Contains("rounds") ? params("rounds").AsUnsigned() : 100;
+  unsigned port = params.Contains("port") ? params("port").AsUnsigned() : 40000;
+  if(idle <= 1)
+    idle = 5000;
+  idle = PMIN(idle, 50000);
+  active = PMAX(1, PMIN(active, 5000));
+  rounds = PMAX(1, PMIN(rounds, 10000));
+
+  // both ends of every connection are in this process
+  struct rlimit limit;
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+  {
+    unsigned available = (limit.rlim_cur > 1024) ? (limit.rlim_cur - 1024) / 2 : 0;
+    if(active > available)
+      active = available;
+    if(idle + active > available)
+      idle = available - active;
+  }
+  if(active == 0)
+  {
+    result = "{\"error\":\"not enough file descriptors\"}";
+    return FALSE;
+  }
+
+  ThreadGroupMap groupsStart;
+  GetThreadGroups(groupsStart);
+
+  BenchmarkSocketServer server;
+  MCUListener *listener = MCUListener::Create(MCU_LISTENER_TCP_SERVER, "127.0.0.1", port, BenchmarkAcceptCallback, &server);
+  if(listener == NULL)
+  {
+    result = "{\"error\":\"cannot listen on port " + PString(port) + "\"}";
+    return FALSE;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+  // connect in steps to stay inside the backlog of the listening socket
+  std::vector<int> fds;
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned i = 0; i < idle + active; i++)
+  {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd == -1)
+      break;
+    if(connect(fd, (const sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+      close(fd);
+      break;
+    }
+    fds.push_back(fd);
+    if(fds.size() % 256 == 0)
+      BenchmarkAcceptedCount(server, fds.size() - 128, 5000);
+  }
+  unsigned accepted = BenchmarkAcceptedCount(server, fds.size(), 10000);
+  uint64_t connectUsec = MCUTime::GetMonoTimestampUsec() - start;
+  active = PMIN(active, (unsigned)fds.size());
+
+  ThreadGroupMap groupsConnected;
+  GetThreadGroups(groupsConnected);
+
+  // every active connection sends a message and waits for the echo, a round ends with the last echo
+  const unsigned messageSize = 64;
+  std::string message(messageSize - 1, 'x');
+  message += "\n";
+  std::vector<struct pollfd> pfds(active);
+  std::vector<unsigned> received(active);
+  std::vector<uint64_t> roundUsec;
+  uint64_t echoes = 0;
+  BOOL ok = TRUE;
+  start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned r = 0; r < rounds && ok; r++)
+  {
+    uint64_t roundStart = MCUTime::GetMonoTimestampUsec();
+    for(unsigned i = 0; i < active; i++)
+    {
+      int fd = fds[fds.size() - active + i];
+      if(send(fd, message.c_str(), messageSize, MSG_NOSIGNAL) != (int)messageSize)
+        ok = FALSE;
+      pfds[i].fd = fd;
+      pfds[i].events = POLLIN;
+      received[i] = 0;
+    }
+    unsigned pending = active;
+    while(ok && pending > 0)
+    {
+      if(poll(&pfds[0], active, 5000) <= 0)
+      {
+        ok = FALSE;
+        break;
+      }
+      for(unsigned i = 0; i < active; i++)
+      {
+        if(pfds[i].fd < 0 || !(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+          continue;
+        char buffer[4096];
+        int len = recv(pfds[i].fd, buffer, sizeof(buffer), 0);
+        if(len <= 0)
+        {
+          ok = FALSE;
+          break;
+        }
+        received[i] += len;
+        if(received[i] >= messageSize)
+        {
+          // ignored by poll until the next round
+          pfds[i].fd = -pfds[i].fd - 1;
+          echoes++;
+          pending--;
+        }
+      }
+    }
+    for(unsigned i = 0; i < active; i++)
+    {
+      if(pfds[i].fd < 0)
+        pfds[i].fd = -pfds[i].fd - 1;
+    }
+    roundUsec.push_back(MCUTime::GetMonoTimestampUsec() - roundStart);
+  }
+  uint64_t echoUsec = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+
+  ThreadGroupMap groupsEnd;
+  GetThreadGroups(groupsEnd);
+
+  // the clients close first, then the listeners are deleted as on a shutdown
+  start = MCUTime::GetMonoTimestampUsec();
+  for(size_t i = 0; i < fds.size(); i++)
+    close(fds[i]);
+  delete listener;
+  {
+    PWaitAndSignal m(server.mutex);
+    for(size_t i = 0; i < server.listeners.size(); i++)
+      delete server.listeners[i];
+    server.listeners.clear();
+  }
+  uint64_t teardownUsec = MCUTime::GetMonoTimestampUsec() - start;
+
+  std::sort(roundUsec.begin(), roundUsec.end());
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+#if MCU_SOCKET_REACTOR
+  json.Insert("reactor", OpenMCU::Current().GetSocketReactor() != NULL);
+#else
+  json.Insert("reactor", false);
+#endif
+  json.Insert("connections", (unsigned long)fds.size());
+  json.Insert("accepted", accepted);
+  json.Insert("active", active);
+  json.Insert("rounds", (unsigned long)roundUsec.size());
+  json.Insert("echo_ok", ok != FALSE);
+  json.Insert("connect_usec", (long long)connectUsec);
+  json.Insert("echoes_per_sec", 1000000.0 * echoes / echoUsec);
+  if(roundUsec.size())
+  {
+    json.Insert("round_usec_p50", (long long)roundUsec[roundUsec.size() / 2]);
+    json.Insert("round_usec_p99", (long long)roundUsec[roundUsec.size() * 99 / 100]);
+  }
+  json.Insert("teardown_usec", (long long)teardownUsec);
+
+  // threads while connected and the CPU time of the echo rounds
+  MCUJSON *jsonThreads = MCUJSON::Object("threads");
+  unsigned threadsStart = 0, threadsConnected = 0;
+  for(ThreadGroupMap::iterator it = groupsStart.begin(); it != groupsStart.end(); ++it)
+    threadsStart += it->second.threads;
+  for(ThreadGroupMap::iterator it = groupsConnected.begin(); it != groupsConnected.end(); ++it)
+  {
+    threadsConnected += it->second.threads;
+    uint64_t usec = it->second.usec;
+    ThreadGroupMap::iterator end = groupsEnd.find(it->first);
+    usec = (end != groupsEnd.end() && end->second.usec > usec) ? end->second.usec - usec : 0;
+    unsigned threads = it->second.threads;
+    ThreadGroupMap::iterator s = groupsStart.find(it->first);
+    if(s != groupsStart.end())
+      threads = (threads > s->second.threads) ? threads - s->second.threads : 0;
+    if(threads == 0 && usec == 0)
+      continue;
+    MCUJSON *jsonGroup = MCUJSON::Object((const char *)it->first);
+    jsonGroup->Insert("added", threads);
+    jsonGroup->Insert("echo_cpu_usec", (long long)usec);
+    jsonThreads->Insert(jsonGroup);
+  }
+  json.Insert("threads_added", (int)threadsConnected - (int)threadsStart);
+  json.Insert(jsonThreads);
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: sockets " << result);
+  return TRUE;
+#else
+  result = "{\"error\":\"not supported\"}";
+  return FALSE;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+static int BenchmarkRtspAcceptCallback(void *context, MCUSocket *socket, PString)
+{
+  // the viewers of the benchmark go to the fan-out without the RTSP server
+  MCURtspFanout *fanout = (MCURtspFanout *)context;
+  if(socket == NULL)
+    return 0;
+  return fanout->AddViewer(socket, NULL) ? 1 : 0;
+}
+
+static BOOL BenchmarkRtspRequest(int fd, const PString & request, PString & response)
+{
+  if(send(fd, (const char *)request, request.GetLength(), MSG_NOSIGNAL) != request.GetLength())
+    return FALSE;
+
+  // the headers and the body of Content-Length
+  std::string data;
+  for(;;)
+  {
+    size_t end = data.find("\r\n\r\n");
+    if(end != std::string::npos)
+    {
+      size_t size = end + 4;
+      size_t pos = data.find("Content-Length:");
+      if(pos != std::string::npos && pos < end)
+        size += atoi(data.c_str() + pos + 15);
+      if(data.size() >= size)
+        break;
+    }
+    char buffer[4096];
+    int len = recv(fd, buffer, sizeof(buffer), 0);
+    if(len <= 0)
+      return FALSE;
+    data.append(buffer, len);
+  }
+  response = data.c_str();
+  return response.Find("RTSP/1.0 200") == 0;
+}
+
+struct BenchmarkRtspViewer
+{
+  BenchmarkRtspViewer() : fd(-1), rtp_fd(-1), rtcp_fd(-1), playTime(0), firstTime(0), packets(0), firstSeq(0), lastSeq(0), reports(0) { }
+  int fd;
+  int rtp_fd;
+  int rtcp_fd;
+  uint64_t playTime;
+  uint64_t firstTime;
+  unsigned packets;
+  // extended sequence numbers
+  unsigned firstSeq;
+  unsigned lastSeq;
+  unsigned reports;
+};
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunRtsp(const PStringToString & params, PString & result)
+{
+#ifndef _WIN32
+  // viewers of a fan-out server on the loopback, the room has one synthetic member and the cache encoder
+  unsigned viewers = params("rtsp").AsUnsigned();
+  PString codec = params.Contains("codec") ? params("codec") : PString("H.264{sw}");
+  unsigned width = params.Contains("w") ? params("w").AsUnsigned() : CIF_WIDTH;
+  unsigned height = params.Contains("h") ? params("h").AsUnsigned() : CIF_HEIGHT;
+  unsigned frameRate = params.Contains("fps") ? params("fps").AsUnsigned() : 25;
+  unsigned bitrate = params.Contains("bitrate") ? params("bitrate").AsUnsigned() : 512;
+  unsigned duration = params.Contains("s") ? params("s").AsUnsigned() : 10;
+  unsigned port = params.Contains("port") ? params("port").AsUnsigned() : 40554;
+  if(viewers <= 1)
+    viewers = 1000;
+  viewers = PMIN(viewers, 10000);
+  frameRate = PMAX(1, PMIN(frameRate, MCU_MAX_FRAME_RATE));
+  duration = PMAX(1, PMIN(duration, BENCHMARK_MAX_DURATION));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  // a connection, its accepted socket and the RTP and RTCP sockets of every viewer
+  struct rlimit limit;
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+  {
+    unsigned available = (limit.rlim_cur > 1024) ? (limit.rlim_cur - 1024) / 4 : 0;
+    viewers = PMIN(viewers, available);
+  }
+  if(viewers == 0)
+  {
+    runMutex.Signal();
+    result = "{\"error\":\"not enough file descriptors\"}";
+    return FALSE;
+  }
+
+  PString room = "benchmark_rtsp";
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference)
+  {
+    conference->Unlock();
+    runMutex.Signal();
+    result = "{\"error\":\"room " + room + " exists\"}";
+    return FALSE;
+  }
+  conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  if(conference == NULL)
+  {
+    runMutex.Signal();
+    result = "{\"error\":\"could not create room " + room + "\"}";
+    return FALSE;
+  }
+  conference->AddMember(new ConferenceSyntheticMember(conference, this, 0, width, height, frameRate, ""));
+  conference->Unlock();
+
+  MCUTRACE(1, trace_section << "start RTSP fan-out, " << viewers << " viewers " << width << "x" << height << "x" << frameRate << ", codec " << codec << ", " << duration << "s");
+
+  MCURtspFanout *fanout = new MCURtspFanout("benchmark", room);
+  MCUListener *listener = NULL;
+  if(fanout->SetVideo(codec, width, height, frameRate, bitrate))
+    listener = MCUListener::Create(MCU_LISTENER_TCP_SERVER, "127.0.0.1", port, BenchmarkRtspAcceptCallback, fanout);
+  if(listener == NULL)
+  {
+    delete fanout;
+    manager->RemoveConference(room);
+    runMutex.Signal();
+    result = "{\"error\":\"cannot start the fan-out of " + codec + " on port " + PString(port) + "\"}";
+    return FALSE;
+  }
+
+  ThreadGroupMap groupsStart, groupsEnd;
+  GetThreadGroups(groupsStart);
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  PString url = "rtsp://127.0.0.1:" + PString(port) + "/benchmark";
+
+  // DESCRIBE, SETUP and PLAY of every viewer with blocking sockets
+  std::vector<BenchmarkRtspViewer> clients(viewers);
+  unsigned playing = 0;
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned i = 0; i < viewers; i++)
+  {
+    BenchmarkRtspViewer & v = clients[i];
+    v.fd = socket(AF_INET, SOCK_STREAM, 0);
+    v.rtp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    v.rtcp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(v.fd == -1 || v.rtp_fd == -1 || v.rtcp_fd == -1)
+      break;
+    struct timeval tv = { 5, 0 };
+    setsockopt(v.fd, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof(tv));
+    int size = 256*1024;
+    setsockopt(v.rtp_fd, SOL_SOCKET, SO_RCVBUF, (char *)&size, sizeof(size));
+
+    struct sockaddr_in local;
+    socklen_t localSize = sizeof(local);
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &local.sin_addr);
+    unsigned rtpPort = 0, rtcpPort = 0;
+    if(bind(v.rtp_fd, (const sockaddr *)&local, sizeof(local)) == 0 && getsockname(v.rtp_fd, (sockaddr *)&local, &localSize) == 0)
+      rtpPort = ntohs(local.sin_port);
+    local.sin_port = 0;
+    localSize = sizeof(local);
+    if(bind(v.rtcp_fd, (const sockaddr *)&local, sizeof(local)) == 0 && getsockname(v.rtcp_fd, (sockaddr *)&local, &localSize) == 0)
+      rtcpPort = ntohs(local.sin_port);
+    if(rtpPort == 0 || rtcpPort == 0 || connect(v.fd, (const sockaddr *)&addr, sizeof(addr)) == -1)
+      break;
+
+    PString response;
+    if(!BenchmarkRtspRequest(v.fd, "DESCRIBE " + url + " RTSP/1.0\r\nCSeq: 1\r\nAccept: application/sdp\r\n\r\n", response))
+      break;
+    if(!BenchmarkRtspRequest(v.fd, "SETUP " + url + "/video RTSP/1.0\r\nCSeq: 2\r\nTransport: RTP/AVP;unicast;client_port="
+                                   + PString(rtpPort) + "-" + PString(rtcpPort) + "\r\n\r\n", response))
+      break;
+    PINDEX pos = response.Find("Session: ");
+    PString session = (pos == P_MAX_INDEX) ? PString() : response.Mid(pos + 9).Tokenise(";\r\n")[0];
+    if(!BenchmarkRtspRequest(v.fd, "PLAY " + url + " RTSP/1.0\r\nCSeq: 3\r\nSession: " + session + "\r\n\r\n", response))
+      break;
+    v.playTime = MCUTime::GetMonoTimestampUsec();
+    playing++;
+  }
+  uint64_t setupUsec = MCUTime::GetMonoTimestampUsec() - start;
+
+  // the RTP and RTCP sockets of the playing viewers
+  std::vector<struct pollfd> pfds(playing * 2);
+  for(unsigned i = 0; i < playing; i++)
+  {
+    pfds[i*2].fd = clients[i].rtp_fd;
+    pfds[i*2].events = POLLIN;
+    pfds[i*2+1].fd = clients[i].rtcp_fd;
+    pfds[i*2+1].events = POLLIN;
+  }
+
+  uint64_t packetsIn = fanout->GetPacketsIn();
+  uint64_t packetsOut = fanout->GetPacketsOut();
+  uint64_t sendUsec = fanout->GetSendUsec();
+  uint64_t received = 0;
+  uint64_t cpuStart = GetProcessCPUTime();
+  start = MCUTime::GetMonoTimestampUsec();
+  uint64_t end = start + (uint64_t)duration * 1000000;
+  while(playing && MCUTime::GetMonoTimestampUsec() < end)
+  {
+    if(poll(&pfds[0], pfds.size(), 100) <= 0)
+      continue;
+    uint64_t now = MCUTime::GetMonoTimestampUsec();
+    for(unsigned i = 0; i < pfds.size(); i++)
+    {
+      if(!(pfds[i].revents & POLLIN))
+        continue;
+      BenchmarkRtspViewer & v = clients[i / 2];
+      BYTE buffer[2048];
+      int len;
+      while((len = recv(pfds[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+      {
+        if(i % 2)
+        {
+          if(len >= 28 && buffer[1] == 200)
+            v.reports++;
+          continue;
+        }
+        if(len < 12)
+          continue;
+        received++;
+        unsigned seq = (buffer[2] << 8) | buffer[3];
+        if(v.packets == 0)
+        {
+          v.firstTime = now;
+          v.firstSeq = v.lastSeq = seq;
+        }
+        else
+        {
+          // extend across the wrap of the 16 bit number
+          unsigned ext = (v.lastSeq & ~0xffff) | seq;
+          if(ext + 0x8000 < v.lastSeq)
+            ext += 0x10000;
+          if(ext > v.lastSeq)
+            v.lastSeq = ext;
+        }
+        v.packets++;
+      }
+    }
+  }
+  uint64_t elapsed = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+  uint64_t cpu = GetProcessCPUTime() - cpuStart;
+  GetThreadGroups(groupsEnd);
+  packetsIn = fanout->GetPacketsIn() - packetsIn;
+  packetsOut = fanout->GetPacketsOut() - packetsOut;
+  sendUsec = fanout->GetSendUsec() - sendUsec;
+
+  unsigned started = 0;
+  uint64_t lost = 0, reports = 0;
+  double maxLoss = 0;
+  std::vector<uint64_t> latency;
+  for(unsigned i = 0; i < playing; i++)
+  {
+    BenchmarkRtspViewer & v = clients[i];
+    reports += v.reports;
+    if(v.packets == 0)
+      continue;
+    started++;
+    latency.push_back(v.firstTime - v.playTime);
+    unsigned expected = v.lastSeq - v.firstSeq + 1;
+    if(expected > v.packets)
+    {
+      lost += expected - v.packets;
+      maxLoss = PMAX(maxLoss, 100.0 * (expected - v.packets) / expected);
+    }
+  }
+  std::sort(latency.begin(), latency.end());
+
+  // the clients close first, the viewers are deleted with the fan-out
+  for(unsigned i = 0; i < viewers; i++)
+  {
+    if(clients[i].fd != -1) close(clients[i].fd);
+    if(clients[i].rtp_fd != -1) close(clients[i].rtp_fd);
+    if(clients[i].rtcp_fd != -1) close(clients[i].rtcp_fd);
+  }
+  delete listener;
+  delete fanout;
+  manager->RemoveConference(room);
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("viewers", viewers);
+  json.Insert("playing", playing);
+  json.Insert("started", started);
+  json.Insert("codec", codec);
+  json.Insert("width", width);
+  json.Insert("height", height);
+  json.Insert("fps", frameRate);
+  json.Insert("bitrate", bitrate);
+  json.Insert("setup_usec", (long long)setupUsec);
+  json.Insert("duration_usec", (long long)elapsed);
+  json.Insert("packets_received", (long long)received);
+  json.Insert("packets_per_sec", 1000000.0 * received / elapsed);
+  json.Insert("packets_lost", (long long)lost);
+  json.Insert("max_loss_percent", maxLoss);
+  json.Insert("sender_reports", (long long)reports);
+  if(latency.size())
+  {
+    json.Insert("first_packet_usec_p50", (long long)latency[latency.size() / 2]);
+    json.Insert("first_packet_usec_p99", (long long)latency[latency.size() * 99 / 100]);
+  }
+
+  // one packet of the cache to all viewers
+  MCUJSON *jsonFanout = MCUJSON::Object("fanout");
+  jsonFanout->Insert("packets_in", (long long)packetsIn);
+  jsonFanout->Insert("packets_out", (long long)packetsOut);
+  jsonFanout->Insert("send_usec", (long long)sendUsec);
+  jsonFanout->Insert("send_nsec_per_packet", packetsOut ? 1000.0 * sendUsec / packetsOut : 0.0);
+  json.Insert(jsonFanout);
+
+  MCUJSON *jsonCPU = MCUJSON::Object("cpu");
+  jsonCPU->Insert("process_usec", (long long)cpu);
+  jsonCPU->Insert("process_percent", 100.0 * cpu / elapsed);
+  ThreadGroupMap::iterator it = groupsEnd.find("rtsp_fanout");
+  if(it != groupsEnd.end())
+  {
+    ThreadGroupMap::iterator sit = groupsStart.find("rtsp_fanout");
+    uint64_t usec = it->second.usec;
+    if(sit != groupsStart.end())
+      usec = (usec > sit->second.usec ? usec - sit->second.usec : 0);
+    jsonCPU->Insert("rtsp_fanout_usec", (long long)usec);
+  }
+  json.Insert(jsonCPU);
+
+  result = json.AsString();
+  MCUTRACE(1, trace_section << "RTSP fan-out " << result);
+
+  runMutex.Signal();
+  return TRUE;
+#else
+  result = "{\"error\":\"not supported\"}";
+  return FALSE;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::RunReplay(const PStringToString & params, PString & result)
+{
+  // a capture of "room X capture <id> start" through the media path, a regression of the
+  // jitter buffer, the decoder or the mixers changes the checksums
+  PString fileName = params("replay");
+  PString room = params.Contains("room") ? params("room") : PString("benchmark_replay");
+  unsigned width = params.Contains("w") ? params("w").AsUnsigned() : CIF_WIDTH;
+  unsigned height = params.Contains("h") ? params("h").AsUnsigned() : CIF_HEIGHT;
+  unsigned runs = params.Contains("runs") ? params("runs").AsUnsigned() : 2;
+  width = PMAX(16, PMIN(width, 1920)) & ~1;
+  height = PMAX(16, PMIN(height, 1080)) & ~1;
+  runs = PMAX(1, PMIN(runs, 10));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  MCUJSON *jsonRuns = MCUJSON::Array("runs");
+  std::string decoded, mixed;
+  BOOL ok = TRUE, deterministic = TRUE;
+  for(unsigned i = 0; ok && i < runs; i++)
+  {
+    MCUJSON *jsonRun = MCUJSON::Object();
+    PString error;
+    ok = MCURtpReplay::Run(fileName, room, width, height, *jsonRun, error);
+    if(!ok)
+    {
+      delete jsonRun;
+      json.Insert("error", error);
+      break;
+    }
+    std::string runDecoded = jsonRun->Find("decoded_checksum")->AsString();
+    std::string runMixed = jsonRun->Find("mixed_checksum")->AsString();
+    if(i == 0)
+    {
+      decoded = runDecoded;
+      mixed = runMixed;
+    }
+    else if(decoded != runDecoded || mixed != runMixed)
+      deterministic = FALSE;
+    jsonRuns->Insert(jsonRun);
+  }
+  json.Insert(jsonRuns);
+  json.Insert("deterministic", ok && deterministic);
+
+  runMutex.Signal();
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: replay " << result);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// raw audio of the loss test, a tone for the encoder, the decoded samples are kept
+class BenchmarkLossAudio : public PChannel
+{
+  PCLASSINFO(BenchmarkLossAudio, PChannel);
+  public:
+    BenchmarkLossAudio(unsigned sampleRate)
+      : phase(0), step(6.283185307179586 * 440 / sampleRate)
+    {
+      os_handle = 0;
+    }
+
+    BOOL Read(void * buffer, PINDEX amount)
+    {
+      short *samples = (short *)buffer;
+      for(PINDEX i = 0; i < amount / 2; i++)
+      {
+        samples[i] = (short)(8000 * sin(phase));
+        phase += step;
+      }
+      lastReadCount = amount;
+      return TRUE;
+    }
+
+    BOOL Write(const void * buffer, PINDEX amount)
+    {
+      const short *samples = (const short *)buffer;
+      output.insert(output.end(), samples, samples + amount / 2);
+      lastWriteCount = amount;
+      return TRUE;
+    }
+
+    std::vector<short> output;
+
+  protected:
+    double phase;
+    double step;
+};
+
+struct BenchmarkLossPacket
+{
+  WORD sequence;
+  DWORD timestamp;
+  std::vector<BYTE> payload;
+};
+
+// decodes the stream, a lost packet is either played as the jitter buffer does, an empty frame
+// in its slot, or not played at all and left to the gap in the sequence numbers
+static BOOL BenchmarkLossDecode(MCUCapability * cap, const std::vector<BenchmarkLossPacket> & packets, const std::vector<bool> & lost,
+                                BOOL fill, MCUJSON & json, std::vector<short> & output, BOOL & concealedAll)
+{
+  concealedAll = TRUE;
+  H323Codec *codec = MCUCapability::CreateCodec(cap, MCUCodec::Decoder);
+  if(codec == NULL)
+    return FALSE;
+  const OpalMediaFormat & mf = codec->GetMediaFormat();
+  BenchmarkLossAudio *audio = new BenchmarkLossAudio(mf.GetTimeUnits() * 1000);
+  codec->AttachChannel(audio, TRUE);
+
+  RTP_DataFrame frame, nextFrame;
+  frame.SetPayloadType(mf.GetPayloadType());
+  nextFrame.SetPayloadType(mf.GetPayloadType());
+  BOOL ok = TRUE;
+  unsigned lostPackets = 0;
+  for(size_t i = 0; ok && i < packets.size(); i++)
+  {
+    unsigned written;
+    frame.SetSequenceNumber(packets[i].sequence);
+    frame.SetTimestamp(packets[i].timestamp);
+    if(lost[i])
+    {
+      lostPackets++;
+      if(fill)
+      {
+        // the jitter buffer holds the packet after the slot when it has arrived, as MCU_RTPChannel peeks it
+        if(i + 1 < packets.size() && !lost[i + 1] && PIsDescendant(codec, MCUFramedAudioCodec))
+        {
+          int nextSize = (int)packets[i + 1].payload.size();
+          nextFrame.SetSequenceNumber(packets[i + 1].sequence);
+          nextFrame.SetTimestamp(packets[i + 1].timestamp);
+          nextFrame.SetPayloadSize(nextSize);
+          memcpy(nextFrame.GetPayloadPtr(), &packets[i + 1].payload[0], nextSize);
+          ((MCUFramedAudioCodec *)codec)->SetNextFrame(&nextFrame);
+        }
+        frame.SetPayloadSize(0);
+        ok = codec->Write(NULL, 0, frame, written);
+      }
+      continue;
+    }
+    int size = (int)packets[i].payload.size();
+    frame.SetPayloadSize(size);
+    memcpy(frame.GetPayloadPtr(), &packets[i].payload[0], size);
+    const BYTE * ptr = frame.GetPayloadPtr();
+    while(ok && size > 0)
+    {
+      ok = codec->Write(ptr, size, frame, written);
+      size -= written != 0 ? written : size;
+      ptr += written;
+    }
+  }
+
+  output = audio->output;
+  json.Insert("lost", lostPackets);
+  json.Insert("samples", (unsigned)output.size());
+  if(PIsDescendant(codec, MCUFramedAudioCodec))
+  {
+    MCUFramedAudioCodec *audioCodec = (MCUFramedAudioCodec *)codec;
+    json.Insert("concealed", audioCodec->GetFramesConcealed());
+    json.Insert("recovered", audioCodec->GetFramesRecovered());
+    // each slot played in place of a lost packet is concealed by a decoder that can do it
+    if(fill && audioCodec->CanConcealFrames())
+    {
+      concealedAll = (audioCodec->GetFramesConcealed() + audioCodec->GetFramesRecovered() == lostPackets);
+      json.Insert("concealed_all", concealedAll);
+    }
+  }
+  delete codec;
+  return ok;
+}
+
+// signal to noise ratio of a decode against the clean one, in dB
+static double BenchmarkLossSNR(const std::vector<short> & clean, const std::vector<short> & output)
+{
+  double signal = 0, noise = 0;
+  size_t count = PMIN(clean.size(), output.size());
+  for(size_t i = 0; i < count; i++)
+  {
+    double diff = (double)clean[i] - output[i];
+    signal += (double)clean[i] * clean[i];
+    noise += diff * diff;
+  }
+  if(noise == 0)
+    return 999;
+  if(signal == 0)
+    return 0;
+  return 10 * log10(signal / noise);
+}
+
+BOOL MCUBenchmark::RunLoss(const PStringToString & params, PString & result)
+{
+  // the same stream with the same losses every time, a recorded capture or an encoded tone,
+  // decoded clean and through the losses, the output must keep the length of the clean one
+  unsigned lossPercent = params("loss").AsUnsigned();
+  unsigned burst = params.Contains("burst") ? params("burst").AsUnsigned() : 1;
+  unsigned seed = params.Contains("seed") ? params("seed").AsUnsigned() : 1;
+  unsigned count = params.Contains("packets") ? params("packets").AsUnsigned() : 500;
+  PString fileName = params.Contains("file") ? params("file") : PString::Empty();
+  PString formatName = params.Contains("codec") ? params("codec") : PString("OPUS_48K");
+  lossPercent = PMIN(lossPercent, 90);
+  burst = PMAX(1, PMIN(burst, 50));
+  count = PMAX(10, PMIN(count, 100000));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  std::vector<BenchmarkLossPacket> packets;
+  MCUCapability *cap = NULL;
+  PString error;
+
+  if(!fileName.IsEmpty())
+  {
+    MCURtpCaptureReader reader;
+    if(!reader.Open(fileName))
+      error = "could not read capture " + fileName;
+    else
+    {
+      formatName = reader.GetFormatName();
+      RTP_DataFrame frame;
+      while(packets.size() < count && reader.Read(frame, (uint64_t)-1) == 1)
+      {
+        BenchmarkLossPacket packet;
+        packet.sequence = frame.GetSequenceNumber();
+        packet.timestamp = frame.GetTimestamp();
+        packet.payload.assign(frame.GetPayloadPtr(), frame.GetPayloadPtr() + frame.GetPayloadSize());
+        if(!packet.payload.empty())
+          packets.push_back(packet);
+      }
+    }
+  }
+
+  if(error.IsEmpty())
+  {
+    cap = MCUCapability::Create(formatName);
+    if(cap == NULL || cap->GetMainType() != MCUCapability::e_Audio)
+      error = "unknown audio format " + formatName;
+  }
+
+  if(error.IsEmpty() && fileName.IsEmpty())
+  {
+    H323Codec *encoder = MCUCapability::CreateCodec(cap, MCUCodec::Encoder);
+    if(encoder == NULL)
+      error = "could not create encoder " + formatName;
+    else
+    {
+      encoder->AttachChannel(new BenchmarkLossAudio(encoder->GetMediaFormat().GetTimeUnits() * 1000), TRUE);
+      std::vector<BYTE> buffer(8192);
+      RTP_DataFrame frame;
+      DWORD timestamp = 0;
+      for(unsigned i = 0; i < count; i++)
+      {
+        unsigned length = 0;
+        if(!encoder->Read(&buffer[0], length, frame))
+        {
+          error = "could not encode " + formatName;
+          break;
+        }
+        BenchmarkLossPacket packet;
+        packet.sequence = (WORD)i;
+        packet.timestamp = timestamp;
+        packet.payload.assign(buffer.begin(), buffer.begin() + length);
+        timestamp += encoder->GetFrameRate();
+        if(!packet.payload.empty())
+          packets.push_back(packet);
+      }
+      delete encoder;
+    }
+  }
+
+  if(error.IsEmpty() && packets.size() < 2)
+    error = "no packets";
+
+  BOOL ok = error.IsEmpty();
+  if(ok)
+  {
+    // deterministic losses, the first packet always arrives for the decoder to start
+    std::vector<bool> lost(packets.size(), false);
+    unsigned random = seed, burstLeft = 0;
+    for(size_t i = 1; i < packets.size(); i++)
+    {
+      random = random * 1103515245 + 12345;
+      if(burstLeft == 0 && (random >> 16) % 100 < lossPercent)
+        burstLeft = burst;
+      if(burstLeft > 0)
+      {
+        lost[i] = true;
+        burstLeft--;
+      }
+    }
+
+    std::vector<bool> none(packets.size(), false);
+    std::vector<short> clean, filled, gaps;
+    MCUJSON *jsonClean = MCUJSON::Object("clean");
+    MCUJSON *jsonFilled = MCUJSON::Object("jitter");
+    MCUJSON *jsonGaps = MCUJSON::Object("gaps");
+    BOOL concealedAll = TRUE, unused;
+    ok = BenchmarkLossDecode(cap, packets, none, FALSE, *jsonClean, clean, unused)
+      && BenchmarkLossDecode(cap, packets, lost, TRUE, *jsonFilled, filled, concealedAll)
+      && BenchmarkLossDecode(cap, packets, lost, FALSE, *jsonGaps, gaps, unused);
+    if(!ok)
+      error = "could not decode " + formatName;
+
+    // the jitter buffer played a frame in each lost slot, concealed in the slot by a decoder
+    // that can do it; a frame filled in ahead of the next packet on top of it would make the
+    // output longer. The gaps are filled by the decoder up to the clean length unless a burst
+    // is longer than the decoder restores
+    BOOL filledMatch = (filled.size() == clean.size());
+    BOOL gapsMatch = (gaps.size() == clean.size());
+    jsonFilled->Insert("length_match", filledMatch);
+    jsonFilled->Insert("snr_db", BenchmarkLossSNR(clean, filled));
+    jsonGaps->Insert("length_match", gapsMatch);
+    jsonGaps->Insert("snr_db", BenchmarkLossSNR(clean, gaps));
+    json.Insert(jsonClean);
+    json.Insert(jsonFilled);
+    json.Insert(jsonGaps);
+    ok = ok && filledMatch && concealedAll && (gapsMatch || burst > AUDIO_MAX_LOST_FRAMES);
+  }
+
+  json.Insert("format", formatName);
+  json.Insert("packets", (unsigned)packets.size());
+  json.Insert("loss", lossPercent);
+  json.Insert("burst", burst);
+  json.Insert("seed", seed);
+  if(!error.IsEmpty())
+    json.Insert("error", error);
+  json.Insert("ok", ok);
+  delete cap;
+
+  runMutex.Signal();
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: loss " << result);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// plugin codec context with the options of the format as MCUVideoCodec sets them, and the extra ones
+static void * BenchmarkCodecCreate(PluginCodec_Definition * defn, const OpalMediaFormat & mf, const PStringArray & extra)
+{
+  void *context = (*defn->createCodec)(defn);
+  if(context == NULL)
+    return NULL;
+  PluginCodec_ControlDefn * ctl = GetCodecControl(defn, SET_CODEC_OPTIONS_CONTROL);
+  if(ctl != NULL)
+  {
+    PStringArray list;
+    for(PINDEX i = 0; i < mf.GetOptionCount(); i++)
+    {
+      list += mf.GetOption(i).GetName();
+      list += mf.GetOption(i).AsString();
+    }
+    for(PINDEX i = 0; i < extra.GetSize(); i++)
+      list += extra[i];
+    char ** options = list.ToCharArray();
+    unsigned optionsLen = sizeof(options);
+    (*ctl->control)(defn, context, SET_CODEC_OPTIONS_CONTROL, options, &optionsLen);
+    free(options);
+  }
+  return context;
+}
+
+BOOL MCUBenchmark::RunDecode(const PStringToString & params, PString & result)
+{
+  // the same encoded stream decoded with each thread count, the frame threads deliver the last
+  // pictures after the end of the stream and are counted as delayed
+  PStringArray threadList = params("decode").Tokenise(",", FALSE);
+  PString threadType = params.Contains("type") ? params("type") : PString("slice");
+  PString formatName = params.Contains("codec") ? params("codec") : PString("H.264{sw}");
+  unsigned width = params.Contains("w") ? params("w").AsUnsigned() : 1280;
+  unsigned height = params.Contains("h") ? params("h").AsUnsigned() : 720;
+  unsigned frames = params.Contains("frames") ? params("frames").AsUnsigned() : 300;
+  unsigned bitrate = params.Contains("bitrate") ? params("bitrate").AsUnsigned() : 2048; // kbit
+  width = (PMAX(16, PMIN(width, 1920)) / 2) * 2;
+  height = (PMAX(16, PMIN(height, 1088)) / 2) * 2;
+  frames = PMAX(10, PMIN(frames, 10000));
+  if(threadList.GetSize() == 0)
+    threadList = PString("1,2,4").Tokenise(",", FALSE);
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  PString error;
+  PluginCodec_Definition *encoderDefn = NULL, *decoderDefn = NULL;
+  MCUCapability *cap = MCUCapability::Create(formatName);
+  if(cap == NULL || cap->GetMainType() != MCUCapability::e_Video)
+    error = "unknown video format " + formatName;
+  else
+  {
+    encoderDefn = MCUPluginCodecManager::GetPluginCodec(cap, MCUCodec::Encoder);
+    decoderDefn = MCUPluginCodecManager::GetPluginCodec(cap, MCUCodec::Decoder);
+    if(encoderDefn == NULL || decoderDefn == NULL)
+      error = "no plugin codec for " + formatName;
+  }
+
+  // moving diagonal bars, one keyframe at the start
+  std::vector< std::vector<BYTE> > packets;
+  if(error.IsEmpty())
+  {
+    OpalMediaFormat & wf = cap->GetWritableMediaFormat();
+    SetFormatParams(wf, width, height, 25, bitrate);
+    void *encoder = BenchmarkCodecCreate(encoderDefn, wf, PStringArray());
+    if(encoder == NULL)
+      error = "could not create encoder " + formatName;
+    else
+    {
+      RTP_DataFrame src(sizeof(PluginCodec_Video_FrameHeader) + width * height * 3 / 2, TRUE);
+      PluginCodec_Video_FrameHeader *header = (PluginCodec_Video_FrameHeader *)src.GetPayloadPtr();
+      header->x = header->y = 0;
+      header->width = width;
+      header->height = height;
+      BYTE *data = OPAL_VIDEO_FRAME_DATA_PTR(header);
+      RTP_DataFrame dst(2048);
+      for(unsigned n = 0; n < frames && error.IsEmpty(); n++)
+      {
+        BYTE *y = data;
+        for(unsigned row = 0; row < height; row++)
+          for(unsigned col = 0; col < width; col++)
+            *y++ = (BYTE)(((col + row + n * 2) & 0x3f) * 3 + 32);
+        memset(data + width * height, 100, width * height / 2);
+
+        unsigned flags = (n == 0) ? PluginCodec_CoderForceIFrame : 0;
+        do
+        {
+          unsigned fromLen = src.GetHeaderSize() + src.GetPayloadSize();
+          unsigned toLen = dst.GetSize();
+          flags &= PluginCodec_CoderForceIFrame;
+          if((*encoderDefn->codecFunction)(encoderDefn, encoder, src.GetPointer(), &fromLen, dst.GetPointer(), &toLen, &flags) == 0)
+          {
+            error = "could not encode " + formatName;
+            break;
+          }
+          if(toLen > (unsigned)dst.GetHeaderSize())
+            packets.push_back(std::vector<BYTE>(dst.GetPointer(), dst.GetPointer() + toLen));
+        } while((flags & PluginCodec_ReturnCoderLastFrame) == 0);
+      }
+      (*encoderDefn->destroyCodec)(encoderDefn, encoder);
+    }
+  }
+  if(error.IsEmpty() && packets.empty())
+    error = "no packets";
+
+  MCUJSON *jsonRuns = MCUJSON::Array("runs");
+  BOOL ok = error.IsEmpty();
+  for(PINDEX t = 0; ok && t < threadList.GetSize(); t++)
+  {
+    PStringArray extra;
+    extra += PLUGINCODEC_OPTION_OUTPUT_PLANES;
+    extra += "1";
+    extra += OPTION_DECODER_THREADS;
+    extra += threadList[t];
+    extra += OPTION_DECODER_THREAD_TYPE;
+    extra += threadType;
+    void *decoder = BenchmarkCodecCreate(decoderDefn, cap->GetMediaFormat(), extra);
+    if(decoder == NULL)
+    {
+      error = "could not create decoder " + formatName;
+      ok = FALSE;
+      break;
+    }
+
+    std::vector<BYTE> picture(sizeof(PluginCodec_Video_FrameHeader) + 1920 * 1088 * 3 / 2 + 64);
+    std::vector<uint64_t> samples;
+    unsigned pictures = 0;
+    uint64_t frameStart = 0;
+    uint64_t cpuStart = GetProcessCPUTime();
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    for(size_t i = 0; i < packets.size(); i++)
+    {
+      uint64_t now = MCUTime::GetMonoTimestampUsec();
+      if(frameStart == 0)
+        frameStart = now;
+      unsigned fromLen = packets[i].size();
+      unsigned toLen = picture.size();
+      unsigned flags = 0;
+      (*decoderDefn->codecFunction)(decoderDefn, decoder, &packets[i][0], &fromLen, &picture[0], &toLen, &flags);
+      // the marker packet ends the frame, its decode time is the time of the frame
+      if(packets[i][1] & 0x80)
+      {
+        now = MCUTime::GetMonoTimestampUsec();
+        samples.push_back(now - frameStart);
+        frameStart = 0;
+      }
+      if((flags & PluginCodec_ReturnCoderLastFrame) && toLen >= (unsigned)RTP_DataFrame::MinHeaderSize + sizeof(PluginCodec_Video_FrameHeader))
+        pictures++;
+    }
+    uint64_t elapsed = MCUTime::GetMonoTimestampUsec() - start;
+    uint64_t cpu = GetProcessCPUTime() - cpuStart;
+    (*decoderDefn->destroyCodec)(decoderDefn, decoder);
+
+    std::sort(samples.begin(), samples.end());
+    MCUJSON *run = MCUJSON::Object();
+    run->Insert("threads", threadList[t]);
+    run->Insert("frames", (unsigned)samples.size());
+    run->Insert("pictures", pictures);
+    run->Insert("delayed", (unsigned)(samples.size() > pictures ? samples.size() - pictures : 0));
+    run->Insert("fps", elapsed ? (double)samples.size() * 1000000 / elapsed : 0.0);
+    run->Insert("cpu_usec_per_frame", (long long)(samples.size() ? cpu / samples.size() : 0));
+    if(!samples.empty())
+    {
+      run->Insert("p50_usec", (long long)samples[samples.size() / 2]);
+      run->Insert("p99_usec", (long long)samples[samples.size() * 99 / 100]);
+      run->Insert("max_usec", (long long)samples.back());
+    }
+    jsonRuns->Insert(run);
+    // the decoder is broken when most of the frames never come out
+    if(pictures * 2 < samples.size())
+    {
+      error = "decoder lost pictures with " + threadList[t] + " threads";
+      ok = FALSE;
+    }
+  }
+
+  json.Insert(jsonRuns);
+  json.Insert("format", formatName);
+  json.Insert("width", width);
+  json.Insert("height", height);
+  json.Insert("type", threadType);
+  json.Insert("packets", (unsigned)packets.size());
+  if(!error.IsEmpty())
+    json.Insert("error", error);
+  json.Insert("ok", ok);
+  delete cap;
+
+  runMutex.Signal();
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: decode " << result);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the argument of a record that writes a record of its own
+static const char * BenchmarkTraceNested(unsigned n)
+{
+  MCUTRACE(1, "Benchmark: nested trace record " << n);
+  return "outer";
+}
+
+class BenchmarkTraceWriter : public PThread
+{
+  PCLASSINFO(BenchmarkTraceWriter, PThread);
+  public:
+    BenchmarkTraceWriter(unsigned _index, unsigned _records, unsigned _level)
+      : PThread(10000, NoAutoDeleteThread, NormalPriority, "trace_writer:%0x"),
+        index(_index), records(_records), level(_level), cpu(0)
+    { Resume(); }
+
+    virtual void Main()
+    {
+      latency.reserve(records);
+      uint64_t cpuStart = GetThreadCPUTime();
+      for(unsigned n = 0; n < records; n++)
+      {
+        uint64_t start = MCUTime::GetMonoTimestampUsec();
+        if(n % 100 == 99)
+        {
+          MCUTRACE(level, "Benchmark: writer " << index << " record " << n << " " << BenchmarkTraceNested(n));
+        }
+        else
+        {
+          MCUTRACE(level, "Benchmark: writer " << index << " record " << n);
+        }
+        latency.push_back(MCUTime::GetMonoTimestampUsec() - start);
+        // a burst of records and a pause, as a call setup traces
+        if(n % 50 == 49)
+          MCUTime::Sleep(1);
+      }
+      cpu = GetThreadCPUTime() - cpuStart;
+    }
+
+    unsigned index;
+    unsigned records;
+    unsigned level;
+    uint64_t cpu;
+    std::vector<uint64_t> latency;
+};
+
+BOOL MCUBenchmark::RunTrace(const PStringToString & params, PString & result)
+{
+  // writers on all cores against the trace thread, the cost of a record for the caller
+  // and the records dropped by the full rings, every hundredth record has a nested one
+  unsigned threads = params("trace").AsUnsigned();
+  unsigned records = params.Contains("records") ? params("records").AsUnsigned() : 2000;
+  unsigned level = params.Contains("level") ? params("level").AsUnsigned() : 1;
+  threads = PMAX(1, PMIN(threads, 256));
+  records = PMAX(1, PMIN(records, 1000000));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  BOOL ok = PTrace::CanTrace(level);
+  if(!ok)
+    json.Insert("error", "trace level is lower than " + PString(level));
+  else
+  {
+    unsigned droppedStart = MCUTracer::GetDroppedRecords();
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    std::vector<BenchmarkTraceWriter *> writers;
+    for(unsigned i = 0; i < threads; i++)
+      writers.push_back(new BenchmarkTraceWriter(i, records, level));
+
+    std::vector<uint64_t> latency;
+    uint64_t cpu = 0;
+    for(unsigned i = 0; i < threads; i++)
+    {
+      writers[i]->WaitForTermination();
+      latency.insert(latency.end(), writers[i]->latency.begin(), writers[i]->latency.end());
+      cpu += writers[i]->cpu;
+      delete writers[i];
+    }
+    uint64_t elapsed = MCUTime::GetMonoTimestampUsec() - start;
+    // the trace thread drains the rest
+    MCUTime::Sleep(TRACE_DRAIN_INTERVAL * 10);
+    unsigned dropped = MCUTracer::GetDroppedRecords() - droppedStart;
+
+    std::sort(latency.begin(), latency.end());
+    uint64_t total = (uint64_t)threads * (records + records / 100);
+    json.Insert("threads", threads);
+    json.Insert("records", (long long)total);
+    json.Insert("dropped", dropped);
+    json.Insert("records_per_sec", elapsed ? (double)total * 1000000 / elapsed : 0.0);
+    json.Insert("cpu_usec_per_record", total ? (double)cpu / total : 0.0);
+    json.Insert("p50_usec", (long long)latency[latency.size() / 2]);
+    json.Insert("p99_usec", (long long)latency[latency.size() * 99 / 100]);
+    json.Insert("max_usec", (long long)latency.back());
+  }
+  json.Insert("ok", ok);
+
+  runMutex.Signal();
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: trace " << result);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// a receive channel of the jitter test, the loop of MCU_RTPChannel::Receive and IncomingAudio::Write:
+// the jitter buffer with its own thread and a sleep, or the buffer filled while waiting for the playout
+class BenchmarkJitterReader : public PThread
+{
+  public:
+    BenchmarkJitterReader(MCU_RTP_UDP & _session, BOOL _threadless)
+      : PThread(10000, NoAutoDeleteThread, NormalPriority, "jitter_reader:%0x"),
+        session(_session), threadless(_threadless), running(TRUE), frames(0), empty(0)
+    { Resume(); }
+
+    virtual void Main()
+    {
+      MCUDelay delay;
+      RTP_DataFrame frame;
+      DWORD timestamp = 0;
+      while(running)
+      {
+        if(!session.ReadBufferedData(timestamp, frame))
+          break;
+        timestamp = frame.GetTimestamp();
+        if(frame.GetPayloadSize() == 0)
+        {
+          timestamp += BENCHMARK_JITTER_SAMPLES;
+          empty++;
+        }
+        else
+          frames++;
+        uint32_t interval = delay.NextIntervalUsec(BENCHMARK_JITTER_SAMPLES * 125);
+        if(threadless)
+          session.WaitPlayout(interval);
+        else if(interval)
+          MCUTime::SleepUsec(interval);
+      }
+    }
+
+    MCU_RTP_UDP & session;
+    BOOL threadless;
+    BOOL running;
+    unsigned frames;
+    unsigned empty;
+};
+
+BOOL MCUBenchmark::RunJitterStream(H323Connection & connection, unsigned channels, unsigned seconds, WORD port, BOOL threadless, MCUJSON & json)
+{
+  std::vector<MCU_RTP_UDP *> sessions;
+  std::vector<WORD> ports;
+  for(unsigned i = 0; i < channels; i++)
+  {
+    MCU_RTP_UDP * session = new MCU_RTP_UDP(
+#ifdef H323_RTP_AGGREGATE
+                                            NULL,
+#endif
+                                            RTP_Session::DefaultAudioSessionID);
+    if(!session->Open(PIPSocket::Address("127.0.0.1"), port, 65000, 0, connection, NULL, NULL))
+    {
+      delete session;
+      break;
+    }
+    port = session->GetLocalDataPort() + 2;
+    // 20..200 ms of PCMU, as the connection sets it
+    if(threadless)
+      session->CreateJitterBuffer(20 * 8, 200 * 8);
+    else
+      session->SetJitterBufferSize(20 * 8, 200 * 8);
+    sessions.push_back(session);
+    ports.push_back(session->GetLocalDataPort());
+  }
+  if(sessions.size() < channels)
+  {
+    json.Insert("error", "cannot open " + PString(channels) + " sessions");
+    for(size_t i = 0; i < sessions.size(); i++)
+      delete sessions[i];
+    return FALSE;
+  }
+
+  std::vector<BenchmarkJitterReader *> readers;
+  for(unsigned i = 0; i < channels; i++)
+    readers.push_back(new BenchmarkJitterReader(*sessions[i], threadless));
+
+  // one sender for all channels, a packet of each channel every 20 ms
+  PUDPSocket socket;
+  socket.Listen(PIPSocket::Address("127.0.0.1"));
+  RTP_DataFrame frame(BENCHMARK_JITTER_SAMPLES);
+  frame.SetPayloadType(RTP_DataFrame::PCMU);
+  memset(frame.GetPayloadPtr(), 0xff, BENCHMARK_JITTER_SAMPLES);
+  MCUDelay delay;
+  unsigned packets = seconds * 50;
+  uint64_t cpuStart = GetProcessCPUTime();
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  unsigned threads = 0;
+  for(unsigned n = 0; n < packets; n++)
+  {
+    for(unsigned i = 0; i < channels; i++)
+    {
+      frame.SetSyncSource(0x1000 + i);
+      frame.SetSequenceNumber((WORD)n);
+      frame.SetTimestamp(n * BENCHMARK_JITTER_SAMPLES);
+      socket.WriteTo(frame.GetPointer(), frame.GetHeaderSize() + BENCHMARK_JITTER_SAMPLES, PIPSocket::Address("127.0.0.1"), ports[i]);
+    }
+    // the threads while the stream runs
+    if(n == packets / 2)
+    {
+      ThreadGroupMap groups;
+      GetThreadGroups(groups);
+      for(ThreadGroupMap::iterator it = groups.begin(); it != groups.end(); ++it)
+        threads += it->second.threads;
+    }
+    delay.DelayUsec(BENCHMARK_JITTER_SAMPLES * 125);
+  }
+  uint64_t elapsed = MCUTime::GetMonoTimestampUsec() - start;
+  uint64_t cpu = GetProcessCPUTime() - cpuStart;
+
+  unsigned frames = 0, empty = 0, tooLate = 0;
+  for(unsigned i = 0; i < channels; i++)
+  {
+    readers[i]->running = FALSE;
+    readers[i]->WaitForTermination();
+    frames += readers[i]->frames;
+    empty += readers[i]->empty;
+    tooLate += sessions[i]->GetPacketsTooLate();
+    delete readers[i];
+    sessions[i]->Close(TRUE);
+    delete sessions[i];
+  }
+
+  json.Insert("threads", threads);
+  json.Insert("cpu_percent", elapsed ? 100.0 * cpu / elapsed : 0.0);
+  json.Insert("cpu_usec_per_channel_sec", elapsed ? (double)cpu * 1000000 / elapsed / channels : 0.0);
+  json.Insert("frames_played", frames);
+  json.Insert("frames_empty", empty);
+  json.Insert("packets_too_late", tooLate);
+  return TRUE;
+}
+
+BOOL MCUBenchmark::RunJitter(const PStringToString & params, PString & result)
+{
+  // audio receive channels with the jitter buffer thread against the buffer filled by the
+  // receive thread: threads of the process, CPU per channel and the frames played
+  unsigned channels = params("jitter").AsUnsigned();
+  unsigned seconds = params.Contains("s") ? params("s").AsUnsigned() : 10;
+  unsigned port = params.Contains("port") ? params("port").AsUnsigned() : 30000;
+  channels = PMAX(1, PMIN(channels ? channels : 100, 1000));
+  seconds = PMAX(1, PMIN(seconds, BENCHMARK_MAX_DURATION));
+  port = PMAX(1024, PMIN(port, 60000));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  // never set up, the sessions need a connection only for the NAT methods
+  H323Connection connection(OpenMCU::Current().GetEndpoint(), 0);
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("channels", channels);
+  json.Insert("seconds", seconds);
+  BOOL ok = TRUE;
+  for(unsigned threadless = 0; ok && threadless < 2; threadless++)
+  {
+    MCUJSON * run = MCUJSON::Object(threadless ? "threadless" : "jitter_thread");
+    ok = RunJitterStream(connection, channels, seconds, (WORD)port, threadless, *run);
+    json.Insert(run);
+  }
+  json.Insert("ok", ok);
+
+  runMutex.Signal();
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: jitter " << result);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// 0, 16, 63 and 255 often, the values the branches of the row kernels check
+static void BenchmarkYUVRandom(std::vector<BYTE> & buffer, unsigned & seed)
+{
+  static const BYTE special[4] = { 0, 16, 63, 255 };
+  for(size_t i = 0; i < buffer.size(); i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    unsigned r = seed >> 8;
+    buffer[i] = (r & 3) == 0 ? special[(r >> 2) & 3] : (BYTE)(r >> 4);
+  }
+}
+
+// runs the compositing of every width, position and alignment with the kernel set and the
+// scalar kernels, returns the cases where the frames differ
+static unsigned BenchmarkYUVCompare(const PString & kernels, unsigned & cases)
+{
+  unsigned mismatches = 0;
+  unsigned seed = 1;
+  const unsigned fh = 3;
+  std::vector<BYTE> src, dst, ref, in;
+  for(unsigned fw = 1; fw <= 1920; fw = (fw < 80 ? fw + 1 : (fw < 1920 ? 1920 : fw + 1)))
+  {
+    unsigned step = fw > 80 ? 61 : 1;
+    for(unsigned width = 0; width <= fw; width += step)
+    {
+      unsigned xpos = (fw - width) * ((cases % 3) + 1) / 4;
+      // the buffers start at any offset of a vector
+      unsigned offset = cases % 32;
+      src.resize(offset + width * fh);
+      in.resize(offset + fw * fh);
+      BenchmarkYUVRandom(src, seed);
+      BenchmarkYUVRandom(in, seed);
+      for(unsigned mode = 0; mode < 4; mode++)
+      {
+        cases++;
+        for(unsigned pass = 0; pass < 2; pass++)
+        {
+          SetYUVKernels(pass == 0 ? PString("scalar") : kernels);
+          std::vector<BYTE> & out = (pass == 0 ? ref : dst);
+          out = in;
+          BYTE * s = &src[0] + offset;
+          BYTE * d = &out[0] + offset;
+          if(mode < 2)
+            MixRectIntoFrameGrayscale(s, d, xpos, 0, width, fh, fw, fh, mode);
+          else if(mode == 2)
+          {
+            for(unsigned y = 0; y < fh; y++)
+              SplitLineRow(d + y * fw + xpos, width);
+          }
+          else
+          {
+#if USE_FREETYPE
+            MixRectIntoFrameSubsMode(s, d, xpos, 0, width, fh, fw, fh, 0);
+#endif
+          }
+        }
+        if(dst != ref)
+        {
+          if(mismatches < 10)
+          {
+            MCUTRACE(1, "Benchmark: yuv " << kernels << " differs, mode " << mode << " fw " << fw << " width " << width << " xpos " << xpos << " offset " << offset);
+          }
+          mismatches++;
+        }
+      }
+    }
+  }
+  return mismatches;
+}
+
+// a frame of the layout composed as the mixer does when all positions have changed:
+// the picture of every position with a transparent label, the blocks and the grid
+static void BenchmarkYUVLayout(const VMPCfgLayout & layout, unsigned width, unsigned height,
+                               const BYTE * picture, const BYTE * label, BYTE * position, BYTE * mixed)
+{
+  for(unsigned i = 0; i < layout.splitcfg.vidnum; i++)
+  {
+    const VMPCfgOptions & vmpcfg = layout.vmpcfg[i];
+    int px = (float)vmpcfg.posx  *width/CIF4_WIDTH;
+    int py = (float)vmpcfg.posy  *height/CIF4_HEIGHT;
+    int pw = (float)vmpcfg.width *width/CIF4_WIDTH;
+    int ph = (float)vmpcfg.height*height/CIF4_HEIGHT;
+    if(pw<2 || ph<2) continue;
+
+    memcpy(position, picture, pw*ph*3/2);
+    int lh = (ph / 8) & ~1;
+    MixRectIntoFrameGrayscale(label, position, 0, ph - lh, pw, lh, pw, ph, 1);
+
+    if(vmpcfg.blks == 1)
+      CopyRectIntoFrame(position, mixed, px, py, pw, ph, width, height);
+    else
+      for(unsigned b = 0; b < vmpcfg.blks; b++)
+        CopyRFromRIntoR(position, mixed, px, py, pw, ph,
+          AlignUp2(vmpcfg.blk[b].posx*width/CIF4_WIDTH), AlignUp2(vmpcfg.blk[b].posy*height/CIF4_HEIGHT),
+          AlignUp2(vmpcfg.blk[b].width*width/CIF4_WIDTH), AlignUp2(vmpcfg.blk[b].height*height/CIF4_HEIGHT),
+          width, height, pw, ph);
+
+    if(vmpcfg.border)
+    {
+      if(px != 0)
+        for(int y = 0; y < ph; y++)
+          SplitLineRow(mixed + (py + y) * width + px, 1);
+      if(py != 0)
+        SplitLineRow(mixed + py * width + px, pw);
+    }
+  }
+}
+
+BOOL MCUBenchmark::RunYUV(const PStringToString & params, PString & result)
+{
+  // the SIMD kernel sets against the scalar ones, the time of a 1080p frame for each set,
+  // then the frames of the layouts of layouts.conf at the output sizes of the mixers
+  unsigned iterations = params("yuv").AsUnsigned();
+  iterations = PMAX(1, PMIN(iterations ? iterations : 100, 100000));
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  const unsigned fw = 1920, fh = 1080;
+  PString current = GetYUVKernels();
+  PStringArray list = GetYUVKernelsList();
+  unsigned seed = 1;
+  std::vector<BYTE> src(fw * fh), frame(fw * fh * 3 / 2);
+  BenchmarkYUVRandom(src, seed);
+  BenchmarkYUVRandom(frame, seed);
+
+  BOOL ok = TRUE;
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("selected", current);
+  json.Insert("iterations", iterations);
+  MCUJSON * sets = MCUJSON::Array("kernels");
+  for(PINDEX i = 0; i < list.GetSize(); i++)
+  {
+    MCUJSON * set = MCUJSON::Object();
+    set->Insert("name", list[i]);
+    unsigned cases = 0;
+    unsigned mismatches = BenchmarkYUVCompare(list[i], cases);
+    if(mismatches)
+      ok = FALSE;
+    set->Insert("cases", cases);
+    set->Insert("mismatches", mismatches);
+
+    SetYUVKernels(list[i]);
+    // a quarter of the frame over the frame, the layout of a 2x2 room
+    uint64_t start = MCUTime::GetMonoTimestampUsec();
+    for(unsigned n = 0; n < iterations; n++)
+      MixRectIntoFrameGrayscale(&src[0], &frame[0], fw / 4, fh / 4, fw / 2, fh / 2, fw, fh, 1);
+    set->Insert("grayscale_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+    start = MCUTime::GetMonoTimestampUsec();
+    for(unsigned n = 0; n < iterations; n++)
+      for(unsigned y = 0; y < fh; y++)
+        SplitLineRow(&frame[y * fw], fw);
+    set->Insert("split_line_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+#if USE_FREETYPE
+    start = MCUTime::GetMonoTimestampUsec();
+    for(unsigned n = 0; n < iterations; n++)
+      MixRectIntoFrameSubsMode(&src[0], &frame[0], 0, 0, fw, fh, fw, fh, 0);
+    set->Insert("subtitles_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+#endif
+    sets->Insert(set);
+  }
+  SetYUVKernels(current);
+  json.Insert(sets);
+
+  // every layout is composed at every size with every set, a tenth of the iterations
+  static const unsigned sizes[][2] = { { CIF_WIDTH, CIF_HEIGHT }, { CIF4_WIDTH, CIF4_HEIGHT }, { 1280, 720 }, { 1920, 1080 } };
+  unsigned layoutIterations = PMAX(1, iterations / 10);
+  std::vector<BYTE> picture(fw * fh * 3 / 2), label(fw * fh), position(fw * fh * 3 / 2);
+  BenchmarkYUVRandom(picture, seed);
+  BenchmarkYUVRandom(label, seed);
+  MCUJSON * layouts = MCUJSON::Array("layouts");
+  for(unsigned s = 0; s < PARRAYSIZE(sizes); s++)
+  {
+    unsigned width = sizes[s][0], height = sizes[s][1];
+    MCUJSON * size = MCUJSON::Object();
+    size->Insert("size", PString(width) + "x" + PString(height));
+    MCUJSON * total = MCUJSON::Object("usec_per_frame");
+    MCUJSON * frames = MCUJSON::Array("frames");
+    std::vector<double> sums(list.GetSize(), 0.0);
+    for(unsigned l = 0; l < OpenMCU::vmcfg.vmconfs; l++)
+    {
+      const VMPCfgLayout & layout = OpenMCU::vmcfg.vmconf[l];
+      MCUJSON * frameJson = MCUJSON::Object();
+      frameJson->Insert("id", PString(layout.splitcfg.Id));
+      frameJson->Insert("positions", layout.splitcfg.vidnum);
+      for(PINDEX i = 0; i < list.GetSize(); i++)
+      {
+        SetYUVKernels(list[i]);
+        uint64_t start = MCUTime::GetMonoTimestampUsec();
+        for(unsigned n = 0; n < layoutIterations; n++)
+          BenchmarkYUVLayout(layout, width, height, &picture[0], &label[0], &position[0], &frame[0]);
+        double usec = (double)(MCUTime::GetMonoTimestampUsec() - start) / layoutIterations;
+        frameJson->Insert((const char *)list[i], usec);
+        sums[i] += usec;
+      }
+      frames->Insert(frameJson);
+    }
+    SetYUVKernels(current);
+    for(PINDEX i = 0; i < list.GetSize(); i++)
+      total->Insert((const char *)list[i], OpenMCU::vmcfg.vmconfs ? sums[i] / OpenMCU::vmcfg.vmconfs : 0.0);
+    size->Insert(total);
+    size->Insert(frames);
+    layouts->Insert(size);
+  }
+  json.Insert(layouts);
+
+  // the memset and memcpy paths of the frame, full width blocks and the rectangles of a row
+  MCUJSON * fill = MCUJSON::Object("fill");
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned n = 0; n < iterations; n++)
+    FillYUVRect(&frame[0], fw, fh, 0, 0, 0, 0, 0, fw, fh);
+  fill->Insert("fill_frame_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+  start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned n = 0; n < iterations; n++)
+    FillYUVRect(&frame[0], fw, fh, 0, 0, 0, 2, 0, fw - 4, fh);
+  fill->Insert("fill_rect_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+  start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned n = 0; n < iterations; n++)
+    ReplaceUV_Rect(&frame[0], fw, fh, 128, 128, 0, 0, fw, fh);
+  fill->Insert("replace_uv_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+  std::vector<BYTE> copy(fw * fh * 3 / 2);
+  start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned n = 0; n < iterations; n++)
+    CopyRFromRIntoR(&copy[0], &frame[0], 0, 0, fw, fh, 0, 0, fw, fh, fw, fh, fw, fh);
+  fill->Insert("copy_frame_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+  start = MCUTime::GetMonoTimestampUsec();
+  for(unsigned n = 0; n < iterations; n++)
+    CopyRFromRIntoR(&copy[0], &frame[0], 0, 0, fw / 2, fh, 0, 0, fw / 2, fh, fw, fh, fw / 2, fh);
+  fill->Insert("copy_rect_usec", (double)(MCUTime::GetMonoTimestampUsec() - start) / iterations);
+  json.Insert(fill);
+  json.Insert("ok", ok);
+
+  runMutex.Signal();
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: yuv " << result);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// one updater of the metrics test: a counter of one cache line as the metrics had it,
+// or the counter and the histogram of the metrics
+class BenchmarkMetricWriter : public PThread
+{
+  public:
+    BenchmarkMetricWriter(unsigned _mode, unsigned _updates, volatile int64_t * _shared, MCUMetric * _counter, MCUMetric * _histogram)
+      : PThread(10000, NoAutoDeleteThread, NormalPriority, "metric_writer:%0x"),
+        mode(_mode), updates(_updates), shared(_shared), counter(_counter), histogram(_histogram)
+    { Resume(); }
+
+    virtual void Main()
+    {
+      for(unsigned n = 0; n < updates; n++)
+      {
+        if(mode == 0)
+          sync_fetch_and_add64(shared, 1);
+        else if(mode == 1)
+          counter->Inc();
+        else
+          histogram->Observe(n & 1023);
+      }
+    }
+
+    unsigned mode;
+    unsigned updates;
+    volatile int64_t * shared;
+    MCUMetric * counter;
+    MCUMetric * histogram;
+};
+
+BOOL MCUBenchmark::RunMetrics(const PStringToString & params, PString & result)
+{
+  // updates of one metric from many threads, as the RTP threads of the calls count the packets:
+  // a single atomic counter against the shards of the metrics, nsec per update
+  PStringArray threadList = params("metrics").Tokenise(",", FALSE);
+  unsigned updates = params.Contains("updates") ? params("updates").AsUnsigned() : 1000000;
+  updates = PMAX(1000, PMIN(updates, 100000000));
+  if(threadList.GetSize() == 0)
+    threadList = PString("1,2,4,8").Tokenise(",", FALSE);
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  static const char * const modeNames[3] = { "shared_counter", "metric_counter", "metric_histogram" };
+  MCUMetric counter(MCUMetric::Counter, "benchmark_counter", "");
+  MCUMetric histogram(MCUMetric::Histogram, "benchmark_histogram", "");
+  volatile int64_t shared = 0;
+
+  BOOL ok = TRUE;
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("updates", updates);
+  MCUJSON * runs = MCUJSON::Array("runs");
+  for(PINDEX t = 0; t < threadList.GetSize(); t++)
+  {
+    unsigned threads = PMAX(1, PMIN(threadList[t].AsUnsigned(), 256));
+    MCUJSON * run = MCUJSON::Object();
+    run->Insert("threads", threads);
+    for(unsigned mode = 0; mode < 3; mode++)
+    {
+      int64_t before = (mode == 0 ? shared : (mode == 1 ? counter.GetCount() : histogram.GetCount()));
+      uint64_t start = MCUTime::GetMonoTimestampUsec();
+      std::vector<BenchmarkMetricWriter *> writers;
+      for(unsigned i = 0; i < threads; i++)
+        writers.push_back(new BenchmarkMetricWriter(mode, updates, &shared, &counter, &histogram));
+      for(unsigned i = 0; i < threads; i++)
+      {
+        writers[i]->WaitForTermination();
+        delete writers[i];
+      }
+      uint64_t elapsed = MCUTime::GetMonoTimestampUsec() - start;
+      int64_t after = (mode == 0 ? shared : (mode == 1 ? counter.GetCount() : histogram.GetCount()));
+      // the sum of the shards is every update
+      if(after - before != (int64_t)threads * updates)
+        ok = FALSE;
+      run->Insert(modeNames[mode] + std::string("_nsec"), (double)elapsed * 1000 / ((double)threads * updates));
+    }
+    runs->Insert(run);
+  }
+  json.Insert(runs);
+  json.Insert("ok", ok);
+
+  runMutex.Signal();
+
+  result = json.AsString();
+  MCUTRACE(1, "Benchmark: metrics " << result);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUBenchmark::Run(const PStringToString & params, PString & result)
+{
+  if(params.Contains("registrar"))
+    return RunRegistrar(params, result);
+  if(params.Contains("lookup"))
+    return RunLookup(params, result);
+  if(params.Contains("json"))
+    return RunJSON(params, result);
+  if(params.Contains("srtp"))
+    return RunSRTP(params, result);
+  if(params.Contains("sockets"))
+    return RunSockets(params, result);
+  if(params.Contains("rtsp"))
+    return RunRtsp(params, result);
+  if(params.Contains("templates"))
+    return RunTemplates(params, result);
+  if(params.Contains("control"))
+    return RunControl(params, result);
+  if(params.Contains("status"))
+    return RunStatus(params, result);
+  if(params.Contains("snapshots"))
+    return RunSnapshots(params, result);
+  if(params.Contains("replay"))
+    return RunReplay(params, result);
+  if(params.Contains("loss"))
+    return RunLoss(params, result);
+  if(params.Contains("decode"))
+    return RunDecode(params, result);
+  if(params.Contains("trace"))
+    return RunTrace(params, result);
+  if(params.Contains("yuv"))
+    return RunYUV(params, result);
+  if(params.Contains("jitter"))
+    return RunJitter(params, result);
+  if(params.Contains("metrics"))
+    return RunMetrics(params, result);
+
+  if(!runMutex.Wait(0))
+  {
+    result = "{\"error\":\"benchmark is already running\"}";
+    return FALSE;
+  }
+
+  PString room = params("room");
+  if(room == "")
+    room = "benchmark";
+  unsigned members = params.Contains("members") ? params("members").AsUnsigned() : 4;
+  unsigned width = params.Contains("w") ? params("w").AsUnsigned() : CIF_WIDTH;
+  unsigned height = params.Contains("h") ? params("h").AsUnsigned() : CIF_HEIGHT;
+  unsigned frameRate = params.Contains("fps") ? params("fps").AsUnsigned() : 25;
+  unsigned duration = params.Contains("s") ? params("s").AsUnsigned() : 10;
+  unsigned bitrate = params("bitrate").AsUnsigned(); // kbit
+  PString codec = params("codec");
+
+  members = PMAX(1, PMIN(members, BENCHMARK_MAX_MEMBERS));
+  width = (PMAX(16, PMIN(width, 1920)) / 2) * 2;
+  height = (PMAX(16, PMIN(height, 1088)) / 2) * 2;
+  frameRate = PMAX(1, PMIN(frameRate, 60));
+  duration = PMAX(1, PMIN(duration, BENCHMARK_MAX_DURATION));
+  if(bitrate == 0)
+    bitrate = PMAX(64, width * height * frameRate / 10000);
+
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+
+  // the room is created for the run and deleted with the members
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference)
+  {
+    conference->Unlock();
+    runMutex.Signal();
+    result = "{\"error\":\"room " + room + " exists\"}";
+    return FALSE;
+  }
+  conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  if(conference == NULL)
+  {
+    runMutex.Signal();
+    result = "{\"error\":\"could not create room " + room + "\"}";
+    return FALSE;
+  }
+  conference->Unlock();
+
+  MCUTRACE(1, trace_section << "start room " << room << ", " << members << " members " << width << "x" << height << "x" << frameRate << ", codec " << (codec == "" ? "none" : codec) << ", " << duration << "s");
+
+  // one cache encoder for all members, as for the real connections
+  PString cacheName;
+  if(codec != "")
+  {
+    OpalMediaFormat format(codec);
+    if(!format.IsValid() && codec.Right(4) == "{sw}" && codec.GetLength() > 4)
+      format = OpalMediaFormat(codec.Left(codec.GetLength()-4));
+    if(format.IsValid() && format.GetDefaultSessionID() == OpalMediaFormat::DefaultVideoSessionID)
+    {
+      format.SetOptionInteger(OPTION_FRAME_WIDTH, width);
+      format.SetOptionInteger(OPTION_FRAME_HEIGHT, height);
+      format.SetOptionInteger(OPTION_FRAME_TIME, 90000/frameRate);
+      format.SetOptionInteger(OPTION_MAX_BIT_RATE, bitrate*1000);
+      cacheName = format + "@" + PString(width) + "x" + PString(height) + ":" + PString(bitrate*1000) + "x" + PString(frameRate) + "_" + room + "/0";
+      if(!OpenVideoCache(room, format, cacheName))
+        cacheName = "";
+    }
+    if(cacheName == "")
+      MCUTRACE(1, trace_section << "could not open encoder " << codec);
+  }
+
+  conference = manager->FindConferenceWithLock(room);
+  if(conference == NULL)
+  {
+    runMutex.Signal();
+    result = "{\"error\":\"room " + room + " is lost\"}";
+    return FALSE;
+  }
+  for(unsigned i = 0; i < members; i++)
+  {
+    ConferenceSyntheticMember *member = new ConferenceSyntheticMember(conference, this, i, width, height, frameRate, cacheName);
+    conference->AddMember(member);
+  }
+  conference->Unlock();
+
+  // warm up: the mixers change the layout, the encoder starts with a keyframe
+  MCUTime::Sleep(1000);
+  {
+    PWaitAndSignal m(sampleMutex);
+    for(unsigned i = 0; i < STAGE_COUNT; i++)
+      samples[i].clear();
+    generatorUsec = 0;
+  }
+  ThreadGroupMap groupsStart, groupsEnd;
+  GetThreadGroups(groupsStart);
+  uint64_t memoryStart = GetMemoryUsage();
+  uint64_t updatesStart = MCUMetrics::GetUpdates();
+  uint64_t cpuStart = GetProcessCPUTime();
+  uint64_t timeStart = MCUTime::GetMonoTimestampUsec();
+
+  MCUTime::Sleep(duration * 1000);
+
+  uint64_t elapsed = MCUTime::GetMonoTimestampUsec() - timeStart;
+  uint64_t cpu = GetProcessCPUTime() - cpuStart;
+  uint64_t updates = MCUMetrics::GetUpdates() - updatesStart;
+  uint64_t memoryEnd = GetMemoryUsage();
+  GetThreadGroups(groupsEnd);
+  unsigned encoders = GetEncoderCount(room);
+
+  // the members add the generator time on exit
+  manager->RemoveConference(room);
+
+  MCUJSON json(MCUJSON::JSON_OBJECT);
+  json.Insert("room", room);
+  json.Insert("members", members);
+  json.Insert("width", width);
+  json.Insert("height", height);
+  json.Insert("fps", frameRate);
+  json.Insert("codec", cacheName != "" ? codec : PString());
+  json.Insert("bitrate", bitrate);
+  json.Insert("duration_usec", (long long)elapsed);
+  json.Insert("encoders", encoders);
+
+  MCUJSON *jsonCPU = MCUJSON::Object("cpu");
+  jsonCPU->Insert("process_usec", (long long)cpu);
+  jsonCPU->Insert("process_percent", elapsed ? 100.0 * cpu / elapsed : 0.0);
+  jsonCPU->Insert("generator_usec", (long long)generatorUsec);
+  MCUJSON *jsonThreads = MCUJSON::Object("threads");
+  for(ThreadGroupMap::iterator it = groupsEnd.begin(); it != groupsEnd.end(); ++it)
+  {
+    // the threads started during the run have no start time
+    uint64_t usec = it->second.usec;
+    ThreadGroupMap::iterator sit = groupsStart.find(it->first);
+    if(sit != groupsStart.end())
+      usec = (usec > sit->second.usec ? usec - sit->second.usec : 0);
+    MCUJSON *jsonGroup = MCUJSON::Object((const char *)it->first);
+    jsonGroup->Insert("usec", (long long)usec);
+    jsonGroup->Insert("threads", it->second.threads);
+    jsonThreads->Insert(jsonGroup);
+  }
+  jsonCPU->Insert(jsonThreads);
+  json.Insert(jsonCPU);
+
+  MCUJSON *jsonStages = MCUJSON::Object("stages");
+  for(unsigned i = 0; i < STAGE_COUNT; i++)
+  {
+    std::vector<uint64_t> & v = samples[i];
+    std::sort(v.begin(), v.end());
+    MCUJSON *jsonStage = MCUJSON::Object(GetStageName(i));
+    jsonStage->Insert("count", (unsigned long)v.size());
+    if(v.size())
+    {
+      jsonStage->Insert("p50_usec", (long long)v[v.size() * 50 / 100]);
+      jsonStage->Insert("p90_usec", (long long)v[v.size() * 90 / 100]);
+      jsonStage->Insert("p99_usec", (long long)v[v.size() * 99 / 100]);
+      jsonStage->Insert("max_usec", (long long)v.back());
+    }
+    jsonStages->Insert(jsonStage);
+  }
+  json.Insert(jsonStages);
+
+  MCUJSON *jsonMemory = MCUJSON::Object("memory");
+  jsonMemory->Insert("rss_start", (long long)memoryStart);
+  jsonMemory->Insert("rss_end", (long long)memoryEnd);
+  json.Insert(jsonMemory);
+
+  // instrumentation cost: the metric updates made during the run times the cost of one update
+  double updateNsec = GetMetricUpdateNsec();
+  MCUJSON *jsonMetrics = MCUJSON::Object("metrics");
+  jsonMetrics->Insert("updates", (long long)updates);
+  jsonMetrics->Insert("update_nsec", updateNsec);
+  jsonMetrics->Insert("overhead_percent", cpu ? updates * updateNsec / 10.0 / cpu : 0.0);
+  json.Insert(jsonMetrics);
+
+  result = json.AsString();
+  MCUTRACE(1, trace_section << "done " << result);
+
+  runMutex.Signal();
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int MCUBenchmark::Main(OpenMCU & app, const PStringToString & params)
+{
+  if(params.GetSize() == 0)
+  {
+    cerr << "usage: " << app.GetFile().GetTitle() << " <name>=<value> ..., the benchmarks are listed in benchmark.h" << endl;
+    return 1;
+  }
+
+  // the endpoints, the servers and the managers of the configuration, the HTTP listener is not opened
+  if(!app.OnStart())
+  {
+    cerr << "could not start " << PRODUCT_NAME_TEXT << endl;
+    return 1;
+  }
+
+  PString result;
+  MCUBenchmark benchmark;
+  BOOL ok = benchmark.Run(params, result);
+  cout << result << endl;
+
+  app.OnStop();
+  return ok ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
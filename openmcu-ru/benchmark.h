@@ -0,0 +1,195 @@
+/*
+ * benchmark.h
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+
+#ifndef _MCU_BENCHMARK_H
+#define _MCU_BENCHMARK_H
+
+#include "conference.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define BENCHMARK_MAX_MEMBERS   100
+#define BENCHMARK_MAX_DURATION  600
+// samples kept per stage, enough for the percentiles of a long run
+#define BENCHMARK_MAX_SAMPLES   200000
+#define BENCHMARK_MAX_ACCOUNTS  100000
+// PCMU samples of a 20 ms packet of the jitter test
+#define BENCHMARK_JITTER_SAMPLES 160
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MCUBenchmark;
+class OpenMCU;
+
+// participant without a connection: sends a tone and a moving pattern through the mixers,
+// reads the mixed audio and, when a codec is given, the encoded stream of the room cache
+class ConferenceSyntheticMember : public ConferenceMember
+{
+  PCLASSINFO(ConferenceSyntheticMember, ConferenceMember);
+  public:
+    ConferenceSyntheticMember(Conference * conference, MCUBenchmark * benchmark, unsigned index, unsigned width, unsigned height, unsigned frameRate, const PString & cacheName);
+    ~ConferenceSyntheticMember();
+
+    virtual void Close();
+
+    PDECLARE_NOTIFIER(PThread, ConferenceSyntheticMember, AudioThread);
+    PDECLARE_NOTIFIER(PThread, ConferenceSyntheticMember, VideoThread);
+    PDECLARE_NOTIFIER(PThread, ConferenceSyntheticMember, CacheThread);
+
+  protected:
+    void FillPattern(BYTE * frame, unsigned frameNumber);
+
+    MCUBenchmark * benchmark;
+    unsigned index;
+    unsigned width;
+    unsigned height;
+    unsigned frameRate;
+    PString cacheName;
+
+    BOOL running;
+    PThread * audioThread;
+    PThread * videoThread;
+    PThread * cacheThread;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The benchmark tool, openmcu-ru-benchmark <name>=<value> ..., is built by "make benchmark" and is
+// not a part of the MCU. It starts the MCU of the configuration without the web interface, runs
+// one benchmark and prints the JSON result:
+//   load test, members=<n> w=<width> h=<height> fps=<n> codec=<format> s=<seconds>
+//   registration storm, registrar=<accounts> cycles=<n> expires=<seconds>
+//   account lookups, lookup=<accounts>[,<accounts>...]
+//   room status document, json=<members>
+//   SRTP ciphers, srtp=<streams> size=<bytes> packets=<n>
+//   listener sockets, sockets=<idle> active=<n> rounds=<n> port=<port>
+//   room templates, templates=<members> count=<templates>
+//   control commands over the telnet server, control=<members> port=<port>
+//   status pages against the mixers, status=<watchers> members=<n> w=<width> h=<height> fps=<n> s=<seconds>
+//   room previews, snapshots=<clients> members=<n> w=<width> h=<height> s=<seconds>
+//   RTSP cache fan-out, rtsp=<viewers> codec=<format> w=<width> h=<height> fps=<n> bitrate=<kbit> s=<seconds> port=<port>
+//   RTP capture replay, replay=<file> room=<name> w=<width> h=<height> runs=<n>
+//   audio loss recovery, loss=<percent> burst=<n> seed=<n> packets=<n> codec=<format> file=<capture>
+//   video decoding threads, decode=<threads>[,<threads>...] type=slice|frame codec=<format> w=<width> h=<height> frames=<n> bitrate=<kbit>
+//   trace writers, trace=<threads> records=<n> level=<n>
+//   compositing kernels, the SIMD sets against the scalar ones and the layouts, yuv=<iterations>
+//   audio jitter buffers with and without their threads, jitter=<channels> s=<seconds> port=<port>
+//   metric updates from many threads, metrics=<threads>[,<threads>...] updates=<n>
+class MCUBenchmark
+{
+  public:
+    enum Stages
+    {
+      STAGE_VIDEO_WRITE = 0, // member frame to the mixer, usec
+      STAGE_AUDIO_READ,      // mixed audio for a member, usec
+      STAGE_ENCODE,          // captured by the cache encoder to read by a member, usec
+      STAGE_COUNT
+    };
+
+    MCUBenchmark();
+
+    BOOL Run(const PStringToString & params, PString & result);
+
+    // the run of the benchmark tool, returns the exit code
+    static int Main(OpenMCU & app, const PStringToString & params);
+
+    void AddSample(unsigned stage, uint64_t value);
+    void AddGeneratorTime(uint64_t usec);
+
+    static const char * GetStageName(unsigned stage);
+
+  protected:
+    struct ThreadGroupTime
+    {
+      ThreadGroupTime() : usec(0), threads(0) { }
+      uint64_t usec;
+      unsigned threads;
+    };
+    typedef std::map<PString, ThreadGroupTime> ThreadGroupMap;
+
+    static uint64_t GetProcessCPUTime();
+    static uint64_t GetMemoryUsage();
+    static void GetThreadGroups(ThreadGroupMap & groups);
+    static double GetMetricUpdateNsec();
+    static BOOL RunRegistrar(const PStringToString & params, PString & result);
+    static BOOL RunLookup(const PStringToString & params, PString & result);
+    static MCUJSON * RunLookupList(const char * name, MCURegistrarAccountList & accountList, unsigned accounts, unsigned lookups);
+    static BOOL RunJSON(const PStringToString & params, PString & result);
+    static BOOL RunTemplates(const PStringToString & params, PString & result);
+    static BOOL RunControl(const PStringToString & params, PString & result);
+    static BOOL RunSRTP(const PStringToString & params, PString & result);
+    static BOOL RunSockets(const PStringToString & params, PString & result);
+    static BOOL RunReplay(const PStringToString & params, PString & result);
+    static BOOL RunLoss(const PStringToString & params, PString & result);
+    static BOOL RunDecode(const PStringToString & params, PString & result);
+    static BOOL RunTrace(const PStringToString & params, PString & result);
+    static BOOL RunYUV(const PStringToString & params, PString & result);
+    static BOOL RunJitter(const PStringToString & params, PString & result);
+    static BOOL RunMetrics(const PStringToString & params, PString & result);
+    static BOOL RunJitterStream(H323Connection & connection, unsigned channels, unsigned seconds, WORD port, BOOL threadless, MCUJSON & json);
+    BOOL RunRtsp(const PStringToString & params, PString & result);
+    BOOL RunStatus(const PStringToString & params, PString & result);
+    BOOL RunSnapshots(const PStringToString & params, PString & result);
+    unsigned GetEncoderCount(const PString & room);
+
+    PString trace_section;
+    PMutex sampleMutex;
+    std::vector<uint64_t> samples[STAGE_COUNT];
+    uint64_t generatorUsec;
+
+    static PMutex runMutex;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if MCU_BENCHMARK_TOOL
+// the process of the benchmark tool, main.cxx is built once more with the MCU process as Base
+template <class Base>
+class MCUBenchmarkProcess : public Base
+{
+  public:
+    MCUBenchmarkProcess()
+    { Base::httpListenerEnabled = FALSE; }
+
+    // a command line tool, not a service
+    virtual int _main(void * = NULL)
+    {
+      PStringToString params;
+      PArgList & args = Base::GetArguments();
+      for(PINDEX i = 0; i < args.GetCount(); i++)
+      {
+        PString arg = args[i];
+        PINDEX pos = arg.Find('=');
+        if(pos == P_MAX_INDEX)
+          params.SetAt(arg, "");
+        else
+          params.SetAt(arg.Left(pos), arg.Mid(pos+1));
+      }
+      return MCUBenchmark::Main(*this, params);
+    }
+};
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MCU_BENCHMARK_H
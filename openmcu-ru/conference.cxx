@@ -357,32 +357,17 @@ void ConferenceManager::OnCreateConference(Conference * conference)
     return;
   }
 
-  FILE *membLst;
-
-  // read members.conf into conference->membersConf
-  membLst = fopen(PString(SYS_CONFIG_DIR) + PATH_SEPARATOR + "members_" + conference->GetNumber() + ".conf","rt");
-  PStringStream membersConf;
-  if(membLst!=NULL)
-  { char buf [128];
-    while(fgets(buf, 128, membLst)!=NULL) membersConf << buf;
-    fclose(membLst);
-  }
-
-  conference->membersConf=membersConf;
-  if(membersConf.Left(1)!="\n") membersConf="\n"+membersConf;
+  // read members.conf into conference->templateStore
+  conference->templateStore.Load(conference->GetTemplateFileName());
 
   // recall last template
   if(!GetConferenceParam(conference->GetNumber(), RoomRecallLastTemplateKey, FALSE)) return;
 
-  PINDEX dp=membersConf.Find("\nLAST_USED ");
-  if(dp!=P_MAX_INDEX)
-  { PINDEX dp2=membersConf.Find('\n',dp+10);
-    if(dp2!=P_MAX_INDEX)
-    { PString lastUsedTemplate=membersConf.Mid(dp+11,dp2-dp-11).Trim();
-      PTRACE(4, "Extracting & loading last used template: " << lastUsedTemplate);
-      conference->confTpl=conference->ExtractTemplate(lastUsedTemplate);
-      conference->LoadTemplate(conference->confTpl);
-    }
+  PString lastUsedTemplate = conference->templateStore.GetLastUsed();
+  if(lastUsedTemplate != "")
+  {
+    PTRACE(4, "Extracting & loading last used template: " << lastUsedTemplate);
+    conference->ApplyTemplate(lastUsedTemplate, FALSE);
   }
 }
 
@@ -433,6 +418,7 @@ void ConferenceManager::OnDestroyConference(Conference * conference)
 
   OpenMCU::Current().HttpWriteCmdRoom("notice_deletion(4,'" + jsName + "')", number);
   OpenMCU::Current().HttpWriteCmdRoom("notice_deletion(5,'" + jsName + "')", number);
+  OpenMCU::Current().GetStatusCache().OnRoomRemoved(number);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -601,6 +587,37 @@ int ConferenceMonitor::Perform(Conference * conference)
     }
   }
 
+  // moved members
+  {
+    MCUMemberList & memberList = conference->GetMemberList();
+    for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+    {
+      ConferenceMember *member = *it;
+      PString target, name;
+      {
+        PWaitAndSignal m(member->GetDialMutex());
+        if(member->moveRoom == "" || member->IsOnline())
+          continue;
+        if(member->dialToken != "" && OpenMCU::Current().GetEndpoint().HasConnection(member->dialToken))
+          continue;
+        target = member->moveRoom;
+        name = member->GetName();
+      }
+      {
+        PWaitAndSignal m(conference->GetMemberListMutex());
+        conference->RemoveFromVideoMixers(member);
+        if(memberList.Erase(it))
+          delete member;
+      }
+      ConferenceMember *newMember = manager.FindMemberSimilarWithLock(target, name);
+      if(newMember)
+      {
+        newMember->Dial();
+        newMember->Unlock();
+      }
+    }
+  }
+
   if(conference->UseSameVideoForAllMembers())
   {
     MCUVideoMixerList & videoMixerList = conference->GetVideoMixerList();
@@ -1128,7 +1145,7 @@ void Conference::WriteMemberAudioLevel(ConferenceMember * member, int audioLevel
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Conference::ReadMemberVideo(ConferenceMember * member, void * buffer, int width, int height, PINDEX & amount)
+void Conference::ReadMemberVideo(ConferenceMember * member, void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage)
 {
   if(videoMixerList.GetSize() == 0)
     return;
@@ -1150,13 +1167,13 @@ void Conference::ReadMemberVideo(ConferenceMember * member, void * buffer, int w
     }
   }
 
-  mixer->ReadFrame(*member, buffer, width, height, amount);
+  mixer->ReadFrame(*member, buffer, width, height, amount, damage);
   mixer->Unlock();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-BOOL Conference::WriteMemberVideo(ConferenceMember * member, const void * buffer, int width, int height)
+BOOL Conference::WriteMemberVideo(ConferenceMember * member, const MCUPlanesYUV & planes, int width, int height)
 {
   if(UseSameVideoForAllMembers())
   {
@@ -1164,14 +1181,14 @@ BOOL Conference::WriteMemberVideo(ConferenceMember * member, const void * buffer
     for(MCUVideoMixerList::shared_iterator it = videoMixerList.begin(); it != videoMixerList.end(); ++it)
     {
       MCUSimpleVideoMixer *mixer = it.GetObject();
-      writeResult |= mixer->WriteFrame(member->GetID(), buffer, width, height);
+      writeResult |= mixer->WriteFrame(member->GetID(), planes, width, height);
     }
     return writeResult;
   }
   else
   {
     for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
-      it->OnExternalSendVideo(member->GetID(), buffer, width, height);
+      it->OnExternalSendVideo(member->GetID(), planes, width, height);
   }
   return TRUE;
 }
@@ -1859,7 +1876,7 @@ void ConferenceMember::ReadAudioGainControl(void * buffer, int amount)
 #if MCU_VIDEO
 
 // called whenever the connection needs a frame of video to send
-void ConferenceMember::ReadVideo(void * buffer, int width, int height, PINDEX & amount)
+void ConferenceMember::ReadVideo(void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage)
 {
   ++totalVideoFramesSent;
   if(!firstFrameSendTime.IsValid())
@@ -1868,16 +1885,16 @@ void ConferenceMember::ReadVideo(void * buffer, int width, int height, PINDEX &
   if(conference != NULL)
   {
     if(conference->UseSameVideoForAllMembers())
-      conference->ReadMemberVideo(this, buffer, width, height, amount);
+      conference->ReadMemberVideo(this, buffer, width, height, amount, damage);
     else if(videoMixer != NULL)
-      videoMixer->ReadFrame(*this, buffer, width, height, amount);
+      videoMixer->ReadFrame(*this, buffer, width, height, amount, damage);
   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // called whenever the connection receives a frame of video
-void ConferenceMember::WriteVideo(const void * buffer, int width, int height)
+void ConferenceMember::WriteVideo(const MCUPlanesYUV & planes, int width, int height)
 {
   ++totalVideoFramesReceived;
   rxFrameWidth = width;
@@ -1886,14 +1903,14 @@ void ConferenceMember::WriteVideo(const void * buffer, int width, int height)
     firstFrameReceiveTime = PTime();
 
   if(conference != NULL)
-    conference->WriteMemberVideo(this, buffer, width, height);
+    conference->WriteMemberVideo(this, planes, width, height);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void ConferenceMember::OnExternalSendVideo(ConferenceMemberId id, const void * buffer, int width, int height)
+void ConferenceMember::OnExternalSendVideo(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height)
 {
-  videoMixer->WriteFrame(id, buffer, width, height);
+  videoMixer->WriteFrame(id, planes, width, height);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -6,6 +6,7 @@
 
 #include "utils.h"
 #include "video.h"
+#include "template.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -238,19 +239,19 @@ class ConferenceMember : public PObject
     /**
       *  Called when the conference member wants to send video data to the conference
       */
-    virtual void WriteVideo(const void * buffer, int width, int height);
+    virtual void WriteVideo(const MCUPlanesYUV & planes, int width, int height);
 
     /**
       *  Called when a conference member wants to read a block of video from the conference
       *  By default, this calls ReadMemberVideo on the conference
       */
-    virtual void ReadVideo(void * buffer, int width, int height, PINDEX & amount);
+    virtual void ReadVideo(void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage = NULL);
 
     /**
       * called when another conference member wants to write a video frame to this endpoint
       * this will only be called when the conference is not "use same video for all members"
       */
-    virtual void OnExternalSendVideo(ConferenceMemberId id, const void * buffer, int width, int height);
+    virtual void OnExternalSendVideo(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height);
 
     /**
       * called to when a new video source added
@@ -355,6 +356,9 @@ class ConferenceMember : public PObject
     BOOL autoDial;
     PString dialToken;
     PMutex dialMutex;
+    // the room the member is moved to, the monitor drops the entry and dials
+    // the member there once its call is gone
+    PString moveRoom;
 
     unsigned muteMask;
     unsigned channelMask;
@@ -530,9 +534,9 @@ class Conference : public PObject
     virtual void WriteMemberAudioLevel(ConferenceMember * member, int audioLevel, int tint);
 
 #if MCU_VIDEO
-    virtual void ReadMemberVideo(ConferenceMember * member, void * buffer, int width, int height, PINDEX & amount);
+    virtual void ReadMemberVideo(ConferenceMember * member, void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage = NULL);
 
-    virtual BOOL WriteMemberVideo(ConferenceMember * member, const void * buffer, int width, int height);
+    virtual BOOL WriteMemberVideo(ConferenceMember * member, const MCUPlanesYUV & planes, int width, int height);
 
     virtual BOOL UseSameVideoForAllMembers()
     { return videoMixerList.GetSize() > 0; }
@@ -552,17 +556,18 @@ class Conference : public PObject
     unsigned short int VAlevel;
     unsigned short int echoLevel;
 
-    PString membersConf;
-    PString confTpl;
-    virtual PString SaveTemplate(PString tplName);
-    virtual void LoadTemplate(PString tpl);
+    // templates of members_<room>.conf, read when the room is created
+    MCUTemplateStore templateStore;
+    // the template loaded last
+    MCUConferenceTemplate confTpl;
+    PString GetTemplateFileName();
+    virtual MCUConferenceTemplate BuildTemplate(PString tplName);
+    virtual BOOL SaveTemplate(PString tplName);
+    virtual BOOL ApplyTemplate(PString tplName, BOOL remember = TRUE);
+    virtual void LoadTemplate(const MCUConferenceTemplate & tpl);
     virtual PString GetTemplateList();
     virtual PString GetSelectedTemplateName();
-    virtual PString ExtractTemplate(PString tplName);
-    virtual void TemplateInsertAndRewrite(PString tplName, PString tpl);
-    virtual void SetLastUsedTemplate(PString tplName);
     virtual void DeleteTemplate(PString tplName);
-    virtual BOOL RewriteMembersConf();
     virtual void EnableSubtitles(int enable);
 
     ConferenceRecorder * conferenceRecorder;
@@ -602,6 +607,8 @@ class Conference : public PObject
     void RemoveAudioConnection(ConferenceMember * member);
     MCUAudioConnectionList audioConnectionList;
 
+    ConferenceMember * FindTemplateMemberWithLock(MCUTemplateMemberIndex & index, const PString & name);
+
     MCUVideoMixerList videoMixerList;
 
     PINDEX onlineMemberCount;
@@ -617,7 +624,7 @@ class Conference : public PObject
     BOOL moderated;
     BOOL muteUnvisible;
     int vidmembernum;
-    PMutex membersConfMutex;
+    PMutex templateMutex;
     BOOL forceScreenSplit;
 };
 
@@ -21,6 +21,8 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #define MCUSIP_SRTP 1
+// SRTP on the EVP ciphers of OpenSSL, AES-NI/CLMUL and the GCM profiles
+#define MCUSIP_SRTP_OPENSSL 1
 #define MCUSIP_ZRTP 0
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -139,6 +141,8 @@
 #  define RECORDS_DIR       "records"
 #  undef  SYS_SSL_DIR
 #  define SYS_SSL_DIR       "ssl"
+#  undef  MCUSIP_SRTP_OPENSSL
+#  define MCUSIP_SRTP_OPENSSL 0
 #  undef  MCU_PLUGIN_DIR
 #  define MCU_PLUGIN_DIR    "."
 #endif
@@ -0,0 +1,739 @@
+/*
+ * control.cxx
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+#include "mcu.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const char ControlHelp[] =
+  "room 'name' ...\r\n"
+  "show ...\r\n"
+  "script\r\n"
+  ;
+
+static const char ControlRoomHelp[] =
+  "room 'name' ...\r\n"
+  "            create\r\n"
+  "            delete\r\n"
+  "            dial 'id'\r\n"
+  "            invite 'address'\r\n"
+  "            drop 'id'|all\r\n"
+  "            mute 'id'|all ['mask']\r\n"
+  "            unmute 'id'|all ['mask']\r\n"
+  "            move 'id' 'room'\r\n"
+  "            capture 'id' start|stop\r\n"
+  "            template 'name'\r\n"
+  "            chat 'text'\r\n"
+  "            show members\r\n"
+  "            start_recorder\r\n"
+  "            stop_recorder\r\n"
+  ;
+
+static const char ControlShowHelp[] =
+  "show ...\r\n"
+  "     registrar ...\r\n"
+  "               accounts\r\n"
+  ;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the text after the first tokens of the line, for the names and messages with spaces
+static PString ControlRestOfLine(const PString & line, PINDEX tokens)
+{
+  PINDEX pos = 0;
+  for(PINDEX i = 0; i < tokens; i++)
+  {
+    while(pos < line.GetLength() && line[pos] == ' ') pos++;
+    while(pos < line.GetLength() && line[pos] != ' ') pos++;
+  }
+  return line.Mid(pos).Trim();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// a member by id or by name/address
+static ConferenceMember * ControlFindMemberWithLock(Conference * conference, const PString & value)
+{
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  long id = value.AsInteger();
+  if(id != 0 && PString(id) == value)
+    return manager->FindMemberWithLock(conference, id);
+  return manager->FindMemberSimilarWithLock(conference, value);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static MCUJSON * ControlMembersJSON(Conference * conference, const std::string & key)
+{
+  MCUJSON *json = MCUJSON::Array(key);
+  MCUMemberList & memberList = conference->GetMemberList();
+  for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+    json->Insert(it->AsJSON());
+  return json;
+}
+
+static MCUJSON * ControlAccountsJSON(const std::string & key)
+{
+  MCUJSON *json = MCUJSON::Array(key);
+  MCUAbookList & abookList = OpenMCU::Current().GetRegistrar()->GetAbookList();
+  for(MCUAbookList::shared_iterator it = abookList.begin(); it != abookList.end(); ++it)
+  {
+    if(it->is_account)
+      json->Insert(it->AsJSON());
+  }
+  return json;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The rooms found by the commands of a batch. The member list of the current room is held
+// while the commands of the room run, the rooms are released when the batch ends.
+class MCUControlBatch
+{
+  public:
+    MCUControlBatch()
+      : app(OpenMCU::Current()), manager(app.GetConferenceManager()), held(NULL)
+    { }
+
+    ~MCUControlBatch()
+    {
+      Hold(NULL);
+      for(std::map<PString, Conference *>::iterator it = conferences.begin(); it != conferences.end(); ++it)
+      {
+        // one refresh of the room page for all the changes of the batch
+        if(changedRooms.find(it->first) != changedRooms.end())
+        {
+          app.HttpWriteCmdRoom(app.GetEndpoint().GetMemberListOptsJavascript(*it->second), it->first);
+          app.HttpWriteCmdRoom(app.GetEndpoint().GetConferenceOptsJavascript(*it->second), it->first);
+          app.HttpWriteCmdRoom("build_page()", it->first);
+        }
+        it->second->Unlock();
+      }
+    }
+
+    BOOL Run(const MCUControlCommand & command, const std::string & dataKey, MCUJSON *& data, PString & text, PString & error);
+
+  protected:
+    Conference * GetConference(const PString & room, BOOL create = FALSE);
+    void Release(const PString & room);
+    void Hold(Conference * conference);
+    BOOL MoveMember(Conference * conference, ConferenceMember * member, const PString & target, PString & error);
+    BOOL CaptureMember(const PString & room, ConferenceMember * member, BOOL start, PString & text, PString & error);
+
+    OpenMCU & app;
+    ConferenceManager *manager;
+    std::map<PString, Conference *> conferences;
+    std::set<PString> changedRooms;
+    Conference *held;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Conference * MCUControlBatch::GetConference(const PString & room, BOOL create)
+{
+  std::map<PString, Conference *>::iterator it = conferences.find(room);
+  if(it != conferences.end())
+    return it->second;
+  Conference *conference;
+  if(create)
+    conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  else
+    conference = manager->FindConferenceWithLock(room);
+  if(conference)
+    conferences.insert(std::pair<PString, Conference *>(room, conference));
+  return conference;
+}
+
+void MCUControlBatch::Release(const PString & room)
+{
+  std::map<PString, Conference *>::iterator it = conferences.find(room);
+  if(it == conferences.end())
+    return;
+  if(held == it->second)
+    Hold(NULL);
+  it->second->Unlock();
+  conferences.erase(it);
+  changedRooms.erase(room);
+}
+
+void MCUControlBatch::Hold(Conference * conference)
+{
+  if(held == conference)
+    return;
+  if(held)
+    held->GetMemberListMutex().Signal();
+  held = conference;
+  if(held)
+    held->GetMemberListMutex().Wait();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlBatch::MoveMember(Conference * conference, ConferenceMember * member, const PString & target, PString & error)
+{
+  // there is no call transfer, the member is added to the other room and only then dropped
+  // and invited, a failure leaves it in its room
+  Conference *targetConference = GetConference(target, TRUE);
+  if(targetConference == NULL)
+  {
+    member->Unlock();
+    error = "could not create room " + target;
+    return FALSE;
+  }
+
+  // the held list of the source room is released by the next room of the batch
+  PString memberName = member->GetName();
+  ConferenceMember *newMember = manager->FindMemberSimilarWithLock(targetConference, memberName);
+  if(newMember == NULL)
+  {
+    newMember = new MCUConnection_ConferenceMember(targetConference, memberName, "");
+    MCUMemberList::shared_iterator it = targetConference->AddMemberToList(newMember);
+    if(it == targetConference->GetMemberList().end())
+    {
+      delete newMember;
+      member->Unlock();
+      error = "could not add member to room " + target;
+      return FALSE;
+    }
+    newMember = it.GetCapturedObject();
+  }
+
+  BOOL dial = member->IsOnline() || member->autoDial;
+  member->SetAutoDial(FALSE);
+  if(member->IsOnline())
+  {
+    // the call is being cleared, the monitor of the room drops the entry and dials
+    // the member in the other room when the call is gone
+    {
+      PWaitAndSignal m(member->GetDialMutex());
+      member->moveRoom = target;
+    }
+    member->Close();
+    member->Unlock();
+    dial = FALSE;
+  }
+  else
+  {
+    conference->RemoveFromVideoMixers(member);
+    member->Close();
+    member->Unlock();
+    MCUMemberList & memberList = conference->GetMemberList();
+    if(memberList.Erase(member))
+      delete member;
+  }
+
+  if(dial)
+    newMember->Dial();
+  newMember->Unlock();
+  changedRooms.insert(target);
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlBatch::CaptureMember(const PString & room, ConferenceMember * member, BOOL start, PString & text, PString & error)
+{
+  PString callToken = member->GetCallToken();
+  long memberID = member->GetID();
+  member->Unlock();
+
+  MCUH323Connection *conn = app.GetEndpoint().FindConnectionWithLock(callToken);
+  if(conn == NULL)
+  {
+    error = "member is offline";
+    return FALSE;
+  }
+
+  const PString & dir = app.vr_ffmpegDir;
+  if(start && !PDirectory::Exists(dir))
+    PDirectory::Create(dir, 0700);
+
+  // the receive channels, the packets are written as they come from the socket
+  unsigned sessions = 0;
+  {
+    PWaitAndSignal m(conn->GetChannelsMutex());
+    MCU_RTPChannel *channels[2] = { conn->GetAudioReceiveChannel(), conn->GetVideoReceiveChannel() };
+    for(int i = 0; i < 2; i++)
+    {
+      if(channels[i] == NULL)
+        continue;
+      MCU_RTP_UDP *session = (MCU_RTP_UDP *)conn->GetSession(channels[i]->GetSessionID());
+      if(session == NULL)
+        continue;
+      if(start)
+      {
+        const H323Capability & cap = channels[i]->GetCapability();
+        PString fileName = dir + PATH_SEPARATOR + "capture_" + room + "_" + PString(memberID) + "_" + PString(channels[i]->GetSessionID()) + ".rtp";
+        if(!session->StartCapture(fileName, cap.GetFormatName(), cap.GetMediaFormat().GetTimeUnits()*1000, channels[i]->GetRTPPayloadType()))
+          continue;
+        text += fileName + "\r\n";
+      }
+      else
+      {
+        if(!session->IsCapturing())
+          continue;
+        text += PString(session->StopCapture()) + " packets, session " + PString(channels[i]->GetSessionID()) + "\r\n";
+      }
+      sessions++;
+    }
+  }
+  conn->Unlock();
+
+  if(sessions == 0)
+  {
+    error = start ? "could not start capture" : "no capture";
+    return FALSE;
+  }
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlBatch::Run(const MCUControlCommand & command, const std::string & dataKey, MCUJSON *& data, PString & text, PString & error)
+{
+  data = NULL;
+
+  if(!command.help.IsEmpty())
+  {
+    text = command.help;
+    return TRUE;
+  }
+  if(command.action == OTFC_SHOW_REGISTRAR_ACCOUNTS)
+  {
+    data = ControlAccountsJSON(dataKey);
+    return TRUE;
+  }
+  if(command.action == OTFC_ROOM_CREATE)
+  {
+    if(GetConference(command.room, TRUE) == NULL)
+    {
+      error = "could not create room";
+      return FALSE;
+    }
+    return TRUE;
+  }
+  if(command.action == OTFC_ROOM_DELETE)
+  {
+    // the room is released by the batch before it is removed
+    Release(command.room);
+    manager->RemoveConference(command.room);
+    return TRUE;
+  }
+
+  Conference *conference = GetConference(command.room);
+  if(conference == NULL)
+  {
+    error = "room not found";
+    return FALSE;
+  }
+  Hold(conference);
+
+  if(command.action == OTFC_ROOM_SHOW_MEMBERS)
+  {
+    data = ControlMembersJSON(conference, dataKey);
+    return TRUE;
+  }
+
+  if(command.action == OTFC_DIAL || command.action == OTFC_DROP_MEMBER || command.action == OTFC_MUTE
+     || command.action == OTFC_UNMUTE || command.action == OTFC_MOVE_MEMBER || command.action == OTFC_RTP_CAPTURE)
+  {
+    ConferenceMember *member = ControlFindMemberWithLock(conference, command.value);
+    if(member == NULL)
+    {
+      error = "member not found";
+      return FALSE;
+    }
+    if(member->IsSystem())
+    {
+      member->Unlock();
+      error = "system member";
+      return FALSE;
+    }
+    if(command.action == OTFC_DIAL)
+      member->Dial(!member->autoDial);
+    else if(command.action == OTFC_DROP_MEMBER)
+    {
+      member->SetAutoDial(FALSE);
+      if(member->IsOnline())
+        member->Close();
+    }
+    else if(command.action == OTFC_MUTE)
+      member->SetChannelPauses(command.option);
+    else if(command.action == OTFC_UNMUTE)
+      member->UnsetChannelPauses(command.option);
+    else if(command.action == OTFC_MOVE_MEMBER)
+    {
+      // released by MoveMember
+      changedRooms.insert(command.room);
+      return MoveMember(conference, member, command.target, error);
+    }
+    else if(command.action == OTFC_RTP_CAPTURE)
+    {
+      // released by CaptureMember, the room does not change
+      return CaptureMember(command.room, member, command.option, text, error);
+    }
+    member->Unlock();
+    changedRooms.insert(command.room);
+    return TRUE;
+  }
+
+  // the other actions are those of the room control page, they lock the room themselves
+  Hold(NULL);
+  PStringToString params;
+  command.GetParams(params);
+  if(!app.OTFControl(params, text))
+  {
+    error = "failed";
+    return FALSE;
+  }
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUControlCommand::GetParams(PStringToString & data) const
+{
+  data.SetAt("action", PString(action));
+  data.SetAt("room", room);
+  // the value is unescaped by OTFControl
+  data.SetAt("v", value.IsEmpty() ? PString("0") : PURL::TranslateString(value, PURL::QueryTranslation));
+  data.SetAt("o", PString(option));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlEngine::Parse(const PString & line, MCUControlCommand & command, PString & error)
+{
+  command = MCUControlCommand();
+  command.line = line.Trim();
+
+  PStringArray tokens = command.line.Tokenise(" ");
+  if(tokens.GetSize() == 0)
+  {
+    error = "empty command";
+    return FALSE;
+  }
+
+  if(tokens[0] == "?")
+  {
+    command.help = ControlHelp;
+    return TRUE;
+  }
+
+  if(tokens[0] == "show")
+  {
+    if(tokens.GetSize() < 2 || tokens[1] == "?")
+    {
+      command.help = ControlShowHelp;
+      return TRUE;
+    }
+    if(tokens[1] == "registrar" && tokens.GetSize() > 2 && tokens[2] == "accounts")
+    {
+      command.action = OTFC_SHOW_REGISTRAR_ACCOUNTS;
+      return TRUE;
+    }
+    error = "unknown command";
+    return FALSE;
+  }
+
+  if(tokens[0] != "room")
+  {
+    error = "unknown command";
+    return FALSE;
+  }
+  if(tokens.GetSize() < 3 || tokens[1] == "?")
+  {
+    command.help = ControlRoomHelp;
+    return TRUE;
+  }
+
+  command.room = tokens[1];
+  const PString & name = tokens[2];
+
+  if(name == "create")
+    command.action = OTFC_ROOM_CREATE;
+  else if(name == "delete")
+    command.action = OTFC_ROOM_DELETE;
+  else if(name == "start_recorder")
+    command.action = OTFC_VIDEO_RECORDER_START;
+  else if(name == "stop_recorder")
+    command.action = OTFC_VIDEO_RECORDER_STOP;
+  else if(name == "show")
+  {
+    if(tokens.GetSize() < 4 || tokens[3] != "members")
+    {
+      error = "unknown command";
+      return FALSE;
+    }
+    command.action = OTFC_ROOM_SHOW_MEMBERS;
+  }
+  else if(name == "template" || name == "chat")
+  {
+    command.action = (name == "template") ? OTFC_TEMPLATE_RECALL : OTFC_CHAT;
+    command.value = ControlRestOfLine(command.line, 3);
+    if(command.value.IsEmpty())
+    {
+      error = "missing argument";
+      return FALSE;
+    }
+  }
+  else if(name == "dial" || name == "invite" || name == "drop" || name == "mute" || name == "unmute" || name == "move" || name == "capture")
+  {
+    if(tokens.GetSize() < 4)
+    {
+      error = "missing argument";
+      return FALSE;
+    }
+    command.value = tokens[3];
+    if(name == "dial")
+      command.action = OTFC_DIAL;
+    else if(name == "invite")
+      command.action = OTFC_INVITE;
+    else if(name == "drop")
+      command.action = (command.value == "all") ? OTFC_DROP_ALL_ACTIVE_MEMBERS : OTFC_DROP_MEMBER;
+    else if(name == "mute" || name == "unmute")
+    {
+      if(command.value == "all")
+        command.action = (name == "mute") ? OTFC_MUTE_ALL : OTFC_UNMUTE_ALL;
+      else
+        command.action = (name == "mute") ? OTFC_MUTE : OTFC_UNMUTE;
+      // audio input by default, as the mute button of the room page
+      command.option = (tokens.GetSize() > 4) ? tokens[4].AsUnsigned() : 1;
+      if(command.option == 0)
+      {
+        error = "invalid mask";
+        return FALSE;
+      }
+    }
+    else if(name == "capture")
+    {
+      if(tokens.GetSize() < 5 || (tokens[4] != "start" && tokens[4] != "stop"))
+      {
+        error = "missing argument";
+        return FALSE;
+      }
+      command.action = OTFC_RTP_CAPTURE;
+      command.option = (tokens[4] == "start") ? 1 : 0;
+    }
+    else
+    {
+      if(tokens.GetSize() < 5)
+      {
+        error = "missing argument";
+        return FALSE;
+      }
+      command.action = OTFC_MOVE_MEMBER;
+      command.target = tokens[4];
+      if(command.target == command.room)
+      {
+        error = "same room";
+        return FALSE;
+      }
+    }
+  }
+  else
+  {
+    error = "unknown command";
+    return FALSE;
+  }
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlEngine::IsMemberAction(int action)
+{
+  return (action == OTFC_DIAL || action == OTFC_DROP_MEMBER || action == OTFC_MUTE || action == OTFC_UNMUTE || action == OTFC_MOVE_MEMBER
+          || action == OTFC_RTP_CAPTURE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlEngine::Check(const std::vector<MCUControlCommand> & commands, std::vector<PString> & errors)
+{
+  // the rooms created and deleted by the batch itself
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  std::set<PString> created, deleted;
+  BOOL ok = TRUE;
+  for(size_t i = 0; i < commands.size(); i++)
+  {
+    const MCUControlCommand & command = commands[i];
+    if(!command.help.IsEmpty() || command.action == OTFC_SHOW_REGISTRAR_ACCOUNTS)
+      continue;
+    if(command.action == OTFC_ROOM_CREATE)
+    {
+      created.insert(command.room);
+      deleted.erase(command.room);
+      continue;
+    }
+    if(command.action == OTFC_ROOM_DELETE)
+    {
+      deleted.insert(command.room);
+      created.erase(command.room);
+      continue;
+    }
+    if(command.action == OTFC_MOVE_MEMBER && deleted.find(command.target) != deleted.end())
+    {
+      errors[i] = "room " + command.target + " is deleted";
+      ok = FALSE;
+      continue;
+    }
+    if(created.find(command.room) != created.end())
+      continue;
+    Conference *conference = NULL;
+    if(deleted.find(command.room) == deleted.end())
+      conference = manager->FindConferenceWithLock(command.room);
+    if(conference == NULL)
+    {
+      errors[i] = "room not found";
+      ok = FALSE;
+      continue;
+    }
+    if(IsMemberAction(command.action))
+    {
+      ConferenceMember *member = ControlFindMemberWithLock(conference, command.value);
+      if(member == NULL)
+      {
+        errors[i] = "member not found";
+        ok = FALSE;
+      }
+      else
+        member->Unlock();
+    }
+    conference->Unlock();
+  }
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString MCUControlEngine::Response(const MCUControlCommand & command, BOOL ok, const PString & error, MCUJSON * data)
+{
+  MCUJSON response(MCUJSON::JSON_OBJECT);
+  response.Insert("command", command.line);
+  response.Insert("ok", ok != FALSE);
+  if(!error.IsEmpty())
+    response.Insert("error", error);
+  if(!command.help.IsEmpty())
+    response.Insert("help", command.help);
+  if(data)
+    response.Insert(data);
+  return response.AsString();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlEngine::Execute(const PStringArray & lines, BOOL atomic, PStringArray & responses)
+{
+  std::vector<MCUControlCommand> commands;
+  std::vector<PString> errors;
+  BOOL parsed = TRUE;
+  for(PINDEX i = 0; i < lines.GetSize(); i++)
+  {
+    PString line = lines[i].Trim();
+    if(line.IsEmpty() || line[0] == '#')
+      continue;
+    MCUControlCommand command;
+    PString error;
+    if(!Parse(line, command, error))
+    {
+      command.line = line;
+      parsed = FALSE;
+    }
+    commands.push_back(command);
+    errors.push_back(error);
+  }
+
+  OpenMCU & app = OpenMCU::Current();
+  PWaitAndSignal m(app.GetOTFCMutex());
+
+  // nothing of an atomic batch is executed when a line is wrong, a room or a member is missing
+  if(atomic && (!parsed || !Check(commands, errors)))
+  {
+    for(size_t i = 0; i < commands.size(); i++)
+      responses.AppendString(Response(commands[i], FALSE, errors[i].IsEmpty() ? PString("batch is not executed") : errors[i]));
+    return FALSE;
+  }
+
+  BOOL ok = parsed;
+  MCUControlBatch batch;
+  for(size_t i = 0; i < commands.size(); i++)
+  {
+    if(!errors[i].IsEmpty())
+    {
+      responses.AppendString(Response(commands[i], FALSE, errors[i]));
+      continue;
+    }
+    MCUJSON *data = NULL;
+    PString text, error;
+    BOOL result = batch.Run(commands[i], "data", data, text, error);
+    if(data == NULL && !text.IsEmpty() && commands[i].help.IsEmpty())
+      data = MCUJSON::String("data", (const char *)text);
+    responses.AppendString(Response(commands[i], result, error, data));
+    if(!result)
+      ok = FALSE;
+  }
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlEngine::Execute(const PString & text, BOOL atomic, PString & result)
+{
+  PStringArray responses;
+  BOOL ok = Execute(text.Lines(), atomic, responses);
+  result = "[";
+  for(PINDEX i = 0; i < responses.GetSize(); i++)
+  {
+    if(i != 0)
+      result += ",";
+    result += responses[i];
+  }
+  result += "]";
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUControlEngine::Execute(const MCUControlCommand & command, PString & rdata)
+{
+  OpenMCU & app = OpenMCU::Current();
+  PWaitAndSignal m(app.GetOTFCMutex());
+
+  MCUJSON *data = NULL;
+  PString error;
+  BOOL ok;
+  {
+    MCUControlBatch batch;
+    ok = batch.Run(command, "", data, rdata, error);
+  }
+  if(data)
+  {
+    std::string str;
+    data->ToString(str, true, true);
+    rdata = str;
+    delete data;
+  }
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
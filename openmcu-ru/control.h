@@ -0,0 +1,89 @@
+/*
+ * control.h
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+
+#ifndef _MCU_CONTROL_H
+#define _MCU_CONTROL_H
+
+#include "utils_json.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// one command of the telnet console or of the Control page,
+// the actions are those of the room control page (OTFC_*)
+class MCUControlCommand
+{
+  public:
+    MCUControlCommand() : action(-1), option(0) { }
+
+    // the request of OpenMCU::OTFControl for the actions without a fast path
+    void GetParams(PStringToString & data) const;
+
+    // the text of the command, returned with the response
+    PString line;
+    // not empty for "?", nothing is executed
+    PString help;
+
+    int action;
+    PString room;
+    // member id or name, address, template name or text
+    PString value;
+    // channel mask of mute/unmute
+    unsigned option;
+    // destination room of OTFC_MOVE_MEMBER
+    PString target;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Parses and runs the control commands of telnet and HTTP. A batch is executed under one hold of
+// the control mutex, every room of the batch is found once and its member list is held while
+// the consecutive commands of the room run, members do not join or leave between them.
+// An atomic batch is checked first and is not started when a line is wrong, a room or a member
+// is missing. Atomic means this check only: the commands are not rolled back, a command failing
+// while the batch runs, a dial or a room that can not be created, leaves the ones before it done.
+class MCUControlEngine
+{
+  public:
+    // "room <name> <command> ...", "show ..." or "?"
+    static BOOL Parse(const PString & line, MCUControlCommand & command, PString & error);
+
+    // The lines of a script, empty lines and lines beginning with '#' are skipped. A line that is
+    // not parsed or fails does not stop the others unless the batch is atomic. The response of
+    // a command is a JSON object: "command", "ok", "error", "data" or "help".
+    static BOOL Execute(const PStringArray & lines, BOOL atomic, PStringArray & responses);
+
+    // one command per line, the responses as a JSON array
+    static BOOL Execute(const PString & text, BOOL atomic, PString & result);
+
+    // one console command, the response as text
+    static BOOL Execute(const MCUControlCommand & command, PString & rdata);
+
+  protected:
+    static BOOL IsMemberAction(int action);
+    static BOOL Check(const std::vector<MCUControlCommand> & commands, std::vector<PString> & errors);
+    static PString Response(const MCUControlCommand & command, BOOL ok, const PString & error, MCUJSON * data = NULL);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MCU_CONTROL_H
@@ -245,10 +245,22 @@ void ConferenceCacheMember::CacheThread(PThread &, INT)
     conn->OpenVideoChannel(TRUE, (H323VideoCodec &)*codec);
   }
 
+  MCUMetric *encodeMetric = NULL;
+  if(!isAudio)
+  {
+    encodeMetric = MCUMetrics::Acquire(MCUMetric::Histogram, "mcu_cache_encode_seconds", "Encoding time of a frame by the cache encoder",
+                                       MCUMetrics::Label("room", roomName) + "," + MCUMetrics::Label("cache", cacheName));
+    ((MCUVideoCodec *)codec)->SetEncodeMetric(encodeMetric);
+  }
+
   RTP_DataFrame frame;
   unsigned length = 0;
   status = 1;
 
+  // video frames are stamped with the 90 kHz capture time, the recorder takes PTS from it
+  BOOL frameStart = TRUE;
+  DWORD frameTimestamp = 0;
+
   // from here we are ready to call codec->Read in cicle
   while(running)
   {
@@ -288,7 +300,14 @@ void ConferenceCacheMember::CacheThread(PThread &, INT)
       if(isAudio)
         codec->Read(frame.GetPayloadPtr(), length, frame);
       else
+      {
         ((MCUVideoCodec *)codec)->Read(frame.GetPayloadPtr(), length, frame, flags);
+        if(frameStart)
+          frameTimestamp = (DWORD)(MCUTime::GetMonoTimestampUsec() * 9 / 100);
+        frame.SetTimestamp(frameTimestamp);
+        if(length > 0)
+          frameStart = frame.GetMarker();
+      }
 
       PutCacheRTP(cache, frame, length, flags);
     }
@@ -303,6 +322,12 @@ void ConferenceCacheMember::CacheThread(PThread &, INT)
     MCUTime::Sleep(1);
   }
 
+  if(encodeMetric)
+  {
+    ((MCUVideoCodec *)codec)->SetEncodeMetric(NULL);
+    MCUMetrics::Release(encodeMetric);
+  }
+
   // must destroy videograbber and videochanell here? fix it
   delete(conn); conn = NULL;
   delete(codec); codec = NULL;
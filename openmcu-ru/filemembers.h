@@ -105,6 +105,9 @@ class ConferenceCacheMember : public ConferenceMember
     int GetCacheUsersNumber() const
     { return (cache ? cache->GetUsersNumber() : 0); }
 
+    const CacheRTP * GetCache() const
+    { return cache; }
+
     const H323Codec * GetCodec() const
     { return codec; }
 
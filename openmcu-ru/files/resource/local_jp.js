@@ -295,6 +295,8 @@ window.l_max_bit_rate                              = "Max bit rate";
 window.l_tx_key_frame_period                       = "Tx key frame period";
 window.l_encoding_threads                          = "Encoding threads";
 window.l_encoding_cpu_used                         = "Encoding CPU used";
+window.l_decoding_threads                          = "Decoding threads";
+window.l_decoding_thread_type                      = "Decoding thread type";
 ///
 window.l_enable_export                             = "Enable export";
 window.l_video_frame_rate                          = "Video frame rate";
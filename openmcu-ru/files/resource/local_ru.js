@@ -304,6 +304,8 @@ window.l_max_bit_rate                              = "Максимальный 
 window.l_tx_key_frame_period                       = "Интервал отправки опорных кадров";
 window.l_encoding_threads                          = "Количество потоков кодирования";
 window.l_encoding_cpu_used                         = "Использование процессора для кодирования";
+window.l_decoding_threads                          = "Количество потоков декодирования";
+window.l_decoding_thread_type                      = "Тип потоков декодирования";
 ///
 window.l_enable_export                             = "Включить экспорт";
 window.l_video_frame_rate                          = "Видео частота кадров";
@@ -299,6 +299,8 @@ window.l_max_bit_rate                              = "Максимальний 
 window.l_tx_key_frame_period                       = "Інтервал відправки опорних кадрів";
 window.l_encoding_threads                          = "Кількість потоків кодування";
 window.l_encoding_cpu_used                         = "Використання процесора для кодування";
+window.l_decoding_threads                          = "Кількість потоків декодування";
+window.l_decoding_thread_type                      = "Тип потоків декодування";
 ///
 window.l_enable_export                             = "Включити експорт";
 window.l_video_frame_rate                          = "Відео частота кадрів";
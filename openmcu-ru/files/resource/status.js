@@ -47,6 +47,7 @@ var fortyTwo=42
   ,store             = []
   ,timer             = null
   ,xro               = null
+  ,dataTag           = ""
   ,cache_fps         = []
   ,haveCode          = 0
   ;
@@ -226,6 +227,7 @@ function member_get_nice_packets(m)
   if(m[1]==FILE_RECORDER_NAME) return "-";
   var plost='', vplost='', plostTx='', vplostTx='';
   if(m[23])  plost  ="<font color='red'>/"+m[23]+"</font>";
+  if(m[28] || m[29]) plost+="<font color='green' title='concealed/recovered'>/"+m[28]+"/"+m[29]+"</font>";
   if(m[24]) vplost  ="<font color='red'>/"+m[24]+"</font>";
   if(m[25])  plostTx="<font color='red'>/"+m[25]+"</font>";
   if(m[26]) vplostTx="<font color='red'>/"+m[26]+"</font>";
@@ -420,6 +422,7 @@ function get_data()
   if(xro == null) xro=createRequestObject();
   requestTimer=setTimeout(get_data_fail, REQUEST_TIMEOUT);
   xro.open('GET','Status/?js',true);
+  if(dataTag) xro.setRequestHeader('If-None-Match',dataTag);
   xro.onreadystatechange=got_data;
   xro.send(null);
 }
@@ -488,6 +491,11 @@ function got_data()
       while(store.length >= STEPS_TO_REMEMBER) on_delete_data(store.shift());
       data=data_sort_function(data);
       store.push(data);
+      dataTag=xro.getResponseHeader('ETag');
+      getDataErrorCount=0;
+    }
+    else if(xro.status==304) // the document of the previous request
+    {
       getDataErrorCount=0;
     }
     else
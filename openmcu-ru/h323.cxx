@@ -949,6 +949,7 @@ PString MCUH323EndPoint::GetRoomStatusJS()
         int codecCacheMode=-1, cacheUsersNumber=-1;
         MCUH323Connection * conn = NULL;
         DWORD orx=0, otx=0, vorx=0, votx=0, prx=0, ptx=0, vprx=0, vptx=0, plost=0, vplost=0, plostTx=0, vplostTx=0;
+        unsigned aconcealed=0, arecovered=0;
         bool isAudioCache = false;
         if(member->GetType() == MEMBER_TYPE_PIPE)
         {
@@ -1021,6 +1022,19 @@ PString MCUH323EndPoint::GetRoomStatusJS()
                 prx = sess->GetPacketsReceived(); ptx = sess->GetPacketsSent();
                 plost = sess->GetPacketsLost(); plostTx = sess->GetPacketsLostTx();
               }
+
+              conn->GetChannelsMutex().Wait();
+              if(conn->GetAudioReceiveChannel() != NULL)
+              {
+                MCUFramedAudioCodec * acodec = dynamic_cast<MCUFramedAudioCodec *>(conn->GetAudioReceiveChannel()->GetCodec());
+                if(acodec != NULL)
+                {
+                  aconcealed = acodec->GetFramesConcealed();
+                  arecovered = acodec->GetFramesRecovered();
+                }
+              }
+              conn->GetChannelsMutex().Signal();
+
 #             if MCU_VIDEO
                 videoCodecR = conn->GetVideoReceiveCodecName() + "@" + member->GetVideoRxFrameSize();
                 videoCodecT = conn->GetVideoTransmitCodecName();
@@ -1060,6 +1074,7 @@ PString MCUH323EndPoint::GetRoomStatusJS()
           << "," << JsQuoteScreen(ra)                                          // c[r][4][m][22]: remote application name
           << "," << plost << "," << vplost << "," << plostTx << "," << vplostTx// c[r][4][m][23-26]: rx & tx_from_RTCP packets lost (audio, video)
           << "," << isAudioCache                                               // c[r][4][m][27]: audio cache
+          << "," << aconcealed << "," << arecovered                            // c[r][4][m][28,29]: audio frames concealed, recovered
           << ")";
         firstMember = FALSE;
       }
@@ -1343,9 +1358,10 @@ PString MCUH323EndPoint::GetConferenceOptsJavascript(Conference & c)
   for(MCUVideoMixerList::shared_iterator it = videoMixerList.begin(); it != videoMixerList.end(); ++it)
   {
     MCUSimpleVideoMixer *mixer = it.GetObject();
-    MCUJSON* vmc=GetVideoMixerConfiguration(mixer, it.GetIndex());
-    r << "," << vmc->AsString();
-    delete vmc; //FIXME? Delete structure?
+    std::string vmc;
+    MCUJSONWriter a(vmc);
+    GetVideoMixerConfiguration(mixer, it.GetIndex(), a);
+    r << "," << vmc;
   }
 
   r << "];"; //l1 close
@@ -1354,80 +1370,84 @@ PString MCUH323EndPoint::GetConferenceOptsJavascript(Conference & c)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MCUJSON* MCUH323EndPoint::GetVideoMixerConfiguration(MCUVideoMixer * mixer, int number)
+void MCUH323EndPoint::GetVideoMixerConfiguration(MCUVideoMixer * mixer, int number, MCUJSONWriter & a)
 {
-  MCUJSON* a = new MCUJSON(MCUJSON::JSON_ARRAY);
-  if(mixer == NULL) return a;
+  a.BeginArray();
+  if(mixer == NULL) { a.End(); return; }
   unsigned n = mixer->GetPositionSet();
   VMPCfgSplitOptions & split=OpenMCU::vmcfg.vmconf[n].splitcfg;
   VMPCfgOptions      * p    =OpenMCU::vmcfg.vmconf[n].vmpcfg;
   
-  MCUJSON* b = new MCUJSON(MCUJSON::JSON_ARRAY);
-  b->Insert(split.mockup_width);
-  b->Insert(split.mockup_height);   //   a[0][0-1] = mw * mh
-  b->Insert(n);                     //   a[0][2]   = position set (layout)
-  b->Insert(number);                //   a[0][3]   = number
-
-  a->Insert(b);
+  a.BeginArray();
+  a.Insert(split.mockup_width);
+  a.Insert(split.mockup_height);    //   a[0][0-1] = mw * mh
+  a.Insert(n);                      //   a[0][2]   = position set (layout)
+  a.Insert(number);                 //   a[0][3]   = number
+  a.End();
   
-  MCUJSON* c=new MCUJSON(MCUJSON::JSON_ARRAY); // a[1]: frame geometry for each position i:
+  a.BeginArray(); // a[1]: frame geometry for each position i:
   for(unsigned i=0;i<split.vidnum;i++)
   {
-    MCUJSON* b = new MCUJSON(MCUJSON::JSON_ARRAY);
-    b->Insert(p[i].posx); // a[1][i][0-1]= posx & posy
-    b->Insert(p[i].posy);
-    b->Insert(p[i].width);  // a[1][i][2-3]= width & height
-    b->Insert(p[i].height);
-    b->Insert(p[i].border);  // a[1][i][4]  = border
-    c->Insert(b);
-  }
-  a->Insert(c);
+    a.BeginArray();
+    a.Insert(p[i].posx); // a[1][i][0-1]= posx & posy
+    a.Insert(p[i].posy);
+    a.Insert(p[i].width);  // a[1][i][2-3]= width & height
+    a.Insert(p[i].height);
+    a.Insert(p[i].border);  // a[1][i][4]  = border
+    a.End();
+  }
+  a.End();
   
-  a->Insert(mixer->VMPListScanJS()); // a[2], a[3]: members' ids & types
+  a.BeginArray();
+  mixer->VMPListScanJS(a); // a[2], a[3]: members' ids & types
+  a.End();
 
-  return a;
+  a.End();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MCUJSON* MCUH323EndPoint::GetMemberDataJS(ConferenceMember * member)
+void MCUH323EndPoint::GetMemberDataJS(ConferenceMember * member, MCUJSONWriter & a)
 {
-  MCUJSON* a = new MCUJSON(MCUJSON::JSON_ARRAY);
-  if(!member) return a;
-  a->Insert(member->IsOnline()); //0: 1=online
-  a->Insert((long)member->GetID()); //1: long id
-  a->Insert(member->GetName()); //2: name [ip]
-  a->Insert(member->muteMask); //3: mute
-  a->Insert(member->disableVAD); //4
-  a->Insert(member->chosenVan); //5
-  a->Insert(member->GetAudioLevel()); //6: audio level
-  a->Insert(member->GetVideoMixerNumber()); //7: number of mixer member receiving
-  a->Insert(member->GetNameID()); //8: memberName id
-  a->Insert(member->channelMask); //9: RTP channels check bit mask 0000vVaA
-  a->Insert(member->kManualGainDB); //10: Audio level gain for manual tune, integer: -20..60
-  a->Insert(member->kOutputGainDB); //11: Output audio gain, integer: -20..60
-  a->Insert(GetVideoMixerConfiguration(member->videoMixer, 0)); //12: mixer configuration
-  a->Insert(member->GetType()); //13
-  a->Insert(member->autoDial); //14
-  a->Insert(member->resizerRule); //15
-  return a;
+  a.BeginArray();
+  if(!member) { a.End(); return; }
+  a.Insert(member->IsOnline()); //0: 1=online
+  a.Insert((long)member->GetID()); //1: long id
+  a.Insert(member->GetName()); //2: name [ip]
+  a.Insert(member->muteMask); //3: mute
+  a.Insert(member->disableVAD); //4
+  a.Insert(member->chosenVan); //5
+  a.Insert(member->GetAudioLevel()); //6: audio level
+  a.Insert(member->GetVideoMixerNumber()); //7: number of mixer member receiving
+  a.Insert(member->GetNameID()); //8: memberName id
+  a.Insert(member->channelMask); //9: RTP channels check bit mask 0000vVaA
+  a.Insert(member->kManualGainDB); //10: Audio level gain for manual tune, integer: -20..60
+  a.Insert(member->kOutputGainDB); //11: Output audio gain, integer: -20..60
+  GetVideoMixerConfiguration(member->videoMixer, 0, a); //12: mixer configuration
+  a.Insert(member->GetType()); //13
+  a.Insert(member->autoDial); //14
+  a.Insert(member->resizerRule); //15
+  a.End();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 PString MCUH323EndPoint::GetMemberListOptsJavascript(Conference & conference)
 {
-  MCUJSON a(MCUJSON::JSON_ARRAY);
+  std::string str = "members=";
+  MCUJSONWriter a(str);
+  a.BeginArray();
   MCUMemberList & memberList = conference.GetMemberList();
   for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
   {
     ConferenceMember *member = *it;
     if(member->IsSystem())
       continue;
-    a.Insert(GetMemberDataJS(member));
+    GetMemberDataJS(member, a);
   }
+  a.End();
 
-  return "members=" + a.AsString();
+  return str;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1596,13 +1616,7 @@ PString MCUH323EndPoint::SetRoomParams(const PStringToString & data)
   if(data.Contains("refresh")) // JavaScript data refreshing
   {
     PTRACE(6,"WebCtrl\tJS refresh");
-    Conference *conference = conferenceManager.FindConferenceWithLock(room);
-    if(conference == NULL)
-      return "";
-
-    PString data = GetMemberListOptsJavascript(*conference);
-    conference->Unlock();
-    return data;
+    return OpenMCU::Current().GetStatusCache().GetMemberList(room);
   }
 
   OpenMCU::Current().HttpWriteEventRoom("MCU Operator connected",room);
@@ -2184,6 +2198,17 @@ void MCUH323Connection::JoinConference(const PString & roomToJoin)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+RTP_Session * MCUH323Connection::UseOpenSession(unsigned sessionID)
+{
+  // the manager keeps its mutex locked when the session is not found, the channel that holds
+  // the session keeps it in the manager between the two calls
+  if(GetSession(sessionID) == NULL)
+    return NULL;
+  return rtpSessions.UseSession(sessionID);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 RTP_Session * MCUH323Connection::UseSession(unsigned sessionID,
                                          const H245_TransportAddress & taddr,
 			                 H323Channel::Directions dir,
@@ -2951,11 +2976,24 @@ BOOL MCUH323Connection::OpenVideoChannel(BOOL isEncoding, H323VideoCodec & codec
       frameRate = ep.GetVideoFrameRate();
     codec.SetTargetFrameTimeMs(1000/frameRate); // ???
 
+    // Кодек с временными слоями (VP8): один кэш на все частоты кадров,
+    // частота кадров выбирает слой, а не отдельный кодировщик
+    unsigned cacheFrameRate = frameRate;
+    int cacheTemporalLayer = -1;
+    if(cacheMode == 2 && mf.HasOption(OPTION_TEMPORAL_LAYERS))
+    {
+      cacheFrameRate = PMAX(frameRate, ep.GetVideoFrameRate());
+      // the highest layer not faster than the channel, the layer below the top has half of its rate
+      cacheTemporalLayer = CACHE_TEMPORAL_LAYERS - 1;
+      while(cacheTemporalLayer > 0 && cacheFrameRate > (frameRate << (CACHE_TEMPORAL_LAYERS - 1 - cacheTemporalLayer)))
+        cacheTemporalLayer--;
+    }
+
     // update format string
     videoTransmitCodecName = mf + "@" + PString(codec.GetWidth())
                              + "x" + PString(codec.GetHeight())
                              + ":" + PString(mf.GetOptionInteger(OPTION_MAX_BIT_RATE))
-                             + "x" + PString(frameRate);
+                             + "x" + PString(cacheFrameRate);
 
     // videoGrabber
     // Нужен в режиме без кэша или для потока кэша
@@ -2989,10 +3027,17 @@ BOOL MCUH323Connection::OpenVideoChannel(BOOL isEncoding, H323VideoCodec & codec
     if(cacheMode == 2)
     {
       videoTransmitCodecName = videoTransmitCodecName + "_" + requestedRoom + "/" + (PString)videoMixerNumber;
-      if(!OpenVideoCache(requestedRoom, codec.GetMediaFormat(), videoTransmitCodecName))
+      OpalMediaFormat cacheFormat = codec.GetMediaFormat();
+      if(cacheTemporalLayer >= 0)
+      {
+        cacheFormat.SetOptionInteger(OPTION_FRAME_TIME, 90000/cacheFrameRate);
+        cacheFormat.SetOptionInteger(OPTION_TEMPORAL_LAYERS, CACHE_TEMPORAL_LAYERS);
+      }
+      if(!OpenVideoCache(requestedRoom, cacheFormat, videoTransmitCodecName))
         return FALSE;
       videoTransmitChannel->SetCacheName(videoTransmitCodecName);
       videoTransmitChannel->SetCacheMode(2);
+      videoTransmitChannel->SetCacheTemporalLayer(cacheTemporalLayer);
     }
 
     if(conferenceMember)
@@ -3563,10 +3608,10 @@ BOOL MCUH323Connection::OnOutgoingAudio(const uint64_t & timestamp, void * buffe
 
 #if MCU_VIDEO
 
-BOOL MCUH323Connection::OnOutgoingVideo(void * buffer, int width, int height, PINDEX & amount)
+BOOL MCUH323Connection::OnOutgoingVideo(void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage)
 {
   if(conferenceMember != NULL)
-    conferenceMember->ReadVideo(buffer, width, height, amount);
+    conferenceMember->ReadVideo(buffer, width, height, amount, damage);
   else
     return FALSE;
 
@@ -3575,10 +3620,10 @@ BOOL MCUH323Connection::OnOutgoingVideo(void * buffer, int width, int height, PI
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-BOOL MCUH323Connection::OnIncomingVideo(const void * buffer, int width, int height)
+BOOL MCUH323Connection::OnIncomingVideo(const MCUPlanesYUV & planes, int width, int height)
 {
   if(conferenceMember == NULL) return FALSE;
-  conferenceMember->WriteVideo(buffer, width, height);
+  conferenceMember->WriteVideo(planes, width, height);
   return TRUE;
 }
 
@@ -3963,12 +4008,20 @@ BOOL OutgoingAudio::Close()
 IncomingAudio::IncomingAudio(MCUH323Connection & _conn, unsigned int _sampleRate, unsigned _channels)
   : conn(_conn), sampleRate(_sampleRate), channels(_channels)
 {
+  session = (MCU_RTP_UDP *)conn.UseOpenSession(RTP_Session::DefaultAudioSessionID);
   os_handle = 0;
   lastWriteCount = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+IncomingAudio::~IncomingAudio()
+{
+  Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 BOOL IncomingAudio::Write(const void * buffer, PINDEX amount)
 {
   PWaitAndSignal mutexW(audioChanMutex);
@@ -3985,7 +4038,12 @@ BOOL IncomingAudio::Write(const void * buffer, PINDEX amount)
 
   conn.OnIncomingAudio(timestamp, buffer, amount, sampleRate, channels);
 
-  delay.DelayUsec(delay_us);
+  // the jitter buffer is filled while waiting for the next frame
+  uint32_t interval = delay.NextIntervalUsec(delay_us);
+  if(session)
+    session->WaitPlayout(interval);
+  else if(interval)
+    MCUTime::SleepUsec(interval);
 
   lastWriteCount = amount;
   return TRUE;
@@ -4000,6 +4058,11 @@ BOOL IncomingAudio::Close()
 
   PWaitAndSignal mutexA(audioChanMutex);
   os_handle = -1;
+  if(session)
+  {
+    conn.ReleaseSession(session->GetSessionID());
+    session = NULL;
+  }
   return TRUE;
 }
 
@@ -9,6 +9,8 @@
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+class MCUVideoDamage;
+
 PString H323GetAliasUserName(const H225_ArrayOf_AliasAddress & aliases);
 PString H323GetAliasDisplayName(const H225_ArrayOf_AliasAddress & aliases);
 
@@ -52,8 +54,8 @@ class MCUH323EndPoint : public H323EndPoint
     PString GetRoomStatus(const PString & block);
     PString GetRoomStatusJS();
     PString GetRoomStatusJSStart();
-    MCUJSON* GetVideoMixerConfiguration(MCUVideoMixer * mixer, int number);
-    MCUJSON* GetMemberDataJS(ConferenceMember * member);
+    void GetVideoMixerConfiguration(MCUVideoMixer * mixer, int number, MCUJSONWriter & a);
+    void GetMemberDataJS(ConferenceMember * member, MCUJSONWriter & a);
     PString GetConferenceOptsJavascript(Conference & c);
     PString GetMemberListOptsJavascript(Conference & conference);
     PString GetAddressBookOptsJavascript();
@@ -180,12 +182,15 @@ class IncomingAudio : public PChannel
 
   public:
     IncomingAudio(MCUH323Connection & conn, unsigned int _sampleRate, unsigned _channels);
+    ~IncomingAudio();
 
     BOOL Write(const void * buffer, PINDEX amount);
     BOOL Close();
 
   protected:
     MCUH323Connection & conn;
+    // used until Close(), the receive thread fills its jitter buffer in Write()
+    MCU_RTP_UDP * session;
 
     unsigned int sampleRate;
     unsigned channels; //1=mono, 2=stereo
@@ -325,6 +330,10 @@ class MCUH323Connection : public H323Connection
 
     virtual void SetupCacheConnection(PString & format,Conference * conf, ConferenceMember * memb);
 
+    // one more use of a session held by an open channel, ReleaseSession() must follow;
+    // NULL when there is no such session
+    RTP_Session * UseOpenSession(unsigned sessionID);
+
     virtual RTP_Session * UseSession(
       unsigned sessionID,
       const H245_TransportAddress & pdu,
@@ -344,8 +353,8 @@ class MCUH323Connection : public H323Connection
     PString GetEndpointParam(PString param, PString defaultValue, bool asterisk = true);
 
 #if MCU_VIDEO
-    virtual BOOL OnIncomingVideo(const void * buffer, int width, int height);
-    virtual BOOL OnOutgoingVideo(void * buffer, int width, int height, PINDEX & amount);
+    virtual BOOL OnIncomingVideo(const MCUPlanesYUV & planes, int width, int height);
+    virtual BOOL OnOutgoingVideo(void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage = NULL);
     virtual void RestartGrabber();
     unsigned videoMixerNumber;
 #endif
@@ -570,6 +579,7 @@ class MCUPVideoInputDevice : public PVideoInputDevice
   /** Create a new MCU video input device.
    */
     MCUPVideoInputDevice(MCUH323Connection & conn);
+    ~MCUPVideoInputDevice();
 
     /**Open the device given the device name.
       */
@@ -708,14 +718,18 @@ class MCUPVideoInputDevice : public PVideoInputDevice
     virtual BOOL TestAllFormats()
       { return TRUE; }
       
-    void Restart() { grabDelay.Restart(); }
+    void Restart() { grabClock.Restart(); }
+
+    // regions of the last frame changed since the previous one
+    const PString & GetDamagedRegions() const;
 
   protected:
     MCUH323Connection & mcuConnection;
+    MCUVideoDamage * damage;
     unsigned grabCount;
     PINDEX   videoFrameSize;
     PINDEX   scanLineWidth;
-    PAdaptiveDelay grabDelay;
+    MCUVideoClock grabClock;
 };
 
 
@@ -781,6 +795,14 @@ class MCUPVideoOutputDevice : public PVideoOutputDevice
       BOOL endFrame = TRUE
     );
 
+    /**Pass a decoded frame by plane references, without a packed copy.
+      */
+    virtual BOOL SetFramePlanes(
+      unsigned width,
+      unsigned height,
+      const MCUPlanesYUV & planes
+    );
+
     /**Indicate frame may be displayed.
       */
     virtual BOOL EndFrame();
@@ -722,6 +722,8 @@ VideoPConfigPage::VideoPConfigPage(PHTTPServiceProcess & app,const PString & tit
   s << SeparatorField("H.264");
   s << IntegerField("H.264 Max Bit Rate", "H.264 "+JsLocal("max_bit_rate"), cfg.GetString("H.264 Max Bit Rate"), MCU_MIN_BIT_RATE/1000, MCU_MAX_BIT_RATE/1000, 0, "range "+PString(MCU_MIN_BIT_RATE/1000)+".."+PString(MCU_MAX_BIT_RATE/1000)+" kbit (for outgoing video, 0 disable)");
   s << IntegerField("H.264 Encoding Threads", "H.264 "+JsLocal("encoding_threads"), cfg.GetString("H.264 Encoding Threads"), 0, 64, 0, "range 0..64 (0 auto)");
+  s << IntegerField("H.264 Decoding Threads", "H.264 "+JsLocal("decoding_threads"), cfg.GetString("H.264 Decoding Threads"), 0, 64, 0, "range 0..64 (0 auto, limited by the number of processors for all decoders)");
+  s << SelectField("H.264 Decoding Thread Type", "H.264 "+JsLocal("decoding_thread_type"), cfg.GetString("H.264 Decoding Thread Type", "slice"), "slice,frame");
 
   s << SeparatorField("VP8");
   s << IntegerField("VP8 Max Bit Rate", "VP8 "+JsLocal("max_bit_rate"), cfg.GetString("VP8 Max Bit Rate"), MCU_MIN_BIT_RATE/1000, MCU_MAX_BIT_RATE/1000, 0, "range "+PString(MCU_MIN_BIT_RATE/1000)+".."+PString(MCU_MAX_BIT_RATE/1000)+" kbit (for outgoing video, 0 disable)");
@@ -1379,6 +1381,7 @@ RtspServersPConfigPage::RtspServersPConfigPage(PHTTPServiceProcess & app,const P
   optionNames.AppendString(UserNameKey);
   optionNames.AppendString(PasswordKey);
   optionNames.AppendString(RoomNameKey);
+  optionNames.AppendString(RtspFanoutKey);
 
   optionNames.AppendString(NATRouterIPKey);
   optionNames.AppendString(NATStunServerKey);
@@ -1438,6 +1441,7 @@ RtspServersPConfigPage::RtspServersPConfigPage(PHTTPServiceProcess & app,const P
       s2 += RowArray()+EmptyInputItem(name)+"</tr>";
       s2 += RowArray()+EmptyInputItem(name)+"</tr>";
       s2 += RowArray()+EmptyInputItem(name)+"</tr>";
+      s2 += RowArray()+EmptyInputItem(name)+"</tr>";
       s2 += EndItemArray();
       s << s2;
     } else {
@@ -1447,6 +1451,8 @@ RtspServersPConfigPage::RtspServersPConfigPage(PHTTPServiceProcess & app,const P
       s2 += RowArray()+JsLocal("name_user")+StringItem(name, scfg.GetString(UserNameKey));
       s2 += RowArray()+JsLocal("name_password")+StringItem(name, scfg.GetString(PasswordKey));
       s2 += RowArray()+JsLocal("name_roomname")+StringItem(name, scfg.GetString(RoomNameKey))+"</tr>";
+      // viewers share the packets of the room cache, without connections
+      s2 += RowArray()+"Cache fan-out"+BoolItem(name, scfg.GetBoolean(RtspFanoutKey))+"</tr>";
       s2 += EndItemArray();
       s << s2;
     }
@@ -2251,23 +2257,28 @@ BOOL MainStatusPage::OnGET (PHTTPServer & server, const PURL &url, const PMIMEIn
   if((q=request.Find("?"))!=P_MAX_INDEX) { request=request.Mid(q+1,P_MAX_INDEX); PURL::SplitQueryVars(request,data); }
   if(!data.Contains("js")) return PServiceHTTPString::OnGET(server, url, info, connectInfo);
 
-  PString body;
+  PString body, tag;
+  BOOL modified = TRUE;
 
   if(data.Contains("start"))
     body = OpenMCU::Current().GetEndpoint().GetRoomStatusJSStart();
   else
-    body = OpenMCU::Current().GetEndpoint().GetRoomStatusJS();
+    modified = app.GetStatusCache().GetRoomStatus(info("If-None-Match"), body, tag);
+  if(!modified)
+    body = "";
   PINDEX length = body.GetLength();
 
   PStringStream message;
-  message << "HTTP/1.1 200 OK\r\n"
+  message << (modified ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 304 Not Modified\r\n")
           << "Date: " << PTime().AsString(PTime::RFC1123, PTime::GMT) << "\r\n"
           << "Server: " << PRODUCT_NAME_TEXT << "\r\n"
           << "MIME-Version: 1.0\r\n"
           << "Cache-Control: no-cache, must-revalidate\r\n"
           << "Expires: Sat, 26 Jul 1997 05:00:00 GMT\r\n"
-          << "Content-Type: text/html;charset=utf-8\r\n"
-          << "Content-Length: " << length << "\r\n"
+          << "Content-Type: text/html;charset=utf-8\r\n";
+  if(!tag.IsEmpty())
+    message << "ETag: " << tag << "\r\n";
+  message << "Content-Length: " << length << "\r\n"
           << "Connection: Close\r\n"
           << "\r\n";  //that's the last time we need to type \r\n instead of just \n
 
@@ -2371,86 +2382,120 @@ BOOL JpegFrameHTTP::OnGET (PHTTPServer & server, const PURL &url, const PMIMEInf
 
   int width=atoi(data("w"));
   int height=atoi(data("h"));
+  if(width<0) width=0;
+  if(height<0) height=0;
 
   long requestedMixer=0;
   if(data.Contains("mixer")) requestedMixer=data("mixer").AsInteger();
 
-  const unsigned long t1=(unsigned long)time(0);
+  if(data("stream") == "1")
+    return OnStream(server, room, requestedMixer, width, height);
+
+  // encoded by the snapshot service at most once per interval for all clients
+  MCUSnapshotService *snapshotService = app.GetSnapshotService();
+  if(snapshotService == NULL || !snapshotService->Use())
+    return FALSE;
+  PBYTEArray jpeg;
+  uint64_t timestamp = 0;
+  BOOL ok = snapshotService->GetSnapshot(room, requestedMixer, width, height, jpeg, timestamp);
+  snapshotService->Release();
+  if(!ok)
+    return FALSE;
+
+  PTime now;
+  PStringStream message;
+  message << "HTTP/1.1 200 OK\r\n"
+          << "Date: " << now.AsString(PTime::RFC1123, PTime::GMT) << "\r\n"
+          << "Server: " << PRODUCT_NAME_TEXT << "\r\n"
+          << "MIME-Version: 1.0\r\n"
+          << "Cache-Control: no-cache, must-revalidate\r\n"
+          << "Expires: Sat, 26 Jul 1997 05:00:00 GMT\r\n"
+          << "Content-Type: image/jpeg\r\n"
+          << "Content-Length: " << jpeg.GetSize() << "\r\n"
+          << "Connection: Close\r\n"
+          << "\r\n";  //that's the last time we need to type \r\n instead of just \n
+
+  server.Write((const char*)message,message.GetLength());
+  server.Write(jpeg.GetPointer(),jpeg.GetSize());
+  server.flush();
 
-  // lock!
-  PWaitAndSignal m(jpegMixerMutex);
+  return TRUE;
+}
 
-  ConferenceManager *cm = app.GetConferenceManager();
-  jpegMixer = cm->FindVideoMixerWithLock(room, requestedMixer);
-  if(jpegMixer == NULL) // no mixer found
+BOOL JpegFrameHTTP::OnStream(PHTTPServer & server, const PString & room, long mixer, unsigned width, unsigned height)
+{
+  MCUSnapshotService *snapshotService = app.GetSnapshotService();
+  if(snapshotService == NULL || !snapshotService->StartStream())
     return FALSE;
 
-  if(t1-(jpegMixer->jpegTime)>1) // artificial limitation to prevent overload: no more than 1 frame per second
-  {
-    if(width<1||height<1||width>2048||height>2048) //suspicious, it's better to get size from layouts.conf
+  PTime now;
+  PStringStream message;
+  message << "HTTP/1.1 200 OK\r\n"
+          << "Date: " << now.AsString(PTime::RFC1123, PTime::GMT) << "\r\n"
+          << "Server: " << PRODUCT_NAME_TEXT << "\r\n"
+          << "MIME-Version: 1.0\r\n"
+          << "Cache-Control: no-cache, must-revalidate\r\n"
+          << "Expires: Sat, 26 Jul 1997 05:00:00 GMT\r\n"
+          << "Content-Type: multipart/x-mixed-replace; boundary=mcuframe\r\n"
+          << "Connection: Close\r\n"
+          << "\r\n";
+  BOOL ok = server.Write((const char*)message,message.GetLength());
+
+  // the same preview is not sent twice, the client gets a new part once per interval
+  uint64_t lastTimestamp = 0;
+  while(ok && snapshotService->IsRunning())
+  {
+    PBYTEArray jpeg;
+    uint64_t timestamp = 0;
+    if(!snapshotService->GetSnapshot(room, mixer, width, height, jpeg, timestamp))
+      break;
+    if(timestamp != lastTimestamp)
     {
-      width=OpenMCU::vmcfg.vmconf[jpegMixer->GetPositionSet()].splitcfg.mockup_width;
-      height=OpenMCU::vmcfg.vmconf[jpegMixer->GetPositionSet()].splitcfg.mockup_height;
+      PStringStream part;
+      part << "--mcuframe\r\n"
+           << "Content-Type: image/jpeg\r\n"
+           << "Content-Length: " << jpeg.GetSize() << "\r\n"
+           << "\r\n";
+      ok = server.Write((const char*)part,part.GetLength())
+        && server.Write(jpeg.GetPointer(),jpeg.GetSize())
+        && server.Write("\r\n",2);
+      server.flush();
+      lastTimestamp = timestamp;
     }
+    MCUTime::Sleep(SNAPSHOT_INTERVAL_MS / 4);
+  }
 
-    width = (width/2)*2;
-    height = (height/2)*2;
-
-#if USE_LIBJPEG
-    struct my_jpeg_compress_struct cinfo;
-    cinfo.context = this;
-    struct jpeg_error_mgr jerr;
-
-    JSAMPROW row_pointer[1];
-    int row_stride;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-
-    PINDEX amount=width*height*3/2;
-    unsigned char *videoData=new unsigned char[amount];
-
-    jpegMixer->ReadMixedFrame((void*)videoData,width,height,amount);
-    PColourConverter * converter = PColourConverter::Create("YUV420P", "RGB24", width, height);
-    converter->SetDstFrameSize(width, height);
-    unsigned char * bitmap = new unsigned char[width*height*3];
-    converter->Convert(videoData,bitmap);
-    delete converter;
-    delete[] videoData;
-
-    jpeg_set_defaults(&cinfo);
-    cinfo.dest = new jpeg_destination_mgr;
-    cinfo.dest->init_destination = &jpeg_init_destination;
-    cinfo.dest->empty_output_buffer = &jpeg_empty_output_buffer;
-    cinfo.dest->term_destination = &jpeg_term_destination;
-    jpeg_start_compress(&cinfo,TRUE);
-    row_stride = cinfo.image_width * 3;
-    while (cinfo.next_scanline < cinfo.image_height)
-    { row_pointer[0] = (JSAMPLE *) & bitmap [cinfo.next_scanline * row_stride];
-      (void) jpeg_write_scanlines(&cinfo, row_pointer, 1);
-    }
-    jpeg_finish_compress(&cinfo);
-    delete[] bitmap; delete cinfo.dest; cinfo.dest=NULL;
-    jpeg_destroy_compress(&cinfo);
+  snapshotService->StopStream();
+  return TRUE;
+}
 
-#else
-    PINDEX buffer_size = width * height * 3 / 2;
-    MCUBuffer buffer(buffer_size);
-    jpegMixer->ReadMixedFrame(buffer.GetPointer(), width, height, buffer_size);
-
-    int dst_size = 65536;
-    jpegMixer->jpegSize = 0;
-    jpegMixer->myjpeg.SetSize(dst_size);
-    if(MCU_AVEncodeFrame(AV_CODEC_ID_MJPEG, buffer.GetPointer(), buffer_size, jpegMixer->myjpeg.GetPointer(), dst_size, width, height))
-      jpegMixer->jpegSize = dst_size;
-#endif
+///////////////////////////////////////////////////////////////
+
+TraceDumpHTTP::TraceDumpHTTP(OpenMCU & _app, PHTTPAuthority & auth)
+  : PServiceHTTPString("Trace", "", "text/plain; charset=utf-8", auth),
+    app(_app)
+{
+}
+
+BOOL TraceDumpHTTP::OnGET (PHTTPServer & server, const PURL &url, const PMIMEInfo & info, const PHTTPConnectionInfo & connectInfo)
+{
+  PHTTPRequest * req = CreateRequest(url, info, connectInfo.GetMultipartFormInfo(), server); // check authorization
+  if(!CheckAuthority(server, *req, connectInfo)) {delete req; return FALSE;}
+  delete req;
 
-    jpegMixer->jpegTime = t1;
+  unsigned seconds = 10;
+  PString request = url.AsString();
+  PINDEX q = request.Find("?");
+  if(q != P_MAX_INDEX)
+  {
+    PStringToString data;
+    PURL::SplitQueryVars(request.Mid(q+1, P_MAX_INDEX), data);
+    if(data.Contains("s"))
+      seconds = PMIN(data("s").AsUnsigned(), TRACE_HISTORY_SEC);
   }
 
+  PString dump = MCUTracer::Dump(seconds);
+
   PTime now;
   PStringStream message;
   message << "HTTP/1.1 200 OK\r\n"
@@ -2459,17 +2504,110 @@ BOOL JpegFrameHTTP::OnGET (PHTTPServer & server, const PURL &url, const PMIMEInf
           << "MIME-Version: 1.0\r\n"
           << "Cache-Control: no-cache, must-revalidate\r\n"
           << "Expires: Sat, 26 Jul 1997 05:00:00 GMT\r\n"
-          << "Content-Type: image/jpeg\r\n"
-          << "Content-Length: " << jpegMixer->jpegSize << "\r\n"
+          << "Content-Type: text/plain; charset=utf-8\r\n"
+          << "Content-Length: " << dump.GetLength() << "\r\n"
           << "Connection: Close\r\n"
-          << "\r\n";  //that's the last time we need to type \r\n instead of just \n
+          << "\r\n";
 
-  server.Write((const char*)message,message.GetLength());
-  server.Write(jpegMixer->myjpeg.GetPointer(),jpegMixer->jpegSize);
+  server.Write((const char*)message, message.GetLength());
+  server.Write((const char*)dump, dump.GetLength());
+  server.flush();
+
+  return TRUE;
+}
+
+///////////////////////////////////////////////////////////////
+
+ControlHTTP::ControlHTTP(OpenMCU & _app, PHTTPAuthority & auth)
+  : PServiceHTTPString("Control", "", "application/json", auth),
+    app(_app)
+{
+}
+
+BOOL ControlHTTP::OnGET (PHTTPServer & server, const PURL &url, const PMIMEInfo & info, const PHTTPConnectionInfo & connectInfo)
+{
+  PHTTPRequest * req = CreateRequest(url, info, connectInfo.GetMultipartFormInfo(), server); // check authorization
+  if(!CheckAuthority(server, *req, connectInfo)) {delete req; return FALSE;}
+  delete req;
+
+  PStringToString data;
+  PString request = url.AsString();
+  PINDEX q = request.Find("?");
+  if(q != P_MAX_INDEX)
+    PURL::SplitQueryVars(request.Mid(q+1, P_MAX_INDEX), data);
+
+  return Run(server, data("cmd"), data("atomic") == "1");
+}
+
+BOOL ControlHTTP::OnPOST(PHTTPServer & server, const PURL & url, const PMIMEInfo & info, const PStringToString & data, const PHTTPConnectionInfo & connectInfo)
+{
+  PHTTPRequest * req = CreateRequest(url, info, connectInfo.GetMultipartFormInfo(), server); // check authorization
+  if(!CheckAuthority(server, *req, connectInfo)) {delete req; return FALSE;}
+  delete req;
+
+  // a form with "cmd" or the lines as the body
+  PString text = data.Contains("cmd") ? data("cmd") : connectInfo.GetEntityBody();
+  BOOL atomic = (data("atomic") == "1") || (url.GetQueryVars()("atomic") == "1");
+  return Run(server, text, atomic);
+}
+
+BOOL ControlHTTP::Run(PHTTPServer & server, const PString & text, BOOL atomic)
+{
+  PString result;
+  BOOL ok = MCUControlEngine::Execute(text, atomic, result);
+
+  PTime now;
+  PStringStream message;
+  message << "HTTP/1.1 " << (ok ? "200 OK" : "409 Conflict") << "\r\n"
+          << "Date: " << now.AsString(PTime::RFC1123, PTime::GMT) << "\r\n"
+          << "Server: " << PRODUCT_NAME_TEXT << "\r\n"
+          << "MIME-Version: 1.0\r\n"
+          << "Cache-Control: no-cache, must-revalidate\r\n"
+          << "Expires: Sat, 26 Jul 1997 05:00:00 GMT\r\n"
+          << "Content-Type: application/json\r\n"
+          << "Content-Length: " << result.GetLength() << "\r\n"
+          << "Connection: Close\r\n"
+          << "\r\n";
+
+  server.Write((const char*)message, message.GetLength());
+  server.Write((const char*)result, result.GetLength());
   server.flush();
 
-  // unlock mixer
-  jpegMixer->Unlock();
+  return TRUE;
+}
+
+///////////////////////////////////////////////////////////////
+
+MetricsHTTP::MetricsHTTP(OpenMCU & _app, PHTTPAuthority & auth)
+  : PServiceHTTPString("Metrics", "", "text/plain; version=0.0.4", auth),
+    app(_app)
+{
+}
+
+BOOL MetricsHTTP::OnGET (PHTTPServer & server, const PURL &url, const PMIMEInfo & info, const PHTTPConnectionInfo & connectInfo)
+{
+  PHTTPRequest * req = CreateRequest(url, info, connectInfo.GetMultipartFormInfo(), server); // check authorization
+  if(!CheckAuthority(server, *req, connectInfo)) {delete req; return FALSE;}
+  delete req;
+
+  PString result = MCUMetrics::Render();
+
+  PTime now;
+  PStringStream message;
+  message << "HTTP/1.1 200 OK\r\n"
+          << "Date: " << now.AsString(PTime::RFC1123, PTime::GMT) << "\r\n"
+          << "Server: " << PRODUCT_NAME_TEXT << "\r\n"
+          << "MIME-Version: 1.0\r\n"
+          << "Cache-Control: no-cache, must-revalidate\r\n"
+          << "Expires: Sat, 26 Jul 1997 05:00:00 GMT\r\n"
+          << "Content-Type: text/plain; version=0.0.4\r\n"
+          << "Content-Length: " << result.GetLength() << "\r\n"
+          << "Connection: Close\r\n"
+          << "\r\n";
+
+  server.Write((const char*)message, message.GetLength());
+  server.Write((const char*)result, result.GetLength());
+  server.flush();
 
   return TRUE;
 }
@@ -909,55 +909,57 @@ class SectionPConfigPage : public DefaultPConfigPage
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// room preview from the snapshot service, Jpeg?room=<room>&mixer=<n>&w=<width>&h=<height>,
+// with &stream=1 the previews are sent as multipart/x-mixed-replace (MJPEG)
 class JpegFrameHTTP : public PServiceHTTPString
 {
   public:
     JpegFrameHTTP(OpenMCU & app, PHTTPAuthority & auth);
     BOOL OnGET (PHTTPServer & server, const PURL &url, const PMIMEInfo & info, const PHTTPConnectionInfo & connectInfo);
 
-#if USE_LIBJPEG
-    struct my_jpeg_compress_struct : jpeg_compress_struct
-    {
-      JpegFrameHTTP *context;
-    };
+  private:
+    BOOL OnStream(PHTTPServer & server, const PString & room, long mixer, unsigned width, unsigned height);
+    OpenMCU & app;
+};
 
-    static void jpeg_init_destination(struct jpeg_compress_struct *cinfo)
-    {
-      MCUSimpleVideoMixer *jpegMixer = JpegFrameHTTP::GetMixer(cinfo);
-      if(jpegMixer->myjpeg.GetSize() < 32768)
-        jpegMixer->myjpeg.SetSize(32768);
-      cinfo->dest->next_output_byte = &jpegMixer->myjpeg[0];
-      cinfo->dest->free_in_buffer = jpegMixer->myjpeg.GetSize();
-    }
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    static boolean jpeg_empty_output_buffer(struct jpeg_compress_struct *cinfo)
-    {
-      MCUSimpleVideoMixer *jpegMixer = JpegFrameHTTP::GetMixer(cinfo);
-      PINDEX oldsize = jpegMixer->myjpeg.GetSize();
-      jpegMixer->myjpeg.SetSize(oldsize + 16384);
-      cinfo->dest->next_output_byte = &jpegMixer->myjpeg[oldsize];
-      cinfo->dest->free_in_buffer = jpegMixer->myjpeg.GetSize() - oldsize;
-      return true;
-    }
+// recent MCUTRACE records, Trace?s=<seconds>
+class TraceDumpHTTP : public PServiceHTTPString
+{
+  public:
+    TraceDumpHTTP(OpenMCU & app, PHTTPAuthority & auth);
+    BOOL OnGET (PHTTPServer & server, const PURL &url, const PMIMEInfo & info, const PHTTPConnectionInfo & connectInfo);
+  private:
+    OpenMCU & app;
+};
 
-    static void jpeg_term_destination(struct jpeg_compress_struct *cinfo)
-    {
-      MCUSimpleVideoMixer *jpegMixer = JpegFrameHTTP::GetMixer(cinfo);
-      jpegMixer->jpegSize = jpegMixer->myjpeg.GetSize() - cinfo->dest->free_in_buffer;
-      jpegMixer->jpegTime = (long)time(0);
-    }
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    static MCUSimpleVideoMixer * GetMixer(struct jpeg_compress_struct *cinfo)
-    {
-      my_jpeg_compress_struct *my_cinfo = static_cast<my_jpeg_compress_struct *>(cinfo);
-      return my_cinfo->context->jpegMixer;
-    }
-#endif
+// control commands of MCUControlEngine, Control?cmd=<lines>[&atomic=1] or the lines in the body of POST,
+// the response is a JSON array with an object for every command
+class ControlHTTP : public PServiceHTTPString
+{
+  public:
+    ControlHTTP(OpenMCU & app, PHTTPAuthority & auth);
+    BOOL OnGET (PHTTPServer & server, const PURL &url, const PMIMEInfo & info, const PHTTPConnectionInfo & connectInfo);
+    BOOL OnPOST(PHTTPServer & server, const PURL & url, const PMIMEInfo & info, const PStringToString & data, const PHTTPConnectionInfo & connectInfo);
+  protected:
+    BOOL Run(PHTTPServer & server, const PString & text, BOOL atomic);
+  private:
+    OpenMCU & app;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// counters, gauges and histograms in the Prometheus text format, see MCUMetrics
+class MetricsHTTP : public PServiceHTTPString
+{
+  public:
+    MetricsHTTP(OpenMCU & app, PHTTPAuthority & auth);
+    BOOL OnGET (PHTTPServer & server, const PURL &url, const PMIMEInfo & info, const PHTTPConnectionInfo & connectInfo);
   private:
     OpenMCU & app;
-    PMutex jpegMixerMutex;
-    MCUSimpleVideoMixer *jpegMixer;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -2,6 +2,9 @@
 #include "precompile.h"
 #include "mcu.h"
 #include "yuv.h"
+#if MCU_BENCHMARK_TOOL
+#include "benchmark.h"
+#endif
 
 extern unsigned char preMediaFrameData[];
 unsigned char
@@ -168,7 +171,12 @@ void * MyMCU::LoadFrame(PString fileName, unsigned & width, unsigned & height, B
 
 #endif // MCU_VIDEO
 
+#if MCU_BENCHMARK_TOOL
+typedef MCUBenchmarkProcess<MyMCU> MyMCUBenchmark;
+PCREATE_PROCESS(MyMCUBenchmark);
+#else
 PCREATE_PROCESS(MyMCU);
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 
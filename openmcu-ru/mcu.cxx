@@ -58,6 +58,9 @@ OpenMCU::OpenMCU()
   sipendpoint       = NULL;
   rtspServer        = NULL;
   registrar         = NULL;
+#if MCU_SOCKET_REACTOR
+  socketReactor     = NULL;
+#endif
   currentLogLevel   = -1;
   currentTraceLevel = -1;
   traceFileRotated  = FALSE;
@@ -68,6 +71,7 @@ OpenMCU::OpenMCU()
 
   httpBufferIndex = 0;
   httpBufferComplete = 0;
+  httpListenerEnabled = TRUE;
 
   uniqueMemberID = 1000;
 }
@@ -103,8 +107,13 @@ BOOL OpenMCU::OnStart()
   endpoint = new MCUH323EndPoint(*manager);
   sipendpoint = new MCUSipEndPoint(endpoint);
   registrar = new Registrar(endpoint, sipendpoint);
+#if MCU_SOCKET_REACTOR
+  // before the first listener
+  socketReactor = new MCUSocketReactor();
+#endif
   rtspServer = new MCURtspServer(endpoint, sipendpoint);
   telnetServer = new MCUTelnetServer();
+  snapshotService = new MCUSnapshotService();
 
   //
   httpNameSpace.AddResource(new PHTTPDirectory("data", "data"));
@@ -129,8 +138,15 @@ void OpenMCU::OnStop()
   // telnet
   delete telnetServer;
 
+  // room previews, after the http threads, new clients are refused and the destructor waits
+  // for the clients left
+  MCUSnapshotService *service = snapshotService;
+  snapshotService = NULL;
+  delete service;
+
   // close endpoints listeners
   rtspServer->RemoveListeners();
+  rtspServer->RemoveFanouts();
   //sipendpoint->RemoveListeners();
   endpoint->RemoveListener(NULL);
 
@@ -161,9 +177,18 @@ void OpenMCU::OnStop()
   delete registrar;
   registrar = NULL;
 
+#if MCU_SOCKET_REACTOR
+  // after all listeners
+  delete socketReactor;
+  socketReactor = NULL;
+#endif
+
   delete manager;
   manager = NULL;
 
+  // flush the trace rings, further records are written synchronously
+  MCUTracer::Stop();
+
 #ifndef _WIN32
   CommonDestruct(); // save config
 #endif
@@ -316,6 +341,9 @@ BOOL OpenMCU::Initialise(const char * initMsg)
   CreateHTTPResource("Records");
   CreateHTTPResource("Jpeg");
   CreateHTTPResource("Comm");
+  CreateHTTPResource("Trace");
+  CreateHTTPResource("Metrics");
+  CreateHTTPResource("Control");
 
   CreateHTTPResource("welcome.html");
   CreateHTTPResource("monitor.txt");
@@ -390,7 +418,11 @@ BOOL OpenMCU::Initialise(const char * initMsg)
   // set up the HTTP port for listening & start the first HTTP thread
   PString ip = cfg.GetString(HttpIPKey, "0.0.0.0");
   WORD port = cfg.GetInteger(HttpPortKey, DefaultHTTPPort);
-  if(MCUHTTPListenerCreate(ip, port))
+  if(!httpListenerEnabled)
+  {
+    PTRACE(0, trace_section << "HTTP listener is disabled");
+  }
+  else if(MCUHTTPListenerCreate(ip, port))
   {
     PSYSTEMLOG(Info, "Opened master socket for HTTP: " << ip << ":" << port);
     PTRACE(0, trace_section << "Opened master socket for HTTP: " << ip << ":" << port);
@@ -510,6 +542,12 @@ void OpenMCU::CreateHTTPResource(const PString & name)
     httpNameSpace.AddResource(new JpegFrameHTTP(*this, authConference), PHTTPSpace::Overwrite);
   else if(name == "Comm")
     httpNameSpace.AddResource(new InteractiveHTTP(*this, authConference), PHTTPSpace::Overwrite);
+  else if(name == "Trace")
+    httpNameSpace.AddResource(new TraceDumpHTTP(*this, authSettings), PHTTPSpace::Overwrite);
+  else if(name == "Metrics")
+    httpNameSpace.AddResource(new MetricsHTTP(*this, authSettings), PHTTPSpace::Overwrite);
+  else if(name == "Control")
+    httpNameSpace.AddResource(new ControlHTTP(*this, authConference), PHTTPSpace::Overwrite);
 
   else if(name == "welcome.html")
     httpNameSpace.AddResource(new WelcomePage(*this, authConference), PHTTPSpace::Overwrite);
@@ -674,11 +712,12 @@ void OpenMCU::MCUHTTPListenerShutdown()
   if(httpListeningSocket == NULL)
     return;
 
-  if(!httpListeningSocket->IsOpen())
-    return;
-
-  PTRACE(0, trace_section << "Closing listener socket");
-  httpListeningSocket->Close();
+  // the threads of a socket closed before can still serve requests
+  if(httpListeningSocket->IsOpen())
+  {
+    PTRACE(0, trace_section << "Closing listener socket");
+    httpListeningSocket->Close();
+  }
 
   httpThreadsMutex.Wait();
   int threshold = 0;
@@ -759,104 +798,12 @@ void OpenMCU::PrintOnStartInfo()
 
 BOOL OpenMCU::OTFControl(const PString & data, PString & rdata)
 {
-  PStringToString command;
-  command.SetAt("v", "0");
-  PStringArray tokens = data.Tokenise(" ");
-  if(tokens[0] == "?")
-  {
-    rdata = "room 'name' ...\r\n"
-            "show ...\r\n"
-            ;
-    return TRUE;
-  }
-  if(tokens[0] == "room")
-  {
-    if(tokens[1] == "?" || tokens.GetSize() < 3)
-    {
-      rdata = "room 'name' ...\r\n"
-              "            create\r\n"
-              "            delete\r\n"
-              "            dial 'id'\r\n"
-              "            invite 'address'\r\n"
-              "            drop 'id'\r\n"
-              "            show members\r\n"
-              "            start_recorder\r\n"
-              "            stop_recorder\r\n"
-              ;
-      return TRUE;
-    }
-    command.SetAt("room", tokens[1]);
-    if(tokens[2] == "create")
-    {
-      command.SetAt("action", OTFC_ROOM_CREATE);
-      return OTFControl(command, rdata);
-    }
-    if(tokens[2] == "delete")
-    {
-      command.SetAt("action", OTFC_ROOM_DELETE);
-      return OTFControl(command, rdata);
-    }
-    if(tokens[2] == "dial")
-    {
-      command.SetAt("action", OTFC_DIAL);
-      command.SetAt("v", tokens[3]);
-      return OTFControl(command, rdata);
-    }
-    if(tokens[2] == "invite")
-    {
-      command.SetAt("action", OTFC_INVITE);
-      command.SetAt("v", tokens[3]);
-      return OTFControl(command, rdata);
-    }
-    if(tokens[2] == "drop")
-    {
-      command.SetAt("action", OTFC_DROP_MEMBER);
-      command.SetAt("v", PString(tokens[3]));
-      return OTFControl(command, rdata);
-    }
-    if(tokens[2] == "show")
-    {
-      if(tokens[3] == "members")
-      {
-        command.SetAt("action", OTFC_ROOM_SHOW_MEMBERS);
-        return OTFControl(command, rdata);
-      }
-      return FALSE;
-    }
-    if(tokens[2] == "start_recorder")
-    {
-      command.SetAt("action", OTFC_VIDEO_RECORDER_START);
-      return OTFControl(command, rdata);
-    }
-    if(tokens[2] == "stop_recorder")
-    {
-      command.SetAt("action", OTFC_VIDEO_RECORDER_STOP);
-      return OTFControl(command, rdata);
-    }
-  }
-  if(tokens[0] == "show")
-  {
-    if(tokens[1] == "?")
-    {
-      rdata = "show ...\r\n"
-              "     registrar ...\r\n"
-              "               accounts\r\n"
-              ;
-      return TRUE;
-    }
-    if(tokens[1] == "registrar")
-    {
-      if(tokens[2] == "accounts")
-      {
-        command.SetAt("action", OTFC_SHOW_REGISTRAR_ACCOUNTS);
-        return OTFControl(command, rdata);
-      }
-      return FALSE;
-    }
+  // console commands, see MCUControlEngine
+  MCUControlCommand command;
+  PString error;
+  if(!MCUControlEngine::Parse(data, command, error))
     return FALSE;
-  }
-
-  return FALSE;
+  return MCUControlEngine::Execute(command, rdata);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -983,9 +930,7 @@ BOOL OpenMCU::OTFControl(const PStringToString & data, PString & rdata)
       HttpWriteCmdRoom("r_moder()",room);
     }
 
-    conference->confTpl = conference->ExtractTemplate(value);
-    conference->LoadTemplate(conference->confTpl);
-    conference->SetLastUsedTemplate(value);
+    conference->ApplyTemplate(value);
     PStringStream msg;
     msg << endpoint->GetMemberListOptsJavascript(*conference) << "\n"
         << "p." << endpoint->GetConferenceOptsJavascript(*conference) << "\n"
@@ -1002,9 +947,7 @@ BOOL OpenMCU::OTFControl(const PStringToString & data, PString & rdata)
     if(templateName=="") return FALSE;
     if(templateName.Right(1) == "*") templateName=templateName.Left(templateName.GetLength()-1).RightTrim();
     if(templateName=="") return FALSE;
-    conference->confTpl = conference->SaveTemplate(templateName);
-    conference->TemplateInsertAndRewrite(templateName, conference->confTpl);
-    conference->LoadTemplate(conference->confTpl);
+    conference->SaveTemplate(templateName);
     PStringStream msg;
     msg << endpoint->GetMemberListOptsJavascript(*conference) << "\n"
         << "p." << endpoint->GetConferenceOptsJavascript(*conference) << "\n"
@@ -1021,8 +964,6 @@ BOOL OpenMCU::OTFControl(const PStringToString & data, PString & rdata)
     if(templateName=="") return FALSE;
     if(templateName.Right(1) == "*") return FALSE;
     conference->DeleteTemplate(templateName);
-    conference->LoadTemplate("");
-    conference->SetLastUsedTemplate("");
     PStringStream msg;
     msg << endpoint->GetMemberListOptsJavascript(*conference) << "\n"
         << "p." << endpoint->GetConferenceOptsJavascript(*conference) << "\n"
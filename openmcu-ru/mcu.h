@@ -16,6 +16,10 @@
 #include "mcu_codecs.h"
 #include "sockets.h"
 #include "telnet.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "control.h"
+#include "status.h"
 
 #if P_SSL
 typedef PSecureHTTPServiceProcess OpenMCUProcessAncestor;
@@ -183,6 +187,7 @@ static const char BandwidthFromKey[]       = "Bandwidth from MCU";
 static const char BandwidthToKey[]         = "Bandwidth to MCU";
 static const char FrameRateFromKey[]       = "Frame rate from MCU";
 static const char VideoCacheKey[]          = "Video cache";
+static const char RtspFanoutKey[]          = "Cache fan-out";
 
 static const char OPTION_FRAME_TIME[] = "Frame Time";
 static const char OPTION_FRAME_RATE[] = "Frame Rate";
@@ -192,7 +197,10 @@ static const char OPTION_MAX_BIT_RATE[] = "Max Bit Rate";
 static const char OPTION_ENCODER_QUALITY[] = "Encoding Quality";
 static const char OPTION_ENCODER_CHANNELS[] = "Encoder Channels";
 static const char OPTION_DECODER_CHANNELS[] = "Decoder Channels";
+static const char OPTION_DECODER_THREADS[] = "Decoding Threads";
+static const char OPTION_DECODER_THREAD_TYPE[] = "Decoding Thread Type";
 static const char OPTION_TX_KEY_FRAME_PERIOD[] = "Tx Key Frame Period";
+static const char OPTION_TEMPORAL_LAYERS[] = "Temporal Layers";
 
 static const char VideoScaleFilterKey[] = "Video scale filter";
 
@@ -259,6 +267,8 @@ static PString MCUControlCodes = "NO ACTION,"
 #define OTFC_REMOVE_OFFLINE_MEMBER    33
 #define OTFC_DIAL                     34
 #define OTFC_CHAT                     35
+#define OTFC_MOVE_MEMBER              36
+#define OTFC_RTP_CAPTURE              37
 #define OTFC_DROP_ALL_ACTIVE_MEMBERS  64
 #define OTFC_INVITE_ALL_INACT_MMBRS   65
 #define OTFC_REMOVE_ALL_INACT_MMBRS   66
@@ -386,6 +396,14 @@ class OpenMCU : public OpenMCUPreInit, public OpenMCUProcessAncestor
     MCUTelnetServer *GetTelnetServer()
     { return telnetServer; }
 
+#if MCU_SOCKET_REACTOR
+    MCUSocketReactor *GetSocketReactor()
+    { return socketReactor; }
+#endif
+
+    MCUSnapshotService *GetSnapshotService()
+    { return snapshotService; }
+
     const PString & GetServerId() const
     { return serverId; }
 
@@ -404,6 +422,12 @@ class OpenMCU : public OpenMCUPreInit, public OpenMCUProcessAncestor
     BOOL OTFControl(const PStringToString & data, PString & rdata);
     BOOL OTFControl(const PString & data, PString & rdata);
 
+    PMutex & GetOTFCMutex()
+    { return otfcMutex; }
+
+    MCUStatusCache & GetStatusCache()
+    { return statusCache; }
+
     int GetHttpBuffer() const { return httpBuffer; }
 
     virtual void HttpWrite_(PString evt) {
@@ -419,12 +443,14 @@ class OpenMCU : public OpenMCUPreInit, public OpenMCUProcessAncestor
       if(copyWebLogToLog) LogMessageHTML(evt0);
     }
     virtual void HttpWriteEventRoom(PString evt, PString room){
+      statusCache.OnRoomChanged(room);
       PString evt0; PTime now;
       evt0 += room + "\t" + now.AsString("h:mm:ss. ", PTime::Local) + evt;
       HttpWrite_(evt0+"<br>\n");
       if(copyWebLogToLog) LogMessageHTML(evt0);
     }
     virtual void HttpWriteCmdRoom(PString evt, PString room){
+      statusCache.OnRoomChanged(room);
       PStringStream evt0;
       evt0 << room << "\t<script>p." << evt << "</script>\n";
       HttpWrite_(evt0);
@@ -602,6 +628,8 @@ class OpenMCU : public OpenMCUPreInit, public OpenMCUProcessAncestor
     BOOL MCUHTTPListenerCreate(const PString & ip, unsigned port);
     void MCUHTTPListenerShutdown();
     void MCUHTTPListenerDelete();
+    // the benchmark tool runs the MCU without the web interface
+    BOOL httpListenerEnabled;
 
     void InitialiseTrace();
     int currentLogLevel, currentTraceLevel;
@@ -621,6 +649,10 @@ class OpenMCU : public OpenMCUPreInit, public OpenMCUProcessAncestor
     Registrar *registrar;
     MCURtspServer *rtspServer;
     MCUTelnetServer *telnetServer;
+    MCUSnapshotService *snapshotService;
+#if MCU_SOCKET_REACTOR
+    MCUSocketReactor *socketReactor;
+#endif
 
     PString    serverId;
     PString    defaultRoomName;
@@ -641,6 +673,8 @@ class OpenMCU : public OpenMCUPreInit, public OpenMCUProcessAncestor
     PMutex     httpBufferMutex;
     PMutex otfcMutex;
 
+    MCUStatusCache statusCache;
+
 #if MCU_VIDEO
     int scaleFilterType;
 #endif
@@ -29,7 +29,19 @@ MCUFramedAudioCodec::MCUFramedAudioCodec(const OpalMediaFormat & fmt, Direction
     channels = mediaFormat.GetOptionInteger(OPTION_ENCODER_CHANNELS, 1);
   bytesPerFrame = mediaFormat.GetFrameSize();
 
-  sampleBuffer = PShortArray(samplesPerFrame * channels);
+  sequenceValid = FALSE;
+  lastSequenceNumber = 0;
+  coveredFrames = 0;
+  lostFrames = 0;
+  nextFrame = NULL;
+  framesConcealed = 0;
+  framesRecovered = 0;
+
+  // decoder output has room for the lost frames filled in ahead of the packet
+  if(direction == Decoder)
+    sampleBuffer = PShortArray(samplesPerFrame * channels * (1 + AUDIO_MAX_LOST_FRAMES));
+  else
+    sampleBuffer = PShortArray(samplesPerFrame * channels);
 
   if(context == NULL)
   {
@@ -100,16 +112,105 @@ BOOL MCUFramedAudioCodec::DecodeFrame(const BYTE * buffer, unsigned length, unsi
     return FALSE;
 
   unsigned flags = 0;
+  if(lostFrames > 0)
+    flags = PluginCodec_CoderPacketLoss | (lostFrames << PluginCodec_CoderLostFramesPos);
+
   if((codec->codecFunction)(codec, context, buffer, &length, (unsigned char *)sampleBuffer.GetPointer(),
                             &bytesDecoded, &flags) == 0)
     return FALSE;
 
+  // decoders without loss recovery leave the flags alone, the gap stays in the output
+  if(lostFrames > 0 && (flags & PluginCodec_ReturnCoderLostFrames) != 0)
+  {
+    unsigned filled = (flags & PluginCodec_CoderLostFramesMask) >> PluginCodec_CoderLostFramesPos;
+    if((flags & PluginCodec_ReturnCoderRecovered) != 0 && filled > 0)
+    {
+      framesRecovered++;
+      filled--;
+    }
+    framesConcealed += filled;
+    PTRACE(6, "MCUFramedAudioCodec\tLost " << lostFrames << " frames, concealed " << filled
+              << ((flags & PluginCodec_ReturnCoderRecovered) != 0 ? ", recovered 1" : ""));
+  }
+
   written = length;
   return TRUE;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+unsigned MCUFramedAudioCodec::GetLostFrames(const RTP_DataFrame & rtpFrame)
+{
+  WORD sequenceNumber = rtpFrame.GetSequenceNumber();
+  // the silence frames written since the previous packet
+  unsigned covered = coveredFrames;
+  coveredFrames = 0;
+
+  if(!sequenceValid)
+  {
+    sequenceValid = TRUE;
+    lastSequenceNumber = sequenceNumber;
+    return 0;
+  }
+
+  // next frame of the same packet
+  if(sequenceNumber == lastSequenceNumber)
+    return 0;
+
+  // late packet, already concealed
+  if((WORD)(lastSequenceNumber - sequenceNumber) <= AUDIO_MAX_LOST_FRAMES)
+    return 0;
+
+  WORD gap = sequenceNumber - lastSequenceNumber - 1;
+  lastSequenceNumber = sequenceNumber;
+  if(gap > AUDIO_MAX_LOST_FRAMES)
+    return 0;
+  // the jitter buffer has played silence in place of the lost packets,
+  // a frame filled in now would be heard twice and delay the playout
+  if(gap <= covered)
+    return 0;
+  return gap - covered;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUFramedAudioCodec::ConcealFrame(unsigned length)
+{
+  const RTP_DataFrame * next = nextFrame;
+  nextFrame = NULL;
+  if(!CanConcealFrames() || direction != Decoder)
+    return FALSE;
+
+  // the in-band FEC of a packet carries the one before it, the slot is the latest one covered
+  static const BYTE empty = 0;
+  const BYTE * data = &empty;
+  unsigned dataLength = 0;
+  if(next != NULL && next->GetPayloadSize() > 0 && next->GetSequenceNumber() == (WORD)(lastSequenceNumber + coveredFrames + 1))
+  {
+    data = next->GetPayloadPtr();
+    dataLength = next->GetPayloadSize();
+  }
+
+  unsigned flags = PluginCodec_CoderConcealFrame;
+  unsigned output = length;
+  if((codec->codecFunction)(codec, context, data, &dataLength, (unsigned char *)sampleBuffer.GetPointer(), &output, &flags) == 0)
+    return FALSE;
+  if((flags & PluginCodec_ReturnCoderLostFrames) == 0 || output == 0)
+    return FALSE;
+
+  if((flags & PluginCodec_ReturnCoderRecovered) != 0)
+    framesRecovered++;
+  else
+    framesConcealed++;
+  if(output < length)
+    memset((BYTE *)sampleBuffer.GetPointer() + output, 0, length - output);
+  PTRACE(6, "MCUFramedAudioCodec\tLost slot " << (WORD)(lastSequenceNumber + coveredFrames)
+            << ((flags & PluginCodec_ReturnCoderRecovered) != 0 ? " recovered" : " concealed"));
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 BOOL MCUFramedAudioCodec::DetectSilence(){ return FALSE; }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -187,7 +288,7 @@ BOOL MCUFramedAudioCodec::Read(BYTE * buffer, unsigned & length, RTP_DataFrame &
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-BOOL MCUFramedAudioCodec::Write(const BYTE * buffer, unsigned length, const RTP_DataFrame & /*rtpFrame*/, unsigned & written)
+BOOL MCUFramedAudioCodec::Write(const BYTE * buffer, unsigned length, const RTP_DataFrame & rtpFrame, unsigned & written)
 {
   PWaitAndSignal mutex(rawChannelMutex);
 
@@ -209,17 +310,34 @@ BOOL MCUFramedAudioCodec::Write(const BYTE * buffer, unsigned length, const RTP_
       length = bytesPerFrame;
     written = bytesPerFrame;
 
+    // The decoder may output the lost frames ahead of this packet
+    unsigned bytesOutput = sampleBuffer.GetSize() * 2;
+    lostFrames = GetLostFrames(rtpFrame);
+
     // Decode the data
-    if(!DecodeFrame(buffer, length, written, bytesDecoded))
+    if(!DecodeFrame(buffer, length, written, bytesOutput))
     {
       written = length;
       length = 0;
     }
+    else
+      bytesDecoded = bytesOutput;
   }
 
   // was memset(sampleBuffer.GetPointer(samplesPerFrame), 0, bytesDecoded);
   if(length == 0)
-    DecodeSilenceFrame(sampleBuffer.GetPointer(bytesDecoded), bytesDecoded);
+  {
+    // the slot of a packet that has not arrived, DTX or loss, concealed by the decoder if it can
+    BOOL concealed = FALSE;
+    if(buffer == NULL && sequenceValid)
+    {
+      coveredFrames++;
+      concealed = ConcealFrame(bytesDecoded);
+    }
+    nextFrame = NULL;
+    if(!concealed)
+      DecodeSilenceFrame(sampleBuffer.GetPointer(bytesDecoded), bytesDecoded);
+  }
 
   // Write as 16bit PCM to sound channel
   if(IsRawDataHeld)
@@ -578,6 +696,10 @@ MCUVideoCodec::MCUVideoCodec(const OpalMediaFormat & fmt, Direction direction, P
   lastFrameTimeRTP = 0;
   sendIntra = true;
   converter = NULL;
+  encodeMetric = NULL;
+  encodeUsec = 0;
+  // the encoders that declare the option get the changed regions of each frame
+  damagedRegions = (direction == Encoder && mediaFormat.HasOption(PLUGINCODEC_OPTION_DAMAGED_REGIONS));
 
   // Need to allocate buffer to the maximum framesize statically
   // and clear the memory in the destructor to avoid segfault in destructor
@@ -601,6 +723,19 @@ MCUVideoCodec::MCUVideoCodec(const OpalMediaFormat & fmt, Direction direction, P
       list += option.AsString();
       PTRACE(5, "OpalPlugin\tSetting codec option '" << option.GetName() << "'=" << option.AsString());
     }
+    if(direction == Decoder)
+    {
+      // decoders that support it return references to their own picture
+      list += PLUGINCODEC_OPTION_OUTPUT_PLANES;
+      list += "1";
+      // threading from the video settings page, 0 - auto
+      PString pluginName = GetPluginName(mediaFormat);
+      MCUConfig cfg("Video");
+      list += OPTION_DECODER_THREADS;
+      list += PString(cfg.GetInteger(pluginName+" "+OPTION_DECODER_THREADS, 0));
+      list += OPTION_DECODER_THREAD_TYPE;
+      list += cfg.GetString(pluginName+" "+OPTION_DECODER_THREAD_TYPE, "slice");
+    }
     char ** _options = list.ToCharArray();
     unsigned int optionsLen = sizeof(_options);
     (*ctl->control)(codec, context, SET_CODEC_OPTIONS_CONTROL, _options, &optionsLen);
@@ -718,6 +853,14 @@ BOOL MCUVideoCodec::Read(BYTE * buffer, unsigned & length, RTP_DataFrame & dst,
 
     videoIn->EnableAccess();
 
+    if(damagedRegions)
+    {
+      PVideoInputDevice * grabber = videoIn->GetVideoReader();
+      if(grabber != NULL && PIsDescendant(grabber, MCUPVideoInputDevice))
+        SetCodecControl(codec, context, SET_CODEC_OPTIONS_CONTROL, PLUGINCODEC_OPTION_DAMAGED_REGIONS,
+                        ((MCUPVideoInputDevice *)grabber)->GetDamagedRegions());
+    }
+
     RenderFrame(data);
 
     PTimeInterval now = PTimer::Tick();
@@ -743,7 +886,18 @@ BOOL MCUVideoCodec::Read(BYTE * buffer, unsigned & length, RTP_DataFrame & dst,
   flags = sendIntra ? PluginCodec_CoderForceIFrame : 0;
   int retval = 0;
 
+  uint64_t encodeStart = encodeMetric ? MCUTime::GetMonoTimestampUsec() : 0;
   retval = (codec->codecFunction)(codec, context, bufferRTP.GetPointer(), &fromLen, dst.GetPointer(), &toLen, &flags);
+  if(encodeMetric)
+  {
+    // the frame is encoded on the first call, the next calls return its packets
+    encodeUsec += MCUTime::GetMonoTimestampUsec() - encodeStart;
+    if(flags & PluginCodec_ReturnCoderLastFrame)
+    {
+      encodeMetric->Observe(encodeUsec);
+      encodeUsec = 0;
+    }
+  }
 
   if(retval == 0 && codec != NULL)
   {
@@ -816,7 +970,9 @@ BOOL MCUVideoCodec::Write(const BYTE * buffer, unsigned length, const RTP_DataFr
   if(flags & PluginCodec_ReturnCoderRequestIFrame)
   {
     PTRACE(6,"MCUVideoCodec\tIFrame Request Decoder: Unimplemented.");
-    ((MCU_RTPChannel *)logicalChannel)->SendMiscCommand(H245_MiscellaneousCommand_type::e_videoFastUpdatePicture);
+    // no channel in a replay
+    if(logicalChannel)
+      ((MCU_RTPChannel *)logicalChannel)->SendMiscCommand(H245_MiscellaneousCommand_type::e_videoFastUpdatePicture);
   }
 
   if(toLen < (unsigned)bufferRTP.GetHeaderSize())
@@ -838,7 +994,10 @@ BOOL MCUVideoCodec::Write(const BYTE * buffer, unsigned length, const RTP_DataFr
   if(flags & PluginCodec_ReturnCoderLastFrame)
   {
     SetFrameSize(frameHeader->width, frameHeader->height);
-    RenderFrame(OPAL_VIDEO_FRAME_DATA_PTR(frameHeader));
+    if(flags & PluginCodec_ReturnCoderPlanes)
+      RenderFramePlanes((const PluginCodec_Video_FramePlanes *)OPAL_VIDEO_FRAME_DATA_PTR(frameHeader));
+    else
+      RenderFrame(OPAL_VIDEO_FRAME_DATA_PTR(frameHeader));
   }
 
   written = length;
@@ -864,6 +1023,24 @@ BOOL MCUVideoCodec::RenderFrame(const BYTE * buffer)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+BOOL MCUVideoCodec::RenderFramePlanes(const PluginCodec_Video_FramePlanes * framePlanes)
+{
+  PVideoChannel *videoOut = (PVideoChannel *)rawDataChannel;
+
+  if(!videoOut->IsRenderOpen())
+    return TRUE;
+
+  // the planes belong to the decoder, hand them to the connection without a packed copy
+  MCUPVideoOutputDevice *display = (MCUPVideoOutputDevice *)videoOut->GetVideoPlayer();
+  if(display == NULL)
+    return FALSE;
+
+  PTRACE(9, "MCUVideoCodec\tWrite planes to video renderer");
+  return display->SetFramePlanes(frameWidth, frameHeight, MCUPlanesYUV(framePlanes->data, framePlanes->linesize));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 BOOL MCUVideoCodec::SetFrameSize(int _width, int _height)
 {
   if(frameWidth == _width && frameHeight == _height)
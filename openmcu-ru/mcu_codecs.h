@@ -5,6 +5,7 @@
 #define _MCU_CODECS_H
 
 #include "utils.h"
+#include "metrics.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -14,6 +15,10 @@ static const char GET_OUTPUT_DATA_SIZE_CONTROL[] = "get_output_data_size";
 static const char SET_CODEC_OPTIONS_CONTROL[]    = "set_codec_options";
 static const char EVENT_CODEC_CONTROL[]          = "event_codec";
 
+// Longest sequence gap filled in by the audio decoder, larger gaps are
+// treated as a stream restart
+#define AUDIO_MAX_LOST_FRAMES 5
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 inline static BOOL CallCodecControl(PluginCodec_Definition * defn, void * context, const char * name, void * parm, unsigned int * parmLen, int & retVal)
@@ -231,7 +236,25 @@ class MCUFramedAudioCodec : public H323AudioCodec
     MCU_RTPChannel * GetLogicalChannel()
     { return (MCU_RTPChannel *)logicalChannel; }
 
+    // Lost frames concealed by the decoder (PLC) and recovered from in-band FEC
+    unsigned GetFramesConcealed() const
+    { return framesConcealed; }
+
+    unsigned GetFramesRecovered() const
+    { return framesRecovered; }
+
+    // The decoder conceals the slots of the lost packets played by the jitter buffer
+    BOOL CanConcealFrames() const
+    { return codec != NULL && (codec->flags & PluginCodec_DecodeLost) != 0; }
+
+    // The packet queued after the next empty slot written, its in-band FEC may restore the slot
+    void SetNextFrame(const RTP_DataFrame * frame)
+    { nextFrame = frame; }
+
   protected:
+    unsigned GetLostFrames(const RTP_DataFrame & rtpFrame);
+    BOOL ConcealFrame(unsigned length);
+
     void * context;
     PluginCodec_Definition * codec;
 
@@ -239,6 +262,15 @@ class MCUFramedAudioCodec : public H323AudioCodec
     unsigned bytesPerFrame;
     unsigned sampleRate;
     unsigned channels;
+
+    BOOL sequenceValid;
+    WORD lastSequenceNumber;
+    // silence frames written for the packets not received in time
+    unsigned coveredFrames;
+    unsigned lostFrames;
+    const RTP_DataFrame * nextFrame;
+    unsigned framesConcealed;
+    unsigned framesRecovered;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -283,10 +315,15 @@ class MCUVideoCodec : public H323VideoCodec
     }
 
     BOOL RenderFrame(const BYTE * buffer);
+    BOOL RenderFramePlanes(const PluginCodec_Video_FramePlanes * framePlanes);
 
     MCU_RTPChannel * GetLogicalChannel()
     { return (MCU_RTPChannel *)logicalChannel; }
 
+    // encoding time of each frame is observed by the histogram, NULL to stop
+    void SetEncodeMetric(MCUMetric * metric)
+    { encodeMetric = metric; }
+
   protected:
     void * context;
     PluginCodec_Definition * codec;
@@ -301,6 +338,10 @@ class MCUVideoCodec : public H323VideoCodec
     int          maxHeight;
     bool         sendIntra;
     bool         lastPacketSent;
+    bool         damagedRegions;
+
+    MCUMetric *  encodeMetric;
+    int64_t      encodeUsec;
 
     mutable PTimeInterval lastFrameTick;
 };
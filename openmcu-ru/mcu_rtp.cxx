@@ -23,6 +23,11 @@ MCU_RTPChannel::MCU_RTPChannel(H323Connection & conn, const H323Capability & cap
 
   cache = NULL;
   cacheMode = -1;
+  cacheTemporalLayer = -1;
+  cacheTL0PicIdx = -1;
+  cacheFrameStart = true;
+  cacheReplay = false;
+  cacheReplayTimestamp = 0;
   encoderSeqN = 0;
 }
 
@@ -242,12 +247,16 @@ void MCU_RTPChannel::Receive()
 
   PTRACE(2, "MCU_RTPChannel\tReceive " << mediaFormat << " thread started.");
 
-  // if jitter buffer required, start the thread that is on the other end of it
+  // if jitter buffer required, this thread fills it while waiting for the next playout
   if(isAudio && audioJitterEnable && mediaFormat.NeedsJitterBuffer())
   {
-    rtpSession.SetJitterBufferSize(connection.GetMinAudioJitterDelay()*mediaFormat.GetTimeUnits(),
-                                   connection.GetMaxAudioJitterDelay()*mediaFormat.GetTimeUnits(),
-                                   endpoint.GetJitterThreadStackSize());
+    unsigned minJitterDelay = connection.GetMinAudioJitterDelay()*mediaFormat.GetTimeUnits();
+    unsigned maxJitterDelay = connection.GetMaxAudioJitterDelay()*mediaFormat.GetTimeUnits();
+    MCU_RTP_UDP * session = dynamic_cast<MCU_RTP_UDP *>(&rtpSession);
+    if(session)
+      session->CreateJitterBuffer(minJitterDelay, maxJitterDelay);
+    else
+      rtpSession.SetJitterBufferSize(minJitterDelay, maxJitterDelay);
   }
 
   // Keep time using th RTP timestamps.
@@ -271,6 +280,8 @@ void MCU_RTPChannel::Receive()
   BOOL allowRtpPayloadChange = FALSE;
 
   MCU_RTP_DataFrame frame;
+  RTP_DataFrame nextFrame;
+  BOOL concealFrames = (isAudio && PIsDescendant(codec, MCUFramedAudioCodec) && ((MCUFramedAudioCodec *)codec)->CanConcealFrames());
   while(1)
   {
     // Запрос intra-frame
@@ -300,6 +311,9 @@ void MCU_RTPChannel::Receive()
     BOOL ok = TRUE;
     if(size == 0)
     {
+      // the slot of a lost packet, the packet after it may already be here with the slot in its FEC
+      if(concealFrames && ((MCU_RTP_UDP &)rtpSession).PeekJitterFrame(nextFrame))
+        ((MCUFramedAudioCodec *)codec)->SetNextFrame(&nextFrame);
       ok = codec->Write(NULL, 0, frame, written);
       rtpTimestamp += codecFrameRate;
     } else {
@@ -399,6 +413,84 @@ class CodecReadAnalyser
 };
 #endif
 
+BOOL MCU_RTPChannel::ReadCacheFrame(RTP_DataFrame & frame, unsigned & length, unsigned & flags)
+{
+  unsigned inFlags = flags;
+  while(1)
+  {
+    flags = inFlags;
+    if(!GetCacheRTP(cache, frame, length, encoderSeqN, flags))
+      return FALSE;
+    if(cacheTemporalLayer < 0)
+      break;
+
+    unsigned tid = 0;
+    int tl0PicIdx = -1;
+    bool frameStart = false;
+    if(!GetVP8TemporalLayer(frame, tid, tl0PicIdx, frameStart))
+      break;
+    if((int)tid > cacheTemporalLayer)
+    {
+      // the skipped layer is not sent when the channel closes
+      if(terminating)
+        return FALSE;
+      continue;
+    }
+
+    // base layer frames lost in the cache, the upper layers can not be decoded
+    if(tid == 0 && frameStart && tl0PicIdx >= 0)
+    {
+      if(cacheTL0PicIdx >= 0 && tl0PicIdx != ((cacheTL0PicIdx + 1) & 0xff) && !(flags & PluginCodec_ReturnCoderIFrame))
+      {
+        PTRACE(3, "MCU_RTPChannel	Cache " << cacheName << " TL0PICIDX gap " << cacheTL0PicIdx << " -> " << tl0PicIdx);
+        OnFastUpdatePicture();
+      }
+      cacheTL0PicIdx = tl0PicIdx;
+    }
+    break;
+  }
+
+  // the kept GOP is not sent in one burst, the frames are paced by the capture timestamps
+  if(cacheReplay && cacheFrameStart)
+  {
+    if(encoderSeqN > cache->GetLastFrameNum())
+    {
+      cacheReplay = false;
+      PTRACE(5, "MCU_RTPChannel\tCache " << cacheName << " reader reached the live frames");
+    }
+    else
+    {
+      PINDEX elapsed = (PINDEX)(PTimer::Tick() - cacheReplayTick).GetMilliSeconds();
+      PINDEX due = (PINDEX)((DWORD)(frame.GetTimestamp() - cacheReplayTimestamp) / 90 / CACHE_GOP_REPLAY_SPEED);
+      if(due > elapsed)
+        MCUTime::Sleep(PMIN(due - elapsed, 1000));
+    }
+  }
+  cacheFrameStart = frame.GetMarker();
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCU_RTPChannel::SeekCacheKeyFrame()
+{
+  cacheFrameStart = true;
+  if(!SeekCacheRTPKeyFrame(cache, encoderSeqN))
+  {
+    cacheReplay = false;
+    return FALSE;
+  }
+  // the capture timestamp of the keyframe starts the replay
+  RTP_DataFrame frame;
+  unsigned seqN = encoderSeqN, length, flags;
+  cacheReplay = GetCacheRTP(cache, frame, length, seqN, flags, 0);
+  cacheReplayTimestamp = frame.GetTimestamp();
+  cacheReplayTick = PTimer::Tick();
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void MCU_RTPChannel::Transmit()
 {
   if(terminating)
@@ -443,6 +535,8 @@ void MCU_RTPChannel::Transmit()
   DWORD rtpFirstTimestamp = rand();
   DWORD rtpTimestamp = rtpFirstTimestamp;
   PTimeInterval firstFrameTick = PTimer::Tick();
+  BOOL cacheTimestampValid = FALSE;
+  DWORD cacheTimestampOffset = 0;
   frame.SetPayloadSize(0);
 
 #if PTRACING
@@ -468,7 +562,9 @@ void MCU_RTPChannel::Transmit()
       DetachCacheRTP(cache);
       while(!AttachCacheRTP(cache, cacheName, encoderSeqN))
         MCUTime::Sleep(100);
-      OnFastUpdatePicture();
+      cacheTL0PicIdx = -1;
+      if(!SeekCacheKeyFrame())
+        OnFastUpdatePicture();
     }
 
     // periodic intra-frame refresh
@@ -487,16 +583,24 @@ void MCU_RTPChannel::Transmit()
         if((PTimer::Tick()-firstFrameTick).GetInterval() > 2000 && frame.GetMarker())
         {
           preVideoFrames = FALSE;
-          encoderSeqN = cache->GetLastFrameNum();
-          OnFastUpdatePicture();
-          while(1)
+          if(SeekCacheKeyFrame())
           {
             flags = 0;
-            retval = GetCacheRTP(cache, frame, length, encoderSeqN, flags);
-            if(flags & PluginCodec_ReturnCoderIFrame)
-              break;
-            if(terminating)
-              break;
+            retval = ReadCacheFrame(frame, length, flags);
+          }
+          else
+          {
+            encoderSeqN = cache->GetLastFrameNum();
+            OnFastUpdatePicture();
+            while(1)
+            {
+              flags = 0;
+              retval = ReadCacheFrame(frame, length, flags);
+              if(flags & PluginCodec_ReturnCoderIFrame)
+                break;
+              if(terminating)
+                break;
+            }
           }
         }
         else
@@ -505,13 +609,25 @@ void MCU_RTPChannel::Transmit()
       else
       {
         flags = 0;
-        retval = GetCacheRTP(cache, frame, length, encoderSeqN, flags);
+        retval = ReadCacheFrame(frame, length, flags);
       }
     }
 
     if(retval == FALSE)
       break;
 
+    // the cached video frames keep the intervals of the capture timestamps,
+    // the replayed GOP is not squeezed into the time it is sent
+    if(!isAudio && cacheMode == 2 && !preVideoFrames)
+    {
+      if(!cacheTimestampValid)
+      {
+        cacheTimestampOffset = rtpTimestamp - frame.GetTimestamp();
+        cacheTimestampValid = TRUE;
+      }
+      rtpTimestamp = frame.GetTimestamp() + cacheTimestampOffset;
+    }
+
     // ???
     if(freezeWrite)
       length = 0;
@@ -771,6 +887,10 @@ MCU_RTP_UDP::MCU_RTP_UDP(
 
   zrtp_secured = FALSE;
   srtp_secured = FALSE;
+
+  capture = NULL;
+  replay = NULL;
+  lastWriteTime = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -784,6 +904,103 @@ MCU_RTP_UDP::~MCU_RTP_UDP()
     delete r->second;
     frameQueue.erase(r);
   }
+  delete capture;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCU_RTP_UDP::StartCapture(const PString & fileName, const PString & formatName, unsigned clockRate, unsigned payloadType)
+{
+  MCURtpCaptureFile *file = new MCURtpCaptureFile();
+  if(!file->Open(fileName, formatName, clockRate, payloadType))
+  {
+    delete file;
+    return FALSE;
+  }
+  StopCapture();
+  PWaitAndSignal m(captureMutex);
+  capture = file;
+  MCUTRACE(1, "MCU_RTP_UDP Session " << GetSessionID() << ", capture " << fileName << " started");
+  return TRUE;
+}
+
+unsigned MCU_RTP_UDP::StopCapture()
+{
+  PWaitAndSignal m(captureMutex);
+  if(capture == NULL)
+    return 0;
+  unsigned packets = capture->GetPackets();
+  MCUTRACE(1, "MCU_RTP_UDP Session " << GetSessionID() << ", capture " << capture->GetFileName() << " stopped, " << packets << " packets");
+  delete capture;
+  capture = NULL;
+  return packets;
+}
+
+void MCU_RTP_UDP::CaptureData(const RTP_DataFrame & frame)
+{
+  if(capture == NULL)
+    return;
+  PWaitAndSignal m(captureMutex);
+  if(capture && !capture->Write(frame, GetReceiveTimeUsec()))
+  {
+    MCUTRACE(1, "MCU_RTP_UDP Session " << GetSessionID() << ", capture " << capture->GetFileName() << " is full, " << capture->GetPackets() << " packets");
+    delete capture;
+    capture = NULL;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RTP_Session::SendReceiveStatus MCU_RTP_UDP::ReadDataPDU(RTP_DataFrame & frame)
+{
+  SendReceiveStatus status = ReadDataOrControlPDU(*dataSocket, frame, TRUE);
+  if(status != e_ProcessPacket)
+    return status;
+
+  // Check received PDU is big enough
+  PINDEX pduSize = dataSocket->GetLastReadCount();
+  if(pduSize < RTP_DataFrame::MinHeaderSize || pduSize < frame.GetHeaderSize())
+  {
+    PTRACE(2, "MCU_RTP_UDP\tSession " << sessionID << ", Received data packet too small: " << pduSize << " bytes");
+    return e_IgnorePacket;
+  }
+  frame.SetPayloadSize(pduSize - frame.GetHeaderSize());
+
+  status = OnReceiveEncrypted(frame);
+  if(status != e_ProcessPacket)
+    return status;
+
+  // the order and the time of arrival, OnReceiveData can ignore it or take another one of the queue
+  CaptureData(frame);
+  return OnReceiveData(frame, *this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t MCU_RTP_UDP::GetReceiveTimeUsec() const
+{
+  if(replay)
+    return replay->GetTimeUsec();
+  return MCUTime::GetMonoTimestampUsec();
+}
+
+void MCU_RTP_UDP::SleepReceiveUsec(uint32_t usec)
+{
+  if(replay)
+    replay->Sleep(usec);
+  else
+    MCUTime::SleepUsec(usec);
+}
+
+RTP_Session::SendReceiveStatus MCU_RTP_UDP::ReadReplayPDU(RTP_DataFrame & frame, uint64_t timeout_usec)
+{
+  int status = replay->Read(frame, timeout_usec);
+  if(status < 0)
+    return e_AbortTransport;
+  if(status == 0)
+    return e_IgnorePacket;
+  // the capture is taken after decryption, the packet goes to the base class
+  return MCU_RTP_UDP::OnReceiveData(frame, *this);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -894,6 +1111,7 @@ BOOL MCU_RTP_UDP::PostWriteData(RTP_DataFrame & frame)
   }
 
   writeDataErrorsTime = 0;
+  MCUMetrics::rtpPacketsSent.Inc();
   return TRUE;
 }
 
@@ -937,7 +1155,7 @@ BOOL MCU_RTP_UDP::WriteControl(RTP_ControlFrame & frame)
 
 void MCU_RTP_UDP::SetLastTimeRTPQueue(void)
 {
-  PTime oldTime;
+  uint64_t oldTime = GetReceiveTimeUsec();
   std::map<WORD, RTP_DataFrame *>::iterator r;
 
   for(r = frameQueue.begin(); r != frameQueue.end(); r++)
@@ -979,7 +1197,7 @@ BOOL MCU_RTP_UDP::ReadRTPQueue(RTP_DataFrame & frame)
     return TRUE;
   }
 
-  if((PTime() - lastWriteTime).GetMilliSeconds() > 250)
+  if(GetReceiveTimeUsec() - lastWriteTime > 250000)
   {
     WORD i = 0; while( (r = frameQueue.find(expectedSequenceNumber + i)) == frameQueue.end()) i++;
     PTRACE(6, "MCU_RTP_UDP\tReadRTPQueue Timeout, return first frame from queue " << expectedSequenceNumber + i);
@@ -1005,7 +1223,7 @@ BOOL MCU_RTP_UDP::ProcessRTPQueue(RTP_DataFrame & frame)
     return TRUE;
   }
 
-  PTime now;  // Get timestamp now
+  uint64_t now = GetReceiveTimeUsec();  // Get timestamp now
 
 // if((now - lastWriteTime).GetMilliSeconds() > 250 && frameQueue.size() == 0) return TRUE;
 
@@ -1018,10 +1236,9 @@ BOOL MCU_RTP_UDP::ProcessRTPQueue(RTP_DataFrame & frame)
     SetLastTimeRTPQueue();
   }
 
-  ((MCU_RTP_DataFrame &)frame).localTimeStamp = now;
-
   MCU_RTP_DataFrame * newFrame = new MCU_RTP_DataFrame();
   CopyRTPDataFrame(*newFrame,frame);
+  newFrame->localTimeStamp = now;
 
   frameQueue.insert(std::map<WORD, RTP_DataFrame *>::value_type(sequenceNumber, newFrame));
   SetLastTimeRTPQueue();
@@ -1039,7 +1256,7 @@ BOOL MCU_RTP_UDP::ProcessRTPQueue(RTP_DataFrame & frame)
     return TRUE;
   }
 
-  if((now - lastWriteTime).GetMilliSeconds() > 250) // Timeout, return first frame from queue
+  if(now - lastWriteTime > 250000) // Timeout, return first frame from queue
   {
     WORD i = 0; while( (r = frameQueue.find(expectedSequenceNumber + i)) == frameQueue.end()) i++;
     PTRACE(6, "MCU_RTP_UDP\tProcessRTPQueue Timeout, return first frame from queue " << expectedSequenceNumber + i);
@@ -1065,6 +1282,16 @@ BOOL MCU_RTP_UDP::ReadData(RTP_DataFrame & frame, BOOL loop)
       return TRUE; // Got frame from queue
     }
 
+    if(replay)
+    {
+      SendReceiveStatus status = ReadReplayPDU(frame, (uint64_t)-1);
+      if(status == e_AbortTransport)
+        return FALSE;
+      if(status == e_ProcessPacket)
+        return TRUE;
+      continue;
+    }
+
 #ifdef H323_RTP_AGGREGATE
     PTime start;
 #endif
@@ -1126,6 +1353,208 @@ BOOL MCU_RTP_UDP::ReadData(RTP_DataFrame & frame, BOOL loop)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+int MCU_RTP_UDP::ReadDataTimeout(RTP_DataFrame & frame, const PTimeInterval & timeout)
+{
+  if(replay)
+  {
+    uint64_t timeout_usec = timeout.GetMilliSeconds() * 1000;
+    switch (ReadReplayPDU(frame, timeout_usec)) {
+      case e_ProcessPacket :
+        return 1;
+      case e_IgnorePacket :
+        return 0;
+      default :
+        // the end of the capture is a quiet socket until the audio left in the jitter buffer
+        // is played, then the session closes
+        if(replay->GetTimeUsec() > replay->GetLastArrivalUsec() + RTP_REPLAY_DRAIN_USEC)
+          return -1;
+        replay->Sleep(timeout_usec);
+        return 0;
+    }
+  }
+
+  int selectStatus = PSocket::Select(*dataSocket, *controlSocket, timeout);
+
+  if(shutdownRead)
+  {
+    PTRACE(3, "MCU_RTP_UDP\tSession " << sessionID << ", Read shutdown.");
+    shutdownRead = FALSE;
+    return -1;
+  }
+
+  switch (selectStatus) {
+    case -2 :
+      if (ReadControlPDU() == e_AbortTransport)
+        return -1;
+      return 0;
+
+    case -3 :
+      if (ReadControlPDU() == e_AbortTransport)
+        return -1;
+      // Then do -1 case
+
+    case -1 :
+      switch (ReadDataPDU(frame)) {
+        case e_ProcessPacket :
+          if (shutdownRead)
+            return -1;
+          return 1;
+        case e_IgnorePacket :
+          return 0;
+        case e_AbortTransport :
+          return -1;
+      }
+      return 0;
+
+    case 0 :
+      if (!SendReport())
+        return -1;
+      return 0;
+
+    case PSocket::Interrupted:
+      PTRACE(3, "MCU_RTP_UDP\tSession " << sessionID << ", Interrupted.");
+      return -1;
+
+    default :
+      PTRACE(1, "MCU_RTP_UDP\tSession " << sessionID << ", Select error: " << PChannel::GetErrorText((PChannel::Errors)selectStatus));
+      return -1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCU_RTP_UDP::CreateJitterBuffer(unsigned minJitterDelay, unsigned maxJitterDelay)
+{
+  if(jitter == NULL && (minJitterDelay != 0 || maxJitterDelay != 0))
+  {
+    SetIgnoreOutOfOrderPackets(FALSE);
+    jitter = new MCUJitterBuffer(*this, minJitterDelay, maxJitterDelay);
+  }
+  else
+    RTP_Session::SetJitterBufferSize(minJitterDelay, maxJitterDelay);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCU_RTP_UDP::WaitPlayout(uint32_t delay_usec)
+{
+  MCUJitterBuffer * buffer = dynamic_cast<MCUJitterBuffer *>(jitter);
+  if((buffer == NULL || !buffer->Fill(delay_usec)) && delay_usec)
+    SleepReceiveUsec(delay_usec);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCU_RTP_UDP::PeekJitterFrame(RTP_DataFrame & frame)
+{
+  MCUJitterBuffer * buffer = dynamic_cast<MCUJitterBuffer *>(jitter);
+  return (buffer != NULL && buffer->PeekFrame(frame));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUJitterBuffer::MCUJitterBuffer(MCU_RTP_UDP & session, unsigned minJitterDelay, unsigned maxJitterDelay)
+  : RTP_JitterBuffer(session, minJitterDelay, maxJitterDelay), rtpSession(session)
+{
+  // the frame being read is kept out of the free list
+  readFrame = freeFrames;
+  freeFrames = freeFrames->next;
+  freeFrames->prev = NULL;
+  readFrame->next = readFrame->prev = NULL;
+
+  markerWarning = FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUJitterBuffer::~MCUJitterBuffer()
+{
+  delete readFrame;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUJitterBuffer::ReadData(DWORD timestamp, RTP_DataFrame & frame)
+{
+  // packets received since the last wait
+  if(!Fill(0))
+    return FALSE;
+  return RTP_JitterBuffer::ReadData(timestamp, frame);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUJitterBuffer::Fill(uint32_t timeout_usec)
+{
+  if(shuttingDown)
+    return FALSE;
+
+  uint64_t deadline = rtpSession.GetReceiveTimeUsec() + timeout_usec;
+  for(;;)
+  {
+    uint64_t now = rtpSession.GetReceiveTimeUsec();
+    unsigned wait_ms = (now < deadline) ? (unsigned)((deadline - now) / 1000) : 0;
+
+    int status = rtpSession.ReadDataTimeout(*readFrame, wait_ms);
+    if(status < 0)
+    {
+      shuttingDown = TRUE;
+      PTRACE(3, "MCUJitterBuffer\tSession closed");
+      return FALSE;
+    }
+    if(status == 0)
+    {
+      if(wait_ms == 0)
+        break;
+      continue;
+    }
+
+    // older than the frame already played
+    if(lastWriteTimestamp != 0 && (int)(readFrame->GetTimestamp() - lastWriteTimestamp) <= 0)
+    {
+      packetsTooLate++;
+      MCUMetrics::jitterPacketsLate.Inc();
+      continue;
+    }
+
+    // swap the frame read with a free one, same as the jitter thread
+    Entry * nextFrame;
+    bufferMutex.Wait();
+    PreRead(nextFrame, markerWarning);
+    InsertFrame(readFrame, markerWarning);
+    bufferMutex.Signal();
+    readFrame = nextFrame;
+  }
+
+  // the rest of the interval is under timer resolution
+  uint64_t now = rtpSession.GetReceiveTimeUsec();
+  if(now < deadline)
+    rtpSession.SleepReceiveUsec((uint32_t)(deadline - now));
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUJitterBuffer::PeekFrame(RTP_DataFrame & frame)
+{
+  PWaitAndSignal m(bufferMutex);
+  if(oldestFrame == NULL)
+    return FALSE;
+  PINDEX size = oldestFrame->GetHeaderSize() + oldestFrame->GetPayloadSize();
+  memcpy(frame.GetPointer(size), oldestFrame->GetPointer(), size);
+  frame.SetPayloadSize(oldestFrame->GetPayloadSize());
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PTimeInterval MCUJitterBuffer::GetTick() const
+{
+  return PTimeInterval((PInt64)(rtpSession.GetReceiveTimeUsec() / 1000));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 RTP_Session::SendReceiveStatus MCU_RTP_UDP::OnReceiveData(const RTP_DataFrame & frame, const RTP_UDP & rtp)
 {
   // Check that the PDU is the right version
@@ -1136,6 +1565,8 @@ RTP_Session::SendReceiveStatus MCU_RTP_UDP::OnReceiveData(const RTP_DataFrame &
   if(frame.GetPayloadType() > RTP_DataFrame::MaxPayloadType)
     return e_IgnorePacket; // Non fatal error, just ignore
 
+  MCUMetrics::rtpPacketsReceived.Inc();
+
   PTimeInterval tick = PTimer::Tick();  // Get timestamp now
 
   // Have not got SSRC yet, so grab it now
@@ -1206,6 +1637,7 @@ RTP_Session::SendReceiveStatus MCU_RTP_UDP::OnReceiveData(const RTP_DataFrame &
              << sequenceNumber << " expected " << expectedSequenceNumber
              << " ssrc=" << syncSourceIn);
       packetsOutOfOrder++;
+      MCUMetrics::rtpPacketsReordered.Inc();
 
       // Check for Cisco bug where sequence numbers suddenly start incrementing
       // from a different base.
@@ -1224,6 +1656,7 @@ RTP_Session::SendReceiveStatus MCU_RTP_UDP::OnReceiveData(const RTP_DataFrame &
       unsigned dropped = sequenceNumber - expectedSequenceNumber;
       packetsLost += dropped;
       packetsLostSinceLastRR += dropped;
+      MCUMetrics::rtpPacketsLost.Add(dropped);
       PTRACE(3, "RTP\tDropped " << dropped << " packet(s) at " << sequenceNumber
              << ", ssrc=" << syncSourceIn);
       expectedSequenceNumber = (WORD)(sequenceNumber + 1);
@@ -1411,8 +1844,8 @@ BOOL MCUSIP_RTP_UDP::WriteData(RTP_DataFrame & frame)
   if(srtp_write)
   {
     int len = frame.GetHeaderSize() + frame.GetPayloadSize();
-    frame.SetMinSize(len + SRTP_MAX_TRAILER_LEN);
-    if(SRTP_ERROR(srtp_protect, (srtp_write->GetSession(), frame.GetPointer(), &len)))
+    frame.SetMinSize(len + SIP_SRTP_MAX_TRAILER_LEN);
+    if(!srtp_write->Protect(frame.GetPointer(), len))
       return TRUE;
     //cout << "SRTP Protected RTP packet\n";
     frame.SetPayloadSize(len - frame.GetHeaderSize());
@@ -1472,38 +1905,38 @@ RTP_Session::SendReceiveStatus MCUSIP_RTP_UDP::OnReceiveData(const RTP_DataFrame
     _frame.SetPayloadSize(0);
     return e_ProcessPacket;
   }
+  return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RTP_Session::SendReceiveStatus MCUSIP_RTP_UDP::OnReceiveEncrypted(RTP_DataFrame & frame)
+{
+  // decrypted in the order of arrival, the reorder queue keeps the decrypted packets
+  if(freezeRead && (!zrtp_initialised || zrtp_sas_token != ""))
+    return e_ProcessPacket;
 
 #if MCUSIP_SRTP
   if(srtp_read)
   {
-    RTP_DataFrame & _frame = *PRemoveConst(RTP_DataFrame, &frame);
-    int len = _frame.GetHeaderSize() + _frame.GetPayloadSize();
-    if(SRTP_ERROR(srtp_unprotect, (srtp_read->GetSession(), _frame.GetPointer(), &len)))
-    {
-      _frame.SetPayloadSize(0);
-      return e_ProcessPacket;
-    }
-    //cout << "SRTP Unprotected RTP packet\n";
-    _frame.SetPayloadSize(len - _frame.GetHeaderSize());
+    int len = frame.GetHeaderSize() + frame.GetPayloadSize();
+    if(!srtp_read->Unprotect(frame.GetPointer(), len))
+      return e_IgnorePacket;
+    frame.SetPayloadSize(len - frame.GetHeaderSize());
   }
 #endif
 #if MCUSIP_ZRTP
   if(zrtp_initialised)
   {
-    // ZRTP frame proto version validation fails in RTP_UDP::OnReceiveData
-    //if(status == e_IgnorePacket && frame.GetVersion() != RTP_DataFrame::ProtocolVersion)
-    //  return e_ProcessPacket;
-
-    RTP_DataFrame & _frame = *PRemoveConst(RTP_DataFrame, &frame);
-    unsigned len = _frame.GetPayloadSize() + _frame.GetHeaderSize();
-    unsigned hlen = _frame.GetHeaderSize();
-    //cout << "ZRTP OnReceiveData " << len << "\n";
-    if(ZRTP_ERROR(zrtp_process_srtp, (zrtp_stream, (char *)_frame.GetPointer(), &len)))
+    // the packets of the ZRTP protocol are taken by zrtp_process_srtp
+    unsigned len = frame.GetPayloadSize() + frame.GetHeaderSize();
+    unsigned hlen = frame.GetHeaderSize();
+    if(ZRTP_ERROR(zrtp_process_srtp, (zrtp_stream, (char *)frame.GetPointer(), &len)))
       return e_IgnorePacket;
-    _frame.SetPayloadSize(len - hlen);
+    frame.SetPayloadSize(len - hlen);
   }
 #endif
-  return status;
+  return e_ProcessPacket;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
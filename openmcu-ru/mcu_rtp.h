@@ -7,6 +7,7 @@
 #include "utils.h"
 #include "mcu_rtp_cache.h"
 #include "mcu_rtp_secure.h"
+#include "mcu_rtp_capture.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -53,6 +54,10 @@ class MCU_RTPChannel : public H323_RTPChannel
     const PString & GetCacheName() const
     { return cacheName; }
 
+    // -1 - all layers
+    void SetCacheTemporalLayer(int layer)
+    { cacheTemporalLayer = layer; }
+
     void OnFastUpdatePicture()
     {
       if(cache)
@@ -73,6 +78,9 @@ class MCU_RTPChannel : public H323_RTPChannel
     { audioJitterEnable = enable; }
 
   protected:
+    BOOL ReadCacheFrame(RTP_DataFrame & frame, unsigned & length, unsigned & flags);
+    BOOL SeekCacheKeyFrame();
+
     bool freezeWrite;
     bool isAudio;
     bool audioJitterEnable;
@@ -84,6 +92,12 @@ class MCU_RTPChannel : public H323_RTPChannel
     int cacheMode; // -1 - default no cache, 0 - no cache, 1 - cached, 2 - caching
     PString cacheName;
     CacheRTP *cache;
+    int cacheTemporalLayer;
+    int cacheTL0PicIdx;
+    bool cacheFrameStart;
+    bool cacheReplay;
+    PTimeInterval cacheReplayTick;
+    DWORD cacheReplayTimestamp;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -155,6 +169,36 @@ class MCU_RTP_UDP : public RTP_UDP
     // Get total number transmitted packets lost in session (via RTCP).
     DWORD GetPacketsLostTx() const { return packetsLostTx; }
 
+    // Creates MCUJitterBuffer (no thread) in place of RTP_Session::SetJitterBufferSize
+    void CreateJitterBuffer(unsigned minJitterDelay, unsigned maxJitterDelay);
+
+    // Wait until the next playout, receiving packets into the jitter buffer
+    void WaitPlayout(uint32_t delay_usec);
+
+    // Copy of the oldest packet in the jitter buffer, the next one to play; FALSE if none
+    BOOL PeekJitterFrame(RTP_DataFrame & frame);
+
+    // Read one data packet waiting at most timeout, control packets are handled on the way.
+    // Returns 1 - frame read, 0 - nothing read, -1 - session closed or error
+    int ReadDataTimeout(RTP_DataFrame & frame, const PTimeInterval & timeout);
+
+    // Write the packets read to a capture file, replacing a running capture. A packet is captured
+    // as it arrives, after decryption, with the time of arrival, before the checks of the session
+    // and the reorder queue; the packets the session ignores are captured too.
+    BOOL StartCapture(const PString & fileName, const PString & formatName, unsigned clockRate, unsigned payloadType);
+    // Returns the number of packets captured
+    unsigned StopCapture();
+
+    BOOL IsCapturing() const
+    { return capture != NULL; }
+
+    // Read the packets from a capture instead of the sockets, on the clock of the replay
+    void SetReplay(MCURtpCaptureReader * _replay)
+    { replay = _replay; }
+
+    // Clock of the receive side: monotonic, or the clock of the replay
+    uint64_t GetReceiveTimeUsec() const;
+    void SleepReceiveUsec(uint32_t usec);
 
     BOOL           zrtp_secured;
     PString        zrtp_sas_token;
@@ -170,8 +214,23 @@ class MCU_RTP_UDP : public RTP_UDP
     MCUTime writeDataErrorsTime;
     unsigned writeControlErrors;
 
+    SendReceiveStatus ReadReplayPDU(RTP_DataFrame & frame, uint64_t timeout_usec);
+    void CaptureData(const RTP_DataFrame & frame);
+
+    // Hides RTP_UDP::ReadDataPDU, the packet of the socket is decrypted and captured
+    // before OnReceiveData
+    SendReceiveStatus ReadDataPDU(RTP_DataFrame & frame);
+    // Decryption of a packet of the socket, the packets of the reorder queue and of a replay
+    // are decrypted already
+    virtual SendReceiveStatus OnReceiveEncrypted(RTP_DataFrame & frame)
+    { return e_ProcessPacket; }
+
+    PMutex captureMutex;
+    MCURtpCaptureFile *capture;
+    MCURtpCaptureReader *replay;
+
     std::map<WORD, RTP_DataFrame *> frameQueue;
-    PTime  lastWriteTime;
+    uint64_t lastWriteTime;
     DWORD  lastRcvdTimeStamp;
     void   SetLastTimeRTPQueue();
     BOOL   ReadRTPQueue(RTP_DataFrame&);
@@ -181,6 +240,34 @@ class MCU_RTP_UDP : public RTP_UDP
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Jitter buffer without a thread of its own. Packets are read from the session by the
+// reader of the buffer, on every ReadData() and while it waits for the next playout.
+class MCUJitterBuffer : public RTP_JitterBuffer
+{
+  PCLASSINFO(MCUJitterBuffer, RTP_JitterBuffer);
+  public:
+    MCUJitterBuffer(MCU_RTP_UDP & session, unsigned minJitterDelay, unsigned maxJitterDelay);
+    ~MCUJitterBuffer();
+
+    virtual BOOL ReadData(DWORD timestamp, RTP_DataFrame & frame);
+
+    // Receive packets into the buffer for timeout_usec, FALSE if the session is closed
+    BOOL Fill(uint32_t timeout_usec);
+
+    // Copy of the oldest packet in the buffer, FALSE if the buffer is empty
+    BOOL PeekFrame(RTP_DataFrame & frame);
+
+  protected:
+    // arrival and playout on the clock of the session
+    virtual PTimeInterval GetTick() const;
+
+    MCU_RTP_UDP & rtpSession;
+    Entry * readFrame;
+    BOOL markerWarning;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 class MCUH323_RTP_UDP : public MCU_RTP_UDP
 {
   public:
@@ -213,6 +300,7 @@ class MCUSIP_RTP_UDP : public MCU_RTP_UDP
 
     virtual BOOL ReadData(RTP_DataFrame & frame, BOOL loop);
     virtual SendReceiveStatus OnReceiveData(const RTP_DataFrame & frame, const RTP_UDP & rtp);
+    virtual SendReceiveStatus OnReceiveEncrypted(RTP_DataFrame & frame);
 
     virtual BOOL WriteData(RTP_DataFrame & frame);
 
@@ -256,10 +344,11 @@ class MCU_RTP_DataFrame : public RTP_DataFrame
 
   public:
     MCU_RTP_DataFrame(PINDEX payloadSize = 2048, BOOL dynamicAllocation = TRUE)
-      : RTP_DataFrame(payloadSize, dynamicAllocation)
+      : RTP_DataFrame(payloadSize, dynamicAllocation), localTimeStamp(0)
     { }
 
-    PTime  localTimeStamp;
+    // receive time, usec
+    uint64_t localTimeStamp;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
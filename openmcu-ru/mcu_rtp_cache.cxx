@@ -121,7 +121,7 @@ void PutCacheRTP(CacheRTP *& cache, RTP_DataFrame & frame, unsigned int len, uns
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool GetCacheRTP(CacheRTP *& cache, RTP_DataFrame & frame, unsigned & toLen, unsigned & seqN, unsigned & flags)
+bool GetCacheRTP(CacheRTP *& cache, RTP_DataFrame & frame, unsigned & toLen, unsigned & seqN, unsigned & flags, int timeout)
 {
   if(!cache)
   {
@@ -131,8 +131,7 @@ bool GetCacheRTP(CacheRTP *& cache, RTP_DataFrame & frame, unsigned & toLen, uns
   }
   if(flags & PluginCodec_CoderForceIFrame)
     cache->OnFastUpdatePicture();
-  cache->GetFrame(frame, toLen, seqN, flags);
-  return true;
+  return cache->GetFrame(frame, toLen, seqN, flags, timeout);
   //cout << "GetCacheRTP length=" << toLen << " marker=" << frame.GetMarker() << " flags=" << flags  << "\n";
 }
 
@@ -152,6 +151,47 @@ bool AttachCacheRTP(CacheRTP *& cache, const PString & key, unsigned & encoderSe
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+bool SeekCacheRTPKeyFrame(CacheRTP *& cache, unsigned & encoderSeqN)
+{
+  // the reader starts from the keyframe kept by the cache, without a new one from the encoder
+  if(cache == NULL || !cache->GetKeyFrameNum(encoderSeqN))
+    return false;
+  MCUTRACE(3, "CacheRTP " << cache->GetName() << " reader starts from keyframe " << encoderSeqN);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool GetVP8TemporalLayer(const RTP_DataFrame & frame, unsigned & tid, int & tl0PicIdx, bool & frameStart)
+{
+  // VP8 payload descriptor, RFC 7741 section 4.2
+  const BYTE * p = frame.GetPayloadPtr();
+  PINDEX size = frame.GetPayloadSize();
+  if(size < 1)
+    return false;
+
+  frameStart = ((p[0] & 0x10) && (p[0] & 0x0f) == 0);
+  if((p[0] & 0x80) == 0 || size < 2)
+    return false;
+
+  BYTE x = p[1];
+  PINDEX pos = 2;
+  if(x & 0x80) // I: picture ID
+    pos += (pos < size && (p[pos] & 0x80)) ? 2 : 1;
+  if(x & 0x40) // L: TL0PICIDX
+  {
+    if(pos >= size)
+      return false;
+    tl0PicIdx = p[pos++];
+  }
+  if((x & 0x20) == 0 || pos >= size) // T: TID
+    return false;
+  tid = p[pos] >> 6;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void DetachCacheRTP(CacheRTP *& cache)
 {
   if(cache == NULL)
@@ -163,3 +203,70 @@ void DetachCacheRTP(CacheRTP *& cache)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString FindVideoCacheRTP(const PString & room, unsigned videoMixerNumber, unsigned & width, unsigned & height, unsigned & frameRate)
+{
+  // cache name: H.264{sw}@704x576:768000x25_room101/0
+  PString roomSuffix = "_" + room + "/";
+  PString found;
+  unsigned foundWidth = 0, foundHeight = 0, foundFrameRate = 0;
+  BOOL foundMixer = FALSE;
+  for(MCUCacheRTPList::shared_iterator it = cacheRTPList.begin(); it != cacheRTPList.end(); ++it)
+  {
+    PString name = it->GetName();
+    PINDEX atPos = name.Find("@");
+    PINDEX slashPos = name.FindLast("/");
+    if(atPos == P_MAX_INDEX || slashPos == P_MAX_INDEX || slashPos + 1 >= name.GetLength())
+      continue;
+    PString mixerNumber = name.Mid(slashPos+1);
+    if(mixerNumber.FindSpan("0123456789") != P_MAX_INDEX)
+      continue;
+    PString suffix = roomSuffix + mixerNumber;
+    if(name.GetLength() <= suffix.GetLength() || name.Right(suffix.GetLength()) != suffix)
+      continue;
+    PString pluginName = GetPluginName(name.Left(atPos));
+    if(pluginName != "H.264" && pluginName != "VP8")
+      continue;
+
+    PStringArray params = name.Mid(atPos+1, name.GetLength()-suffix.GetLength()-atPos-1).Tokenise(":");
+    if(params.GetSize() != 2)
+      continue;
+    PStringArray res = params[0].Tokenise("x");
+    PStringArray rate = params[1].Tokenise("x");
+    if(res.GetSize() != 2 || rate.GetSize() != 2)
+      continue;
+    unsigned w = res[0].AsUnsigned(), h = res[1].AsUnsigned();
+    if(w == 0 || h == 0)
+      continue;
+
+    // the requested mixer first, then the requested resolution, then the largest one
+    BOOL mixer = (mixerNumber.AsUnsigned() == videoMixerNumber);
+    if(found != "")
+    {
+      if(foundMixer && !mixer)
+        continue;
+      if(foundMixer == mixer)
+      {
+        if(foundWidth == width && foundHeight == height)
+          continue;
+        if(!(w == width && h == height) && w*h <= foundWidth*foundHeight)
+          continue;
+      }
+    }
+    found = name;
+    foundMixer = mixer;
+    foundWidth = w;
+    foundHeight = h;
+    foundFrameRate = rate[1].AsUnsigned();
+  }
+
+  if(found != "")
+  {
+    width = foundWidth;
+    height = foundHeight;
+    frameRate = foundFrameRate;
+  }
+  return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
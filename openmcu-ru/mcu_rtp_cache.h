@@ -12,6 +12,18 @@
 #define FRAME_BUF_SIZE	0x2000
 #define FRAME_OFFSET	0x100
 
+// temporal layers of the cache encoder, when the codec supports them (VP8),
+// readers with lower frame rate drop the upper layers instead of opening own cache
+#define CACHE_TEMPORAL_LAYERS 3
+
+// at most one keyframe is forced in the interval, the requests of the readers are merged
+#define CACHE_INTRA_INTERVAL_MS 1000
+// the last GOP is kept for new readers up to this number of packets
+#define CACHE_GOP_MAX_UNITS 4096
+// a new reader sends the kept GOP paced by the capture timestamps, faster by this factor
+// until it reaches the live frames
+#define CACHE_GOP_REPLAY_SPEED 2
+
 // cacheRTPListMutex - используется при создании кэшей
 // предотвращает создание в списке двух одноименных кэшей
 extern PMutex cacheRTPListMutex;
@@ -26,9 +38,13 @@ CacheRTP * CreateCacheRTP(const PString & key);
 void DeleteCacheRTP(CacheRTP *& cache);
 bool FindCacheRTP(const PString & key);
 void PutCacheRTP(CacheRTP *& cache, RTP_DataFrame & frame, unsigned int len, unsigned int flags);
-bool GetCacheRTP(CacheRTP *& cache, RTP_DataFrame & frame, unsigned & toLen, unsigned & seqN, unsigned & flags);
+// timeout in milliseconds, -1 waits for the frame
+bool GetCacheRTP(CacheRTP *& cache, RTP_DataFrame & frame, unsigned & toLen, unsigned & seqN, unsigned & flags, int timeout = -1);
 bool AttachCacheRTP(CacheRTP *& cache, const PString & key, unsigned & encoderSeqN);
+bool SeekCacheRTPKeyFrame(CacheRTP *& cache, unsigned & encoderSeqN);
 void DetachCacheRTP(CacheRTP *& cache);
+PString FindVideoCacheRTP(const PString & room, unsigned videoMixerNumber, unsigned & width, unsigned & height, unsigned & frameRate);
+bool GetVP8TemporalLayer(const RTP_DataFrame & frame, unsigned & tid, int & tl0PicIdx, bool & frameStart);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -44,6 +60,11 @@ class CacheRTP
       iframeN = 0;
       uN = 0;
       fastUpdate = false;
+      gopComplete = false;
+      keyFrameTime = 0;
+      intraRequests = 0;
+      keyFrames = 0;
+      keyFramesForced = 0;
     }
 
    ~CacheRTP()
@@ -63,8 +84,13 @@ class CacheRTP
     const PString & GetName() const
     { return name; }
 
+    // requests of the readers are merged, see GetFastUpdate
     void OnFastUpdatePicture()
-    { fastUpdate = true; }
+    {
+      PWaitAndSignal m(mutex);
+      intraRequests++;
+      fastUpdate = true;
+    }
 
     bool GetMarker (unsigned char *pkt)
     { return (pkt[1] & 0x80); }
@@ -78,41 +104,82 @@ class CacheRTP
     unsigned GetUsersNumber() const
     { return uN; }
 
+    unsigned GetIntraRequests() const
+    { return intraRequests; }
+
+    unsigned GetKeyFrames() const
+    { return keyFrames; }
+
+    unsigned GetKeyFramesForced() const
+    { return keyFramesForced; }
+
+    // one keyframe is forced for all requests received within CACHE_INTRA_INTERVAL_MS
+    // after the last keyframe, a keyframe produced meanwhile answers them
     void GetFastUpdate(unsigned & flags)
     {
+      PWaitAndSignal m(mutex);
       if(!fastUpdate)
         return;
-      if(seqN - iframeN <= FRAME_OFFSET * 10)
+      uint64_t now = MCUTime::GetMonoTimestampUsec() / 1000;
+      if(now - keyFrameTime < CACHE_INTRA_INTERVAL_MS)
         return;
-      MCUTRACE(1, "CacheRTP " << name << " FastUpdate needed");
+      MCUTRACE(1, "CacheRTP " << name << " FastUpdate needed, requests " << intraRequests << ", keyframes " << keyFrames);
       flags |= PluginCodec_CoderForceIFrame;
       fastUpdate = false;
+      keyFrameTime = now;
+      keyFramesForced++;
     }
 
     unsigned int GetLastFrameNum()
     {
+      PWaitAndSignal m(mutex);
       CacheRTPUnitMap::reverse_iterator r = unitList.rbegin();
       if(r != unitList.rend())
         return r->first;
       return 0;
     }
 
+    // position of the last keyframe, false when the cache has no complete GOP
+    bool GetKeyFrameNum(unsigned & num)
+    {
+      PWaitAndSignal m(mutex);
+      if(!gopComplete)
+        return false;
+      num = iframeN;
+      return true;
+    }
+
     void PutFrame(RTP_DataFrame & frame, unsigned len, unsigned flags)
     {
-      CacheRTPUnit *unit;
+      PWaitAndSignal m(mutex);
+      CacheRTPUnit *unit = NULL;
       unsigned int l;
       //MCUTRACE(6, "CacheRTP " << name << " seqN/lastN " << seqN << "/" << lastN);
-      CacheRTPUnitMap::iterator r = unitList.find(lastN);
-      while(r == unitList.end() && seqN - lastN >= FRAME_BUF_SIZE)
+      // the units behind the window are reused, except the last GOP which is kept until
+      // the next keyframe or until it outgrows CACHE_GOP_MAX_UNITS
+      while(seqN - lastN >= FRAME_BUF_SIZE && (!InLastGOP(lastN) || unitList.size() >= CACHE_GOP_MAX_UNITS))
       {
-        lastN = (lastN & FRAME_MASK) + FRAME_OFFSET;
-        r = unitList.find(lastN);
-      };
+        CacheRTPUnitMap::iterator r = unitList.find(lastN);
+        if(r == unitList.end())
+        {
+          lastN = (lastN & FRAME_MASK) + FRAME_OFFSET;
+          continue;
+        }
+        // the units of the previous GOP are freed, one is reused
+        if(unit)
+          delete unit;
+        unit = r->second;
+        unitList.erase(r);
+        if(lastN == iframeN)
+        {
+          MCUTRACE(3, "CacheRTP " << name << " GOP is longer than " << CACHE_GOP_MAX_UNITS << " packets, keyframe dropped");
+          gopComplete = false;
+        }
+        lastN++;
+      }
 
-      if(r == unitList.end())
+      if(unit == NULL)
         unit = new CacheRTPUnit();
-      else
-      { unit = r->second; unitList.erase(r); lastN++; }
       unit->PutFrame(frame);
       unit->len = len;
       unit->lock = 0;
@@ -121,12 +188,17 @@ class CacheRTP
       if(flags & PluginCodec_ReturnCoderIFrame && seqN > (iframeN & FRAME_MASK) + FRAME_OFFSET)
       {
         iframeN = seqN;
+        gopComplete = true;
+        keyFrames++;
+        keyFrameTime = MCUTime::GetMonoTimestampUsec() / 1000;
+        fastUpdate = false;
         MCUTRACE(6, "CacheRTP " << name << " new iframe " << iframeN);
       }
       if(GetMarker(frame.GetPointer()))
       {
 	seqN = (seqN & FRAME_MASK) + FRAME_OFFSET;
         l = seqN - FRAME_BUF_SIZE / 2;
+        CacheRTPUnitMap::iterator r;
 	do // lock all frame
         {
 	  r = unitList.find(l);
@@ -140,23 +212,40 @@ class CacheRTP
         seqN++;
     }
 
-    void GetFrame(RTP_DataFrame & frame, unsigned & toLen, unsigned & num, unsigned & flags)
+    bool GetFrame(RTP_DataFrame & frame, unsigned & toLen, unsigned & num, unsigned & flags, int timeout)
     {
+      int waited = 0;
       while(num >= seqN)
+      {
+        if(timeout >= 0 && waited >= timeout)
+          return false;
         MCUTime::Sleep(10);
+        waited += 10;
+      }
+      PWaitAndSignal m(mutex);
       CacheRTPUnitMap::iterator r = unitList.find(num);
       int i=0;
-      while((r == unitList.end() || r->second->lock) && num < seqN)
+      // a reader behind the window skips the locked frames, to the last keyframe when it is
+      // ahead, the frames of the last GOP are read even when they are old
+      while((r == unitList.end() || (r->second->lock && !InLastGOP(num))) && num < seqN)
       { // for debug
         PTRACE_IF(3, i > 0, "H323READ\t Lost Packet " << i << " " << num);
         PTRACE_IF(3, (r != unitList.end() && r->second->lock), "H323READ\t Lost Packet " << i << " " << num << " " << r->second->lock);
-        num = (num & FRAME_MASK) + FRAME_OFFSET; // may be lost frames, fix it
+        if(gopComplete && (int)(iframeN - num) > 0)
+          num = iframeN;
+        else
+          num = (num & FRAME_MASK) + FRAME_OFFSET; // may be lost frames, fix it
         r = unitList.find(num);
         i++;
       }
       while(r == unitList.end())
       {
+        if(timeout >= 0 && waited >= timeout)
+          return false;
+        mutex.Signal();
         MCUTime::Sleep(10);
+        waited += 10;
+        mutex.Wait();
         r = unitList.find(num);
       }
       r->second->GetFrame(frame);
@@ -167,9 +256,12 @@ class CacheRTP
       if(num == iframeN)
         flags |= PluginCodec_ReturnCoderIFrame;
       num++;
+      return true;
     }
 
   private:
+    bool InLastGOP(unsigned num) const
+    { return (gopComplete && (int)(num - iframeN) >= 0); }
 
     long id;
     PString name;
@@ -179,6 +271,16 @@ class CacheRTP
     bool fastUpdate;
     unsigned uN;
 
+    // the units from the keyframe iframeN on are all in the list
+    bool gopComplete;
+
+    uint64_t keyFrameTime;
+    unsigned intraRequests;
+    unsigned keyFrames;
+    unsigned keyFramesForced;
+
+    PMutex mutex;
+
     class CacheRTPUnit
     {
         friend class CacheRTP;
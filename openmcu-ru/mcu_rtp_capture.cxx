@@ -0,0 +1,476 @@
+
+#include "precompile.h"
+#include "mcu.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define RTP_CAPTURE_RECORD_HEADER  6
+#define RTP_REPLAY_CHECKSUM_BASIS  2166136261U
+
+static void CaptureSetUInt(BYTE * data, uint32_t value, unsigned size)
+{
+  for(unsigned i = 0; i < size; i++)
+    data[i] = (BYTE)(value >> (i * 8));
+}
+
+static uint32_t CaptureGetUInt(const BYTE * data, unsigned size)
+{
+  uint32_t value = 0;
+  for(unsigned i = 0; i < size; i++)
+    value |= (uint32_t)data[i] << (i * 8);
+  return value;
+}
+
+// FNV-1a, the order of the frames changes the sum
+static void ReplayChecksum(uint32_t & hash, const BYTE * data, unsigned size)
+{
+  for(unsigned i = 0; i < size; i++)
+    hash = (hash ^ data[i]) * 16777619U;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtpCaptureFile::MCURtpCaptureFile()
+{
+  file = NULL;
+  lastTime = 0;
+  size = 0;
+  packets = 0;
+}
+
+MCURtpCaptureFile::~MCURtpCaptureFile()
+{
+  Close();
+}
+
+BOOL MCURtpCaptureFile::Open(const PString & _fileName, const PString & formatName, unsigned clockRate, unsigned payloadType)
+{
+  Close();
+
+  file = fopen(_fileName, "wb");
+  if(file == NULL)
+  {
+    MCUTRACE(1, "MCURtpCaptureFile could not create " << _fileName);
+    return FALSE;
+  }
+  fileName = _fileName;
+  lastTime = 0;
+  size = 0;
+  packets = 0;
+
+  BYTE header[7];
+  CaptureSetUInt(header, formatName.GetLength(), 2);
+  CaptureSetUInt(header + 2, clockRate, 4);
+  header[6] = (BYTE)payloadType;
+  if(!WriteBytes((const BYTE *)RTP_CAPTURE_MAGIC, 8) || !WriteBytes(header, 2)
+     || !WriteBytes((const BYTE *)(const char *)formatName, formatName.GetLength()) || !WriteBytes(header + 2, 5))
+  {
+    Close();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void MCURtpCaptureFile::Close()
+{
+  if(file == NULL)
+    return;
+  fclose(file);
+  file = NULL;
+}
+
+BOOL MCURtpCaptureFile::WriteBytes(const BYTE * data, unsigned length)
+{
+  if(length != 0 && fwrite(data, 1, length, file) != length)
+    return FALSE;
+  size += length;
+  return TRUE;
+}
+
+BOOL MCURtpCaptureFile::Write(const RTP_DataFrame & frame, uint64_t time_usec)
+{
+  if(file == NULL)
+    return FALSE;
+
+  unsigned length = frame.GetHeaderSize() + frame.GetPayloadSize();
+  if(length > RTP_CAPTURE_MAX_PACKET)
+    return TRUE;
+  if(size + RTP_CAPTURE_RECORD_HEADER + length > RTP_CAPTURE_MAX_SIZE)
+    return FALSE;
+
+  uint64_t delta = (packets == 0 || time_usec < lastTime) ? 0 : time_usec - lastTime;
+  lastTime = time_usec;
+
+  BYTE header[RTP_CAPTURE_RECORD_HEADER];
+  CaptureSetUInt(header, (uint32_t)PMIN(delta, 0xffffffff), 4);
+  CaptureSetUInt(header + 4, length, 2);
+  if(!WriteBytes(header, RTP_CAPTURE_RECORD_HEADER) || !WriteBytes(frame.GetPointer(), length))
+    return FALSE;
+
+  packets++;
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtpCaptureReader::MCURtpCaptureReader()
+{
+  file = NULL;
+  clockRate = 0;
+  payloadType = 0;
+  pending = FALSE;
+  nextArrival = clock = lastArrival = RTP_REPLAY_CLOCK_START_USEC;
+  packets = 0;
+  mismatches = 0;
+}
+
+MCURtpCaptureReader::~MCURtpCaptureReader()
+{
+  Close();
+}
+
+BOOL MCURtpCaptureReader::Open(const PString & fileName)
+{
+  Close();
+
+  file = fopen(fileName, "rb");
+  if(file == NULL)
+    return FALSE;
+
+  BYTE header[8];
+  if(!ReadBytes(header, 8) || memcmp(header, RTP_CAPTURE_MAGIC, 8) != 0 || !ReadBytes(header, 2))
+  {
+    MCUTRACE(1, "MCURtpCaptureReader " << fileName << " is not a capture");
+    Close();
+    return FALSE;
+  }
+  unsigned length = CaptureGetUInt(header, 2);
+  std::vector<char> name(length + 1, 0);
+  if((length != 0 && !ReadBytes((BYTE *)&name[0], length)) || !ReadBytes(header, 5))
+  {
+    Close();
+    return FALSE;
+  }
+  formatName = &name[0];
+  clockRate = CaptureGetUInt(header, 4);
+  payloadType = header[4];
+
+  nextArrival = clock = lastArrival = RTP_REPLAY_CLOCK_START_USEC;
+  packets = 0;
+  mismatches = 0;
+  ReadNext();
+  return TRUE;
+}
+
+void MCURtpCaptureReader::Close()
+{
+  pending = FALSE;
+  if(file == NULL)
+    return;
+  fclose(file);
+  file = NULL;
+}
+
+BOOL MCURtpCaptureReader::ReadBytes(BYTE * data, unsigned size)
+{
+  return fread(data, 1, size, file) == size;
+}
+
+BOOL MCURtpCaptureReader::ReadNext()
+{
+  pending = FALSE;
+  if(file == NULL)
+    return FALSE;
+
+  BYTE header[RTP_CAPTURE_RECORD_HEADER];
+  if(!ReadBytes(header, RTP_CAPTURE_RECORD_HEADER))
+    return FALSE;
+  unsigned length = CaptureGetUInt(header + 4, 2);
+  // shorter than the fixed RTP header, the file is broken
+  if(length < 12)
+    return FALSE;
+  next.resize(length);
+  if(!ReadBytes(&next[0], length))
+    return FALSE;
+
+  nextArrival += CaptureGetUInt(header, 4);
+  pending = TRUE;
+  return TRUE;
+}
+
+int MCURtpCaptureReader::Read(RTP_DataFrame & frame, uint64_t timeout_usec)
+{
+  if(!pending)
+    return -1;
+
+  if(nextArrival > clock && nextArrival - clock > timeout_usec)
+  {
+    clock += timeout_usec;
+    return 0;
+  }
+  if(nextArrival > clock)
+    clock = nextArrival;
+  lastArrival = nextArrival;
+  packets++;
+
+  PINDEX length = next.size();
+  frame.SetSize(length);
+  memcpy(frame.GetPointer(), &next[0], length);
+  BOOL valid = (frame.GetHeaderSize() <= length);
+  if(valid)
+    frame.SetPayloadSize(length - frame.GetHeaderSize());
+  if(valid && (unsigned)frame.GetPayloadType() != payloadType)
+    mismatches++;
+
+  ReadNext();
+  return valid ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the member of a replay, every frame written to the mixers is followed by a read of the mix,
+// the decoded frames and the mix are checksummed. The video mix is read from the mixer of the
+// listener past the logo a new connection is shown, the checksum does not depend on the speed
+// of the replay.
+class ConferenceReplayMember : public ConferenceMember
+{
+  PCLASSINFO(ConferenceReplayMember, ConferenceMember);
+  public:
+    ConferenceReplayMember(Conference * _conference, const PString & _name, BOOL _visible)
+      : ConferenceMember(_conference)
+    {
+      memberType = MEMBER_TYPE_CONN;
+      visible = _visible;
+      name = _name;
+      callToken = "replay-" + PString(GetID());
+      listener = NULL;
+      mixWidth = mixHeight = 0;
+      frames = 0;
+      decodedChecksum = mixedChecksum = RTP_REPLAY_CHECKSUM_BASIS;
+    }
+
+    // the conference waits for offline members before deleting them
+    virtual void Close()
+    { callToken = ""; }
+
+    void SetListener(ConferenceMember * _listener, unsigned width, unsigned height)
+    {
+      listener = _listener;
+      mixWidth = width;
+      mixHeight = height;
+    }
+
+    virtual void WriteAudio(const uint64_t & timestamp, const void * buffer, PINDEX amount, unsigned sampleRate, unsigned channels)
+    {
+      ConferenceMember::WriteAudio(timestamp, buffer, amount, sampleRate, channels);
+      frames++;
+      ReplayChecksum(decodedChecksum, (const BYTE *)buffer, amount);
+      if(listener)
+      {
+        mix.resize(amount);
+        listener->ReadAudio(timestamp, &mix[0], amount, sampleRate, channels);
+        ReplayChecksum(mixedChecksum, &mix[0], amount);
+      }
+    }
+
+#if MCU_VIDEO
+    virtual void WriteVideo(const MCUPlanesYUV & planes, int width, int height)
+    {
+      ConferenceMember::WriteVideo(planes, width, height);
+      frames++;
+      for(int i = 0; i < 3; i++)
+      {
+        int planeWidth = (i == 0) ? width : width / 2;
+        int planeHeight = (i == 0) ? height : height / 2;
+        for(int row = 0; row < planeHeight; row++)
+          ReplayChecksum(decodedChecksum, planes.data[i] + row * planes.linesize[i], planeWidth);
+      }
+      if(listener)
+      {
+        PINDEX amount = mixWidth * mixHeight * 3 / 2;
+        mix.assign(amount, 0);
+        MCUSimpleVideoMixer *mixer = OpenMCU::Current().GetConferenceManager()->FindVideoMixerWithLock(conference, listener->GetVideoMixerNumber());
+        if(mixer)
+        {
+          mixer->ReadMixedFrame(&mix[0], mixWidth, mixHeight, amount);
+          mixer->Unlock();
+        }
+        ReplayChecksum(mixedChecksum, &mix[0], amount);
+      }
+    }
+#endif
+
+    unsigned frames;
+    uint32_t decodedChecksum;
+    uint32_t mixedChecksum;
+
+  protected:
+    ConferenceMember * listener;
+    unsigned mixWidth;
+    unsigned mixHeight;
+    std::vector<BYTE> mix;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// decoded audio of a replay stamped with the clock of the replay, the time of the frame passes
+// while the jitter buffer is filled, as with IncomingAudio of a connection
+class MCURtpReplayAudio : public PChannel
+{
+  PCLASSINFO(MCURtpReplayAudio, PChannel);
+  public:
+    MCURtpReplayAudio(MCU_RTP_UDP & _session, ConferenceMember & _member, unsigned _sampleRate, unsigned _channels)
+      : session(_session), member(_member), sampleRate(_sampleRate), channels(_channels)
+    {
+      os_handle = 0;
+    }
+
+    BOOL Write(const void * buffer, PINDEX amount)
+    {
+      member.WriteAudio(session.GetReceiveTimeUsec(), buffer, amount, sampleRate, channels);
+      session.WaitPlayout((uint32_t)((uint64_t)1000000 * amount / (sampleRate * channels * 2)));
+      return TRUE;
+    }
+
+  protected:
+    MCU_RTP_UDP & session;
+    ConferenceMember & member;
+    unsigned sampleRate;
+    unsigned channels;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtpReplay::Run(const PString & fileName, const PString & room, unsigned width, unsigned height, MCUJSON & json, PString & error)
+{
+  MCURtpCaptureReader reader;
+  if(!reader.Open(fileName))
+  {
+    error = "could not read capture " + fileName;
+    return FALSE;
+  }
+
+  MCUCapability *cap = MCUCapability::Create(reader.GetFormatName());
+  if(cap == NULL)
+  {
+    error = "unknown format " + reader.GetFormatName();
+    return FALSE;
+  }
+  BOOL isAudio = (cap->GetMainType() == MCUCapability::e_Audio);
+#if !MCU_VIDEO
+  if(!isAudio)
+  {
+    delete cap;
+    error = "video is disabled";
+    return FALSE;
+  }
+#endif
+  OpenMCU & app = OpenMCU::Current();
+  MCUH323EndPoint & ep = app.GetEndpoint();
+  ConferenceManager *manager = app.GetConferenceManager();
+  Conference *conference = manager->FindConferenceWithLock(room);
+  if(conference)
+  {
+    // the mix of other members would change the checksums
+    conference->Unlock();
+    delete cap;
+    error = "room " + room + " already exists";
+    return FALSE;
+  }
+
+  MCU_RTP_UDP session(
+#ifdef H323_RTP_AGGREGATE
+                      NULL,
+#endif
+                      isAudio ? RTP_Session::DefaultAudioSessionID : RTP_Session::DefaultVideoSessionID);
+  session.SetReplay(&reader);
+
+  // the receive channel of a connection without signaling, the session is not one of the
+  // connection and only the receive loop of the channel runs
+  MCUH323Connection *conn = new MCUH323Connection(ep, 0, NULL);
+  MCU_RTPChannel *channel = new MCU_RTPChannel(*conn, *cap, H323Channel::IsReceiver, session);
+  H323Codec *codec = channel->GetCodec();
+  if(codec == NULL)
+  {
+    delete channel;
+    delete conn;
+    delete cap;
+    error = "could not create decoder " + reader.GetFormatName();
+    return FALSE;
+  }
+  if(reader.GetPayloadType() >= RTP_DataFrame::DynamicBase)
+    channel->SetDynamicRTPPayloadType(reader.GetPayloadType());
+
+  conference = manager->MakeConferenceWithLock(room, "", TRUE);
+  if(conference == NULL)
+  {
+    delete channel;
+    delete conn;
+    delete cap;
+    error = "could not create room " + room;
+    return FALSE;
+  }
+
+  ConferenceReplayMember *member = new ConferenceReplayMember(conference, "replay", TRUE);
+  ConferenceReplayMember *listener = new ConferenceReplayMember(conference, "replay listener", FALSE);
+  conference->AddMember(member);
+  conference->AddMember(listener);
+  member->SetListener(listener, width, height);
+
+  const OpalMediaFormat & mf = codec->GetMediaFormat();
+  if(isAudio)
+  {
+    // the jitter buffer is set up by the receive loop
+    unsigned sampleRate = mf.GetTimeUnits() * 1000;
+    unsigned channels = mf.GetOptionInteger(OPTION_DECODER_CHANNELS, 1);
+    codec->AttachChannel(new MCURtpReplayAudio(session, *member, sampleRate, channels), TRUE);
+  }
+#if MCU_VIDEO
+  else
+  {
+    // the decoder renders to the connection, as the cache encoders grab from it
+    PString connName = "replay";
+    conn->SetupCacheConnection(connName, conference, member);
+    conn->OpenVideoChannel(FALSE, (H323VideoCodec &)*codec);
+  }
+#endif
+
+  MCUTRACE(1, "MCURtpReplay " << fileName << " " << reader.GetFormatName() << " to room " << room);
+
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+  channel->Receive();
+  uint64_t elapsed = PMAX(1, MCUTime::GetMonoTimestampUsec() - start);
+  uint64_t captured = reader.GetLastArrivalUsec() - RTP_REPLAY_CLOCK_START_USEC;
+  // the loop ends early on a write error of the codec
+  BOOL ok = reader.IsEnd();
+
+  json.Insert("file", fileName);
+  json.Insert("format", reader.GetFormatName());
+  json.Insert("clock_rate", reader.GetClockRate());
+  json.Insert("payload_type", reader.GetPayloadType());
+  json.Insert("completed", ok != FALSE);
+  json.Insert("packets", reader.GetPackets());
+  json.Insert("packets_lost", (unsigned)session.GetPacketsLost());
+  json.Insert("packets_out_of_order", (unsigned)session.GetPacketsOutOfOrder());
+  json.Insert("packets_too_late", (unsigned)session.GetPacketsTooLate());
+  json.Insert("payload_mismatches", reader.GetPayloadMismatches());
+  json.Insert("frames", member->frames);
+  json.Insert("decoded_checksum", psprintf("%08x", member->decodedChecksum));
+  json.Insert("mixed_checksum", psprintf("%08x", member->mixedChecksum));
+  json.Insert("capture_usec", (long long)captured);
+  json.Insert("run_usec", (long long)elapsed);
+  json.Insert("speedup", (double)captured / elapsed);
+
+  // the channel deletes the codec
+  delete channel;
+  delete conn;
+  delete cap;
+
+  conference->Unlock();
+  manager->RemoveConference(room);
+
+  MCUTRACE(1, "MCURtpReplay " << fileName << " " << reader.GetPackets() << " packets, " << member->frames << " frames in " << elapsed << " usec");
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
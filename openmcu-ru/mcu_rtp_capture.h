@@ -0,0 +1,137 @@
+
+#include "precompile.h"
+
+#ifndef _MCU_RTP_CAPTURE_H
+#define _MCU_RTP_CAPTURE_H
+
+#include "utils.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Capture file: "MCURTPC1", the format name (16 bit length and text), the clock rate (32 bit),
+// the payload type (8 bit), then the packets: arrival time since the previous packet in usec
+// (32 bit), length (16 bit) and the RTP packet as received. Integers are little endian.
+#define RTP_CAPTURE_MAGIC            "MCURTPC1"
+#define RTP_CAPTURE_MAX_SIZE         (512*1024*1024)
+#define RTP_CAPTURE_MAX_PACKET       0xffff
+
+// the clock of a replay starts here, the mixers take zero as no timestamp
+#define RTP_REPLAY_CLOCK_START_USEC  1000000
+// time after the last packet for the audio left in the jitter buffer
+#define RTP_REPLAY_DRAIN_USEC        1000000
+
+class MCU_RTP_UDP;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Writes the packets of one session, a full file stops the capture
+class MCURtpCaptureFile
+{
+  public:
+    MCURtpCaptureFile();
+    ~MCURtpCaptureFile();
+
+    BOOL Open(const PString & fileName, const PString & formatName, unsigned clockRate, unsigned payloadType);
+    void Close();
+
+    BOOL Write(const RTP_DataFrame & frame, uint64_t time_usec);
+
+    const PString & GetFileName() const
+    { return fileName; }
+
+    unsigned GetPackets() const
+    { return packets; }
+
+  protected:
+    BOOL WriteBytes(const BYTE * data, unsigned size);
+
+    FILE *file;
+    PString fileName;
+    uint64_t lastTime;
+    uint64_t size;
+    unsigned packets;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Reads a capture file. As the packet source of a replayed session it keeps the clock of the
+// replay, the time moves to the arrival of a packet or by the timeout of a read.
+class MCURtpCaptureReader
+{
+  public:
+    MCURtpCaptureReader();
+    ~MCURtpCaptureReader();
+
+    BOOL Open(const PString & fileName);
+    void Close();
+
+    // 1 - the next packet arrives within timeout_usec, the clock moves to its arrival,
+    // 0 - nothing arrives, the clock moves by timeout_usec, -1 - end of the capture
+    int Read(RTP_DataFrame & frame, uint64_t timeout_usec);
+
+    void Sleep(uint64_t usec)
+    { clock += usec; }
+
+    uint64_t GetTimeUsec() const
+    { return clock; }
+
+    // arrival of the last packet read
+    uint64_t GetLastArrivalUsec() const
+    { return lastArrival; }
+
+    BOOL IsEnd() const
+    { return !pending; }
+
+    const PString & GetFormatName() const
+    { return formatName; }
+
+    unsigned GetClockRate() const
+    { return clockRate; }
+
+    unsigned GetPayloadType() const
+    { return payloadType; }
+
+    unsigned GetPackets() const
+    { return packets; }
+
+    // packets with a payload type other than the one of the capture
+    unsigned GetPayloadMismatches() const
+    { return mismatches; }
+
+  protected:
+    BOOL ReadNext();
+    BOOL ReadBytes(BYTE * data, unsigned size);
+
+    FILE *file;
+    PString formatName;
+    unsigned clockRate;
+    unsigned payloadType;
+
+    // the packet read ahead
+    BOOL pending;
+    std::vector<BYTE> next;
+    uint64_t nextArrival;
+
+    uint64_t clock;
+    uint64_t lastArrival;
+    unsigned packets;
+    unsigned mismatches;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Replays a capture through the receive path of a member without sockets: MCU_RTPChannel::Receive
+// with the reorder queue or the jitter buffer of MCU_RTP_UDP, the depacketiser and the decoder of
+// the codec, the mixers of a room. Every frame written to the room is followed by a read of the mix
+// and both are checksummed. The packets arrive on the clock of the capture and nothing waits, the
+// result of a capture is the same on every run.
+class MCURtpReplay
+{
+  public:
+    // the room is created for the replay and removed after it, the mixed video is read at width x height
+    static BOOL Run(const PString & fileName, const PString & room, unsigned width, unsigned height, MCUJSON & json, PString & error);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MCU_RTP_CAPTURE_H
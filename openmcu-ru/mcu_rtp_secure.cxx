@@ -249,57 +249,518 @@ void sip_zrtp_init()
 
 #if MCUSIP_SRTP
 
-BOOL SipSRTP::Init(const PString & crypto, const PString & key_str)
+static BOOL srtp_get_header_size(const BYTE * packet, int len, int & hlen)
 {
+  if(len < 12)
+    return FALSE;
+  hlen = 12 + 4 * (packet[0] & 0x0f);
+  if(packet[0] & 0x10)
+  {
+    if(len < hlen + 4)
+      return FALSE;
+    hlen += 4 + 4 * ((packet[hlen + 2] << 8) | packet[hlen + 3]);
+  }
+  return (hlen <= len);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class SipSRTPLibsrtp : public SipSRTPBackend
+{
+  public:
+    SipSRTPLibsrtp()
+      : m_session(NULL)
+    { }
+    ~SipSRTPLibsrtp()
+    {
+      if(m_session)
+        srtp_dealloc(m_session);
+    }
+
+    BOOL Init(const PString & crypto, BYTE * key_salt)
+    {
+      srtp_policy_t policy;
+      memset(&policy, 0, sizeof(policy));
+      if(crypto == AES_CM_128_HMAC_SHA1_80)
+        crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtp);
+      else if(crypto == AES_CM_128_HMAC_SHA1_32)
+        crypto_policy_set_aes_cm_128_hmac_sha1_32(&policy.rtp);
+      else
+        return FALSE;
+      // This is all a bit vague in docs for libSRTP. Had to look into source to figure it out.
+      policy.key = key_salt;
+      policy.ssrc.value = 0;
+      policy.ssrc.type = ssrc_any_inbound;
+      policy.next = NULL;
+      if(SRTP_ERROR(srtp_create, (&m_session, &policy)))
+      {
+        m_session = NULL;
+        return FALSE;
+      }
+      return TRUE;
+    }
+
+    virtual const PString & GetName() const
+    { return SRTP_BACKEND_LIBSRTP; }
+
+    virtual BOOL Protect(BYTE * packet, int & len)
+    { return !SRTP_ERROR(srtp_protect, (m_session, packet, &len)); }
+
+    virtual BOOL Unprotect(BYTE * packet, int & len)
+    { return !SRTP_ERROR(srtp_unprotect, (m_session, packet, &len)); }
+
+  protected:
+    srtp_t m_session;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if MCUSIP_SRTP_OPENSSL
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+// streams of a session with their own rollover counter and replay window, the state
+// of the least recently used one is dropped above the limit
+#define SRTP_MAX_STREAMS 16
+
+// RFC 3711 AES-CM with HMAC-SHA1 and RFC 7714 AES-GCM on the EVP ciphers of OpenSSL,
+// the keys are expanded once and the HMAC pads are hashed once per session
+class SipSRTPOpenSSL : public SipSRTPBackend
+{
+  public:
+    SipSRTPOpenSSL()
+      : m_gcm(FALSE), m_tag_length(0), m_cipher(NULL), m_decipher(NULL),
+        m_hmac_inner(NULL), m_hmac_outer(NULL), m_hmac(NULL), m_use(0)
+    { }
+    ~SipSRTPOpenSSL()
+    {
+      if(m_cipher)
+        EVP_CIPHER_CTX_free(m_cipher);
+      if(m_decipher)
+        EVP_CIPHER_CTX_free(m_decipher);
+      if(m_hmac_inner)
+        EVP_MD_CTX_free(m_hmac_inner);
+      if(m_hmac_outer)
+        EVP_MD_CTX_free(m_hmac_outer);
+      if(m_hmac)
+        EVP_MD_CTX_free(m_hmac);
+      memset(m_session_salt, 0, sizeof(m_session_salt));
+    }
+
+    BOOL Init(const PString & crypto, const BYTE * key, int key_length, const BYTE * salt, int salt_length)
+    {
+      const EVP_CIPHER *ctr = (key_length == 32 ? EVP_aes_256_ctr() : EVP_aes_128_ctr());
+      if(crypto == AES_CM_128_HMAC_SHA1_80 || crypto == AES_CM_128_HMAC_SHA1_32)
+      {
+        m_tag_length = (crypto == AES_CM_128_HMAC_SHA1_80 ? 10 : 4);
+      }
+      else if(crypto == AEAD_AES_128_GCM || crypto == AEAD_AES_256_GCM)
+      {
+        m_gcm = TRUE;
+        m_tag_length = 16;
+      }
+      else
+        return FALSE;
+
+      // session keys, RFC 3711 4.3, the key derivation rate is 0
+      BYTE session_key[32];
+      BYTE auth_key[20];
+      if(!Derive(ctr, key, salt, salt_length, 0x00, session_key, key_length))
+        return FALSE;
+      if(!Derive(ctr, key, salt, salt_length, 0x02, m_session_salt, salt_length))
+        return FALSE;
+
+      BOOL ok = FALSE;
+      m_cipher = EVP_CIPHER_CTX_new();
+      if(m_gcm)
+      {
+        const EVP_CIPHER *gcm = (key_length == 32 ? EVP_aes_256_gcm() : EVP_aes_128_gcm());
+        m_decipher = EVP_CIPHER_CTX_new();
+        ok = (m_cipher && m_decipher &&
+              EVP_EncryptInit_ex(m_cipher, gcm, NULL, session_key, NULL) == 1 &&
+              EVP_DecryptInit_ex(m_decipher, gcm, NULL, session_key, NULL) == 1);
+      }
+      else if(Derive(ctr, key, salt, salt_length, 0x01, auth_key, sizeof(auth_key)))
+      {
+        // the digest contexts of EVP, SHA1_* is deprecated since OpenSSL 3.0
+        m_hmac_inner = EVP_MD_CTX_new();
+        m_hmac_outer = EVP_MD_CTX_new();
+        m_hmac = EVP_MD_CTX_new();
+        ok = (m_cipher && m_hmac_inner && m_hmac_outer && m_hmac &&
+              EVP_EncryptInit_ex(m_cipher, ctr, NULL, session_key, NULL) == 1);
+        BYTE pad[64];
+        memset(pad, 0x36, sizeof(pad));
+        for(unsigned i = 0; i < sizeof(auth_key); i++)
+          pad[i] ^= auth_key[i];
+        ok = ok && EVP_DigestInit_ex(m_hmac_inner, EVP_sha1(), NULL) == 1 &&
+                   EVP_DigestUpdate(m_hmac_inner, pad, sizeof(pad)) == 1;
+        memset(pad, 0x5c, sizeof(pad));
+        for(unsigned i = 0; i < sizeof(auth_key); i++)
+          pad[i] ^= auth_key[i];
+        ok = ok && EVP_DigestInit_ex(m_hmac_outer, EVP_sha1(), NULL) == 1 &&
+                   EVP_DigestUpdate(m_hmac_outer, pad, sizeof(pad)) == 1;
+        memset(pad, 0, sizeof(pad));
+      }
+      memset(session_key, 0, sizeof(session_key));
+      memset(auth_key, 0, sizeof(auth_key));
+      return ok;
+    }
+
+    virtual const PString & GetName() const
+    { return SRTP_BACKEND_OPENSSL; }
+
+    virtual BOOL Protect(BYTE * packet, int & len)
+    {
+      int hlen;
+      if(!srtp_get_header_size(packet, len, hlen))
+        return FALSE;
+      // the sender counts the rollovers of the sequence numbers of each of its streams
+      Stream & stream = GetStream(packet);
+      WORD seq = (packet[2] << 8) | packet[3];
+      uint64_t index = seq;
+      if(stream.started)
+      {
+        short delta = (short)(WORD)(seq - (WORD)stream.index);
+        if(delta >= 0 || (uint64_t)(-delta) <= stream.index)
+          index = stream.index + delta;
+      }
+      if(!stream.started || index > stream.index)
+      {
+        stream.index = index;
+        stream.started = TRUE;
+      }
+      return Transform(packet, len, hlen, index, TRUE);
+    }
+
+    virtual BOOL Unprotect(BYTE * packet, int & len)
+    {
+      int hlen;
+      if(!srtp_get_header_size(packet, len - m_tag_length, hlen))
+        return FALSE;
+      // RFC 3711 3.3.1, the index is guessed from the highest authenticated one of the SSRC,
+      // a stream is added after the first authenticated packet
+      DWORD ssrc = ((DWORD)packet[8] << 24) | ((DWORD)packet[9] << 16) | ((DWORD)packet[10] << 8) | packet[11];
+      StreamMap::iterator it = m_streams.find(ssrc);
+      Stream empty;
+      Stream & stream = (it != m_streams.end() ? it->second : empty);
+      WORD seq = (packet[2] << 8) | packet[3];
+      uint64_t index = seq;
+      if(stream.started)
+      {
+        uint32_t roc = (uint32_t)(stream.index >> 16);
+        WORD last = (WORD)stream.index;
+        if(last < 0x8000)
+        {
+          if(seq > last && seq - last > 0x8000 && roc > 0)
+            roc--;
+        }
+        else if(last - 0x8000 > seq)
+          roc++;
+        index = ((uint64_t)roc << 16) | seq;
+        // 64 packets replay window
+        if(index <= stream.index)
+        {
+          uint64_t delta = stream.index - index;
+          if(delta >= 64 || (stream.window & ((uint64_t)1 << delta)))
+            return FALSE;
+        }
+      }
+      if(!Transform(packet, len, hlen, index, FALSE))
+        return FALSE;
+      Stream & known = (it != m_streams.end() ? it->second : GetStream(packet));
+      if(!known.started || index > known.index)
+      {
+        uint64_t delta = (known.started ? index - known.index : 64);
+        known.window = (delta >= 64 ? 0 : known.window << delta) | 1;
+        known.index = index;
+        known.started = TRUE;
+      }
+      else
+        known.window |= (uint64_t)1 << (known.index - index);
+      known.use = ++m_use;
+      return TRUE;
+    }
+
+  protected:
+    // the highest index and the replay window of the received ones, the last sent one
+    struct Stream
+    {
+      Stream()
+        : started(FALSE), index(0), window(0), use(0)
+      { }
+      BOOL     started;
+      uint64_t index;
+      uint64_t window;
+      uint64_t use;
+    };
+    typedef std::map<DWORD, Stream> StreamMap;
+
+    Stream & GetStream(const BYTE * packet)
+    {
+      DWORD ssrc = ((DWORD)packet[8] << 24) | ((DWORD)packet[9] << 16) | ((DWORD)packet[10] << 8) | packet[11];
+      StreamMap::iterator it = m_streams.find(ssrc);
+      if(it == m_streams.end())
+      {
+        if(m_streams.size() >= SRTP_MAX_STREAMS)
+        {
+          StreamMap::iterator oldest = m_streams.begin();
+          for(StreamMap::iterator jt = m_streams.begin(); jt != m_streams.end(); ++jt)
+          {
+            if(jt->second.use < oldest->second.use)
+              oldest = jt;
+          }
+          m_streams.erase(oldest);
+        }
+        it = m_streams.insert(StreamMap::value_type(ssrc, Stream())).first;
+      }
+      it->second.use = ++m_use;
+      return it->second;
+    }
+
+    static BOOL Derive(const EVP_CIPHER * ctr, const BYTE * key, const BYTE * salt, int salt_length, BYTE label, BYTE * out, int out_length)
+    {
+      // x = label * 2^48 XOR master salt, the keystream of AES-CM with IV = x * 2^16
+      BYTE iv[16];
+      memset(iv, 0, sizeof(iv));
+      memcpy(iv, salt, PMIN(salt_length, 14));
+      iv[7] ^= label;
+      memset(out, 0, out_length);
+      EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+      int outl = 0;
+      BOOL ok = (ctx && EVP_EncryptInit_ex(ctx, ctr, NULL, key, iv) == 1 &&
+                 EVP_EncryptUpdate(ctx, out, &outl, out, out_length) == 1);
+      if(ctx)
+        EVP_CIPHER_CTX_free(ctx);
+      return ok;
+    }
+
+    BOOL Transform(BYTE * packet, int & len, int hlen, uint64_t index, BOOL protect)
+    {
+      BYTE iv[16];
+      int outl = 0;
+      if(m_gcm)
+      {
+        // RFC 7714 8.1, IV = (00 00 || SSRC || ROC || SEQ) XOR salt, the header is the AAD
+        memset(iv, 0, sizeof(iv));
+        memcpy(iv + 2, packet + 8, 4);
+        iv[6] = (BYTE)(index >> 40); iv[7] = (BYTE)(index >> 32); iv[8] = (BYTE)(index >> 24);
+        iv[9] = (BYTE)(index >> 16); iv[10] = (BYTE)(index >> 8); iv[11] = (BYTE)index;
+        for(int i = 0; i < 12; i++)
+          iv[i] ^= m_session_salt[i];
+        if(protect)
+        {
+          int plen = len - hlen;
+          if(EVP_EncryptInit_ex(m_cipher, NULL, NULL, NULL, iv) != 1 ||
+             EVP_EncryptUpdate(m_cipher, NULL, &outl, packet, hlen) != 1 ||
+             EVP_EncryptUpdate(m_cipher, packet + hlen, &outl, packet + hlen, plen) != 1 ||
+             EVP_EncryptFinal_ex(m_cipher, packet + hlen + plen, &outl) != 1 ||
+             EVP_CIPHER_CTX_ctrl(m_cipher, EVP_CTRL_GCM_GET_TAG, m_tag_length, packet + len) != 1)
+            return FALSE;
+          len += m_tag_length;
+        }
+        else
+        {
+          int plen = len - hlen - m_tag_length;
+          if(EVP_DecryptInit_ex(m_decipher, NULL, NULL, NULL, iv) != 1 ||
+             EVP_CIPHER_CTX_ctrl(m_decipher, EVP_CTRL_GCM_SET_TAG, m_tag_length, packet + hlen + plen) != 1 ||
+             EVP_DecryptUpdate(m_decipher, NULL, &outl, packet, hlen) != 1 ||
+             EVP_DecryptUpdate(m_decipher, packet + hlen, &outl, packet + hlen, plen) != 1 ||
+             EVP_DecryptFinal_ex(m_decipher, packet + hlen + plen, &outl) != 1)
+            return FALSE;
+          len -= m_tag_length;
+        }
+        return TRUE;
+      }
+
+      // RFC 3711 4.1.1, IV = salt * 2^16 XOR SSRC * 2^64 XOR index * 2^16
+      memset(iv, 0, sizeof(iv));
+      memcpy(iv, m_session_salt, 14);
+      for(int i = 0; i < 4; i++)
+        iv[4 + i] ^= packet[8 + i];
+      for(int i = 0; i < 6; i++)
+        iv[8 + i] ^= (BYTE)(index >> (40 - 8 * i));
+
+      BYTE roc[4];
+      roc[0] = (BYTE)(index >> 40); roc[1] = (BYTE)(index >> 32); roc[2] = (BYTE)(index >> 24); roc[3] = (BYTE)(index >> 16);
+      BYTE tag[SHA_DIGEST_LENGTH];
+      if(protect)
+      {
+        if(EVP_EncryptInit_ex(m_cipher, NULL, NULL, NULL, iv) != 1 ||
+           EVP_EncryptUpdate(m_cipher, packet + hlen, &outl, packet + hlen, len - hlen) != 1)
+          return FALSE;
+        if(!Authenticate(packet, len, roc, tag))
+          return FALSE;
+        memcpy(packet + len, tag, m_tag_length);
+        len += m_tag_length;
+      }
+      else
+      {
+        len -= m_tag_length;
+        if(!Authenticate(packet, len, roc, tag) || CRYPTO_memcmp(tag, packet + len, m_tag_length) != 0)
+        {
+          len += m_tag_length;
+          return FALSE;
+        }
+        if(EVP_EncryptInit_ex(m_cipher, NULL, NULL, NULL, iv) != 1 ||
+           EVP_EncryptUpdate(m_cipher, packet + hlen, &outl, packet + hlen, len - hlen) != 1)
+          return FALSE;
+      }
+      return TRUE;
+    }
+
+    BOOL Authenticate(const BYTE * packet, int len, const BYTE * roc, BYTE * tag)
+    {
+      // HMAC-SHA1 of the packet and the ROC, from the hashed pads
+      unsigned int tag_length = 0;
+      return (EVP_MD_CTX_copy_ex(m_hmac, m_hmac_inner) == 1 &&
+              EVP_DigestUpdate(m_hmac, packet, len) == 1 &&
+              EVP_DigestUpdate(m_hmac, roc, 4) == 1 &&
+              EVP_DigestFinal_ex(m_hmac, tag, &tag_length) == 1 &&
+              EVP_MD_CTX_copy_ex(m_hmac, m_hmac_outer) == 1 &&
+              EVP_DigestUpdate(m_hmac, tag, SHA_DIGEST_LENGTH) == 1 &&
+              EVP_DigestFinal_ex(m_hmac, tag, &tag_length) == 1);
+    }
+
+    BOOL               m_gcm;
+    int                m_tag_length;
+    BYTE               m_session_salt[14];
+    EVP_CIPHER_CTX   * m_cipher;
+    EVP_CIPHER_CTX   * m_decipher;
+    EVP_MD_CTX       * m_hmac_inner;
+    EVP_MD_CTX       * m_hmac_outer;
+    EVP_MD_CTX       * m_hmac;
+
+    StreamMap          m_streams;
+    uint64_t           m_use;
+};
+#endif // MCUSIP_SRTP_OPENSSL
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if MCUSIP_SRTP_OPENSSL
+PString SipSRTP::m_default_backend = SRTP_BACKEND_OPENSSL;
+#else
+PString SipSRTP::m_default_backend = SRTP_BACKEND_LIBSRTP;
+#endif
+
+SipSRTP::SipSRTP()
+  : m_backend(NULL), m_key_length(0), m_salt_length(0)
+{
+  SetCryptoPolicy(AES_CM_128_HMAC_SHA1_80);
+}
+
+SipSRTP::~SipSRTP()
+{
+  if(m_backend)
+    delete m_backend;
+}
+
+BOOL SipSRTP::SetDefaultBackend(const PString & name)
+{
+  if(GetBackends().GetStringsIndex(name) == P_MAX_INDEX)
+    return FALSE;
+  m_default_backend = name;
+  return TRUE;
+}
+
+const PString & SipSRTP::GetDefaultBackend()
+{
+  return m_default_backend;
+}
+
+PStringArray SipSRTP::GetBackends()
+{
+  PStringArray backends;
+  backends.AppendString(SRTP_BACKEND_LIBSRTP);
+#if MCUSIP_SRTP_OPENSSL
+  backends.AppendString(SRTP_BACKEND_OPENSSL);
+#endif
+  return backends;
+}
+
+BOOL SipSRTP::IsSupported(const PString & crypto, const PString & backend)
+{
+  if(crypto == AES_CM_128_HMAC_SHA1_80 || crypto == AES_CM_128_HMAC_SHA1_32)
+    return TRUE;
+#if MCUSIP_SRTP_OPENSSL
+  // libsrtp 1.4 has no GCM
+  if(crypto == AEAD_AES_128_GCM || crypto == AEAD_AES_256_GCM)
+    return (backend != SRTP_BACKEND_LIBSRTP);
+#endif
+  return FALSE;
+}
+
+BOOL SipSRTP::Init(const PString & crypto, const PString & key_str, const PString & backend)
+{
+  if(m_backend)
+    return FALSE;
   if(!SetCryptoPolicy(crypto))
     return FALSE;
   if(!SetKey(key_str))
     return FALSE;
 
-  BYTE key_salt[32];
-  // This is all a bit vague in docs for libSRTP. Had to look into source to figure it out.
+  PString name = backend;
+  if(name == "")
+    name = m_default_backend;
+  // GCM only in OpenSSL
+  if(!IsSupported(crypto, name))
+    name = SRTP_BACKEND_OPENSSL;
+
+  BYTE key_salt[64];
   memcpy(key_salt, m_key, std::min(m_key_length, m_key.GetSize()));
   memcpy(&key_salt[m_key_length], m_salt, std::min(m_salt_length, m_salt.GetSize()));
-  //append_salt_to_key(key_salt, std::min(m_key_length, m_key.GetSize()),
-  //                             m_salt.GetPointer(), m_salt.GetSize());
-  m_policy.key = key_salt;
-  m_policy.ssrc.value = 0;
-  m_policy.ssrc.type = ssrc_any_inbound;
-
-  if(SRTP_ERROR(srtp_create, (&m_session, NULL)))
-    return FALSE;
 
-  if(SRTP_ERROR(srtp_add_stream, (m_session, &m_policy)))
-    return FALSE;
+#if MCUSIP_SRTP_OPENSSL
+  if(name == SRTP_BACKEND_OPENSSL)
+  {
+    SipSRTPOpenSSL *backend_openssl = new SipSRTPOpenSSL();
+    m_backend = backend_openssl;
+    if(!backend_openssl->Init(crypto, key_salt, m_key_length, key_salt + m_key_length, m_salt_length))
+    {
+      PTRACE(1, "SRTP\tOpenSSL initialization failed for " << crypto);
+      return FALSE;
+    }
+  }
+#endif
+  if(m_backend == NULL)
+  {
+    SipSRTPLibsrtp *backend_libsrtp = new SipSRTPLibsrtp();
+    m_backend = backend_libsrtp;
+    if(!backend_libsrtp->Init(crypto, key_salt))
+      return FALSE;
+  }
+  memset(key_salt, 0, sizeof(key_salt));
 
-  PTRACE(1, "SRTP\tCreate SRTP session for direction");
+  PTRACE(1, "SRTP\tCreate SRTP session " << crypto << " " << m_backend->GetName());
   return TRUE;
 }
 
 BOOL SipSRTP::SetCryptoPolicy(const PString & type)
 {
-  if(type == AES_CM_128_HMAC_SHA1_80)
+  if(type == AES_CM_128_HMAC_SHA1_80 || type == AES_CM_128_HMAC_SHA1_32)
   {
-    m_profile = srtp_profile_aes128_cm_sha1_80;
-    m_key_bits = 128;
-    m_salt_bits = 112;
-    m_key_length = srtp_profile_get_master_key_length(m_profile);
-    m_salt_length = srtp_profile_get_master_salt_length(m_profile);
-    crypto_policy_set_aes_cm_128_hmac_sha1_80(&m_policy.rtp);
-    return TRUE;
+    m_key_length = 16;
+    m_salt_length = 14;
   }
-  else if(type == AES_CM_128_HMAC_SHA1_32)
+  else if(type == AEAD_AES_128_GCM && IsSupported(type))
   {
-    m_profile = srtp_profile_aes128_cm_sha1_32;
-    m_key_bits = 128;
-    m_salt_bits = 32;
-    m_key_length = srtp_profile_get_master_key_length(m_profile);
-    m_salt_length = srtp_profile_get_master_salt_length(m_profile);
-    crypto_policy_set_aes_cm_128_hmac_sha1_32(&m_policy.rtp);
-    return TRUE;
+    m_key_length = 16;
+    m_salt_length = 12;
   }
-  PTRACE(1, "SRTP\tunknown policy!");
-  return FALSE;
+  else if(type == AEAD_AES_256_GCM && IsSupported(type))
+  {
+    m_key_length = 32;
+    m_salt_length = 12;
+  }
+  else
+  {
+    PTRACE(1, "SRTP\tunknown policy!");
+    return FALSE;
+  }
+  m_crypto = type;
+  return TRUE;
 }
 
 BOOL SipSRTP::SetKey(const PString & key_str)
@@ -328,7 +789,7 @@ BOOL SipSRTP::SetKey(const PBYTEArray & key_salt)
 
 void SipSRTP::SetRandomKey()
 {
-  SetKey(srtp_get_random_keysalt());
+  SetKey(srtp_get_random_keysalt(m_key_length + m_salt_length));
 }
 
 PString SipSRTP::GetKey() const
@@ -369,12 +830,12 @@ void sip_rtp_shutdown()
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-PString srtp_get_random_keysalt()
+PString srtp_get_random_keysalt(PINDEX size)
 {
 #if MCUSIP_SRTP
-  PBYTEArray key_salt(30);
+  PBYTEArray key_salt(size);
   // set key to random value
-  crypto_get_random(key_salt.GetPointer(), 30);
+  crypto_get_random(key_salt.GetPointer(), size);
   return PBase64::Encode(key_salt);
 #else
   return "";
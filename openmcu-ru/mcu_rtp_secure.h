@@ -30,11 +30,13 @@
 
 static const PString AES_CM_128_HMAC_SHA1_80("AES_CM_128_HMAC_SHA1_80");
 static const PString AES_CM_128_HMAC_SHA1_32("AES_CM_128_HMAC_SHA1_32");
+static const PString AEAD_AES_128_GCM("AEAD_AES_128_GCM");
+static const PString AEAD_AES_256_GCM("AEAD_AES_256_GCM");
 
 void sip_rtp_init();
 void sip_rtp_shutdown();
 
-PString srtp_get_random_keysalt();
+PString srtp_get_random_keysalt(PINDEX size = 30);
 
 #if MCUSIP_ZRTP
 extern zrtp_zid_t zrtp_zid;
@@ -60,38 +62,60 @@ BOOL ZRTPError(zrtp_status_t err, const char * fn, const char * file, int line);
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #if MCUSIP_SRTP
+
+// the longest trailer of the supported profiles, the tag of AEAD_AES_*_GCM
+#define SIP_SRTP_MAX_TRAILER_LEN 16
+
+static const PString SRTP_BACKEND_LIBSRTP("libsrtp");
+static const PString SRTP_BACKEND_OPENSSL("openssl");
+
+// packet transform of one SRTP direction,
+// libsrtp or the OpenSSL EVP ciphers that use AES-NI and CLMUL when the processor has them
+class SipSRTPBackend
+{
+  public:
+    virtual ~SipSRTPBackend() { };
+    virtual const PString & GetName() const = 0;
+    // in place, the buffer has SIP_SRTP_MAX_TRAILER_LEN bytes after the packet
+    virtual BOOL Protect(BYTE * packet, int & len) = 0;
+    virtual BOOL Unprotect(BYTE * packet, int & len) = 0;
+};
+
 class SipSRTP
 {
   public:
-    SipSRTP()
-    {
-      memset(&m_policy, 0, sizeof(m_policy));
-      m_policy.next = NULL;
-      SetCryptoPolicy(AES_CM_128_HMAC_SHA1_80);
-    };
-    ~SipSRTP()
-    {
-      srtp_dealloc(m_session);
-    };
-
-    BOOL Init(const PString & crypto, const PString & key_str);
+    SipSRTP();
+    ~SipSRTP();
+
+    // backend of the new sessions, the fastest one when the name is empty
+    static BOOL SetDefaultBackend(const PString & name);
+    static const PString & GetDefaultBackend();
+    static PStringArray GetBackends();
+    static BOOL IsSupported(const PString & crypto, const PString & backend = "");
+
+    BOOL Init(const PString & crypto, const PString & key_str, const PString & backend = "");
     BOOL SetCryptoPolicy(const PString & crypto);
     BOOL SetKey(const PString & key_str);
     BOOL SetKey(const PBYTEArray & key_salt);
     void SetRandomKey();
     PString GetKey() const;
-    srtp_t & GetSession() { return m_session; };
+
+    BOOL Protect(BYTE * packet, int & len)
+    { return m_backend->Protect(packet, len); }
+    BOOL Unprotect(BYTE * packet, int & len)
+    { return m_backend->Unprotect(packet, len); }
+    const PString & GetBackendName() const
+    { return m_backend->GetName(); }
 
   protected:
-    srtp_profile_t    m_profile;
-    srtp_t            m_session;
-    srtp_policy_t     m_policy;
+    static PString    m_default_backend;
+
+    SipSRTPBackend  * m_backend;
+    PString           m_crypto;
 
     PBYTEArray        m_key;
     PBYTEArray        m_salt;
-    PINDEX            m_key_bits;
     PINDEX            m_key_length;
-    PINDEX            m_salt_bits;
     PINDEX            m_salt_length;
 };
 #endif // MCUSIP_SRTP
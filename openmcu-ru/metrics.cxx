@@ -0,0 +1,409 @@
+/*
+ * metrics.cxx
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+#include "mcu.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const int64_t MCUMetric::bucketBounds[METRIC_BUCKETS] =
+  { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000 };
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PMutex MCUMetrics::metricMutex;
+MCUMetrics::MetricMap MCUMetrics::metricMap;
+
+MCUMetric MCUMetrics::rtpPacketsReceived(MCUMetric::Counter, "mcu_rtp_packets_received_total", "RTP data packets received");
+MCUMetric MCUMetrics::rtpPacketsSent(MCUMetric::Counter, "mcu_rtp_packets_sent_total", "RTP data packets sent");
+MCUMetric MCUMetrics::rtpPacketsLost(MCUMetric::Counter, "mcu_rtp_packets_lost_total", "RTP data packets lost, from the sequence numbers");
+MCUMetric MCUMetrics::rtpPacketsReordered(MCUMetric::Counter, "mcu_rtp_packets_reordered_total", "RTP data packets received out of order");
+MCUMetric MCUMetrics::jitterPacketsLate(MCUMetric::Counter, "mcu_jitter_packets_late_total", "RTP packets dropped by the jitter buffers, older than the frame played");
+MCUMetric MCUMetrics::mixerCompose(MCUMetric::Histogram, "mcu_mixer_compose_seconds", "Video mixer frame composition time");
+MCUMetric MCUMetrics::mixerFrameLatency(MCUMetric::Histogram, "mcu_mixer_frame_latency_seconds", "Time from a member frame written into the video mixer to the first composed frame with it");
+MCUMetric MCUMetrics::sipRequestsReceived(MCUMetric::Counter, "mcu_sip_requests_received_total", "SIP requests received");
+MCUMetric MCUMetrics::sipResponsesReceived(MCUMetric::Counter, "mcu_sip_responses_received_total", "SIP responses received");
+MCUMetric MCUMetrics::sipMessagesSent(MCUMetric::Counter, "mcu_sip_messages_sent_total", "SIP messages sent by the endpoint thread");
+MCUMetric MCUMetrics::registrarRegistrations(MCUMetric::Counter, "mcu_registrar_registrations_total", "SIP REGISTER and H.323 RRQ received by the registrar");
+MCUMetric MCUMetrics::registrarTimerVisits(MCUMetric::Counter, "mcu_registrar_timer_visits_total", "Accounts, connections and subscriptions visited by the registrar timer");
+MCUMetric MCUMetrics::statusRequests(MCUMetric::Counter, "mcu_status_requests_total", "Status and member list documents requested by the web pages");
+MCUMetric MCUMetrics::statusBuilds(MCUMetric::Counter, "mcu_status_builds_total", "Status and member list documents built by the status cache");
+MCUMetric MCUMetrics::statusNotModified(MCUMetric::Counter, "mcu_status_not_modified_total", "Status requests answered with 304 Not Modified");
+
+static MCUMetric * const staticMetrics[] =
+{
+  &MCUMetrics::rtpPacketsReceived,
+  &MCUMetrics::rtpPacketsSent,
+  &MCUMetrics::rtpPacketsLost,
+  &MCUMetrics::rtpPacketsReordered,
+  &MCUMetrics::jitterPacketsLate,
+  &MCUMetrics::mixerCompose,
+  &MCUMetrics::mixerFrameLatency,
+  &MCUMetrics::sipRequestsReceived,
+  &MCUMetrics::sipResponsesReceived,
+  &MCUMetrics::sipMessagesSent,
+  &MCUMetrics::registrarRegistrations,
+  &MCUMetrics::registrarTimerVisits,
+  &MCUMetrics::statusRequests,
+  &MCUMetrics::statusBuilds,
+  &MCUMetrics::statusNotModified
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUMetric::MCUMetric(Types _type, const PString & _name, const PString & _help, const PString & _labels)
+  : type(_type), name(_name), help(_help), labels(_labels), refs(0)
+{
+  memset(shards, 0, sizeof(shards));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetric::Observe(int64_t usec)
+{
+  int i = 0;
+  while(i < METRIC_BUCKETS && usec > bucketBounds[i])
+    i++;
+  Shard & shard = shards[GetShard()];
+  sync_fetch_and_add64(&shard.buckets[i], 1);
+  sync_fetch_and_add64(&shard.value, usec);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int64_t MCUMetric::GetValue()
+{
+  int64_t value = 0;
+  for(int s = 0; s < METRIC_SHARDS; s++)
+    value += sync_fetch_and_add64(&shards[s].value, 0);
+  return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int64_t MCUMetric::GetCount()
+{
+  if(type != Histogram)
+    return GetValue();
+  int64_t count = 0;
+  for(int s = 0; s < METRIC_SHARDS; s++)
+    for(int i = 0; i <= METRIC_BUCKETS; i++)
+      count += sync_fetch_and_add64(&shards[s].buckets[i], 0);
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetric::PrintOn(ostream & strm)
+{
+  if(type != Histogram)
+  {
+    MCUMetrics::PrintSample(strm, name, labels, GetValue());
+    return;
+  }
+
+  // the buckets are kept apart and summed here, an observation is two atomic additions
+  PString prefix = labels.IsEmpty() ? PString() : labels + ",";
+  int64_t count = 0;
+  for(int i = 0; i <= METRIC_BUCKETS; i++)
+  {
+    for(int s = 0; s < METRIC_SHARDS; s++)
+      count += sync_fetch_and_add64(&shards[s].buckets[i], 0);
+    PString le = "+Inf";
+    if(i < METRIC_BUCKETS)
+      le = psprintf("%g", (double)bucketBounds[i] / 1000000);
+    MCUMetrics::PrintSample(strm, name + "_bucket", prefix + "le=\"" + le + "\"", count);
+  }
+  double sum = (double)GetValue() / 1000000;
+  strm << name << "_sum";
+  if(!labels.IsEmpty())
+    strm << "{" << labels << "}";
+  strm << " " << psprintf("%.6f", sum) << "\n";
+  MCUMetrics::PrintSample(strm, name + "_count", labels, count);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUMetric * MCUMetrics::Acquire(MCUMetric::Types type, const PString & name, const PString & help, const PString & labels)
+{
+  PWaitAndSignal m(metricMutex);
+  PString key = name + "{" + labels + "}";
+  MetricMap::iterator it = metricMap.find(key);
+  MCUMetric * metric;
+  if(it != metricMap.end())
+    metric = it->second;
+  else
+  {
+    metric = new MCUMetric(type, name, help, labels);
+    metricMap.insert(MetricMap::value_type(key, metric));
+  }
+  metric->refs++;
+  return metric;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetrics::Release(MCUMetric *& metric)
+{
+  if(metric == NULL)
+    return;
+  PWaitAndSignal m(metricMutex);
+  if(--metric->refs <= 0)
+  {
+    metricMap.erase(metric->GetName() + "{" + metric->GetLabels() + "}");
+    delete metric;
+  }
+  metric = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t MCUMetrics::GetUpdates()
+{
+  // a gauge value is not a number of updates, the counters added with Add() overestimate
+  uint64_t updates = 0;
+  for(unsigned i = 0; i < PARRAYSIZE(staticMetrics); i++)
+    updates += staticMetrics[i]->GetCount();
+
+  PWaitAndSignal m(metricMutex);
+  for(MetricMap::iterator it = metricMap.begin(); it != metricMap.end(); ++it)
+  {
+    if(it->second->GetType() != MCUMetric::Gauge)
+      updates += it->second->GetCount();
+  }
+  return updates;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString MCUMetrics::Label(const PString & name, const PString & value)
+{
+  PString escaped = value;
+  escaped.Replace("\\", "\\\\", TRUE);
+  escaped.Replace("\"", "\\\"", TRUE);
+  escaped.Replace("\n", "\\n", TRUE);
+  return name + "=\"" + escaped + "\"";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetrics::PrintHeader(ostream & strm, const PString & name, const char * type, const PString & help)
+{
+  strm << "# HELP " << name << " " << help << "\n"
+       << "# TYPE " << name << " " << type << "\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetrics::PrintSample(ostream & strm, const PString & name, const PString & labels, int64_t value)
+{
+  strm << name;
+  if(!labels.IsEmpty())
+    strm << "{" << labels << "}";
+  strm << " " << PString(PString::Signed, value) << "\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetrics::PrintRooms(ostream & strm)
+{
+  // one stream per family, a family is printed under a single header
+  PStringStream members, received, lost, reordered, lostTx, cacheUsers, intraRequests, keyFrames, keyFramesForced;
+  unsigned roomCount = 0;
+
+  MCUH323EndPoint & ep = OpenMCU::Current().GetEndpoint();
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  MCUConferenceList & conferenceList = manager->GetConferenceList();
+  for(MCUConferenceList::shared_iterator it = conferenceList.begin(); it != conferenceList.end(); ++it)
+  {
+    Conference *conference = *it;
+    PString room = Label("room", conference->GetNumber());
+    unsigned online = 0;
+    roomCount++;
+
+    MCUMemberList & memberList = conference->GetMemberList();
+    for(MCUMemberList::shared_iterator it2 = memberList.begin(); it2 != memberList.end(); ++it2)
+    {
+      ConferenceMember *member = *it2;
+      if(member->GetType() == MEMBER_TYPE_CACHE)
+      {
+        ConferenceCacheMember *cacheMember = dynamic_cast<ConferenceCacheMember *>(member);
+        if(cacheMember == NULL)
+          continue;
+        PString labels = room + "," + Label("cache", cacheMember->GetCacheName());
+        PrintSample(cacheUsers, "mcu_cache_users", labels, cacheMember->GetCacheUsersNumber());
+        const CacheRTP *cache = cacheMember->GetCache();
+        if(cache && !cacheMember->IsAudio())
+        {
+          PrintSample(intraRequests, "mcu_cache_intra_requests_total", labels, cache->GetIntraRequests());
+          PrintSample(keyFrames, "mcu_cache_keyframes_total", labels, cache->GetKeyFrames());
+          PrintSample(keyFramesForced, "mcu_cache_keyframes_forced_total", labels, cache->GetKeyFramesForced());
+        }
+        continue;
+      }
+      if(!member->IsOnline())
+        continue;
+      online++;
+      if(member->GetType() != MEMBER_TYPE_CONN && member->GetType() != MEMBER_TYPE_STREAM)
+        continue;
+
+      MCUH323Connection *conn = ep.FindConnectionWithLock(member->GetCallToken());
+      if(conn == NULL)
+        continue;
+      PString labels = room + "," + Label("member", member->GetName());
+      for(int media = 0; media < 2; media++)
+      {
+        MCU_RTP_UDP *session = (MCU_RTP_UDP *)conn->GetSession(media == 0 ? RTP_Session::DefaultAudioSessionID : RTP_Session::DefaultVideoSessionID);
+        if(session == NULL)
+          continue;
+        PString sessionLabels = labels + "," + Label("media", media == 0 ? "audio" : "video");
+        PrintSample(received, "mcu_member_packets_received_total", sessionLabels, session->GetPacketsReceived());
+        PrintSample(lost, "mcu_member_packets_lost_total", sessionLabels, session->GetPacketsLost());
+        PrintSample(reordered, "mcu_member_packets_reordered_total", sessionLabels, session->GetPacketsOutOfOrder());
+        PrintSample(lostTx, "mcu_member_packets_lost_tx_total", sessionLabels, session->GetPacketsLostTx());
+      }
+      conn->Unlock();
+    }
+    PrintSample(members, "mcu_room_members", room, online);
+  }
+
+  PrintHeader(strm, "mcu_rooms", "gauge", "Rooms");
+  PrintSample(strm, "mcu_rooms", "", roomCount);
+  PrintHeader(strm, "mcu_room_members", "gauge", "Visible members of the room");
+  strm << members;
+  PrintHeader(strm, "mcu_member_packets_received_total", "counter", "RTP packets received from the member");
+  strm << received;
+  PrintHeader(strm, "mcu_member_packets_lost_total", "counter", "RTP packets from the member lost");
+  strm << lost;
+  PrintHeader(strm, "mcu_member_packets_reordered_total", "counter", "RTP packets from the member received out of order");
+  strm << reordered;
+  PrintHeader(strm, "mcu_member_packets_lost_tx_total", "counter", "RTP packets to the member lost, from the RTCP reports");
+  strm << lostTx;
+  PrintHeader(strm, "mcu_cache_users", "gauge", "Channels reading the cache encoder");
+  strm << cacheUsers;
+  PrintHeader(strm, "mcu_cache_intra_requests_total", "counter", "Intra frame requests of the cache readers");
+  strm << intraRequests;
+  PrintHeader(strm, "mcu_cache_keyframes_total", "counter", "Keyframes produced by the cache encoder");
+  strm << keyFrames;
+  PrintHeader(strm, "mcu_cache_keyframes_forced_total", "counter", "Keyframes forced for the merged intra requests");
+  strm << keyFramesForced;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetrics::PrintQueues(ostream & strm)
+{
+  PrintHeader(strm, "mcu_queue_depth", "gauge", "Messages waiting in the queues");
+  MCUSipEndPoint *sep = OpenMCU::Current().GetSipEndpoint();
+  if(sep)
+  {
+    PrintSample(strm, "mcu_queue_depth", Label("queue", "sip"), sep->GetSipQueue().GetSize());
+    PrintSample(strm, "mcu_queue_depth", Label("queue", "sip_msg"), sep->GetSipMsgQueue().GetSize());
+  }
+  Registrar *registrar = OpenMCU::Current().GetRegistrar();
+  if(registrar)
+  {
+    PrintSample(strm, "mcu_queue_depth", Label("queue", "registrar"), registrar->GetQueue().GetSize());
+    PrintSample(strm, "mcu_queue_depth", Label("queue", "registrar_timer"), registrar->GetTimer().GetSize());
+  }
+#if MCU_SOCKET_REACTOR
+  MCUSocketReactor *reactor = OpenMCU::Current().GetSocketReactor();
+  if(reactor)
+  {
+    PrintSample(strm, "mcu_queue_depth", Label("queue", "socket_reactor"), reactor->GetQueueSize());
+    PrintHeader(strm, "mcu_reactor_sockets", "gauge", "Sockets watched by the socket reactor");
+    PrintSample(strm, "mcu_reactor_sockets", "", reactor->GetSocketCount());
+  }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUMetrics::PrintThreads(ostream & strm)
+{
+  // threads grouped by the name prefix, as in the benchmark: "cache", "snapshot", ...
+#ifdef __linux__
+  std::map<PString, unsigned> groups;
+  PDirectory dir("/proc/self/task");
+  if(!dir.Open())
+    return;
+  do
+  {
+    PString tid = dir.GetEntryName();
+    if(tid == "." || tid == "..")
+      continue;
+    FILE *f = fopen("/proc/self/task/" + tid + "/comm", "r");
+    if(f == NULL)
+      continue;
+    char buf[64];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = 0;
+    PString name = PString(buf).Trim();
+    PINDEX colon = name.Find(":");
+    if(colon != P_MAX_INDEX)
+      name = name.Left(colon);
+    groups[name]++;
+  } while(dir.Next());
+
+  PrintHeader(strm, "mcu_threads", "gauge", "Threads of the process by name");
+  for(std::map<PString, unsigned>::iterator it = groups.begin(); it != groups.end(); ++it)
+    PrintSample(strm, "mcu_threads", Label("group", it->first), it->second);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString MCUMetrics::Render()
+{
+  PStringStream strm;
+
+  for(unsigned i = 0; i < PARRAYSIZE(staticMetrics); i++)
+  {
+    MCUMetric *metric = staticMetrics[i];
+    PrintHeader(strm, metric->GetName(), metric->GetTypeName(), metric->GetHelp());
+    metric->PrintOn(strm);
+  }
+
+  {
+    // the map is ordered by name, the series of a family are adjacent
+    PWaitAndSignal m(metricMutex);
+    PString family;
+    for(MetricMap::iterator it = metricMap.begin(); it != metricMap.end(); ++it)
+    {
+      MCUMetric *metric = it->second;
+      if(metric->GetName() != family)
+      {
+        family = metric->GetName();
+        PrintHeader(strm, family, metric->GetTypeName(), metric->GetHelp());
+      }
+      metric->PrintOn(strm);
+    }
+  }
+
+  PrintRooms(strm);
+  PrintQueues(strm);
+  PrintThreads(strm);
+
+  return strm;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,177 @@
+/*
+ * metrics.h
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+
+#ifndef _MCU_METRICS_H
+#define _MCU_METRICS_H
+
+#include "utils_type.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// histogram upper bounds in usec, the last bucket is +Inf
+#define METRIC_BUCKETS  13
+
+// the threads update their shard of a metric, the shards are summed when it is read
+#define METRIC_SHARDS      16
+// a shard and at least a cache line of padding, two shards never share a line
+#define METRIC_SHARD_SIZE  192
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Counter, gauge or histogram updated with atomic operations only, the registry lock
+// is taken when a metric is acquired, released or rendered. An update goes to the shard
+// of the thread, the RTP threads of all calls do not add to the same cache line.
+class MCUMetric
+{
+  public:
+    enum Types
+    {
+      Counter,
+      Gauge,
+      Histogram // observations in usec, rendered in seconds
+    };
+
+    MCUMetric(Types type, const PString & name, const PString & help, const PString & labels = "");
+
+    void Inc()
+    { sync_fetch_and_add64(&shards[GetShard()].value, 1); }
+
+    void Dec()
+    { sync_fetch_and_add64(&shards[GetShard()].value, -1); }
+
+    void Add(int64_t n)
+    { sync_fetch_and_add64(&shards[GetShard()].value, n); }
+
+    void Observe(int64_t usec);
+
+    Types GetType() const
+    { return type; }
+
+    const char * GetTypeName() const
+    { return (type == Counter ? "counter" : (type == Gauge ? "gauge" : "histogram")); }
+
+    const PString & GetName() const
+    { return name; }
+
+    const PString & GetHelp() const
+    { return help; }
+
+    const PString & GetLabels() const
+    { return labels; }
+
+    // counter/gauge value or the number of observations
+    int64_t GetCount();
+
+    void PrintOn(ostream & strm);
+
+    static const int64_t bucketBounds[METRIC_BUCKETS];
+
+    // the shard of the calling thread, from its id
+    static unsigned GetShard()
+    {
+#ifdef _WIN32
+      unsigned id = (unsigned)GetCurrentThreadId();
+#else
+      unsigned id = (unsigned)(size_t)pthread_self();
+#endif
+      id ^= id >> 16;
+      id *= 0x45d9f3b;
+      id ^= id >> 16;
+      return id % METRIC_SHARDS;
+    }
+
+  protected:
+    friend class MCUMetrics;
+
+    struct Shard
+    {
+      volatile int64_t value;
+      volatile int64_t buckets[METRIC_BUCKETS + 1];
+      char pad[METRIC_SHARD_SIZE - (METRIC_BUCKETS + 2) * sizeof(int64_t)];
+    };
+
+    int64_t GetValue();
+
+    Types type;
+    PString name;
+    PString help;
+    PString labels;
+    int refs;
+
+    Shard shards[METRIC_SHARDS];
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Registry of the metrics rendered by the Metrics page in the Prometheus text format.
+// Process-wide series are static members, labelled ones are acquired by their owner
+// (a cache encoder for example) and released when the owner goes away. Per-room and
+// per-member series are read from the conferences and sessions when the page is rendered.
+class MCUMetrics
+{
+  public:
+    static MCUMetric rtpPacketsReceived;
+    static MCUMetric rtpPacketsSent;
+    static MCUMetric rtpPacketsLost;
+    static MCUMetric rtpPacketsReordered;
+    static MCUMetric jitterPacketsLate;
+    static MCUMetric mixerCompose;
+    static MCUMetric mixerFrameLatency;
+    static MCUMetric sipRequestsReceived;
+    static MCUMetric sipResponsesReceived;
+    static MCUMetric sipMessagesSent;
+    static MCUMetric registrarRegistrations;
+    static MCUMetric registrarTimerVisits;
+    static MCUMetric statusRequests;
+    static MCUMetric statusBuilds;
+    static MCUMetric statusNotModified;
+
+    // returns the metric with the name and labels, created on the first call
+    static MCUMetric * Acquire(MCUMetric::Types type, const PString & name, const PString & help, const PString & labels = "");
+    static void Release(MCUMetric *& metric);
+
+    static PString Render();
+
+    // sum of all counters and observations, the benchmark estimates the instrumentation cost from it
+    static uint64_t GetUpdates();
+
+    // name="value" with the value escaped
+    static PString Label(const PString & name, const PString & value);
+
+    static void PrintHeader(ostream & strm, const PString & name, const char * type, const PString & help);
+    static void PrintSample(ostream & strm, const PString & name, const PString & labels, int64_t value);
+
+  protected:
+    typedef std::map<PString, MCUMetric *> MetricMap;
+
+    static void PrintRooms(ostream & strm);
+    static void PrintQueues(ostream & strm);
+    static void PrintThreads(ostream & strm);
+
+    static PMutex metricMutex;
+    static MetricMap metricMap;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MCU_METRICS_H
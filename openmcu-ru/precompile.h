@@ -46,6 +46,7 @@
 #include <h323pdu.h>
 #include <h323caps.h>
 #include <h323rtp.h>
+#include <jitter.h>
 #include <h245.h>
 #include <codecs.h>
 #include <channels.h>
@@ -101,6 +102,7 @@ extern "C"
 // libyuv
 #if USE_LIBYUV
   #include <libyuv/scale.h>
+  #include <libyuv/convert_from.h>
 #endif
 
 // libjpeg
@@ -122,6 +124,11 @@ extern "C" {
   #include "srtp.h"
   #include "crypto_kernel.h"
 };
+#if MCUSIP_SRTP_OPENSSL
+  #include <openssl/evp.h>
+  #include <openssl/sha.h>
+  #include <openssl/crypto.h>
+#endif
 #endif
 
 // zrtp
@@ -44,6 +44,8 @@ PString GetRecorderCodecs(int media_type)
       codecs += ",mpeg4";
     if(avcodec_find_encoder_by_name("msmpeg4"))
       codecs += ",msmpeg4";
+    // record H.264 or VP8 from the conference cache without encoding
+    codecs += ",cache";
   }
   return codecs;
 }
@@ -121,6 +123,17 @@ void ConferenceRecorder::Reset()
   video_st = NULL;
 
   fmt_context = NULL;
+  header_written = FALSE;
+
+  cache_name = "";
+  cache = NULL;
+  cache_seqN = 0;
+  cache_frame_size = 0;
+  cache_extradata.SetSize(0);
+  cache_keyframe = FALSE;
+  cache_started = FALSE;
+  cache_last_timestamp = 0;
+  cache_pts = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -141,7 +154,9 @@ void ConferenceRecorder::Stop()
     delete thread_video;
   }
 
-  if(fmt_context && (thread_audio || thread_video))
+  DetachCacheRTP(cache);
+
+  if(fmt_context && header_written)
   {
     // write the trailer
     av_write_trailer(fmt_context);
@@ -150,7 +165,7 @@ void ConferenceRecorder::Stop()
   avcodecMutex.Wait();
   if(audio_st)
     avcodec_close(audio_st->codec);
-  if(video_st)
+  if(video_st && cache_name == "")
     avcodec_close(video_st->codec);
   avcodecMutex.Signal();
 
@@ -253,7 +268,24 @@ BOOL ConferenceRecorder::Start()
 
   // codecs
   audio_codec_id = GetCodecId(0, cfg.GetString(RecorderAudioCodecKey, RecorderDefaultAudioCodec));
-  video_codec_id = GetCodecId(1, cfg.GetString(RecorderVideoCodecKey, RecorderDefaultVideoCodec));
+  PString video_codec_name = cfg.GetString(RecorderVideoCodecKey, RecorderDefaultVideoCodec);
+  if(video_codec_name == "cache")
+  {
+    // mux the stream of the conference cache, fall back to encoding if there is no suitable cache
+    cache_name = FindVideoCacheRTP(conference->GetNumber(), GetVideoMixerNumber(), video_width, video_height, video_framerate);
+    if(cache_name != "")
+    {
+      video_codec_id = (GetPluginName(cache_name.Left(cache_name.Find("@"))) == "VP8" ? AV_CODEC_ID_VP8 : AV_CODEC_ID_H264);
+      MCUTRACE(1, trace_section << "recording from cache " << cache_name);
+    }
+    else
+    {
+      video_codec_id = GetCodecId(1, RecorderDefaultVideoCodec);
+      MCUTRACE(1, trace_section << "no H.264/VP8 cache in the conference, encoding with " << RecorderDefaultVideoCodec);
+    }
+  }
+  else
+    video_codec_id = GetCodecId(1, video_codec_name);
   if(audio_codec_id == AV_CODEC_ID_NONE && video_codec_id == AV_CODEC_ID_NONE)
   {
     MCUTRACE(1, trace_section << "failed initialise recorder, codecs not found");
@@ -315,11 +347,16 @@ BOOL ConferenceRecorder::InitRecorder()
   fmt_context->oformat->video_codec = video_codec_id;
 
   audio_st = AddStream(AVMEDIA_TYPE_AUDIO);
-  video_st = AddStream(AVMEDIA_TYPE_VIDEO);
+  if(cache_name != "")
+    video_st = AddCacheStream();
+  else
+    video_st = AddStream(AVMEDIA_TYPE_VIDEO);
 
   if(audio_st && OpenAudio() == FALSE)
     return FALSE;
-  if(video_st && OpenVideo() == FALSE)
+  if(video_st && cache_name == "" && OpenVideo() == FALSE)
+    return FALSE;
+  if(video_st && cache_name != "" && OpenCacheVideo() == FALSE)
     return FALSE;
 
   av_dump_format(fmt_context, 0, filename, 1);
@@ -332,14 +369,28 @@ BOOL ConferenceRecorder::InitRecorder()
     return FALSE;
   }
 
+  // in copy mode the header is written with the first keyframe, H.264 needs SPS/PPS from it
+  if(video_st && cache_name != "")
+    return TRUE;
+
+  return WriteHeader();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ConferenceRecorder::WriteHeader()
+{
+  PWaitAndSignal m(write_mutex);
+
   // write the stream header
-  ret = avformat_write_header(fmt_context, NULL);
+  int ret = avformat_write_header(fmt_context, NULL);
   if(ret < 0)
   {
     MCUTRACE(1, trace_section << "error occurred when opening output file: " << ret << " " << AVErrorToString(ret));
     return FALSE;
   }
 
+  header_written = TRUE;
   return TRUE;
 }
 
@@ -432,7 +483,7 @@ int ConferenceRecorder::WritePacket(AVStream *st, AVPacket *pkt)
 
   pkt->stream_index = st->index;
   pkt->pts = av_rescale_q(pkt->pts, st->codec->time_base, st->time_base);
-  pkt->dts = AV_NOPTS_VALUE;
+  pkt->dts = (st == video_st && cache_name != "") ? pkt->pts : AV_NOPTS_VALUE;
 
   // write the compressed frame to the media file
   PWaitAndSignal m(write_mutex);
@@ -613,6 +664,10 @@ BOOL ConferenceRecorder::WriteAudio(const uint64_t & timestamp)
   AVCodecContext *context = audio_st->codec;
   int ret = 0, got_packet = 0;
 
+  // the header is not written yet, waiting for the video keyframe
+  if(!header_written)
+    return TRUE;
+
   AVPacket pkt = { 0 };
   av_init_packet(&pkt);
 
@@ -737,6 +792,242 @@ BOOL ConferenceRecorder::WriteVideo()
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+AVStream * ConferenceRecorder::AddCacheStream()
+{
+  // no encoder, the packets are copied from the cache as is
+  AVStream *st = avformat_new_stream(fmt_context, NULL);
+  if(st == NULL)
+  {
+    MCUTRACE(1, trace_section << "could not allocate stream");
+    return NULL;
+  }
+  st->id = fmt_context->nb_streams-1;
+
+  AVCodecContext *context = st->codec;
+  context->codec_type    = AVMEDIA_TYPE_VIDEO;
+  context->codec_id      = video_codec_id;
+  context->pix_fmt       = AV_PIX_FMT_YUV420P;
+  context->width         = video_width;
+  context->height        = video_height;
+  context->time_base.num = 1;
+  context->time_base.den = 90000;
+  st->time_base = context->time_base;
+
+  // Some formats want stream headers to be separate
+  if(fmt_context->oformat->flags & AVFMT_GLOBALHEADER)
+    context->flags |= (1 << 22); //AV_CODEC_FLAG_GLOBAL_HEADER
+
+  return st;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ConferenceRecorder::OpenCacheVideo()
+{
+  if(!AttachCacheRTP(cache, cache_name, cache_seqN))
+  {
+    MCUTRACE(1, trace_section << "could not attach to cache " << cache_name);
+    return FALSE;
+  }
+  // the recording starts with a keyframe, do not wait for the periodic one
+  cache->OnFastUpdatePicture();
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ConferenceRecorder::AppendCacheNAL(const BYTE * nal, PINDEX size)
+{
+  static const BYTE startCode[4] = { 0, 0, 0, 1 };
+  if(size <= 0)
+    return;
+
+  BYTE type = nal[0] & 0x1f;
+  if(type == 5 || type == 7)
+    cache_keyframe = TRUE;
+
+  // SPS/PPS of the first keyframe go to the stream header
+  if(!header_written && (type == 7 || type == 8))
+  {
+    PINDEX pos = cache_extradata.GetSize();
+    memcpy(cache_extradata.GetPointer(pos + 4 + size) + pos, startCode, 4);
+    memcpy(cache_extradata.GetPointer() + pos + 4, nal, size);
+  }
+
+  BYTE *dst = cache_frame.GetPointer(cache_frame_size + 4 + size) + cache_frame_size;
+  memcpy(dst, startCode, 4);
+  memcpy(dst + 4, nal, size);
+  cache_frame_size += 4 + size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ConferenceRecorder::ReadCacheFrame()
+{
+  // collects the packets up to the marker into one access unit
+  cache_frame_size = 0;
+  cache_keyframe = FALSE;
+  BOOL complete = TRUE;
+  BOOL fragment = FALSE;
+  while(running)
+  {
+    unsigned length = 0, flags = 0;
+    if(!GetCacheRTP(cache, cache_rtp, length, cache_seqN, flags, RECORDER_CACHE_READ_TIMEOUT_MS))
+    {
+      if(cache == NULL)
+        return FALSE;
+      continue;
+    }
+    if(length == 0)
+      continue;
+
+    const BYTE *payload = cache_rtp.GetPayloadPtr();
+    if(video_codec_id == AV_CODEC_ID_H264)
+    {
+      // RFC 6184: single NAL unit, STAP-A, FU-A
+      BYTE type = payload[0] & 0x1f;
+      if(type != 28)
+        fragment = FALSE;
+      if(type >= 1 && type <= 23)
+        AppendCacheNAL(payload, length);
+      else if(type == 24)
+      {
+        PINDEX pos = 1;
+        while(pos + 2 <= (PINDEX)length)
+        {
+          PINDEX size = (payload[pos] << 8) | payload[pos+1];
+          pos += 2;
+          if(pos + size > (PINDEX)length)
+            break;
+          AppendCacheNAL(payload + pos, size);
+          pos += size;
+        }
+      }
+      else if(type == 28 && length > 2)
+      {
+        if(payload[1] & 0x80)
+        {
+          // restore the NAL header from the FU indicator and header
+          BYTE header = (payload[0] & 0xe0) | (payload[1] & 0x1f);
+          PBYTEArray nal(length - 1);
+          nal[0] = header;
+          memcpy(nal.GetPointer() + 1, payload + 2, length - 2);
+          AppendCacheNAL(nal, length - 1);
+          fragment = TRUE;
+        }
+        else if(fragment)
+        {
+          memcpy(cache_frame.GetPointer(cache_frame_size + length - 2) + cache_frame_size, payload + 2, length - 2);
+          cache_frame_size += length - 2;
+        }
+        else
+        {
+          // the start fragment is lost, drop the rest of the NAL up to the next start
+          complete = FALSE;
+        }
+        if(payload[1] & 0x40)
+          fragment = FALSE;
+      }
+    }
+    else
+    {
+      // RFC 7741: strip the payload descriptor
+      PINDEX pos = 1;
+      if(payload[0] & 0x80)
+      {
+        BYTE x = payload[pos++];
+        if(x & 0x80) // I: picture ID
+          pos += (pos < (PINDEX)length && (payload[pos] & 0x80)) ? 2 : 1;
+        if(x & 0x40) // L: TL0PICIDX
+          pos++;
+        if(x & 0x30) // T/K: TID, KEYIDX
+          pos++;
+      }
+      if(pos < (PINDEX)length)
+      {
+        BOOL partitionStart = (payload[0] & 0x10) && (payload[0] & 0x0f) == 0;
+        if(partitionStart)
+          cache_keyframe = ((payload[pos] & 0x01) == 0);
+        else if(cache_frame_size == 0)
+          complete = FALSE;
+        memcpy(cache_frame.GetPointer(cache_frame_size + length - pos) + cache_frame_size, payload + pos, length - pos);
+        cache_frame_size += length - pos;
+      }
+    }
+
+    if(cache_rtp.GetMarker())
+    {
+      // the beginning of the frame is lost in the cache, drop it and ask for a keyframe
+      if(!complete)
+      {
+        cache_frame_size = 0;
+        cache->OnFastUpdatePicture();
+      }
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL ConferenceRecorder::WriteCacheVideo()
+{
+  if(!ReadCacheFrame())
+    return FALSE;
+
+  // start with a keyframe, the frames before it can not be decoded
+  if(!cache_started)
+  {
+    if(cache_frame_size == 0 || !cache_keyframe || (video_codec_id == AV_CODEC_ID_H264 && cache_extradata.GetSize() == 0))
+    {
+      cache_extradata.SetSize(0);
+      return TRUE;
+    }
+    AVCodecContext *context = video_st->codec;
+    if(cache_extradata.GetSize() > 0)
+    {
+      context->extradata = (uint8_t *)av_mallocz(cache_extradata.GetSize() + AV_INPUT_BUFFER_PADDING_SIZE);
+      memcpy(context->extradata, cache_extradata.GetPointer(), cache_extradata.GetSize());
+      context->extradata_size = cache_extradata.GetSize();
+    }
+    if(WriteHeader() == FALSE)
+    {
+      running = FALSE;
+      return FALSE;
+    }
+    cache_last_timestamp = cache_rtp.GetTimestamp();
+    cache_started = TRUE;
+    MCUTRACE(1, trace_section << "first keyframe from cache " << cache_name << ", " << cache_frame_size << " bytes");
+  }
+
+  if(cache_frame_size == 0)
+    return TRUE;
+
+  AVPacket pkt = { 0 };
+  av_init_packet(&pkt);
+  pkt.data = cache_frame.GetPointer();
+  pkt.size = cache_frame_size;
+  // 90 kHz timestamps of the cache wrap around, the PTS keeps growing
+  cache_pts += (DWORD)(cache_rtp.GetTimestamp() - cache_last_timestamp);
+  cache_last_timestamp = cache_rtp.GetTimestamp();
+  pkt.pts = cache_pts;
+  if(cache_keyframe)
+    pkt.flags |= AV_PKT_FLAG_KEY;
+
+  int ret = WritePacket(video_st, &pkt);
+  if(ret < 0)
+  {
+    MCUTRACE(1, trace_section << "error while writing video frame: " << ret << " " <<  AVErrorToString(ret));
+    return FALSE;
+  }
+  video_frame_count++;
+
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void ConferenceRecorder::RecorderAudio(PThread &, INT)
 {
   MCUTRACE(1, trace_section << "audio thread started");
@@ -764,12 +1055,26 @@ void ConferenceRecorder::RecorderVideo(PThread &, INT)
 {
   MCUTRACE(1, trace_section << "video thread started");
 
+  firstFrameSendTime = PTime();
+
+  // copy mode, paced by the cache encoder
+  if(cache_name != "")
+  {
+    running = TRUE;
+    while(running)
+    {
+      if(WriteCacheVideo() == FALSE)
+        MCUTime::Sleep(10);
+    }
+    running = FALSE;
+    MCUTRACE(1, trace_section << "video thread ended");
+    return;
+  }
+
   unsigned delay_us = av_q2d(video_st->codec->time_base)*1000000;
   if(delay_us <= 1000)
     delay_us = 1000000/video_framerate;
 
-  firstFrameSendTime = PTime();
-
   MCUDelay delay;
 
   running = TRUE;
@@ -30,6 +30,12 @@
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// in the copy mode the video thread waits for a packet of the cache at most
+// RECORDER_CACHE_READ_TIMEOUT_MS to see the stop, the encoder of the cache may be gone
+#define RECORDER_CACHE_READ_TIMEOUT_MS  100
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 static struct recorder_resolution {
   unsigned width;
   unsigned height;
@@ -129,9 +135,24 @@ class ConferenceRecorder : public ConferenceMember
     AVStream *video_st;
 
     AVFormatContext *fmt_context;
+    BOOL header_written;
+
+    // copy mode, the video is taken encoded from the conference cache
+    PString cache_name;
+    CacheRTP *cache;
+    unsigned cache_seqN;
+    RTP_DataFrame cache_rtp;
+    PBYTEArray cache_frame;
+    PINDEX cache_frame_size;
+    PBYTEArray cache_extradata;
+    BOOL cache_keyframe;
+    BOOL cache_started;
+    DWORD cache_last_timestamp;
+    int64_t cache_pts;
 
     void Reset();
     BOOL InitRecorder();
+    BOOL WriteHeader();
 
     AVStream *AddStream(AVMediaType codec_type);
 
@@ -143,6 +164,12 @@ class ConferenceRecorder : public ConferenceMember
     BOOL GetVideoFrame();
     BOOL WriteVideo();
 
+    AVStream *AddCacheStream();
+    BOOL OpenCacheVideo();
+    void AppendCacheNAL(const BYTE * nal, PINDEX size);
+    BOOL ReadCacheFrame();
+    BOOL WriteCacheVideo();
+
     BOOL OpenResampler();
     BOOL Resampler();
     int WritePacket(AVStream *st, AVPacket *pkt);
@@ -123,10 +123,25 @@ void AbookAccount::SaveConfig()
 
 PString AbookAccount::AsJsArray(int state)
 {
-  MCUJSON *json = AsJSON(state);
+  // same text as AsJSON() without keys, written directly
+  PString memberName = display_name+" ["+GetUrl()+"]";
   std::string str;
-  json->ToString(str, false, false);
-  delete json;
+  MCUJSONWriter json(str, false);
+  json.BeginArray();
+  json.Insert(state);
+  json.Insert(MCUURL(memberName).GetMemberNameId());
+  json.Insert(memberName);
+  json.Insert(is_abook);
+  json.Insert(remote_application);
+  json.Insert(reg_state);
+  json.Insert(reg_info);
+  json.Insert(conn_state);
+  json.Insert(conn_info);
+  json.Insert(ping_state);
+  json.Insert(ping_info);
+  json.Insert(is_account);
+  json.Insert(is_saved_account);
+  json.End();
   return str;
 }
 
@@ -187,29 +202,60 @@ RegistrarAccount * Registrar::InsertAccountWithLock(RegAccountTypes account_type
   RegistrarAccount *raccount = new RegistrarAccount(this, id, account_type, username);
   PString name = PString(raccount->account_type)+":"+raccount->username;
   MCURegistrarAccountList::shared_iterator it = accountList.Insert(raccount, id, name);
+  // address book entry
+  ArmAccount(raccount);
   return it.GetCapturedObject();
 }
 
 RegistrarAccount * Registrar::FindAccountWithLock(RegAccountTypes account_type, const PString & username)
 {
-  for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+  if(account_type == ACCOUNT_TYPE_UNKNOWN)
   {
-    if(it->username == username && (account_type == ACCOUNT_TYPE_UNKNOWN || account_type == it->account_type))
-    {
-      return it.GetCapturedObject();
-    }
+    RegistrarAccount *raccount = FindAccountWithLock(ACCOUNT_TYPE_SIP, username);
+    if(!raccount)
+      raccount = FindAccountWithLock(ACCOUNT_TYPE_H323, username);
+    if(!raccount)
+      raccount = FindAccountWithLock(ACCOUNT_TYPE_RTSP, username);
+    return raccount;
   }
+  MCURegistrarAccountList::shared_iterator it = accountList.Find(PString(account_type)+":"+username);
+  if(it != accountList.end())
+    return it.GetCapturedObject();
   return NULL;
 }
 
 PString Registrar::FindAccountNameFromH323Id(const PString & h323id)
 {
-  for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+  PString username;
   {
-    if(it->h323id == h323id)
-      return it->username;
+    PWaitAndSignal m(indexMutex);
+    IndexMap::iterator it = aliasIndex.find(h323id);
+    if(it == aliasIndex.end())
+      return "";
+    username = it->second;
   }
-  return "";
+  // the id is given by the gatekeeper, check that it is not reassigned
+  RegistrarAccount *raccount = FindAccountWithLock(ACCOUNT_TYPE_H323, username);
+  if(raccount == NULL)
+    return "";
+  if(raccount->h323id != h323id)
+    username = "";
+  raccount->Unlock();
+  return username;
+}
+
+void Registrar::SetAccountH323Id(RegistrarAccount *raccount, const PString & h323id)
+{
+  PWaitAndSignal m(indexMutex);
+  if(raccount->h323id != "")
+  {
+    IndexMap::iterator it = aliasIndex.find(raccount->h323id);
+    if(it != aliasIndex.end() && it->second == raccount->username)
+      aliasIndex.erase(it);
+  }
+  raccount->h323id = h323id;
+  if(h323id != "")
+    aliasIndex[h323id] = raccount->username;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -219,6 +265,11 @@ RegistrarSubscription * Registrar::InsertSubWithLock(const PString & username_in
   long id = accountList.GetNextID();
   RegistrarSubscription *rsub = new RegistrarSubscription(this, id, username_in, username_out);
   MCURegistrarSubscriptionList::shared_iterator it = subscriptionList.Insert(rsub, id, rsub->username_pair);
+  if(it != subscriptionList.end())
+  {
+    PWaitAndSignal m(indexMutex);
+    subUserIndex.insert(IndexMultiMap::value_type(username_out, rsub->username_pair));
+  }
   return it.GetCapturedObject();
 }
 
@@ -232,32 +283,109 @@ RegistrarSubscription *Registrar::FindSubWithLock(const PString & username_pair)
   return NULL;
 }
 
+void Registrar::EraseSub(MCURegistrarSubscriptionList::shared_iterator & it)
+{
+  RegistrarSubscription *rsub = *it;
+  {
+    PWaitAndSignal m(indexMutex);
+    std::pair<IndexMultiMap::iterator, IndexMultiMap::iterator> range = subUserIndex.equal_range(rsub->username_out);
+    for(IndexMultiMap::iterator r = range.first; r != range.second; ++r)
+    {
+      if(r->second == rsub->username_pair)
+      {
+        subUserIndex.erase(r);
+        break;
+      }
+    }
+  }
+  if(subscriptionList.Erase(it))
+    delete rsub;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 RegistrarConnection * Registrar::InsertRegConnWithLock(const PString & callToken, const PString & username_in, const PString & username_out)
 {
   long id = connectionList.GetNextID();
   RegistrarConnection *rconn = new RegistrarConnection(this, id, callToken, username_in, username_out);
+  {
+    PWaitAndSignal m(indexMutex);
+    connUserIndex.insert(IndexMultiMap::value_type(username_in, callToken));
+    if(username_out != username_in)
+      connUserIndex.insert(IndexMultiMap::value_type(username_out, callToken));
+  }
   MCURegistrarConnectionList::shared_iterator it = connectionList.Insert(rconn, id, callToken);
   return it.GetCapturedObject();
 }
 
-RegistrarConnection * Registrar::FindRegConnWithLock(const PString & callToken)
+void Registrar::SetRegConnCallTokenOut(RegistrarConnection *rconn, const PString & callToken)
 {
-  for(MCURegistrarConnectionList::shared_iterator it = connectionList.begin(); it != connectionList.end(); ++it)
+  PWaitAndSignal m(indexMutex);
+  if(rconn->callToken_out != "")
+    callTokenIndex.erase(rconn->callToken_out);
+  rconn->callToken_out = callToken;
+  if(callToken != "" && callToken != rconn->callToken_in)
+    callTokenIndex[callToken] = rconn->callToken_in;
+}
+
+void Registrar::EraseRegConn(MCURegistrarConnectionList::shared_iterator & it)
+{
+  RegistrarConnection *rconn = *it;
   {
-    if(it->callToken_in == callToken || it->callToken_out == callToken)
+    PWaitAndSignal m(indexMutex);
+    callTokenIndex.erase(rconn->callToken_out);
+    std::pair<IndexMultiMap::iterator, IndexMultiMap::iterator> range;
+    for(int i = 0; i < 2; i++)
     {
-      return it.GetCapturedObject();
+      range = connUserIndex.equal_range(i == 0 ? rconn->username_in : rconn->username_out);
+      for(IndexMultiMap::iterator r = range.first; r != range.second; ++r)
+      {
+        if(r->second == rconn->callToken_in)
+        {
+          connUserIndex.erase(r);
+          break;
+        }
+      }
     }
   }
+  if(connectionList.Erase(it))
+    delete rconn;
+}
+
+RegistrarConnection * Registrar::FindRegConnWithLock(const PString & callToken)
+{
+  MCURegistrarConnectionList::shared_iterator it = connectionList.Find(callToken);
+  if(it != connectionList.end())
+    return it.GetCapturedObject();
+
+  PString key;
+  {
+    PWaitAndSignal m(indexMutex);
+    IndexMap::iterator r = callTokenIndex.find(callToken);
+    if(r == callTokenIndex.end())
+      return NULL;
+    key = r->second;
+  }
+  it = connectionList.Find(key);
+  if(it != connectionList.end() && it->callToken_out == callToken)
+    return it.GetCapturedObject();
   return NULL;
 }
 
 RegistrarConnection * Registrar::FindRegConnWithLock(RegAccountTypes account_type, const PString & username)
 {
-  for(MCURegistrarConnectionList::shared_iterator it = connectionList.begin(); it != connectionList.end(); ++it)
+  PStringArray keys;
+  {
+    PWaitAndSignal m(indexMutex);
+    std::pair<IndexMultiMap::iterator, IndexMultiMap::iterator> range = connUserIndex.equal_range(username);
+    for(IndexMultiMap::iterator r = range.first; r != range.second; ++r)
+      keys.AppendString(r->second);
+  }
+  for(PINDEX i = 0; i < keys.GetSize(); i++)
   {
+    MCURegistrarConnectionList::shared_iterator it = connectionList.Find(keys[i]);
+    if(it == connectionList.end())
+      continue;
     if((it->account_type_in == account_type && it->username_in == username) ||
        (it->account_type_out == account_type && it->username_out == username))
       return it.GetCapturedObject();
@@ -275,13 +403,11 @@ bool Registrar::HasRegConn(const PString & callToken)
 
 bool Registrar::HasRegConn(RegAccountTypes account_type, const PString & username)
 {
-  for(MCURegistrarConnectionList::shared_iterator it = connectionList.begin(); it != connectionList.end(); ++it)
-  {
-    if((it->account_type_in == account_type && it->username_in == username) ||
-       (it->account_type_out == account_type && it->username_out == username))
-      return true;
-  }
-  return false;
+  RegistrarConnection *rconn = FindRegConnWithLock(account_type, username);
+  if(rconn == NULL)
+    return false;
+  rconn->Unlock();
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -295,7 +421,7 @@ void Registrar::ConnectionCreated(const PString & callToken)
 void Registrar::ConnectionEstablished(const PString & callToken)
 {
   PString *cmd = new PString("established:"+callToken);
-  regQueue.Push(cmd);
+  QueuePush(cmd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -303,7 +429,7 @@ void Registrar::ConnectionEstablished(const PString & callToken)
 void Registrar::ConnectionCleared(const PString & callToken)
 {
   PString *cmd = new PString("cleared:"+callToken);
-  regQueue.Push(cmd);
+  QueuePush(cmd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -368,6 +494,7 @@ BOOL Registrar::AddAbookAccount(const PString & address)
 
   long id = abookList.GetNextID();
   abookList.Insert(ab, id, key);
+  ArmAccount(account_type, ab->username);
 
   MCUTRACE(6, "Address book: " << address << " insert");
   return TRUE;
@@ -407,6 +534,8 @@ BOOL Registrar::RemoveAbookAccount(const PString & address)
   ab->SendRoomControl(2);
   if(abookList.Erase(it))
     delete ab;
+  // a registered account brings its entry back
+  ArmAccount(account_type, url.GetUserName());
 
   MCUTRACE(6, "Address book: " << address << " remove");
   return TRUE;
@@ -508,16 +637,17 @@ BOOL Registrar::MakeCall(const PString & room, const PString & to, PString & cal
   {
     callToken = PGloballyUniqueID().AsString();
     PString *cmd = new PString("invite:"+room+","+address+","+callToken);
-    regQueue.Push(cmd);
+    QueuePush(cmd);
   }
 
   if(callToken != "")
   {
     rconn = InsertRegConnWithLock(callToken, room, username_out);
     rconn->account_type_out = account_type;
-    rconn->callToken_out = callToken;
+    SetRegConnCallTokenOut(rconn, callToken);
     rconn->roomname = room;
     rconn->state = CONN_MCU_WAIT;
+    ArmConnection(rconn);
     rconn->Unlock();
   }
 
@@ -556,7 +686,7 @@ BOOL Registrar::InternalMakeCall(RegistrarConnection *rconn, RegistrarAccount *r
     PString callToken = PGloballyUniqueID().AsString();
     PString *cmd = new PString("invite:"+rconn->username_in+","+address+","+callToken);
     sep->GetSipQueue().Push(cmd);
-    rconn->callToken_out = callToken;
+    SetRegConnCallTokenOut(rconn, callToken);
     return TRUE;
   }
   else if(raccount_out->account_type == ACCOUNT_TYPE_H323)
@@ -566,7 +696,7 @@ BOOL Registrar::InternalMakeCall(RegistrarConnection *rconn, RegistrarAccount *r
     ep->MakeCall(address, callToken_out, userData);
     if(callToken_out != "")
     {
-      rconn->callToken_out = callToken_out;
+      SetRegConnCallTokenOut(rconn, callToken_out);
       return TRUE;
     }
   }
@@ -628,310 +758,369 @@ void Registrar::Leave(int account_type, const PString & callToken)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Registrar::AccountThread(PThread &, INT)
+void RegistrarTimer::Arm(RegTimerTypes type, const PString & key, PInt64 due)
 {
-  while(!terminating)
+  PString id = PString(type)+":"+key;
+  PWaitAndSignal m(timerMutex);
+  std::map<PString, PInt64>::iterator it = timerMap.find(id);
+  if(it != timerMap.end())
   {
-    MCUTime::Sleep(100);
-    if(terminating)
-      break;
-
-    PTime now;
-    for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
-    {
-      RegistrarAccount *raccount = *it;
-      // expires
-      if(raccount->registered)
-      {
-        if(now > raccount->start_time + PTimeInterval(raccount->expires*1000))
-          raccount->registered = FALSE;
-      }
-    }
+    if(it->second <= due)
+      return;
+    timerSet.erase(TimerEntry(it->second, id));
   }
+  timerMap[id] = due;
+  timerSet.insert(TimerEntry(due, id));
+  // wake up the thread if the object is the first
+  if(timerSet.begin()->second == id)
+    sync.Signal();
+}
+
+BOOL RegistrarTimer::Pop(PInt64 now, RegTimerTypes & type, PString & key)
+{
+  PWaitAndSignal m(timerMutex);
+  if(timerSet.empty() || timerSet.begin()->first > now)
+    return FALSE;
+  PString id = timerSet.begin()->second;
+  timerSet.erase(timerSet.begin());
+  timerMap.erase(id);
+  PINDEX pos = id.Find(':');
+  type = (RegTimerTypes)id.Left(pos).AsInteger();
+  key = id.Mid(pos+1);
+  return TRUE;
+}
+
+PInt64 RegistrarTimer::GetDelay(PInt64 now, PInt64 max)
+{
+  PWaitAndSignal m(timerMutex);
+  if(timerSet.empty())
+    return max;
+  PInt64 delay = timerSet.begin()->first - now;
+  return PMAX(0, PMIN(delay, max));
+}
+
+PINDEX RegistrarTimer::GetSize()
+{
+  PWaitAndSignal m(timerMutex);
+  return timerSet.size();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Registrar::ConnectionThread(PThread &, INT)
+void Registrar::ArmAccount(RegistrarAccount *raccount)
+{
+  timer.Arm(TIMER_ACCOUNT, PString(raccount->account_type)+":"+raccount->username, 0);
+}
+
+void Registrar::ArmAccount(RegAccountTypes account_type, const PString & username)
+{
+  if(account_type != ACCOUNT_TYPE_UNKNOWN && username != "")
+    timer.Arm(TIMER_ACCOUNT, PString(account_type)+":"+username, 0);
+}
+
+void Registrar::ArmConnection(RegistrarConnection *rconn)
+{
+  timer.Arm(TIMER_CONNECTION, rconn->callToken_in, 0);
+}
+
+void Registrar::ArmSubscription(RegistrarSubscription *rsub)
+{
+  timer.Arm(TIMER_SUBSCRIPTION, rsub->username_pair, 0);
+}
+
+void Registrar::ArmSubscribers(const PString & username)
+{
+  PWaitAndSignal m(indexMutex);
+  std::pair<IndexMultiMap::iterator, IndexMultiMap::iterator> range = subUserIndex.equal_range(username);
+  for(IndexMultiMap::iterator r = range.first; r != range.second; ++r)
+    timer.Arm(TIMER_SUBSCRIPTION, r->second, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void Registrar::TimerThread(PThread &, INT)
 {
   while(!terminating)
   {
-    MCUTime::Sleep(100);
+    // the objects are armed when they change, the wait is limited for the terminating flag
+    timer.Wait(timer.GetDelay(RegistrarTimer::GetTime(), 1000));
     if(terminating)
       break;
 
-    PTime now;
-    for(MCURegistrarConnectionList::shared_iterator it = connectionList.begin(); it != connectionList.end(); ++it)
-    {
-      RegistrarConnection *rconn = *it;
-      // remove empty connection
-      if(rconn->state == CONN_IDLE)
-      {
-        if(connectionList.Erase(it))
-          delete rconn;
-        continue;
-      }
-      // MCU call answer limit
-      if(rconn->state == CONN_MCU_WAIT)
-      {
-        if(now > rconn->start_time + PTimeInterval(rconn->accept_timeout*1000))
-        {
-          OutgoingCallCancel(rconn);
-          rconn->state = CONN_END;
-        }
-      }
-      // internal call answer limit
-      if(rconn->state == CONN_WAIT)
-      {
-        if(now > rconn->start_time + PTimeInterval(rconn->accept_timeout*1000))
-        {
-          IncomingCallCancel(rconn);
-          OutgoingCallCancel(rconn);
-          rconn->state = CONN_END;
-        }
-      }
-      // make internal call
-      if(rconn->state == CONN_WAIT)
-      {
-        if(rconn->callToken_out == "")
-        {
-          if(!InternalMakeCall(rconn, rconn->username_in, rconn->username_out))
-          {
-            rconn->state = CONN_CANCEL_IN;
-          }
-        }
-      }
-      // accept incoming
-      if(rconn->state == CONN_ACCEPT_IN)
-      {
-        IncomingCallAccept(rconn);
-        rconn->state = CONN_ESTABLISHED;
-      }
-      // cancel incoming
-      if(rconn->state == CONN_CANCEL_IN)
-      {
-        IncomingCallCancel(rconn);
-        rconn->state = CONN_END;
-      }
-      // cancel outgoing
-      if(rconn->state == CONN_CANCEL_OUT)
-      {
-        OutgoingCallCancel(rconn);
-        rconn->state = CONN_END;
-      }
-      // leave incoming
-      if(rconn->state == CONN_LEAVE_IN)
-      {
-        Leave(rconn->account_type_in, rconn->callToken_in);
-        rconn->state = CONN_END;
-      }
-      // leave outgoing
-      if(rconn->state == CONN_LEAVE_OUT)
-      {
-        Leave(rconn->account_type_out, rconn->callToken_out);
-        rconn->state = CONN_END;
-      }
-      // internal call end
-      if(rconn->state == CONN_END)
-      {
-        rconn->state = CONN_IDLE;
-      }
-    }
+    MCUMetrics::registrarTimerVisits.Add(ProcessTimer(RegistrarTimer::GetTime()));
   }
 }
 
+unsigned Registrar::ProcessTimer(PInt64 now)
+{
+  unsigned visits = 0;
+  RegTimerTypes type;
+  PString key;
+  while(!terminating && timer.Pop(now, type, key))
+  {
+    visits++;
+    if(type == TIMER_ACCOUNT)
+      ProcessAccount(key, now);
+    else if(type == TIMER_CONNECTION)
+      ProcessConnection(key, now);
+    else if(type == TIMER_SUBSCRIPTION)
+      ProcessSubscription(key, now);
+  }
+  return visits;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Registrar::BookThread(PThread &, INT)
+void Registrar::ProcessAccount(const PString & key, PInt64 now)
 {
-  while(!terminating)
-  {
-    MCUTime::Sleep(1000);
-    if(terminating)
-      break;
+  MCURegistrarAccountList::shared_iterator it = accountList.Find(key);
+  if(it == accountList.end())
+    return;
+  RegistrarAccount *raccount = *it;
 
-    for(MCURegistrarAccountList::shared_iterator r = accountList.begin(); r != accountList.end(); ++r)
+  PInt64 due = 0;
+  // expires
+  if(raccount->registered)
+  {
+    PInt64 expire = RegistrarTimer::GetTime(raccount->start_time) + (PInt64)raccount->expires*1000;
+    if(now > expire)
+      raccount->registered = FALSE;
+    else
+      due = expire + 1;
+  }
+  // keep alive, the queue thread sends the ping
+  if(raccount->keep_alive_enable)
+  {
+    PInt64 interval = (PInt64)raccount->keep_alive_interval*1000;
+    PInt64 ping = RegistrarTimer::GetTime(raccount->keep_alive_time_request) + interval;
+    if(now > ping)
     {
-      RegistrarAccount *raccount = *r;
-
-      PString key = PString(raccount->account_type)+":"+raccount->username;
-      MCUAbookList::shared_iterator s = abookList.Find(key);
-      if(s != abookList.end())
-        continue;
-
-      AbookAccount *ab = new AbookAccount();
-      ab->is_abook = false;
-      ab->is_account = true;
-      ab->is_saved_account = raccount->is_saved_account;
-      ab->account_type = raccount->account_type;
-      ab->username = raccount->username;
-      ab->host = raccount->host;
-      ab->port = raccount->port;
-      ab->transport = raccount->transport;
-      if(raccount->display_name_saved != "")
-        ab->display_name = raccount->display_name_saved;
-      else
-        ab->display_name = raccount->display_name;
-      ab->remote_application = raccount->remote_application;
-      ab->SendRoomControl();
-
-      long id = abookList.GetNextID();
-      abookList.Insert(ab, id, key);
+      raccount->keep_alive_time_request = PTime();
+      QueuePush(new PString("ping:"+key));
+      ping = now + interval;
     }
+    if(due == 0 || ping + 1 < due)
+      due = ping + 1;
+  }
 
-    AbookAccount oldab;
-    for(MCUAbookList::shared_iterator r = abookList.begin(); r != abookList.end(); ++r)
-    {
-      AbookAccount *ab = *r;
-      oldab.Clear();
-      oldab.Set(*ab);
+  UpdateAbook(raccount);
+  ArmSubscribers(raccount->username);
 
-      MCURegistrarAccountList::shared_iterator s = accountList.Find(PString(r->account_type)+":"+r->username);
-      if(s == accountList.end())
-      {
-        ab->is_account = false;
-        ab->is_saved_account = false;
-        if(oldab.AsJsArray() != ab->AsJsArray())
-          ab->SendRoomControl();
-        continue;
-      }
-      RegistrarAccount *raccount = *s;
-
-      ab->is_account = true;
-      ab->is_saved_account = raccount->is_saved_account;
-      ab->host = raccount->host;
-      ab->port = raccount->port;
-      ab->transport = raccount->transport;
-      if(raccount->display_name_saved != "")
-        ab->display_name = raccount->display_name_saved;
-      else
-        ab->display_name = raccount->display_name;
-      ab->remote_application = raccount->remote_application;
-      ab->reg_state = 0;
-      ab->reg_info = "";
-      ab->conn_state = 0;
-      ab->conn_info = "";
-      ab->ping_state = 0;
-      ab->ping_info = "";
-
-      if(raccount->is_saved_account)
-        ab->reg_state = 1;
-      if(raccount->registered)
-        ab->reg_state = 2;
-      if(ab->reg_state != 0 && raccount->start_time != PTime(0))
-        ab->reg_info = raccount->start_time.AsString("hh:mm:ss dd.MM.yyyy");
-
-      RegistrarConnection *rconn = FindRegConnWithLock(raccount->account_type, raccount->username);
-      if(rconn)
-      {
-        if(rconn->state == CONN_WAIT || rconn->state == CONN_MCU_WAIT)
-          ab->conn_state = 1;
-        else if(rconn->state == CONN_ESTABLISHED || rconn->state == CONN_MCU_ESTABLISHED)
-        {
-          ab->conn_state = 2;
-          ab->conn_info = rconn->start_time.AsString("hh:mm:ss dd.MM.yyyy");
-        }
-        rconn->Unlock();
-      }
+  if(due != 0)
+    timer.Arm(TIMER_ACCOUNT, key, due);
+}
 
-      if(raccount->keep_alive_enable)
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void Registrar::ProcessConnection(const PString & key, PInt64 now)
+{
+  MCURegistrarConnectionList::shared_iterator it = connectionList.Find(key);
+  if(it == connectionList.end())
+    return;
+  RegistrarConnection *rconn = *it;
+
+  PInt64 timeout = RegistrarTimer::GetTime(rconn->start_time) + (PInt64)rconn->accept_timeout*1000;
+  // MCU call answer limit
+  if(rconn->state == CONN_MCU_WAIT)
+  {
+    if(now > timeout)
+    {
+      OutgoingCallCancel(rconn);
+      rconn->state = CONN_END;
+    }
+  }
+  // internal call answer limit
+  if(rconn->state == CONN_WAIT)
+  {
+    if(now > timeout)
+    {
+      IncomingCallCancel(rconn);
+      OutgoingCallCancel(rconn);
+      rconn->state = CONN_END;
+    }
+  }
+  // make internal call
+  if(rconn->state == CONN_WAIT)
+  {
+    if(rconn->callToken_out == "")
+    {
+      if(!InternalMakeCall(rconn, rconn->username_in, rconn->username_out))
       {
-        if(raccount->keep_alive_time_response > raccount->keep_alive_time_request-PTimeInterval(raccount->keep_alive_interval*1000-2000))
-          ab->ping_state = 1;
-        else
-          ab->ping_state = 2;
-        ab->ping_info = raccount->keep_alive_time_response.AsString("hh:mm:ss dd.MM.yyyy");
+        rconn->state = CONN_CANCEL_IN;
       }
+    }
+  }
+  // accept incoming
+  if(rconn->state == CONN_ACCEPT_IN)
+  {
+    IncomingCallAccept(rconn);
+    rconn->state = CONN_ESTABLISHED;
+  }
+  // cancel incoming
+  if(rconn->state == CONN_CANCEL_IN)
+  {
+    IncomingCallCancel(rconn);
+    rconn->state = CONN_END;
+  }
+  // cancel outgoing
+  if(rconn->state == CONN_CANCEL_OUT)
+  {
+    OutgoingCallCancel(rconn);
+    rconn->state = CONN_END;
+  }
+  // leave incoming
+  if(rconn->state == CONN_LEAVE_IN)
+  {
+    Leave(rconn->account_type_in, rconn->callToken_in);
+    rconn->state = CONN_END;
+  }
+  // leave outgoing
+  if(rconn->state == CONN_LEAVE_OUT)
+  {
+    Leave(rconn->account_type_out, rconn->callToken_out);
+    rconn->state = CONN_END;
+  }
+  // internal call end
+  if(rconn->state == CONN_END)
+  {
+    rconn->state = CONN_IDLE;
+  }
 
-      if(ab->AsJsArray() != oldab.AsJsArray())
-        ab->SendRoomControl();
+  // address book and presence of the both sides
+  RegAccountTypes account_type_in = rconn->account_type_in;
+  RegAccountTypes account_type_out = rconn->account_type_out;
+  PString username_in = rconn->username_in;
+  PString username_out = rconn->username_out;
 
-    }
+  // remove empty connection
+  if(rconn->state == CONN_IDLE)
+  {
+    EraseRegConn(it);
   }
+  else if(rconn->state == CONN_WAIT || rconn->state == CONN_MCU_WAIT)
+  {
+    timer.Arm(TIMER_CONNECTION, key, timeout + 1);
+  }
+
+  ArmAccount(account_type_in, username_in);
+  ArmAccount(account_type_out, username_out);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Registrar::SubscriptionThread(PThread &, INT)
+void Registrar::ProcessSubscription(const PString & key, PInt64 now)
 {
-  while(!terminating)
-  {
-    MCUTime::Sleep(1000);
-    if(terminating)
-      break;
+  MCURegistrarSubscriptionList::shared_iterator it = subscriptionList.Find(key);
+  if(it == subscriptionList.end())
+    return;
+  RegistrarSubscription *rsub = *it;
 
-    PTime now;
-    for(MCURegistrarSubscriptionList::shared_iterator it = subscriptionList.begin(); it != subscriptionList.end(); ++it)
-    {
-      RegistrarSubscription *rsub = *it;
-      RegSubscriptionStates state_new;
-      if(now > rsub->start_time + PTimeInterval(rsub->expires*1000))
-      {
-        if(subscriptionList.Erase(it))
-          delete rsub;
-        continue;
-      }
+  PInt64 expire = RegistrarTimer::GetTime(rsub->start_time) + (PInt64)rsub->expires*1000;
+  if(now > expire)
+  {
+    EraseSub(it);
+    return;
+  }
 
-      RegistrarAccount *raccount_out = FindAccountWithLock(ACCOUNT_TYPE_SIP, rsub->username_out);
-      if(!raccount_out)
-        raccount_out = FindAccountWithLock(ACCOUNT_TYPE_H323, rsub->username_out);
+  RegSubscriptionStates state_new;
+  RegistrarAccount *raccount_out = FindAccountWithLock(ACCOUNT_TYPE_SIP, rsub->username_out);
+  if(!raccount_out)
+    raccount_out = FindAccountWithLock(ACCOUNT_TYPE_H323, rsub->username_out);
 
-      if(raccount_out && raccount_out->registered)
-      {
-        state_new = SUB_STATE_OPEN;
-        if(HasRegConn(raccount_out->account_type, raccount_out->username))
-          state_new = SUB_STATE_BUSY;
-      } else {
-        state_new = SUB_STATE_CLOSED;
-      }
+  if(raccount_out && raccount_out->registered)
+  {
+    state_new = SUB_STATE_OPEN;
+    if(HasRegConn(raccount_out->account_type, raccount_out->username))
+      state_new = SUB_STATE_BUSY;
+  } else {
+    state_new = SUB_STATE_CLOSED;
+  }
 
-      // send notify
-      if(rsub->state != state_new)
-      {
-        rsub->state = state_new;
-        SipSendNotify(rsub);
-      }
-      if(raccount_out) raccount_out->Unlock();
-    }
+  // send notify
+  if(rsub->state != state_new)
+  {
+    rsub->state = state_new;
+    SipSendNotify(rsub);
   }
+  if(raccount_out) raccount_out->Unlock();
+
+  timer.Arm(TIMER_SUBSCRIPTION, key, expire + 1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void Registrar::AliveThread(PThread &, INT)
+void Registrar::UpdateAbook(RegistrarAccount *raccount)
 {
-  while(!terminating)
+  PString key = PString(raccount->account_type)+":"+raccount->username;
+  MCUAbookList::shared_iterator r = abookList.Find(key);
+  if(r == abookList.end())
   {
-    MCUTime::Sleep(1000);
-    if(terminating)
-      break;
-
-    PTime now;
-    for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
+    AbookAccount *ab = new AbookAccount();
+    ab->is_abook = false;
+    ab->is_account = true;
+    ab->account_type = raccount->account_type;
+    ab->username = raccount->username;
+    long id = abookList.GetNextID();
+    r = abookList.Insert(ab, id, key);
+    if(r == abookList.end())
     {
-      RegistrarAccount *raccount = *it;
-      if(raccount->keep_alive_enable && now > raccount->keep_alive_time_request+PTimeInterval(raccount->keep_alive_interval*1000))
-      {
-        if(raccount->account_type == ACCOUNT_TYPE_H323)
-        {
-          raccount->keep_alive_time_request = PTime();
-          if(raccount->host == "" || raccount->port == 0)
-            continue;
-          H323TransportTCP transport(OpenMCU::Current().GetEndpoint());
-          if(!transport.SetRemoteAddress(raccount->host+":"+PString(raccount->port)))
-            continue;
-          PBYTEArray rawData;
-          if(transport.Connect() && transport.WritePDU(rawData))
-            raccount->keep_alive_time_response = raccount->keep_alive_time_request;
-        }
-        else if(raccount->account_type == ACCOUNT_TYPE_SIP)
-        {
-          raccount->keep_alive_time_request = now;
-          SipSendPing(raccount);
-        }
-      }
+      delete ab;
+      return;
     }
   }
+  AbookAccount *ab = *r;
+
+  AbookAccount oldab;
+  oldab.Set(*ab);
+
+  ab->is_account = true;
+  ab->is_saved_account = raccount->is_saved_account;
+  ab->host = raccount->host;
+  ab->port = raccount->port;
+  ab->transport = raccount->transport;
+  if(raccount->display_name_saved != "")
+    ab->display_name = raccount->display_name_saved;
+  else
+    ab->display_name = raccount->display_name;
+  ab->remote_application = raccount->remote_application;
+  ab->reg_state = 0;
+  ab->reg_info = "";
+  ab->conn_state = 0;
+  ab->conn_info = "";
+  ab->ping_state = 0;
+  ab->ping_info = "";
+
+  if(raccount->is_saved_account)
+    ab->reg_state = 1;
+  if(raccount->registered)
+    ab->reg_state = 2;
+  if(ab->reg_state != 0 && raccount->start_time != PTime(0))
+    ab->reg_info = raccount->start_time.AsString("hh:mm:ss dd.MM.yyyy");
+
+  RegistrarConnection *rconn = FindRegConnWithLock(raccount->account_type, raccount->username);
+  if(rconn)
+  {
+    if(rconn->state == CONN_WAIT || rconn->state == CONN_MCU_WAIT)
+      ab->conn_state = 1;
+    else if(rconn->state == CONN_ESTABLISHED || rconn->state == CONN_MCU_ESTABLISHED)
+    {
+      ab->conn_state = 2;
+      ab->conn_info = rconn->start_time.AsString("hh:mm:ss dd.MM.yyyy");
+    }
+    rconn->Unlock();
+  }
+
+  if(raccount->keep_alive_enable)
+  {
+    if(raccount->keep_alive_time_response > raccount->keep_alive_time_request-PTimeInterval(raccount->keep_alive_interval*1000-2000))
+      ab->ping_state = 1;
+    else
+      ab->ping_state = 2;
+    ab->ping_info = raccount->keep_alive_time_response.AsString("hh:mm:ss dd.MM.yyyy");
+  }
+
+  if(ab->AsJsArray() != oldab.AsJsArray())
+    ab->SendRoomControl();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -940,7 +1129,7 @@ void Registrar::QueueThread(PThread &, INT)
 {
   while(!terminating)
   {
-    MCUTime::Sleep(100);
+    queueSync.Wait(PTimeInterval(1000));
     if(terminating)
       break;
 
@@ -955,6 +1144,8 @@ void Registrar::QueueThread(PThread &, INT)
         QueueEstablished(cmd->Right(cmd->GetLength()-12));
       else if(cmd->Left(8) == "cleared:")
         QueueCleared(cmd->Right(cmd->GetLength()-8));
+      else if(cmd->Left(5) == "ping:")
+        QueuePing(cmd->Right(cmd->GetLength()-5));
       delete cmd;
     }
   }
@@ -962,6 +1153,14 @@ void Registrar::QueueThread(PThread &, INT)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void Registrar::QueuePush(PString *cmd)
+{
+  regQueue.Push(cmd);
+  queueSync.Signal();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void Registrar::QueueInvite(const PString & data)
 {
   PString from = data.Tokenise(",")[0];
@@ -1014,6 +1213,7 @@ void Registrar::QueueEstablished(const PString & data)
     rconn->state = CONN_MCU_ESTABLISHED;
   if(rconn->state == CONN_WAIT && rconn->callToken_out == callToken)
     rconn->state = CONN_ACCEPT_IN;
+  ArmConnection(rconn);
   rconn->Unlock();
 }
 
@@ -1039,11 +1239,41 @@ void Registrar::QueueCleared(const PString & data)
     rconn->state = CONN_LEAVE_IN;
   if(rconn->state == CONN_ACCEPT_IN && rconn->callToken_in == callToken)
     rconn->state = CONN_LEAVE_OUT;
+  ArmConnection(rconn);
   rconn->Unlock();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void Registrar::QueuePing(const PString & data)
+{
+  MCURegistrarAccountList::shared_iterator it = accountList.Find(data);
+  if(it == accountList.end())
+    return;
+  RegistrarAccount *raccount = *it;
+
+  if(raccount->account_type == ACCOUNT_TYPE_H323)
+  {
+    if(raccount->host == "" || raccount->port == 0)
+      return;
+    H323TransportTCP transport(OpenMCU::Current().GetEndpoint());
+    if(!transport.SetRemoteAddress(raccount->host+":"+PString(raccount->port)))
+      return;
+    PBYTEArray rawData;
+    if(transport.Connect() && transport.WritePDU(rawData))
+    {
+      raccount->keep_alive_time_response = raccount->keep_alive_time_request;
+      ArmAccount(raccount);
+    }
+  }
+  else if(raccount->account_type == ACCOUNT_TYPE_SIP)
+  {
+    SipSendPing(raccount);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void Registrar::InitConfig()
 {
   MCUConfig cfg("Registrar Parameters");
@@ -1166,6 +1396,7 @@ void Registrar::InitAccounts()
       if((raccount->account_type == ACCOUNT_TYPE_SIP && !sip_allow_unauth_reg) || (raccount->account_type == ACCOUNT_TYPE_H323 && !h323_allow_unauth_reg))
         raccount->registered = FALSE;
     }
+    ArmAccount(raccount);
   }
 
   PStringList sect = cfg.GetSections();
@@ -1232,6 +1463,7 @@ void Registrar::InitAccounts()
     // password
     if(account_type == ACCOUNT_TYPE_H323)
       h323Passwords.Insert(PString(username), new PString(raccount->auth.password));
+    ArmAccount(raccount);
     raccount->Unlock();
   }
   // set gatekeeper parameters
@@ -1250,22 +1482,14 @@ void Registrar::Terminating()
     registrarGk = NULL;
   }
 
-  // stop alive refresh
-  if(aliveThread)
+  // stop accounts, connections, subscriptions and abook refresh
+  if(timerThread)
   {
-    PTRACE(5, trace_section << "Waiting for termination alive thread: " << aliveThread->GetThreadName());
-    aliveThread->WaitForTermination();
-    delete aliveThread;
-    aliveThread = NULL;
-  }
-
-  // stop abook refresh
-  if(bookThread)
-  {
-    PTRACE(5, trace_section << "Waiting for termination book thread: " << bookThread->GetThreadName());
-    bookThread->WaitForTermination();
-    delete bookThread;
-    bookThread = NULL;
+    PTRACE(5, trace_section << "Waiting for termination timer thread: " << timerThread->GetThreadName());
+    timer.Signal();
+    timerThread->WaitForTermination();
+    delete timerThread;
+    timerThread = NULL;
   }
   for(MCUAbookList::shared_iterator it = abookList.begin(); it != abookList.end(); ++it)
   {
@@ -1274,60 +1498,30 @@ void Registrar::Terminating()
       delete acc;
   }
 
-  // stop subscriptions refresh
-  if(subscriptionThread)
-  {
-    PTRACE(5, trace_section << "Waiting for termination book thread: " << connectionThread->GetThreadName());
-    subscriptionThread->WaitForTermination();
-    delete subscriptionThread;
-    subscriptionThread = NULL;
-  }
-
   // stop queue thread
   if(queueThread)
   {
     PTRACE(5, trace_section << "Waiting for termination queue thread: " << queueThread->GetThreadName());
+    queueSync.Signal();
     queueThread->WaitForTermination();
     delete queueThread;
     queueThread = NULL;
   }
 
-  // stop accounts refresh
-  if(accountThread)
-  {
-    PTRACE(5, trace_section << "Waiting for termination accounts thread: " << accountThread->GetThreadName());
-    accountThread->WaitForTermination();
-    delete accountThread;
-    accountThread = NULL;
-  }
-
-  // stop connections refresh
-  if(connectionThread)
-  {
-    PTRACE(5, trace_section << "Waiting for termination book thread: " << connectionThread->GetThreadName());
-    connectionThread->WaitForTermination();
-    delete connectionThread;
-    connectionThread = NULL;
-  }
-
   for(MCURegistrarAccountList::shared_iterator it = accountList.begin(); it != accountList.end(); ++it)
   {
     RegistrarAccount *raccount = *it;
     if(accountList.Erase(it))
       delete raccount;
   }
-  for(MCURegistrarConnectionList::shared_iterator it = connectionList.begin(); it != connectionList.end(); ++it)
   {
-    RegistrarConnection *rconn = *it;
-    if(connectionList.Erase(it))
-      delete rconn;
+    PWaitAndSignal m(indexMutex);
+    aliasIndex.clear();
   }
+  for(MCURegistrarConnectionList::shared_iterator it = connectionList.begin(); it != connectionList.end(); ++it)
+    EraseRegConn(it);
   for(MCURegistrarSubscriptionList::shared_iterator it = subscriptionList.begin(); it != subscriptionList.end(); ++it)
-  {
-    RegistrarSubscription *rsub = *it;
-    if(subscriptionList.Erase(it))
-      delete rsub;
-  }
+    EraseSub(it);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1366,12 +1560,8 @@ void Registrar::MainLoop()
 
 void Registrar::Main()
 {
-  accountThread = PThread::Create(PCREATE_NOTIFIER(AccountThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "registrar account:%0x");
-  connectionThread = PThread::Create(PCREATE_NOTIFIER(ConnectionThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "registrar connection:%0x");
-  subscriptionThread = PThread::Create(PCREATE_NOTIFIER(SubscriptionThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "registrar subscription:%0x");
+  timerThread = PThread::Create(PCREATE_NOTIFIER(TimerThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "registrar timer:%0x");
   queueThread = PThread::Create(PCREATE_NOTIFIER(QueueThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "registrar queue:%0x");
-  aliveThread = PThread::Create(PCREATE_NOTIFIER(AliveThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "registrar alive:%0x");
-  bookThread = PThread::Create(PCREATE_NOTIFIER(BookThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "registrar book:%0x");
 
   MainLoop();
 }
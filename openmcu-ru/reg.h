@@ -28,6 +28,11 @@
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// accounts and address book entries, registered endpoints and the saved ones
+#define REGISTRAR_MAX_ACCOUNTS 65536
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 enum RegAccountTypes
 {
   ACCOUNT_TYPE_UNKNOWN,
@@ -540,12 +545,65 @@ class MCUH323Gatekeeper : public H323Gatekeeper
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+enum RegTimerTypes
+{
+  TIMER_ACCOUNT,     // registration expiry, keep alive and address book state
+  TIMER_CONNECTION,  // connection state change or accept timeout
+  TIMER_SUBSCRIPTION // subscription expiry and presence state
+};
+
+// Due times of the registrar objects ordered by time, the objects are armed when their
+// state changes and the timer thread visits only the due ones. An object is armed once,
+// with the earliest time, the handler checks its state and arms the next time.
+class RegistrarTimer
+{
+  public:
+    RegistrarTimer()
+    { }
+
+    // due time in msec, 0 - as soon as possible
+    void Arm(RegTimerTypes type, const PString & key, PInt64 due);
+
+    // removes the first object due at now, FALSE if there is none
+    BOOL Pop(PInt64 now, RegTimerTypes & type, PString & key);
+
+    // msec to the first object, no more than max
+    PInt64 GetDelay(PInt64 now, PInt64 max);
+
+    PINDEX GetSize();
+
+    void Wait(PInt64 msec)
+    { sync.Wait(PTimeInterval(msec)); }
+
+    void Signal()
+    { sync.Signal(); }
+
+    static PInt64 GetTime(const PTime & time)
+    { return time.GetTimestamp()/1000; }
+
+    static PInt64 GetTime()
+    { return PTime().GetTimestamp()/1000; }
+
+  protected:
+    typedef std::pair<PInt64, PString> TimerEntry;
+    std::set<TimerEntry> timerSet;
+    std::map<PString, PInt64> timerMap;
+    PMutex timerMutex;
+    PSyncPoint sync;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 class Registrar : public PThread
 {
   public:
     Registrar(MCUH323EndPoint *_ep, MCUSipEndPoint *_sep):
       PThread(10000,NoAutoDeleteThread,NormalPriority,"Registrar:%0x"),
-      ep(_ep), sep(_sep)
+      ep(_ep), sep(_sep),
+      accountList(REGISTRAR_MAX_ACCOUNTS, true),
+      subscriptionList(MCU_SHARED_LIST_SIZE, true),
+      connectionList(MCU_SHARED_LIST_SIZE, true),
+      abookList(REGISTRAR_MAX_ACCOUNTS, true)
     {
       restart = 1;
       terminating = 0;
@@ -592,10 +650,21 @@ class Registrar : public PThread
     RegistrarAccount * InsertAccountWithLock(RegAccountTypes account_type, const PString & username);
     RegistrarAccount * FindAccountWithLock(RegAccountTypes account_type, const PString & username);
     PString FindAccountNameFromH323Id(const PString & id);
+    void SetAccountH323Id(RegistrarAccount *raccount, const PString & h323id);
 
     MCUQueuePString & GetQueue()
     { return regQueue; }
 
+    RegistrarTimer & GetTimer()
+    { return timer; }
+
+    // the timer thread updates the account as soon as possible
+    void ArmAccount(RegistrarAccount *raccount);
+    void ArmAccount(RegAccountTypes account_type, const PString & username);
+
+    // visits the objects due at now as the timer thread does, returns the number of visits
+    unsigned ProcessTimer(PInt64 now);
+
     MCURegistrarAccountList & GetAccountList()
     { return accountList; }
 
@@ -650,10 +719,14 @@ class Registrar : public PThread
     BOOL SipSendMessage(RegistrarAccount *raccount_in, RegistrarAccount *raccount_out, const PString & message);
     BOOL SipSendPing(RegistrarAccount *raccount);
 
-    void ProcessAccountList();
-    void ProcessSubscriptionList();
-    void ProcessConnectionList();
-    void ProcessKeepAlive();
+    void ArmConnection(RegistrarConnection *rconn);
+    void ArmSubscription(RegistrarSubscription *rsub);
+    void ArmSubscribers(const PString & username);
+
+    void ProcessAccount(const PString & key, PInt64 now);
+    void ProcessConnection(const PString & key, PInt64 now);
+    void ProcessSubscription(const PString & key, PInt64 now);
+    void UpdateAbook(RegistrarAccount *raccount);
 
     int SipPolicyCheck(const msg_t *msg, msg_t *msg_reply, RegistrarAccount *raccount_in, RegistrarAccount *raccount_out);
 
@@ -665,41 +738,48 @@ class Registrar : public PThread
 
     RegistrarSubscription * InsertSubWithLock(const PString & username_in, const PString & username_out);
     RegistrarSubscription * FindSubWithLock(const PString & username_pair);
+    void EraseSub(MCURegistrarSubscriptionList::shared_iterator & it);
 
     RegistrarConnection * InsertRegConnWithLock(const PString & callToken, const PString & username_in, const PString & username_out);
+    void SetRegConnCallTokenOut(RegistrarConnection *rconn, const PString & callToken);
+    void EraseRegConn(MCURegistrarConnectionList::shared_iterator & it);
     RegistrarConnection * FindRegConnWithLock(const PString & callToken);
     RegistrarConnection * FindRegConnWithLock(RegAccountTypes account_type, const PString & username);
     bool HasRegConn(const PString & callToken);
     bool HasRegConn(RegAccountTypes account_type, const PString & username);
 
-    PDECLARE_NOTIFIER(PThread, Registrar, AccountThread);
-    PThread * accountThread;
-
-    PDECLARE_NOTIFIER(PThread, Registrar, ConnectionThread);
-    PThread * connectionThread;
-
-    PDECLARE_NOTIFIER(PThread, Registrar, SubscriptionThread);
-    PThread * subscriptionThread;
+    // accounts, connections, subscriptions and address book
+    PDECLARE_NOTIFIER(PThread, Registrar, TimerThread);
+    PThread * timerThread;
+    RegistrarTimer timer;
 
     PDECLARE_NOTIFIER(PThread, Registrar, QueueThread);
     PThread *queueThread;
     MCUQueuePString regQueue;
+    PSyncPoint queueSync;
 
-    PDECLARE_NOTIFIER(PThread, Registrar, BookThread);
-    PThread * bookThread;
-
-    PDECLARE_NOTIFIER(PThread, Registrar, AliveThread);
-    PThread * aliveThread;
-
+    void QueuePush(PString *cmd);
     void QueueInvite(const PString & data);
     void QueueCleared(const PString & data);
     void QueueEstablished(const PString & data);
+    void QueuePing(const PString & data);
 
     MCURegistrarAccountList accountList;
     MCURegistrarSubscriptionList subscriptionList;
     MCURegistrarConnectionList connectionList;
     MCUAbookList abookList;
 
+    // lookups that are not the list keys: h323id -> username,
+    // outgoing callToken -> connection key, username -> connection keys,
+    // subscribed username -> subscription keys
+    typedef std::map<PString, PString> IndexMap;
+    typedef std::multimap<PString, PString> IndexMultiMap;
+    IndexMap aliasIndex;
+    IndexMap callTokenIndex;
+    IndexMultiMap connUserIndex;
+    IndexMultiMap subUserIndex;
+    PMutex indexMutex;
+
     // mutex - используется в функциях OnReceived, MakeCall
     // предотвращает создание в списках двух одноименных объектов
     PMutex mutex;
@@ -105,10 +105,12 @@ H323Connection::AnswerCallResponse Registrar::OnReceivedH323Invite(MCUH323Connec
   {
     rconn->account_type_in = raccount_in->account_type;
     rconn->state = CONN_MCU_WAIT;
+    ArmConnection(rconn);
     response = H323Connection::AnswerCallNow;
   } else {
     rconn->roomname = MCU_INTERNAL_CALL_PREFIX + OpalGloballyUniqueID().AsString();
     rconn->state = CONN_WAIT;
+    ArmConnection(rconn);
     response = H323Connection::AnswerCallPending;
   }
 
@@ -123,6 +125,8 @@ H323Connection::AnswerCallResponse Registrar::OnReceivedH323Invite(MCUH323Connec
 
 H323GatekeeperRequest::Response RegistrarGk::OnRegistration(H323GatekeeperRRQ & info)
 {
+  MCUMetrics::registrarRegistrations.Inc();
+
   PWaitAndSignal m(mutex);
 
   H323GatekeeperRequest::Response response = H323GatekeeperServer::OnRegistration(info);
@@ -206,12 +210,13 @@ H323GatekeeperRequest::Response RegistrarGk::OnRegistration(H323GatekeeperRRQ &
     raccount->port = port;
   raccount->display_name = display_name;
   raccount->remote_application = remote_application;
-  raccount->h323id = h323id;
+  registrar->SetAccountH323Id(raccount, h323id);
 
   // regsiter TTL
   raccount->registered = TRUE;
   raccount->start_time = PTime();
   raccount->expires = expires;
+  registrar->ArmAccount(raccount);
 
   raccount->Unlock();
 
@@ -236,6 +241,7 @@ H323GatekeeperRequest::Response RegistrarGk::OnUnregistration(H323GatekeeperURQ
       if(raccount)
       {
         raccount->registered = FALSE;
+        registrar->ArmAccount(raccount);
         raccount->Unlock();
       }
     }
@@ -526,6 +532,7 @@ RegistrarGk::~RegistrarGk()
     {
       SendUnregister(raccount->username);
       raccount->registered = FALSE;
+      registrar->ArmAccount(raccount);
     }
   }
 
@@ -30,6 +30,7 @@
 int Registrar::OnReceivedSipRegister(const msg_t *msg)
 {
   PTRACE(1, trace_section << "OnReceivedSipRegister");
+  MCUMetrics::registrarRegistrations.Inc();
 
   PWaitAndSignal m(mutex);
 
@@ -71,6 +72,7 @@ int Registrar::OnReceivedSipRegister(const msg_t *msg)
       if(raccount->expires > sip_reg_max_expires)
         raccount->expires = sip_reg_max_expires;
     }
+    ArmAccount(raccount);
     // add headers
     sip_contact_t *sip_contact = sip_contact_create(sep->GetHome(), URL_STRING_MAKE((const char *)raccount->GetUrl()), NULL);
     sip_add_tl(msg_reply, sip_object(msg_reply),
@@ -252,6 +254,7 @@ int Registrar::OnReceivedSipInvite(const msg_t *msg)
     {
       rconn->account_type_in = raccount_in->account_type;
       rconn->state = CONN_MCU_WAIT;
+      ArmConnection(rconn);
       response_code = -1; // MCU call
       goto return_response;
     }
@@ -259,6 +262,7 @@ int Registrar::OnReceivedSipInvite(const msg_t *msg)
     {
       rconn->roomname = MCU_INTERNAL_CALL_PREFIX + OpalGloballyUniqueID().AsString();
       rconn->state = CONN_WAIT;
+      ArmConnection(rconn);
       response_code = 180; // SIP_180_RINGING
       goto return_response;
     }
@@ -319,6 +323,7 @@ int Registrar::OnReceivedSipSubscribe(msg_t *msg)
     if(!rsub)
       rsub = InsertSubWithLock(username_in, username_out);
     rsub->state = SUB_STATE_CLOSED;
+    rsub->start_time = PTime();
     rsub->ruri_str = url.GetUrl();
     rsub->contact_str = "sip:"+PString(sip->sip_to->a_url->url_user)+"@"+PString(sip->sip_to->a_url->url_host);
     // expires
@@ -330,6 +335,7 @@ int Registrar::OnReceivedSipSubscribe(msg_t *msg)
     msg_header_add_param(msg_home(msg), (msg_common_t *)sip->sip_to, nta_agent_newtag(GetHome(), "tag=%s", GetAgent()));
     // save subscribe message
     rsub->SetSubMsg(msg);
+    ArmSubscription(rsub);
     // add headers
     sip_contact_t *sip_contact = sip_contact_create(sep->GetHome(), URL_STRING_MAKE((const char *)rsub->contact_str), NULL);
     sip_add_tl(msg_reply, sip_object(msg_reply),
@@ -359,6 +365,7 @@ int Registrar::OnReceivedSipOptionsResponse(const msg_t *msg)
   if(raccount)
   {
     raccount->keep_alive_time_response = PTime();
+    ArmAccount(raccount);
     raccount->Unlock();
   }
 
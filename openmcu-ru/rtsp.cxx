@@ -1092,6 +1092,1147 @@ int MCURtspConnection::OnReceived(MCUSocket *socket, PString data)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+static void CloseFanoutSocket(int & fd)
+{
+  if(fd == -1)
+    return;
+#ifdef _WIN32
+  closesocket(fd);
+#else
+  close(fd);
+#endif
+  fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void PutFanoutDWORD(BYTE *p, DWORD value)
+{
+  p[0] = (BYTE)(value >> 24);
+  p[1] = (BYTE)(value >> 16);
+  p[2] = (BYTE)(value >> 8);
+  p[3] = (BYTE)value;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspSubscriber::MCURtspSubscriber()
+{
+  memset(&rtp_addr, 0, sizeof(rtp_addr));
+  memset(&rtcp_addr, 0, sizeof(rtcp_addr));
+  ssrc = (DWORD)random();
+  seq = (WORD)random();
+  ts_offset = (DWORD)random();
+  packets = 0;
+  octets = 0;
+  report_time = 0;
+  activity_time = 0;
+  waiting = TRUE;
+  setup = FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspFanoutStream::MCURtspFanoutStream(MCURtspFanout *_fanout, MediaTypes _media)
+  : fanout(_fanout), media(_media)
+{
+  trace_section = "RTSP fan-out " + fanout->GetName() + ((media == MEDIA_TYPE_AUDIO) ? " audio: " : " video: ");
+  sc = NULL;
+  payload = 0;
+  clock = 0;
+  rtp_fd = -1;
+  rtcp_fd = -1;
+  port = 0;
+  waiting = 0;
+  timestamp = 0;
+  timestampTime = 0;
+  packetsIn = 0;
+  packetsOut = 0;
+  sendUsec = 0;
+  reports = 0;
+  running = FALSE;
+  thread = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspFanoutStream::~MCURtspFanoutStream()
+{
+  Close();
+  CloseFanoutSocket(rtp_fd);
+  CloseFanoutSocket(rtcp_fd);
+  if(sc)
+    delete sc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspFanoutStream::Open(const PString & room, const PString & capname, unsigned width, unsigned height, unsigned frameRate, unsigned bandwidth)
+{
+  sc = new SipCapability(capname);
+  sc->media = media;
+  sc->cap = MCUCapability::Create(capname);
+  if(sc->cap == NULL)
+  {
+    MCUTRACE(1, trace_section << "not found codec " << capname);
+    return FALSE;
+  }
+
+  OpalMediaFormat & wf = sc->cap->GetWritableMediaFormat();
+  if(media == MEDIA_TYPE_AUDIO)
+  {
+    if(sc->payload == -1)
+      sc->payload = 96;
+    unsigned channels = wf.GetOptionInteger(OPTION_ENCODER_CHANNELS, 1);
+    cacheName = wf + "@" + PString(wf.GetTimeUnits() * 1000) + "/" + PString(channels) + "_" + room;
+  }
+  else
+  {
+    if(sc->payload == -1)
+      sc->payload = 97;
+    sc->video_width = width;
+    sc->video_height = height;
+    sc->video_frame_rate = frameRate;
+    sc->bandwidth = bandwidth;
+    sc->fmtp = "";
+    SetFormatParams(wf, width, height, frameRate, bandwidth);
+    // the name of the cache of the RTSP connections with the same settings
+    cacheName = wf + "@" + PString(width) + "x" + PString(height) + ":" + PString(wf.GetOptionInteger(OPTION_MAX_BIT_RATE))
+                + "x" + PString(90000 / wf.GetOptionInteger(OPTION_FRAME_TIME)) + "_" + room + "/0";
+  }
+  format = wf;
+  payload = sc->payload;
+  clock = (sc->clock > 0) ? sc->clock : ((media == MEDIA_TYPE_AUDIO) ? format.GetTimeUnits() * 1000 : 90000);
+
+  if(!OpenCache())
+    return FALSE;
+
+  if(!OpenSockets())
+    return FALSE;
+
+  MCUTRACE(1, trace_section << "cache " << cacheName << ", port " << port);
+
+  running = TRUE;
+  thread = PThread::Create(PCREATE_NOTIFIER(ReaderThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "rtsp_fanout:%0x");
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::Close()
+{
+  running = FALSE;
+  if(thread)
+  {
+    // the reads of the cache are bounded, the reader sees the flag within RTSP_FANOUT_READ_TIMEOUT_MS
+    while(!thread->WaitForTermination(5000))
+      MCUTRACE(1, trace_section << "waiting for the reader thread");
+    delete thread;
+    thread = NULL;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspFanoutStream::OpenCache()
+{
+  BOOL ok;
+  if(media == MEDIA_TYPE_AUDIO)
+    ok = OpenAudioCache(fanout->GetRoom(), format, cacheName);
+  else
+    ok = OpenVideoCache(fanout->GetRoom(), format, cacheName);
+  if(!ok)
+    MCUTRACE(1, trace_section << "could not open cache " << cacheName);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspFanoutStream::OpenSockets()
+{
+  MCUH323EndPoint & ep = OpenMCU::Current().GetEndpoint();
+  unsigned portBase = (ep.GetRtpIpPortBase() + 1) & ~1;
+  unsigned portMax = ep.GetRtpIpPortMax();
+
+  // RTP on an even port, RTCP on the next one
+  for(unsigned p = portBase; p + 1 <= portMax; p += 2)
+  {
+    rtp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    rtcp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(rtp_fd == -1 || rtcp_fd == -1)
+      break;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(p);
+    if(bind(rtp_fd, (const sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+      addr.sin_port = htons(p + 1);
+      if(bind(rtcp_fd, (const sockaddr *)&addr, sizeof(addr)) == 0)
+      {
+        // a packet goes to all viewers at once
+        int size = 4*1024*1024;
+        setsockopt(rtp_fd, SOL_SOCKET, SO_SNDBUF, (char *)&size, sizeof(size));
+        // the receiver reports are read by the reader thread without waiting
+#ifdef _WIN32
+        u_long nonblock = 1;
+        ioctlsocket(rtcp_fd, FIONBIO, &nonblock);
+#else
+        fcntl(rtcp_fd, F_SETFL, fcntl(rtcp_fd, F_GETFL) | O_NONBLOCK);
+#endif
+        port = p;
+        return TRUE;
+      }
+    }
+    CloseFanoutSocket(rtp_fd);
+    CloseFanoutSocket(rtcp_fd);
+  }
+
+  CloseFanoutSocket(rtp_fd);
+  CloseFanoutSocket(rtcp_fd);
+  MCUTRACE(1, trace_section << "could not bind RTP ports, error " << errno << " " << strerror(errno));
+  return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString MCURtspFanoutStream::GetSDP(const PString & control)
+{
+  char buffer[1024];
+  if(media == MEDIA_TYPE_AUDIO)
+  {
+    snprintf(buffer, 1024,
+           "m=audio 0 RTP/AVP %d\r\n"
+           "a=rtpmap:%d %s/%d%s\r\n"
+           "a=control:%s\r\n"
+           , payload, payload, (const char *)sc->format.ToUpper(), clock, (const char *)(sc->params == "" ? "" : "/"+sc->params)
+           , (const char *)control);
+  }
+  else
+  {
+    snprintf(buffer, 1024,
+           "m=video 0 RTP/AVP %d\r\n"
+           "b=AS:%d\r\n"
+           "a=rtpmap:%d %s/90000\r\n"
+           "%s"
+           "a=control:%s\r\n"
+           , payload, sc->bandwidth, payload, (const char *)sc->format.ToUpper()
+           , (const char *)(sc->fmtp == "" ? PString() : "a=fmtp:"+PString(payload)+" "+sc->fmtp+"\r\n")
+           , (const char *)control);
+  }
+  return buffer;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+DWORD MCURtspFanoutStream::GetTimestamp(uint64_t now)
+{
+  if(timestampTime == 0)
+    return timestamp;
+  return timestamp + (DWORD)((now - timestampTime) * clock / 1000000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::GetRtpInfo(MCURtspSubscriber *subscriber, WORD & seq, DWORD & ts)
+{
+  PWaitAndSignal m(subscriberMutex);
+  seq = subscriber->seq;
+  ts = GetTimestamp(MCUTime::GetMonoTimestampUsec()) + subscriber->ts_offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::AddSubscriber(MCURtspSubscriber *subscriber)
+{
+  PWaitAndSignal m(subscriberMutex);
+  if(std::find(subscribers.begin(), subscribers.end(), subscriber) != subscribers.end())
+    return;
+  // video is sent from the next keyframe, audio at once
+  subscriber->waiting = (media == MEDIA_TYPE_VIDEO);
+  subscriber->report_time = 0;
+  if(subscriber->waiting)
+    waiting++;
+  subscribers.push_back(subscriber);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::RemoveSubscriber(MCURtspSubscriber *subscriber)
+{
+  PWaitAndSignal m(subscriberMutex);
+  std::vector<MCURtspSubscriber *>::iterator it = std::find(subscribers.begin(), subscribers.end(), subscriber);
+  if(it == subscribers.end())
+    return;
+  if(subscriber->waiting)
+    waiting--;
+  subscribers.erase(it);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::Send(BYTE *header, PINDEX headerSize, const BYTE *data, PINDEX dataSize, DWORD ts, BOOL keyFrame)
+{
+  uint64_t start = MCUTime::GetMonoTimestampUsec();
+
+  PWaitAndSignal m(subscriberMutex);
+
+  unsigned count = subscribers.size();
+  if(headerBuffer.size() < count * headerSize)
+    headerBuffer.resize(count * headerSize);
+#ifdef __linux__
+  if(messages.size() < count)
+  {
+    messages.resize(count);
+    vectors.resize(count * 2);
+  }
+#else
+  if(packetBuffer.size() < (size_t)(headerSize + dataSize))
+    packetBuffer.resize(headerSize + dataSize);
+  memcpy(&packetBuffer[headerSize], data, dataSize);
+#endif
+
+  unsigned n = 0;
+  for(unsigned i = 0; i < count; i++)
+  {
+    MCURtspSubscriber *s = subscribers[i];
+    if(s->waiting)
+    {
+      if(!keyFrame)
+        continue;
+      s->waiting = FALSE;
+      waiting--;
+    }
+
+    // the header of the viewer: sequence number, timestamp and SSRC
+    BYTE *h = &headerBuffer[n * headerSize];
+    memcpy(h, header, headerSize);
+    h[2] = (BYTE)(s->seq >> 8);
+    h[3] = (BYTE)s->seq;
+    PutFanoutDWORD(h + 4, ts + s->ts_offset);
+    PutFanoutDWORD(h + 8, s->ssrc);
+    s->seq++;
+    s->packets++;
+    s->octets += dataSize;
+
+#ifdef __linux__
+    struct iovec *iov = &vectors[n * 2];
+    iov[0].iov_base = h;
+    iov[0].iov_len = headerSize;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = dataSize;
+    struct msghdr & msg = messages[n].msg_hdr;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &s->rtp_addr;
+    msg.msg_namelen = sizeof(s->rtp_addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+#else
+    memcpy(&packetBuffer[0], h, headerSize);
+    sendto(rtp_fd, (const char *)&packetBuffer[0], headerSize + dataSize, 0, (const sockaddr *)&s->rtp_addr, sizeof(s->rtp_addr));
+#endif
+    n++;
+  }
+
+#ifdef __linux__
+  // one system call per chunk of viewers, a failed destination is skipped
+  for(unsigned i = 0; i < n; )
+  {
+    int r = sendmmsg(rtp_fd, &messages[i], PMIN(n - i, 1024), 0);
+    if(r > 0)
+      i += r;
+    else if(errno != EINTR)
+      i++;
+  }
+#endif
+
+  packetsOut += n;
+  sendUsec += MCUTime::GetMonoTimestampUsec() - start;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::SendReports(uint64_t now)
+{
+  static const char cname[] = PRODUCT_NAME_TEXT;
+  const unsigned cnameSize = strlen(cname) > 255 ? 255 : strlen(cname);
+  // SDES chunk: SSRC, CNAME item, end of the list, padded to 32 bits
+  const unsigned sdesSize = 4 + ((4 + 2 + cnameSize + 1 + 3) & ~3);
+
+  BYTE packet[28 + 4 + 4 + 256 + 8];
+
+  PTime wallTime;
+  DWORD ntpSec = (DWORD)(wallTime.GetTimeInSeconds() + 2208988800U);
+  DWORD ntpFrac = (DWORD)(((uint64_t)wallTime.GetMicrosecond() << 32) / 1000000);
+
+  PWaitAndSignal m(subscriberMutex);
+
+  DWORD ts = GetTimestamp(now);
+  for(unsigned i = 0; i < subscribers.size(); i++)
+  {
+    MCURtspSubscriber *s = subscribers[i];
+    if(s->waiting || s->packets == 0)
+      continue;
+    if(s->report_time != 0 && now - s->report_time < RTSP_FANOUT_REPORT_INTERVAL_MS * 1000)
+      continue;
+    s->report_time = now;
+
+    // sender report without report blocks
+    memset(packet, 0, sizeof(packet));
+    packet[0] = 0x80;
+    packet[1] = 200;
+    packet[3] = 6;
+    PutFanoutDWORD(packet + 4, s->ssrc);
+    PutFanoutDWORD(packet + 8, ntpSec);
+    PutFanoutDWORD(packet + 12, ntpFrac);
+    PutFanoutDWORD(packet + 16, ts + s->ts_offset);
+    PutFanoutDWORD(packet + 20, s->packets);
+    PutFanoutDWORD(packet + 24, s->octets);
+
+    BYTE *sdes = packet + 28;
+    sdes[0] = 0x81;
+    sdes[1] = 202;
+    sdes[3] = (BYTE)(sdesSize / 4 - 1);
+    PutFanoutDWORD(sdes + 4, s->ssrc);
+    sdes[8] = 1;
+    sdes[9] = (BYTE)cnameSize;
+    memcpy(sdes + 10, cname, cnameSize);
+
+    sendto(rtcp_fd, (const char *)packet, 28 + sdesSize, 0, (const sockaddr *)&s->rtcp_addr, sizeof(s->rtcp_addr));
+    reports++;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::ReceiveReports(uint64_t now)
+{
+  BYTE packet[1500];
+  struct sockaddr_in addr;
+  for(;;)
+  {
+    socklen_t addrSize = sizeof(addr);
+    int len = recvfrom(rtcp_fd, (char *)packet, sizeof(packet), 0, (sockaddr *)&addr, &addrSize);
+    if(len < 0)
+      break;
+    // RR, SDES, BYE and the other RTCP packets of the viewer
+    if(len < 8 || (packet[0] & 0xC0) != 0x80 || packet[1] < 200 || packet[1] > 207)
+      continue;
+
+    PWaitAndSignal m(subscriberMutex);
+    for(unsigned i = 0; i < subscribers.size(); i++)
+    {
+      MCURtspSubscriber *s = subscribers[i];
+      if(s->rtcp_addr.sin_addr.s_addr == addr.sin_addr.s_addr && s->rtcp_addr.sin_port == addr.sin_port)
+      {
+        s->activity_time = now;
+        break;
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t MCURtspFanoutStream::GetActivityTime(MCURtspSubscriber *subscriber)
+{
+  PWaitAndSignal m(subscriberMutex);
+  return subscriber->activity_time;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanoutStream::ReaderThread(PThread &, INT)
+{
+  CacheRTP *cache = NULL;
+  unsigned seqN = 0;
+  RTP_DataFrame frame;
+  uint64_t intraTime = 0;
+  uint64_t reportTime = 0;
+
+  // audio frames of the cache are joined into packets of RTSP_FANOUT_AUDIO_PACKET_MS
+  std::vector<BYTE> audioBuffer;
+  unsigned audioSamples = 0;
+  unsigned packetSamples = PMAX((unsigned)format.GetFrameTime(), clock * RTSP_FANOUT_AUDIO_PACKET_MS / 1000);
+  BOOL audioMarker = TRUE;
+
+  while(running)
+  {
+    unsigned count;
+    unsigned waitingCount;
+    {
+      PWaitAndSignal m(subscriberMutex);
+      count = subscribers.size();
+      waitingCount = waiting;
+    }
+
+    // the encoder of the cache does not work for nobody
+    if(count == 0)
+    {
+      if(cache)
+      {
+        DetachCacheRTP(cache);
+        audioBuffer.clear();
+        audioSamples = 0;
+        audioMarker = TRUE;
+      }
+      MCUTime::Sleep(100);
+      continue;
+    }
+
+    uint64_t now = MCUTime::GetMonoTimestampUsec();
+    if(cache == NULL)
+    {
+      if(!AttachCacheRTP(cache, cacheName, seqN))
+      {
+        // the cache is deleted with the room
+        OpenCache();
+        MCUTime::Sleep(100);
+        continue;
+      }
+      intraTime = 0;
+      // the waiting viewers start from the keyframe kept by the cache
+      if(media == MEDIA_TYPE_VIDEO && SeekCacheRTPKeyFrame(cache, seqN))
+        intraTime = now;
+    }
+
+    unsigned flags = 0;
+    if(waitingCount != 0 && now - intraTime >= RTSP_FANOUT_INTRA_INTERVAL_MS * 1000)
+    {
+      flags = PluginCodec_CoderForceIFrame;
+      intraTime = now;
+    }
+
+    // a stopped encoder does not hold the reader, the reports are handled meanwhile
+    unsigned length = 0;
+    if(!GetCacheRTP(cache, frame, length, seqN, flags, RTSP_FANOUT_READ_TIMEOUT_MS))
+    {
+      now = MCUTime::GetMonoTimestampUsec();
+      if(now - reportTime >= 1000000)
+      {
+        reportTime = now;
+        ReceiveReports(now);
+      }
+      continue;
+    }
+    packetsIn++;
+    now = MCUTime::GetMonoTimestampUsec();
+
+    if(length != 0 && media == MEDIA_TYPE_VIDEO)
+    {
+      BYTE *header = frame.GetPointer();
+      header[1] = (header[1] & 0x80) | (BYTE)payload;
+      timestamp = frame.GetTimestamp();
+      timestampTime = now;
+      Send(header, frame.GetHeaderSize(), frame.GetPayloadPtr(), length, timestamp, (flags & PluginCodec_ReturnCoderIFrame) != 0);
+    }
+    else if(length != 0 && media == MEDIA_TYPE_AUDIO)
+    {
+      const BYTE *data = frame.GetPayloadPtr();
+      audioBuffer.insert(audioBuffer.end(), data, data + length);
+      unsigned frameSize = format.GetFrameSize();
+      audioSamples += format.GetFrameTime() * ((frameSize != 0 && length > frameSize) ? (length + frameSize - 1) / frameSize : 1);
+      if(audioSamples >= packetSamples)
+      {
+        BYTE header[12];
+        memset(header, 0, sizeof(header));
+        header[0] = 0x80;
+        header[1] = (audioMarker ? 0x80 : 0) | (BYTE)payload;
+        Send(header, sizeof(header), &audioBuffer[0], audioBuffer.size(), timestamp, TRUE);
+        timestamp += audioSamples;
+        timestampTime = now;
+        audioBuffer.clear();
+        audioSamples = 0;
+        audioMarker = FALSE;
+      }
+    }
+
+    if(now - reportTime >= 1000000)
+    {
+      reportTime = now;
+      ReceiveReports(now);
+      SendReports(now);
+    }
+  }
+
+  DetachCacheRTP(cache);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MCURtspViewerCleaner : public PThread
+{
+  public:
+    MCURtspViewerCleaner(MCURtspFanout *_fanout, MCURtspViewer *_viewer)
+      : PThread(10000, AutoDeleteThread, NormalPriority, "MCU RTSP Viewer Cleaner"), fanout(_fanout), viewer(_viewer)
+    {
+      Resume();
+    }
+    void Main()
+    {
+      fanout->RemoveViewer(viewer);
+    }
+
+  protected:
+    MCURtspFanout *fanout;
+    MCURtspViewer *viewer;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspViewer::MCURtspViewer(MCURtspFanout *_fanout, MCUSocket *socket)
+  : fanout(_fanout)
+{
+  trace_section = "RTSP fan-out " + fanout->GetName() + " viewer " + socket->GetAddress() + ": ";
+  remote_host = socket->GetHost();
+  session_str = PString(random());
+  playing = FALSE;
+  closed = FALSE;
+  activity_time = MCUTime::GetMonoTimestampUsec();
+  listener = NULL;
+
+  auth.scheme = "Digest";
+  auth.username = fanout->GetUserName();
+  auth.password = fanout->GetPassword();
+  if(auth.password != "")
+    auth.type = HTTPAuth::AUTH_WWW;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspViewer::~MCURtspViewer()
+{
+  RemoveSubscribers();
+  if(listener)
+    delete listener;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspViewer::Start(MCUSocket *socket, const msg_t *msg)
+{
+  PWaitAndSignal m(viewerMutex);
+
+  listener = MCUListener::Create(MCU_LISTENER_TCP_CLIENT, socket, OnReceived_wrap, this);
+  if(msg && !OnRequest(msg))
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspViewer::Close()
+{
+  if(closed)
+    return;
+  closed = TRUE;
+  RemoveSubscribers();
+  MCUTRACE(1, trace_section << "closed");
+  fanout->CloseViewer(this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspViewer::CheckTimeout(uint64_t now)
+{
+  PWaitAndSignal m(viewerMutex);
+
+  if(closed)
+    return;
+
+  // the players send GET_PARAMETER or OPTIONS as keepalive, or only the receiver reports
+  uint64_t last = activity_time;
+  MCURtspFanoutStream *stream;
+  if(audio.setup && (stream = fanout->GetStream(MEDIA_TYPE_AUDIO)) != NULL)
+    last = PMAX(last, stream->GetActivityTime(&audio));
+  if(video.setup && (stream = fanout->GetStream(MEDIA_TYPE_VIDEO)) != NULL)
+    last = PMAX(last, stream->GetActivityTime(&video));
+  if(now < last || now - last < (uint64_t)RTSP_FANOUT_SESSION_TIMEOUT * 1000000)
+    return;
+
+  MCUTRACE(1, trace_section << "session timeout, no requests and reports for " << (now - last) / 1000000 << " s");
+  Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspViewer::RemoveSubscribers()
+{
+  playing = FALSE;
+  MCURtspFanoutStream *stream;
+  if((stream = fanout->GetStream(MEDIA_TYPE_AUDIO)) != NULL)
+    stream->RemoveSubscriber(&audio);
+  if((stream = fanout->GetStream(MEDIA_TYPE_VIDEO)) != NULL)
+    stream->RemoveSubscriber(&video);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspViewer::SendResponse(const msg_t *msg, const PString & status, const PString & headers, const PString & body)
+{
+  sip_t *sip = sip_object(msg);
+
+  PString str = "RTSP/1.0 " + status + "\r\n"
+                "CSeq: " + PString(sip->sip_cseq->cs_seq) + "\r\n"
+                "Date: " + PTime().AsString() + "\r\n"
+                + headers +
+                "Server: " + SIP_USER_AGENT + "\r\n";
+  if(body != "")
+    str += "Content-Length: " + PString(body.GetLength()) + "\r\n";
+  str += "\r\n" + body;
+
+  MCUTRACE(3, trace_section << "send " << str.GetLength() << " bytes\n" << str);
+  if(listener == NULL || !listener->Send(str))
+    return FALSE;
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspViewer::CheckAuth(const msg_t *msg)
+{
+  if(auth.type == HTTPAuth::AUTH_NONE)
+    return TRUE;
+
+  sip_t *sip = sip_object(msg);
+  PString method_name = sip->sip_request->rq_method_name;
+  if(method_name == METHOD_OPTIONS)
+    return TRUE;
+
+  if(sip->sip_authorization == NULL)
+  {
+    SendResponse(msg, "401 Unauthorized", "WWW-Authenticate: " + auth.MakeAuthenticateStr() + "\r\n");
+    return FALSE;
+  }
+
+  PString response = msg_params_find(sip->sip_authorization->au_params, "response=");
+  response.Replace("\"","",TRUE,0);
+  HTTPAuth auth_copy(auth);
+  auth_copy.method = method_name;
+  auth_copy.uri = msg_params_find(sip->sip_authorization->au_params, "uri=");
+  if(auth_copy.MakeResponse() != response)
+  {
+    SendResponse(msg, "403 Forbidden");
+    MCUTRACE(1, trace_section << "authorization failure");
+    Close();
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspViewer::OnRequest(const msg_t *msg)
+{
+  sip_t *sip = sip_object(msg);
+  if(sip->sip_request == NULL)
+    return TRUE;
+
+  if(!CheckAuth(msg))
+    return TRUE;
+
+  PString method_name = sip->sip_request->rq_method_name;
+  if(method_name == METHOD_OPTIONS)
+    return SendResponse(msg, "200 OK", "Public: OPTIONS, DESCRIBE, SETUP, TEARDOWN, PLAY, PAUSE, GET_PARAMETER\r\n");
+  if(method_name == METHOD_DESCRIBE)
+    return OnRequestDescribe(msg);
+  if(method_name == METHOD_SETUP)
+    return OnRequestSetup(msg);
+  if(method_name == METHOD_PLAY)
+    return OnRequestPlay(msg);
+  if(method_name == METHOD_PAUSE)
+    return OnRequestPause(msg);
+  // keepalive of the players
+  if(method_name == METHOD_GET_PARAMETER || method_name == METHOD_SET_PARAMETER)
+    return SendResponse(msg, "200 OK", "Session: " + session_str + "\r\n");
+  if(method_name == METHOD_TEARDOWN)
+  {
+    SendResponse(msg, "200 OK", "Session: " + session_str + "\r\n");
+    return FALSE;
+  }
+
+  MCUTRACE(1, trace_section << "unsupported method " << method_name);
+  return SendResponse(msg, "501 Not Implemented");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspViewer::OnRequestDescribe(const msg_t *msg)
+{
+  sip_t *sip = sip_object(msg);
+
+  base_url = url_as_string(msg_home(msg), sip->sip_request->rq_url);
+  while(base_url.GetLength() > 0 && base_url[base_url.GetLength()-1] == '/')
+    base_url = base_url.Left(base_url.GetLength()-1);
+
+  char buffer[1024];
+  snprintf(buffer, 1024,
+           "v=0\r\n"
+           "o=- %s %s IN IP4 " PRODUCT_NAME_TEXT "\r\n"
+           "s=Unnamed\r\n"
+           "i=N/A\r\n"
+           "c=IN IP4 0.0.0.0\r\n"
+           "t=0 0\r\n"
+           "a=recvonly\r\n"
+           "a=type:unicast\r\n"
+           "a=charset:UTF-8\r\n"
+           "a=control:%s\r\n"
+           , (const char *)session_str, (const char *)session_str, (const char *)base_url);
+
+  PString sdp = buffer;
+  if(fanout->GetStream(MEDIA_TYPE_AUDIO))
+    sdp += fanout->GetStream(MEDIA_TYPE_AUDIO)->GetSDP(base_url+"/audio");
+  if(fanout->GetStream(MEDIA_TYPE_VIDEO))
+    sdp += fanout->GetStream(MEDIA_TYPE_VIDEO)->GetSDP(base_url+"/video");
+
+  return SendResponse(msg, "200 OK", "Content-Type: application/sdp\r\n"
+                                     "Content-Base: " + base_url + "/\r\n"
+                                     "Cache-Control: no-cache\r\n", sdp);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspViewer::OnRequestSetup(const msg_t *msg)
+{
+  sip_t *sip = sip_object(msg);
+
+  if(playing)
+    return SendResponse(msg, "455 Method Not Valid in This State");
+
+  MCUURL url(url_as_string(msg_home(msg), sip->sip_request->rq_url));
+  PString setup_media;
+  if(url.GetPath().GetSize() > 0)
+    setup_media = url.GetPath()[url.GetPath().GetSize()-1];
+
+  MCURtspSubscriber *subscriber = NULL;
+  MCURtspFanoutStream *stream = NULL;
+  if(setup_media == "audio")
+  {
+    subscriber = &audio;
+    stream = fanout->GetStream(MEDIA_TYPE_AUDIO);
+  }
+  else if(setup_media == "video")
+  {
+    subscriber = &video;
+    stream = fanout->GetStream(MEDIA_TYPE_VIDEO);
+  }
+  if(stream == NULL)
+  {
+    MCUTRACE(1, trace_section << "unknown media " << setup_media);
+    return SendResponse(msg, "404 Not Found");
+  }
+
+  PString transport_str;
+  for(sip_unknown_t *sip_un = sip->sip_unknown; sip_un != NULL; sip_un = sip_un->un_next)
+  {
+    if(PString(sip_un->un_name) == "Transport")
+      transport_str = sip_un->un_value;
+  }
+
+  // the packets are shared by all viewers, RTP over the RTSP connection is not supported
+  MCUStringDictionary transport_dict(transport_str);
+  PStringArray ports = transport_dict("client_port").Tokenise("-");
+  unsigned rtp_port = (ports.GetSize() > 0) ? ports[0].AsUnsigned() : 0;
+  unsigned rtcp_port = (ports.GetSize() > 1) ? ports[1].AsUnsigned() : rtp_port + 1;
+  if(transport_str.Find("TCP") != P_MAX_INDEX || transport_str.Find("interleaved") != P_MAX_INDEX || rtp_port == 0)
+  {
+    MCUTRACE(1, trace_section << "unsupported transport " << transport_str);
+    return SendResponse(msg, "461 Unsupported Transport");
+  }
+
+  PString remote_ip;
+  if(!MCUSocket::GetHostIP(remote_ip, remote_host))
+  {
+    MCUTRACE(1, trace_section << "incorrect remote ip " << remote_host);
+    return SendResponse(msg, "400 Bad Request");
+  }
+  subscriber->rtp_addr.sin_family = AF_INET;
+  subscriber->rtp_addr.sin_addr = PIPSocket::Address(remote_ip);
+  subscriber->rtcp_addr = subscriber->rtp_addr;
+  subscriber->rtp_addr.sin_port = htons(rtp_port);
+  subscriber->rtcp_addr.sin_port = htons(rtcp_port);
+  subscriber->setup = TRUE;
+
+  char buffer[256];
+  snprintf(buffer, 256, "RTP/AVP;unicast;%s%sclient_port=%u-%u;server_port=%u-%u;ssrc=%08X",
+           (const char *)(fanout->GetSourceAddress() == "" ? "" : "source="), (const char *)(fanout->GetSourceAddress() == "" ? PString() : fanout->GetSourceAddress()+";"),
+           rtp_port, rtcp_port, stream->GetPort(), stream->GetPort()+1, (unsigned)subscriber->ssrc);
+
+  return SendResponse(msg, "200 OK", "Session: " + session_str + ";timeout=" + PString(RTSP_FANOUT_SESSION_TIMEOUT) + "\r\n"
+                                     "Transport: " + PString(buffer) + "\r\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspViewer::OnRequestPlay(const msg_t *msg)
+{
+  MCURtspFanoutStream *audioStream = audio.setup ? fanout->GetStream(MEDIA_TYPE_AUDIO) : NULL;
+  MCURtspFanoutStream *videoStream = video.setup ? fanout->GetStream(MEDIA_TYPE_VIDEO) : NULL;
+  if(audioStream == NULL && videoStream == NULL)
+    return SendResponse(msg, "455 Method Not Valid in This State");
+
+  if(playing)
+    return SendResponse(msg, "200 OK", "Session: " + session_str + "\r\n");
+
+  // the first packet of the viewer follows the RTP-Info
+  PString rtp_info;
+  WORD seq;
+  DWORD ts;
+  if(audioStream)
+  {
+    audioStream->GetRtpInfo(&audio, seq, ts);
+    rtp_info += "url=" + base_url + "/audio;seq=" + PString(seq) + ";rtptime=" + PString(ts);
+  }
+  if(videoStream)
+  {
+    videoStream->GetRtpInfo(&video, seq, ts);
+    rtp_info += PString(rtp_info == "" ? "" : ",") + "url=" + base_url + "/video;seq=" + PString(seq) + ";rtptime=" + PString(ts);
+  }
+
+  if(!SendResponse(msg, "200 OK", "Session: " + session_str + "\r\n"
+                                  "Range: npt=0.000-\r\n"
+                                  "RTP-Info: " + rtp_info + "\r\n"))
+    return FALSE;
+
+  if(audioStream)
+    audioStream->AddSubscriber(&audio);
+  if(videoStream)
+    videoStream->AddSubscriber(&video);
+  playing = TRUE;
+
+  MCUTRACE(1, trace_section << "playing");
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspViewer::OnRequestPause(const msg_t *msg)
+{
+  RemoveSubscribers();
+  return SendResponse(msg, "200 OK", "Session: " + session_str + "\r\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int MCURtspViewer::OnReceived(MCUSocket *socket, PString data)
+{
+  PWaitAndSignal m(viewerMutex);
+
+  if(closed)
+    return 0;
+
+  if(socket == NULL)
+  {
+    MCUTRACE(1, trace_section << "connection closed by remote user");
+    Close();
+    return 0;
+  }
+
+  buffer += data;
+  for(;;)
+  {
+    PINDEX end = buffer.Find("\r\n\r\n");
+    if(end == P_MAX_INDEX)
+      break;
+    PINDEX size = end + 4;
+    PString lower = buffer.Left(size).ToLower();
+    PINDEX pos = lower.Find("content-length:");
+    if(pos != P_MAX_INDEX)
+      size += lower.Mid(pos + 15).Trim().AsInteger();
+    if(buffer.GetLength() < size)
+      break;
+
+    PString msg_str = buffer.Left(size);
+    buffer.Delete(0, size);
+
+    MCUTRACE(3, trace_section << "recv " << msg_str.GetLength() << " bytes\n" << msg_str);
+    msg_t *msg = ParseMsg(msg_str);
+    if(msg == NULL)
+    {
+      MCUTRACE(1, trace_section << "failed parse message");
+      Close();
+      return 0;
+    }
+    activity_time = MCUTime::GetMonoTimestampUsec();
+    BOOL ok = OnRequest(msg);
+    msg_destroy(msg);
+    if(!ok || closed)
+    {
+      Close();
+      return 0;
+    }
+  }
+
+  if(buffer.GetLength() > 65536)
+  {
+    MCUTRACE(1, trace_section << "request is too large");
+    Close();
+    return 0;
+  }
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspFanout::MCURtspFanout(const PString & _name, const PString & _room)
+  : name(_name), room(_room)
+{
+  audioStream = NULL;
+  videoStream = NULL;
+  cleaners = 0;
+
+  running = TRUE;
+  sessionThread = PThread::Create(PCREATE_NOTIFIER(SessionThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "rtsp_session:%0x");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspFanout::~MCURtspFanout()
+{
+  running = FALSE;
+  if(sessionThread)
+  {
+    sessionThread->WaitForTermination();
+    delete sessionThread;
+    sessionThread = NULL;
+  }
+
+  for(MCURtspViewerList::shared_iterator it = viewerList.begin(); it != viewerList.end(); ++it)
+  {
+    MCURtspViewer *viewer = *it;
+    if(viewerList.Erase(it))
+      delete viewer;
+  }
+  // the cleaners of the closed viewers find nothing
+  for(;;)
+  {
+    {
+      PWaitAndSignal m(cleanerMutex);
+      if(cleaners == 0)
+        break;
+    }
+    MCUTime::Sleep(10);
+  }
+
+  if(audioStream)
+    delete audioStream;
+  if(videoStream)
+    delete videoStream;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspFanout::SetAudio(const PString & capname)
+{
+  audioStream = new MCURtspFanoutStream(this, MEDIA_TYPE_AUDIO);
+  if(audioStream->Open(room, capname, 0, 0, 0, 0))
+    return TRUE;
+  delete audioStream;
+  audioStream = NULL;
+  return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspFanout::SetVideo(const PString & capname, unsigned width, unsigned height, unsigned frameRate, unsigned bandwidth)
+{
+  videoStream = new MCURtspFanoutStream(this, MEDIA_TYPE_VIDEO);
+  if(videoStream->Open(room, capname, width, height, frameRate, bandwidth))
+    return TRUE;
+  delete videoStream;
+  videoStream = NULL;
+  return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanout::SetAuth(const PString & _username, const PString & _password)
+{
+  username = _username;
+  password = _password;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCURtspFanout::AddViewer(MCUSocket *socket, const msg_t *msg)
+{
+  // the viewer is in the list before its listener, a closed connection always finds it
+  MCURtspViewer *viewer = new MCURtspViewer(this, socket);
+  if(viewerList.Insert(viewer, (long)viewer, socket->GetAddress()) == viewerList.end())
+  {
+    MCUTRACE(1, "RTSP fan-out " << name << ": too many viewers, " << socket->GetAddress() << " rejected");
+    delete viewer;
+    return FALSE;
+  }
+  viewer->Start(socket, msg);
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanout::CloseViewer(MCURtspViewer *viewer)
+{
+  PWaitAndSignal m(cleanerMutex);
+  cleaners++;
+  new MCURtspViewerCleaner(this, viewer);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanout::RemoveViewer(MCURtspViewer *viewer)
+{
+  MCURtspViewerList::shared_iterator it = viewerList.Find((long)viewer);
+  if(it != viewerList.end() && viewerList.Erase(it))
+    delete viewer;
+
+  PWaitAndSignal m(cleanerMutex);
+  cleaners--;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCURtspFanout::SessionThread(PThread &, INT)
+{
+  unsigned ticks = 0;
+  while(running)
+  {
+    MCUTime::Sleep(100);
+    if(++ticks < 10)
+      continue;
+    ticks = 0;
+
+    uint64_t now = MCUTime::GetMonoTimestampUsec();
+    for(MCURtspViewerList::shared_iterator it = viewerList.begin(); it != viewerList.end(); ++it)
+      (*it)->CheckTimeout(now);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t MCURtspFanout::GetPacketsIn()
+{
+  return (audioStream ? audioStream->GetPacketsIn() : 0) + (videoStream ? videoStream->GetPacketsIn() : 0);
+}
+
+uint64_t MCURtspFanout::GetPacketsOut()
+{
+  return (audioStream ? audioStream->GetPacketsOut() : 0) + (videoStream ? videoStream->GetPacketsOut() : 0);
+}
+
+uint64_t MCURtspFanout::GetSendUsec()
+{
+  return (audioStream ? audioStream->GetSendUsec() : 0) + (videoStream ? videoStream->GetSendUsec() : 0);
+}
+
+uint64_t MCURtspFanout::GetReports()
+{
+  return (audioStream ? audioStream->GetReports() : 0) + (videoStream ? videoStream->GetReports() : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 MCURtspServer::MCURtspServer(MCUH323EndPoint *_ep, MCUSipEndPoint *_sep)
   :ep(_ep), sep(_sep)
 {
@@ -1104,6 +2245,7 @@ MCURtspServer::MCURtspServer(MCUH323EndPoint *_ep, MCUSipEndPoint *_sep)
 MCURtspServer::~MCURtspServer()
 {
   RemoveListeners();
+  RemoveFanouts();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1180,12 +2322,74 @@ BOOL MCURtspServer::HasListener(const PString & host, const PString & port)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-int MCURtspServer::OnReceived(MCUSocket *socket, PString data)
+void MCURtspServer::RemoveFanouts()
 {
   PWaitAndSignal m(rtspMutex);
+  for(std::map<PString, MCURtspFanout *>::iterator it = fanoutMap.begin(); it != fanoutMap.end(); ++it)
+    delete it->second;
+  fanoutMap.clear();
+}
 
-  if(socket->ReadData(data) == FALSE || data.GetLength() == 0)
-    return 0;
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCURtspFanout * MCURtspServer::GetFanout(const PString & path)
+{
+  PWaitAndSignal m(rtspMutex);
+
+  PString section = "RTSP Server "+path;
+  PString room = GetSectionParamFromUrl(RoomNameKey, section, OpenMCU::Current().GetDefaultRoomName());
+  PString audio_codec = GetSectionParamFromUrl(AudioCodecKey, section);
+  PString video_codec = GetSectionParamFromUrl(VideoCodecKey, section);
+  PString video_resolution = GetSectionParamFromUrl(VideoResolutionKey, section, "352x288");
+  unsigned video_bandwidth = GetSectionParamFromUrl(BandwidthFromKey, section, "256").AsInteger();
+  unsigned video_frame_rate = GetSectionParamFromUrl(FrameRateFromKey, section, "10").AsInteger();
+  unsigned video_width = video_resolution.Tokenise("x")[0].AsInteger();
+  unsigned video_height = video_resolution.Tokenise("x")[1].AsInteger();
+  PString username = GetSectionParamFromUrl(UserNameKey, section);
+  PString password = GetSectionParamFromUrl(PasswordKey, section);
+  PString nat_ip = GetSectionParamFromUrl(NATRouterIPKey, section).Tokenise(":")[0];
+
+  PString signature = room+","+audio_codec+","+video_codec+","+PString(video_width)+"x"+PString(video_height)+"x"+PString(video_frame_rate)
+                      +","+PString(video_bandwidth)+","+username+","+password+","+nat_ip;
+
+  std::map<PString, MCURtspFanout *>::iterator it = fanoutMap.find(path);
+  if(it != fanoutMap.end())
+  {
+    // the changed settings apply when the last viewer has gone
+    if(it->second->GetSignature() == signature || it->second->GetViewerCount() != 0)
+      return it->second;
+    MCUTRACE(1, trace_section << "fan-out " << path << " settings changed");
+    delete it->second;
+    fanoutMap.erase(it);
+  }
+
+  MCURtspFanout *fanout = new MCURtspFanout(path, room);
+  fanout->SetSignature(signature);
+  fanout->SetAuth(username, password);
+  fanout->SetSourceAddress(nat_ip);
+  BOOL audio = (audio_codec != "" && fanout->SetAudio(audio_codec));
+  BOOL video = (video_codec != "" && fanout->SetVideo(video_codec, video_width, video_height, video_frame_rate, video_bandwidth));
+  if(!audio && !video)
+  {
+    MCUTRACE(1, trace_section << "fan-out " << path << " without codecs, audio: " << audio_codec << " video: " << video_codec);
+    delete fanout;
+    return NULL;
+  }
+
+  MCUTRACE(1, trace_section << "fan-out " << path << " room " << room << ", audio: " << audio_codec << " video: " << video_codec);
+  fanoutMap.insert(std::map<PString, MCURtspFanout *>::value_type(path, fanout));
+  return fanout;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int MCURtspServer::OnReceived(MCUSocket *socket, PString data)
+{
+  // the request is read by the listener until the end of the headers
+  if(data.Find("\r\n\r\n") == P_MAX_INDEX)
+    return MCU_LISTENER_WAIT_DATA;
+
+  PWaitAndSignal m(rtspMutex);
 
   MCUTRACE(1, trace_section << "read from " << socket->GetAddress() << " "  << data.GetLength() << " bytes\n" << data);
 
@@ -1256,6 +2460,23 @@ BOOL MCURtspServer::CreateConnection(MCUSocket *socket, const msg_t *msg)
     return FALSE;
   }
 
+  // one reader of the room cache for all viewers, without connections
+  if(MCUConfig("RTSP Server "+path).GetBoolean(RtspFanoutKey, FALSE))
+  {
+    MCURtspFanout *fanout = GetFanout(path);
+    if(fanout == NULL)
+    {
+      SendResponse(socket, msg, "503 Service Unavailable");
+      return FALSE;
+    }
+    if(!fanout->AddViewer(socket, msg))
+    {
+      SendResponse(socket, msg, "453 Not Enough Bandwidth");
+      return FALSE;
+    }
+    return TRUE;
+  }
+
   PString callToken = socket->GetAddress();
   MCURtspConnection *conn = new MCURtspConnection(ep, callToken);
   if(!conn->Connect(socket, msg))
@@ -33,6 +33,19 @@ static const PString METHOD_DESCRIBE   = "DESCRIBE";
 static const PString METHOD_SETUP      = "SETUP";
 static const PString METHOD_PLAY       = "PLAY";
 static const PString METHOD_TEARDOWN   = "TEARDOWN";
+static const PString METHOD_PAUSE      = "PAUSE";
+static const PString METHOD_GET_PARAMETER = "GET_PARAMETER";
+static const PString METHOD_SET_PARAMETER = "SET_PARAMETER";
+
+// fan-out: SR interval of every viewer, at most one intra request from the waiting viewers per interval,
+// audio frames are sent in packets of this duration
+#define RTSP_FANOUT_REPORT_INTERVAL_MS  5000
+#define RTSP_FANOUT_INTRA_INTERVAL_MS   1000
+#define RTSP_FANOUT_AUDIO_PACKET_MS     20
+// a viewer without requests and receiver reports is closed after the session timeout (seconds),
+// the reader waits for a frame of the cache at most RTSP_FANOUT_READ_TIMEOUT_MS to see the close
+#define RTSP_FANOUT_SESSION_TIMEOUT     60
+#define RTSP_FANOUT_READ_TIMEOUT_MS     100
 
 class ConferenceStreamMember;
 
@@ -108,6 +121,236 @@ class MCURtspConnection : public MCUSipConnection
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+class MCURtspFanout;
+
+// destination of one stream of a fan-out viewer, the header of the shared packet is rewritten for it
+struct MCURtspSubscriber
+{
+  MCURtspSubscriber();
+
+  struct sockaddr_in rtp_addr;
+  struct sockaddr_in rtcp_addr;
+  DWORD ssrc;
+  WORD seq;
+  DWORD ts_offset;
+  DWORD packets;
+  DWORD octets;
+  uint64_t report_time;
+  // the last RTCP packet of the viewer
+  uint64_t activity_time;
+  // video starts with a keyframe
+  BOOL waiting;
+  BOOL setup;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// one reader of a room cache for all viewers of a fan-out server
+class MCURtspFanoutStream
+{
+  public:
+    MCURtspFanoutStream(MCURtspFanout *fanout, MediaTypes media);
+    ~MCURtspFanoutStream();
+
+    BOOL Open(const PString & room, const PString & capname, unsigned width, unsigned height, unsigned frameRate, unsigned bandwidth);
+    void Close();
+
+    MediaTypes GetMedia() const
+    { return media; }
+
+    unsigned GetPort() const
+    { return port; }
+
+    PString GetSDP(const PString & control);
+
+    // the next packet of the subscriber, for the RTP-Info header
+    void GetRtpInfo(MCURtspSubscriber *subscriber, WORD & seq, DWORD & timestamp);
+
+    void AddSubscriber(MCURtspSubscriber *subscriber);
+    void RemoveSubscriber(MCURtspSubscriber *subscriber);
+    uint64_t GetActivityTime(MCURtspSubscriber *subscriber);
+
+    uint64_t GetPacketsIn() const
+    { return packetsIn; }
+    uint64_t GetPacketsOut() const
+    { return packetsOut; }
+    uint64_t GetSendUsec() const
+    { return sendUsec; }
+    uint64_t GetReports() const
+    { return reports; }
+
+  protected:
+    BOOL OpenCache();
+    BOOL OpenSockets();
+    DWORD GetTimestamp(uint64_t now);
+    void Send(BYTE *header, PINDEX headerSize, const BYTE *payload, PINDEX payloadSize, DWORD timestamp, BOOL keyFrame);
+    void SendReports(uint64_t now);
+    void ReceiveReports(uint64_t now);
+
+    PDECLARE_NOTIFIER(PThread, MCURtspFanoutStream, ReaderThread);
+
+    MCURtspFanout *fanout;
+    MediaTypes media;
+    PString trace_section;
+
+    PString cacheName;
+    OpalMediaFormat format;
+    SipCapability *sc;
+    int payload;
+    unsigned clock;
+
+    int rtp_fd;
+    int rtcp_fd;
+    unsigned port;
+
+    // the subscribers are read by the reader thread only under the mutex
+    PMutex subscriberMutex;
+    std::vector<MCURtspSubscriber *> subscribers;
+    unsigned waiting;
+
+    // one header per subscriber and the shared payload, sent by sendmmsg
+    std::vector<BYTE> headerBuffer;
+#ifdef __linux__
+    std::vector<struct mmsghdr> messages;
+    std::vector<struct iovec> vectors;
+#else
+    std::vector<BYTE> packetBuffer;
+#endif
+
+    // the timeline of the stream: audio counts the samples, video uses the 90 kHz timestamps of the cache
+    DWORD timestamp;
+    uint64_t timestampTime;
+
+    uint64_t packetsIn;
+    uint64_t packetsOut;
+    uint64_t sendUsec;
+    uint64_t reports;
+
+    BOOL running;
+    PThread *thread;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// RTSP session of a fan-out server, the control connection without a call
+class MCURtspViewer
+{
+  public:
+    MCURtspViewer(MCURtspFanout *fanout, MCUSocket *socket);
+    ~MCURtspViewer();
+
+    // takes the socket, the first request was read by the server
+    void Start(MCUSocket *socket, const msg_t *msg);
+    void Close();
+    // closes the session after RTSP_FANOUT_SESSION_TIMEOUT without keepalive requests and receiver reports
+    void CheckTimeout(uint64_t now);
+
+  protected:
+    BOOL OnRequest(const msg_t *msg);
+    BOOL OnRequestDescribe(const msg_t *msg);
+    BOOL OnRequestSetup(const msg_t *msg);
+    BOOL OnRequestPlay(const msg_t *msg);
+    BOOL OnRequestPause(const msg_t *msg);
+    BOOL CheckAuth(const msg_t *msg);
+    void RemoveSubscribers();
+    BOOL SendResponse(const msg_t *msg, const PString & status, const PString & headers = "", const PString & body = "");
+
+    static int OnReceived_wrap(void *context, MCUSocket *socket, PString data)
+    { return ((MCURtspViewer *)context)->OnReceived(socket, data); }
+    int OnReceived(MCUSocket *socket, PString data);
+
+    MCURtspFanout *fanout;
+    PString trace_section;
+    PString remote_host;
+    PString session_str;
+    PString base_url;
+    // the requests of a connection can be split or joined by TCP
+    PString buffer;
+    HTTPAuth auth;
+    BOOL playing;
+    BOOL closed;
+    uint64_t activity_time;
+    PMutex viewerMutex;
+
+    MCURtspSubscriber audio;
+    MCURtspSubscriber video;
+
+    MCUListener *listener;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// RTSP server path in the cache fan-out mode: the viewers are not connections and have no codecs,
+// one reader per room cache sends every packet to all of them
+class MCURtspFanout
+{
+  public:
+    MCURtspFanout(const PString & name, const PString & room);
+    ~MCURtspFanout();
+
+    BOOL SetAudio(const PString & capname);
+    BOOL SetVideo(const PString & capname, unsigned width, unsigned height, unsigned frameRate, unsigned bandwidth);
+    void SetAuth(const PString & username, const PString & password);
+    void SetSourceAddress(const PString & address)
+    { source_address = address; }
+
+    const PString & GetName() const
+    { return name; }
+    const PString & GetRoom() const
+    { return room; }
+    const PString & GetSourceAddress() const
+    { return source_address; }
+    const PString & GetUserName() const
+    { return username; }
+    const PString & GetPassword() const
+    { return password; }
+
+    // settings the fan-out was created with, a changed path is created again when it has no viewers
+    void SetSignature(const PString & _signature)
+    { signature = _signature; }
+    const PString & GetSignature() const
+    { return signature; }
+
+    MCURtspFanoutStream * GetStream(MediaTypes media)
+    { return (media == MEDIA_TYPE_AUDIO) ? audioStream : videoStream; }
+
+    BOOL AddViewer(MCUSocket *socket, const msg_t *msg);
+    // the viewer is deleted by a cleaner thread, not from the callback of its own listener
+    void CloseViewer(MCURtspViewer *viewer);
+    void RemoveViewer(MCURtspViewer *viewer);
+
+    long GetViewerCount()
+    { return viewerList.GetSize(); }
+
+    uint64_t GetPacketsIn();
+    uint64_t GetPacketsOut();
+    uint64_t GetSendUsec();
+    uint64_t GetReports();
+
+  protected:
+    PDECLARE_NOTIFIER(PThread, MCURtspFanout, SessionThread);
+
+    PString name;
+    PString room;
+    PString source_address;
+    PString username;
+    PString password;
+    PString signature;
+
+    MCURtspFanoutStream *audioStream;
+    MCURtspFanoutStream *videoStream;
+
+    MCURtspViewerList viewerList;
+
+    PMutex cleanerMutex;
+    unsigned cleaners;
+
+    BOOL running;
+    PThread *sessionThread;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 class MCURtspServer
 {
   public:
@@ -121,7 +364,11 @@ class MCURtspServer
     void AddListener(const PString & address);
     BOOL HasListener(const PString & host, const PString & port);
 
+    // stops the cache readers, before the rooms are deleted
+    void RemoveFanouts();
+
   protected:
+    MCURtspFanout * GetFanout(const PString & path);
 
     BOOL CreateConnection(MCUSocket *socket, const msg_t *msg);
     void SendResponse(MCUSocket *socket, const msg_t *msg, const PString & status_str);
@@ -139,6 +386,8 @@ class MCURtspServer
 
     PMutex rtspMutex;
     PMutex listenerListMutex;
+
+    std::map<PString, MCURtspFanout *> fanoutMap;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
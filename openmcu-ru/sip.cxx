@@ -843,6 +843,10 @@ BOOL MCUSipConnection::CreateMediaChannel(MediaTypes mtype, int pt, int rtp_dir)
           else                  sc->srtp_local_key = key_video32 = srtp_get_random_keysalt();
         }
       }
+      else if(sc->srtp_local_type == AEAD_AES_128_GCM)
+        sc->srtp_local_key = srtp_get_random_keysalt(28);
+      else if(sc->srtp_local_type == AEAD_AES_256_GCM)
+        sc->srtp_local_key = srtp_get_random_keysalt(44);
     }
     if(rtp_dir == 0) session->CreateSRTP(rtp_dir, sc->srtp_remote_type, sc->srtp_remote_key);
     else             session->CreateSRTP(rtp_dir, sc->srtp_local_type, sc->srtp_local_key);
@@ -1825,8 +1829,13 @@ int MCUSipConnection::ProcessSDP(SipCapMapType & LocalCaps, SipCapMapType & Remo
         secure_type = SECURE_TYPE_SRTP;
         PStringArray attr = PString(a->a_value).Tokenise(" ", FALSE);
         srtp_type = attr[1];
+#if MCUSIP_SRTP
+        if(!SipSRTP::IsSupported(srtp_type))
+          continue;
+#else
         if(srtp_type != AES_CM_128_HMAC_SHA1_32 && srtp_type != AES_CM_128_HMAC_SHA1_80)
           continue;
+#endif
         if(attr[2].Find("inline:") == P_MAX_INDEX)
           continue;
         PString inl = attr[2].Right(attr[2].GetLength()-7);
@@ -3027,6 +3036,8 @@ int MCUSipEndPoint::SendRequest(msg_t *msg)
                         (const url_string_t *)(const char *)url_str,
 			NTATAG_STATELESS(1),
 			TAG_END());
+  if(ret == 0)
+    MCUMetrics::sipMessagesSent.Inc();
   return ret;
 }
 
@@ -3058,6 +3069,7 @@ int MCUSipEndPoint::SipReqReply(const msg_t *msg, msg_t *msg_reply, unsigned sta
   		   SIPTAG_ALLOW_STR(allow_str),
                    SIPTAG_SERVER_STR((const char*)(SIP_USER_AGENT)),
                    TAG_END());
+  MCUMetrics::sipMessagesSent.Inc();
   return 0;
 }
 
@@ -3099,6 +3111,11 @@ int MCUSipEndPoint::ProcessSipEvent_cb(nta_agent_t *agent, msg_t *msg, sip_t *si
   if(sip->sip_status)  status = sip->sip_status->st_status;
   if(sip->sip_cseq)    cseq = sip->sip_cseq->cs_method;
 
+  if(request)
+    MCUMetrics::sipRequestsReceived.Inc();
+  else
+    MCUMetrics::sipResponsesReceived.Inc();
+
   Registrar *registrar = OpenMCU::Current().GetRegistrar();
 
   // repeated responses 200/603 outside call leg
@@ -419,6 +419,9 @@ class MCUSipEndPoint : public PThread
     PSTUNClient * CreateStun(PString address);
     PSTUNClient * GetPreferedStun(PString address);
 
+    MCUQueueMsg & GetSipMsgQueue()
+    { return sipMsgQueue; }
+
     MCUQueuePString & GetSipQueue()
     { return sipQueue; }
 
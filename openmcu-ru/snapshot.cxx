@@ -0,0 +1,356 @@
+/*
+ * snapshot.cxx
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+#include "mcu.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if USE_LIBJPEG
+struct SnapshotJpegDestination : jpeg_destination_mgr
+{
+  PBYTEArray *buffer;
+  PINDEX size;
+};
+
+static void SnapshotJpegInitDestination(j_compress_ptr cinfo)
+{
+  SnapshotJpegDestination *dest = (SnapshotJpegDestination *)cinfo->dest;
+  dest->next_output_byte = dest->buffer->GetPointer(32768);
+  dest->free_in_buffer = dest->buffer->GetSize();
+}
+
+static boolean SnapshotJpegEmptyOutputBuffer(j_compress_ptr cinfo)
+{
+  SnapshotJpegDestination *dest = (SnapshotJpegDestination *)cinfo->dest;
+  PINDEX oldsize = dest->buffer->GetSize();
+  dest->next_output_byte = dest->buffer->GetPointer(oldsize + 16384) + oldsize;
+  dest->free_in_buffer = dest->buffer->GetSize() - oldsize;
+  return TRUE;
+}
+
+static void SnapshotJpegTermDestination(j_compress_ptr cinfo)
+{
+  SnapshotJpegDestination *dest = (SnapshotJpegDestination *)cinfo->dest;
+  dest->size = dest->buffer->GetSize() - dest->free_in_buffer;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUSnapshotService::MCUSnapshotService()
+{
+  trace_section = "Snapshot: ";
+  users = 0;
+  streams = 0;
+  encodes = 0;
+  running = TRUE;
+  thread = PThread::Create(PCREATE_NOTIFIER(SnapshotThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "snapshot");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUSnapshotService::~MCUSnapshotService()
+{
+  {
+    PWaitAndSignal m(snapshotMutex);
+    running = FALSE;
+  }
+  wakeup.Signal();
+  if(thread)
+  {
+    thread->WaitForTermination(10000);
+    delete thread;
+    thread = NULL;
+  }
+
+  // the clients leave GetSnapshot and the stream loop within the interval,
+  // the service is not deleted under them
+  for(unsigned i = 1; ; i++)
+  {
+    {
+      PWaitAndSignal m(snapshotMutex);
+      if(users == 0)
+        break;
+      if(i % 500 == 0)
+        MCUTRACE(1, trace_section << "waiting for " << users << " clients");
+    }
+    MCUTime::Sleep(10);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSnapshotService::GetSize(const PString & room, long mixer, unsigned & width, unsigned & height)
+{
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  MCUSimpleVideoMixer *videoMixer = manager->FindVideoMixerWithLock(room, mixer);
+  if(videoMixer == NULL)
+    return FALSE;
+  unsigned mockupWidth = OpenMCU::vmcfg.vmconf[videoMixer->GetPositionSet()].splitcfg.mockup_width;
+  unsigned mockupHeight = OpenMCU::vmcfg.vmconf[videoMixer->GetPositionSet()].splitcfg.mockup_height;
+  videoMixer->Unlock();
+
+  // the smallest of the mockup sizes that covers the request
+  unsigned scale = 0;
+  if(width > 0 && height > 0 && width <= 2048 && height <= 2048)
+  {
+    for(scale = SNAPSHOT_SCALES - 1; scale > 0; scale--)
+    {
+      if((mockupWidth >> scale) >= width && (mockupHeight >> scale) >= height)
+        break;
+    }
+  }
+  width = ((mockupWidth >> scale) / 2) * 2;
+  height = ((mockupHeight >> scale) / 2) * 2;
+  return (width > 0 && height > 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSnapshotService::GetSnapshot(const PString & room, long mixer, unsigned width, unsigned height, PBYTEArray & jpeg, uint64_t & timestamp)
+{
+  if(!running || !GetSize(room, mixer, width, height))
+    return FALSE;
+
+  PString key = room + "/" + PString(mixer) + "/" + PString(width) + "x" + PString(height);
+  uint64_t start = MCUTime::GetMonoTimestampUsec() / 1000;
+  for(;;)
+  {
+    {
+      PWaitAndSignal m(snapshotMutex);
+      uint64_t now = MCUTime::GetMonoTimestampUsec() / 1000;
+      SnapshotMap::iterator it = snapshotMap.find(key);
+      if(it == snapshotMap.end())
+      {
+        Snapshot snapshot;
+        snapshot.room = room;
+        snapshot.mixer = mixer;
+        snapshot.width = width;
+        snapshot.height = height;
+        snapshot.timestamp = 0;
+        snapshot.lastEncode = 0;
+        snapshot.lastRequest = now;
+        snapshotMap.insert(SnapshotMap::value_type(key, snapshot));
+        wakeup.Signal();
+      }
+      else
+      {
+        it->second.lastRequest = now;
+        if(it->second.jpeg.GetSize() > 0)
+        {
+          // shares the buffer, the encoder replaces it with a new one
+          jpeg = it->second.jpeg;
+          timestamp = it->second.timestamp;
+          return TRUE;
+        }
+      }
+      if(now - start > SNAPSHOT_WAIT_MS)
+        return FALSE;
+    }
+    if(!running)
+      return FALSE;
+    MCUTime::Sleep(20);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSnapshotService::Use()
+{
+  PWaitAndSignal m(snapshotMutex);
+  if(!running)
+    return FALSE;
+  users++;
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSnapshotService::Release()
+{
+  PWaitAndSignal m(snapshotMutex);
+  users--;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSnapshotService::StartStream()
+{
+  PWaitAndSignal m(snapshotMutex);
+  if(!running || streams >= SNAPSHOT_MAX_STREAMS)
+  {
+    MCUTRACE(1, trace_section << "stream rejected, active streams " << streams);
+    return FALSE;
+  }
+  users++;
+  streams++;
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSnapshotService::StopStream()
+{
+  PWaitAndSignal m(snapshotMutex);
+  streams--;
+  users--;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSnapshotService::Encode(Snapshot & snapshot, PBYTEArray & jpeg)
+{
+  int width = snapshot.width;
+  int height = snapshot.height;
+
+  PINDEX buffer_size = width * height * 3 / 2;
+  MCUBuffer buffer(buffer_size);
+
+  ConferenceManager *manager = OpenMCU::Current().GetConferenceManager();
+  MCUSimpleVideoMixer *videoMixer = manager->FindVideoMixerWithLock(snapshot.room, snapshot.mixer);
+  if(videoMixer == NULL)
+    return FALSE;
+  videoMixer->ReadMixedFrame(buffer.GetPointer(), width, height, buffer_size);
+  videoMixer->Unlock();
+
+#if USE_LIBJPEG
+  MCUBuffer bitmap(width * height * 3);
+#if USE_LIBYUV
+  // libjpeg JCS_RGB is R,G,B in memory, libyuv calls it RAW
+  const uint8_t *src_y = buffer.GetPointer();
+  const uint8_t *src_u = src_y + width * height;
+  const uint8_t *src_v = src_u + width * height / 4;
+  libyuv::I420ToRAW(src_y, width, src_u, width / 2, src_v, width / 2, bitmap.GetPointer(), width * 3, width, height);
+#else
+  PColourConverter * converter = PColourConverter::Create("YUV420P", "RGB24", width, height);
+  converter->SetDstFrameSize(width, height);
+  converter->Convert(buffer.GetPointer(), bitmap.GetPointer());
+  delete converter;
+#endif
+
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+
+  SnapshotJpegDestination dest;
+  dest.buffer = &jpeg;
+  dest.size = 0;
+  dest.init_destination = &SnapshotJpegInitDestination;
+  dest.empty_output_buffer = &SnapshotJpegEmptyOutputBuffer;
+  dest.term_destination = &SnapshotJpegTermDestination;
+  cinfo.dest = &dest;
+
+  jpeg_start_compress(&cinfo, TRUE);
+  JSAMPROW row_pointer[1];
+  int row_stride = width * 3;
+  while(cinfo.next_scanline < cinfo.image_height)
+  {
+    row_pointer[0] = (JSAMPLE *)(bitmap.GetPointer() + cinfo.next_scanline * row_stride);
+    jpeg_write_scanlines(&cinfo, row_pointer, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  cinfo.dest = NULL;
+  jpeg_destroy_compress(&cinfo);
+
+  jpeg.SetSize(dest.size);
+#else
+  int dst_size = 65536;
+  jpeg.SetSize(dst_size);
+  if(!MCU_AVEncodeFrame(AV_CODEC_ID_MJPEG, buffer.GetPointer(), buffer_size, jpeg.GetPointer(), dst_size, width, height))
+    return FALSE;
+  jpeg.SetSize(dst_size);
+#endif
+
+  return (jpeg.GetSize() > 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSnapshotService::SnapshotThread(PThread &, INT)
+{
+  MCUTRACE(1, trace_section << "thread started");
+
+  while(running)
+  {
+    wakeup.Wait(SNAPSHOT_INTERVAL_MS / 10);
+    if(!running)
+      break;
+
+    // collect the previews to refresh, encoding is done without the lock
+    std::vector<PString> keys;
+    std::vector<Snapshot> pending;
+    {
+      PWaitAndSignal m(snapshotMutex);
+      uint64_t now = MCUTime::GetMonoTimestampUsec() / 1000;
+      for(SnapshotMap::iterator it = snapshotMap.begin(); it != snapshotMap.end(); )
+      {
+        if(now - it->second.lastRequest > SNAPSHOT_IDLE_MS)
+        {
+          MCUTRACE(3, trace_section << "drop " << it->first);
+          snapshotMap.erase(it++);
+          continue;
+        }
+        if(now - it->second.lastEncode >= SNAPSHOT_INTERVAL_MS)
+        {
+          keys.push_back(it->first);
+          pending.push_back(it->second);
+        }
+        ++it;
+      }
+    }
+
+    for(unsigned i = 0; i < pending.size() && running; i++)
+    {
+      PBYTEArray jpeg;
+      BOOL encoded = Encode(pending[i], jpeg);
+
+      PWaitAndSignal m(snapshotMutex);
+      SnapshotMap::iterator it = snapshotMap.find(keys[i]);
+      if(it == snapshotMap.end())
+        continue;
+      // retry after the interval, the mixer can appear later,
+      // the timestamp of the jpeg changes only with the picture
+      it->second.lastEncode = MCUTime::GetMonoTimestampUsec() / 1000;
+      if(encoded)
+      {
+        it->second.jpeg = jpeg;
+        it->second.timestamp = it->second.lastEncode;
+        encodes++;
+      }
+      else
+        MCUTRACE(3, trace_section << "could not encode " << keys[i]);
+    }
+  }
+
+  PWaitAndSignal m(snapshotMutex);
+  snapshotMap.clear();
+
+  MCUTRACE(1, trace_section << "thread ended");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
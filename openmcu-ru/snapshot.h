@@ -0,0 +1,102 @@
+/*
+ * snapshot.h
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+
+#ifndef _MCU_SNAPSHOT_H
+#define _MCU_SNAPSHOT_H
+
+#include "utils.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// a preview is encoded no more often than the interval
+#define SNAPSHOT_INTERVAL_MS   1000
+// the preview is dropped when nobody asked for it
+#define SNAPSHOT_IDLE_MS       10000
+// the first request waits for the encoder
+#define SNAPSHOT_WAIT_MS       3000
+// the requested size is rounded up to the layout mockup divided by 1, 2 or 4
+#define SNAPSHOT_SCALES        3
+// simultaneous multipart/x-mixed-replace streams
+#define SNAPSHOT_MAX_STREAMS   200
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// JPEG previews of the video mixers, encoded by one thread and shared by all HTTP clients.
+// PBYTEArray is reference counted, a client keeps its copy while the next preview is encoded.
+class MCUSnapshotService
+{
+  public:
+    MCUSnapshotService();
+    ~MCUSnapshotService();
+
+    BOOL GetSnapshot(const PString & room, long mixer, unsigned width, unsigned height, PBYTEArray & jpeg, uint64_t & timestamp);
+
+    // a client calls GetSnapshot between Use and Release, the destructor waits for the clients,
+    // Use fails once the service is stopping
+    BOOL Use();
+    void Release();
+
+    // Use within the limit of the streams
+    BOOL StartStream();
+    void StopStream();
+
+    BOOL IsRunning() const
+    { return running; }
+
+    unsigned GetEncodes() const
+    { return encodes; }
+
+  protected:
+    struct Snapshot
+    {
+      PString room;
+      long mixer;
+      unsigned width;
+      unsigned height;
+      PBYTEArray jpeg;
+      uint64_t timestamp;   // of the jpeg
+      uint64_t lastEncode;  // of the last attempt, a failed one too
+      uint64_t lastRequest;
+    };
+    typedef std::map<PString, Snapshot> SnapshotMap;
+
+    BOOL GetSize(const PString & room, long mixer, unsigned & width, unsigned & height);
+    BOOL Encode(Snapshot & snapshot, PBYTEArray & jpeg);
+
+    PString trace_section;
+    BOOL running;
+
+    SnapshotMap snapshotMap;
+    PMutex snapshotMutex;
+    PSyncPoint wakeup;
+    int users;
+    int streams;
+    unsigned encodes;
+
+    PThread *thread;
+    PDECLARE_NOTIFIER(PThread, MCUSnapshotService, SnapshotThread);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MCU_SNAPSHOT_H
@@ -25,6 +25,10 @@
 #include "precompile.h"
 #include "mcu.h"
 
+#if MCU_SOCKET_REACTOR
+#  include <sys/epoll.h>
+#endif
+
 #ifdef _WIN32
   //fcntl.h
 # define FD_CLOEXEC     1       /* posix */
@@ -226,6 +230,8 @@ MCUSocket::MCUSocket(int fd, int proto, const PString & host, int port)
   socket_timeout_sec = 0;
   socket_timeout_usec = 250000;
 
+  reactor = NULL;
+
   if(socket_proto == SOCK_STREAM)
     socket_address += "tcp:";
   else
@@ -476,6 +482,43 @@ BOOL MCUSocket::GetSocketAddress(int fd, int & proto, PString & host, int & port
 BOOL MCUSocket::SendData(const char *buffer)
 {
   int len = strlen(buffer);
+#if MCU_SOCKET_REACTOR
+  if(reactor)
+  {
+    // the remainder waits for the writable event, the order of the data is kept
+    BOOL want_write = FALSE;
+    {
+      PWaitAndSignal m(writeMutex);
+      int sent = 0;
+      if(write_buffer.empty())
+      {
+        sent = send(socket_fd, buffer, len, MSG_NOSIGNAL);
+        if(sent == -1)
+        {
+          if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+          {
+            MCUTRACE(1, trace_section << "send error: " << errno << " " << strerror(errno));
+            return FALSE;
+          }
+          sent = 0;
+        }
+      }
+      if(sent < len)
+      {
+        if(write_buffer.size() + len - sent > MCU_SOCKET_WRITE_MAX)
+        {
+          MCUTRACE(1, trace_section << "send error: buffer overflow " << write_buffer.size());
+          return FALSE;
+        }
+        want_write = write_buffer.empty();
+        write_buffer.append(buffer + sent, len - sent);
+      }
+    }
+    if(want_write)
+      reactor->WantWrite(socket_fd);
+    return TRUE;
+  }
+#endif
   if(send(socket_fd, buffer, len, 0) == -1)
   {
     MCUTRACE(1, trace_section << "send error: " << errno << " " << strerror(errno));
@@ -486,6 +529,52 @@ BOOL MCUSocket::SendData(const char *buffer)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+BOOL MCUSocket::Flush()
+{
+  PWaitAndSignal m(writeMutex);
+  while(!write_buffer.empty())
+  {
+    int sent = send(socket_fd, write_buffer.data(), write_buffer.size(), MSG_NOSIGNAL);
+    if(sent == -1)
+    {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        return TRUE;
+      MCUTRACE(1, trace_section << "send error: " << errno << " " << strerror(errno));
+      return FALSE;
+    }
+    write_buffer.erase(0, sent);
+  }
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PINDEX MCUSocket::GetWriteBacklog()
+{
+  PWaitAndSignal m(writeMutex);
+  return write_buffer.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSocket::SetReactor(MCUSocketReactor *_reactor)
+{
+  int flags = fcntl(socket_fd, F_GETFL);
+  if(flags != -1)
+    flags = fcntl(socket_fd, F_SETFL, _reactor ? (flags | O_NONBLOCK) : (flags & (~O_NONBLOCK)));
+  if(flags == -1)
+  {
+    MCUTRACE(1, trace_section << "fcntl error " << errno << " " << strerror(errno));
+    return FALSE;
+  }
+  reactor = _reactor;
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 BOOL MCUSocket::RecvData(PString & data)
 {
   char buffer[16384];
@@ -570,16 +659,27 @@ BOOL MCUSocket::ReadData(PString & data)
 
 void MCUListenerHandler::Main()
 {
-  if(callback(callback_context, socket, "") == 0)
-    goto error;
-
-  (*handler_count)--;
-  return;
+  // the socket is blocking, the first request is read with the receive timeout
+  PString data;
+  uint64_t deadline = MCUTime::GetMonoTimestampUsec() / 1000 + MCU_SOCKET_HANDSHAKE_TIMEOUT;
+  int ret = callback(callback_context, socket, data);
+  while(ret == MCU_LISTENER_WAIT_DATA)
+  {
+    if(!socket->ReadData(data) || data.GetLength() >= MCU_SOCKET_HANDSHAKE_MAX || MCUTime::GetMonoTimestampUsec() / 1000 > deadline)
+    {
+      ret = 0;
+      break;
+    }
+    if(data.GetLength() != 0)
+      ret = callback(callback_context, socket, data);
+  }
 
-  error:
+  if(ret == 0)
+  {
     delete socket;
     socket = NULL;
-    (*handler_count)--;
+  }
+  (*handler_count)--;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -597,6 +697,19 @@ MCUListener::MCUListener(MCUListenerType type, MCUSocket *_socket, mcu_listener_
   socket = _socket;
   trace_section = "MCU listener ("+socket->GetAddress()+"): ";
 
+  reactor = NULL;
+#if MCU_SOCKET_REACTOR
+  reactor = OpenMCU::Current().GetSocketReactor();
+  if(reactor)
+  {
+    running = TRUE;
+    if(reactor->Register(this))
+      return;
+    running = FALSE;
+    reactor = NULL;
+  }
+#endif
+
   tcp_thread = PThread::Create(PCREATE_NOTIFIER(ListenerThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "mcu_listener:%0x");
 }
 
@@ -605,6 +718,10 @@ MCUListener::MCUListener(MCUListenerType type, MCUSocket *_socket, mcu_listener_
 MCUListener::~MCUListener()
 {
   running = FALSE;
+#if MCU_SOCKET_REACTOR
+  if(reactor)
+    reactor->Unregister(this);
+#endif
   if(tcp_thread)
   {
 #   ifdef _WIN32
@@ -684,6 +801,47 @@ BOOL MCUListener::Send(const char *buffer)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+int MCUListener::OnAccepted(MCUSocket *client_socket, const PString & data)
+{
+  int ret = callback(callback_context, client_socket, data);
+  if(ret == 0)
+    delete client_socket;
+  return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUListener::OnEvents(BOOL readable, BOOL writable)
+{
+  BOOL ok = TRUE;
+  if(writable)
+    ok = socket->Flush();
+
+  PString data;
+  if(ok && readable)
+    ok = socket->RecvData(data);
+
+  if(!ok)
+  {
+    MCUTRACE(1, trace_section << "error");
+    running = FALSE;
+  }
+
+  // the callback may delete the listener, the data and the end of the connection can come together
+  if(data.GetLength() != 0)
+    callback(callback_context, socket, data);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUListener::OnClosed()
+{
+  callback(callback_context, NULL, "");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void MCUListener::ListenerThread(PThread &, INT)
 {
 #ifndef _WIN32
@@ -728,3 +886,528 @@ void MCUListener::ListenerThread(PThread &, INT)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if MCU_SOCKET_REACTOR
+
+MCUSocketReactor::MCUSocketReactor(unsigned workers)
+  : jobSemaphore(0, 0x7fffffff)
+{
+  trace_section = "MCU socket reactor: ";
+  running = FALSE;
+  pollThread = NULL;
+  wake_fd[0] = wake_fd[1] = -1;
+
+  epoll_fd = epoll_create(1024);
+  if(epoll_fd == -1 || pipe(wake_fd) == -1)
+  {
+    MCUTRACE(1, trace_section << "create error " << errno << " " << strerror(errno));
+    return;
+  }
+  fcntl(wake_fd[0], F_SETFL, fcntl(wake_fd[0], F_GETFL) | O_NONBLOCK);
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = wake_fd[0];
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd[0], &ev) == -1)
+  {
+    MCUTRACE(1, trace_section << "epoll_ctl error " << errno << " " << strerror(errno));
+    return;
+  }
+
+  running = TRUE;
+  pollThread = PThread::Create(PCREATE_NOTIFIER(PollThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "socket_reactor:%0x");
+  for(unsigned i = 0; i < workers; i++)
+    workerThreads.push_back(PThread::Create(PCREATE_NOTIFIER(WorkerThread), 0, PThread::NoAutoDeleteThread, PThread::NormalPriority, "socket_worker:%0x"));
+
+  MCUTRACE(1, trace_section << "create, " << workers << " workers");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUSocketReactor::~MCUSocketReactor()
+{
+  running = FALSE;
+
+  if(pollThread)
+  {
+    char c = 0;
+    if(write(wake_fd[1], &c, 1) != 1)
+      MCUTRACE(1, trace_section << "wake error " << errno << " " << strerror(errno));
+    pollThread->WaitForTermination();
+    delete pollThread;
+  }
+
+  for(size_t i = 0; i < workerThreads.size(); i++)
+    jobSemaphore.Signal();
+  for(size_t i = 0; i < workerThreads.size(); i++)
+  {
+    workerThreads[i]->WaitForTermination();
+    delete workerThreads[i];
+  }
+
+  // the listeners are deleted before the reactor, only accepted sockets can be left
+  for(std::deque<Job>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+  {
+    if(it->client_socket)
+      delete it->client_socket;
+  }
+  for(EntryMap::iterator it = entries.begin(); it != entries.end(); ++it)
+  {
+    if(it->second->server_entry)
+    {
+      delete it->second->socket;
+      delete it->second;
+      continue;
+    }
+    MCUTRACE(1, trace_section << "listener is not removed, fd " << it->first);
+    delete it->second;
+  }
+
+  if(epoll_fd != -1)
+    close(epoll_fd);
+  if(wake_fd[0] != -1)
+    close(wake_fd[0]);
+  if(wake_fd[1] != -1)
+    close(wake_fd[1]);
+
+  MCUTRACE(1, trace_section << "close");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSocketReactor::Register(MCUListener *listener)
+{
+  if(!running)
+    return FALSE;
+
+  MCUListenerType type = listener->GetType();
+  if(type != MCU_LISTENER_TCP_SERVER && type != MCU_LISTENER_TCP_CLIENT)
+    return FALSE;
+
+  MCUSocket *socket = listener->GetSocket();
+  if(!socket->SetReactor(this))
+    return FALSE;
+
+  Entry *entry = new Entry;
+  entry->listener = listener;
+  entry->socket = socket;
+  entry->fd = socket->GetSocket();
+  entry->server = (type == MCU_LISTENER_TCP_SERVER);
+  entry->refs = 0;
+  entry->removed = FALSE;
+  entry->closed = FALSE;
+  entry->released = NULL;
+  entry->server_entry = NULL;
+  entry->deadline = 0;
+
+  PWaitAndSignal m(entryMutex);
+  if(entries.find(entry->fd) != entries.end() || !Arm(entry, EPOLL_CTL_ADD))
+  {
+    delete entry;
+    socket->SetReactor(NULL);
+    return FALSE;
+  }
+  entries[entry->fd] = entry;
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::Unregister(MCUListener *listener)
+{
+  PWaitAndSignal m(entryMutex);
+
+  EntryMap::iterator it = entries.find(listener->GetSocket()->GetSocket());
+  if(it == entries.end() || it->second->listener != listener)
+    return;
+
+  Entry *entry = it->second;
+  entries.erase(it);
+  entry->removed = TRUE;
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, entry->fd, &ev);
+
+  // the accepted sockets waiting for a request, the queued ones are closed by their jobs
+  if(entry->server)
+    RemovePending(entry, (uint64_t)-1);
+
+  // the listener can be deleted from its own callback
+  std::map<PThreadIdentifier, Entry *>::iterator r = runningJobs.find(PThread::GetCurrentThreadId());
+  int own = (r != runningJobs.end() && r->second == entry) ? 1 : 0;
+
+  if(entry->refs > own)
+  {
+    // same limit as for the listener thread
+    PSyncPoint released;
+    entry->released = &released;
+    for(int i = 0; i < 100 && entry->refs > own; i++)
+    {
+      entryMutex.Signal();
+      released.Wait(100);
+      entryMutex.Wait();
+    }
+    entry->released = NULL;
+    if(entry->refs > own)
+      MCUTRACE(1, trace_section << "callbacks are still running, fd " << entry->fd);
+  }
+
+  // otherwise deleted by the last job
+  if(entry->refs == 0)
+    delete entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::WantWrite(int fd)
+{
+  PWaitAndSignal m(entryMutex);
+
+  EntryMap::iterator it = entries.find(fd);
+  if(it == entries.end())
+    return;
+
+  // a running job rearms the socket on release
+  Entry *entry = it->second;
+  if(entry->refs == 0 && !entry->closed)
+    Arm(entry, EPOLL_CTL_MOD);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PINDEX MCUSocketReactor::GetSocketCount()
+{
+  PWaitAndSignal m(entryMutex);
+  return entries.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PINDEX MCUSocketReactor::GetQueueSize()
+{
+  PWaitAndSignal m(jobMutex);
+  return jobs.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSocketReactor::Arm(Entry *entry, int op)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.data.fd = entry->fd;
+  if(entry->server)
+  {
+    ev.events = EPOLLIN;
+  }
+  else
+  {
+    // stop reading while the peer does not take the data
+    PINDEX backlog = entry->socket->GetWriteBacklog();
+    ev.events = EPOLLONESHOT | EPOLLRDHUP;
+    if(backlog < MCU_SOCKET_WRITE_HIGH_MARK)
+      ev.events |= EPOLLIN;
+    if(backlog > 0)
+      ev.events |= EPOLLOUT;
+  }
+
+  if(epoll_ctl(epoll_fd, op, entry->fd, &ev) == -1)
+  {
+    MCUTRACE(1, trace_section << "epoll_ctl error " << errno << " " << strerror(errno) << ", fd " << entry->fd);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::Queue(const Job & job)
+{
+  PWaitAndSignal m(jobMutex);
+  jobs.push_back(job);
+  jobSemaphore.Signal();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::Release(Entry *entry, BOOL closed)
+{
+  PWaitAndSignal m(entryMutex);
+
+  runningJobs.erase(PThread::GetCurrentThreadId());
+  entry->refs--;
+  if(closed)
+    entry->closed = TRUE;
+
+  if(entry->removed)
+  {
+    if(entry->released)
+      entry->released->Signal();
+    else if(entry->refs == 0)
+      delete entry;
+    return;
+  }
+
+  if(!entry->server && !entry->closed && entry->refs == 0)
+    Arm(entry, EPOLL_CTL_MOD);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUSocketReactor::AddPending(Entry *server_entry, MCUSocket *client_socket, const PString & data, uint64_t deadline)
+{
+  if(!client_socket->SetReactor(this))
+    return FALSE;
+
+  Entry *entry = new Entry;
+  entry->listener = server_entry->listener;
+  entry->socket = client_socket;
+  entry->fd = client_socket->GetSocket();
+  entry->server = FALSE;
+  entry->refs = 0;
+  entry->removed = FALSE;
+  entry->closed = FALSE;
+  entry->released = NULL;
+  entry->server_entry = server_entry;
+  entry->data = data;
+  entry->deadline = deadline;
+
+  PWaitAndSignal m(entryMutex);
+  if(server_entry->removed || entries.find(entry->fd) != entries.end() || !Arm(entry, EPOLL_CTL_ADD))
+  {
+    delete entry;
+    return FALSE;
+  }
+  entries[entry->fd] = entry;
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::OnPending(Entry *entry)
+{
+  // the entry is dropped before the socket is handed to the callback, which registers it
+  // with a listener of its own
+  Entry *server_entry = entry->server_entry;
+  MCUSocket *client_socket = entry->socket;
+  PString data = entry->data;
+  uint64_t deadline = entry->deadline;
+  BOOL removed;
+  {
+    PWaitAndSignal m(entryMutex);
+    EntryMap::iterator it = entries.find(entry->fd);
+    if(it != entries.end() && it->second == entry)
+      entries.erase(it);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, entry->fd, &ev);
+    delete entry;
+
+    removed = server_entry->removed;
+    if(!removed)
+      runningJobs[PThread::GetCurrentThreadId()] = server_entry;
+  }
+
+  if(removed)
+  {
+    delete client_socket;
+    Release(server_entry, FALSE);
+    return;
+  }
+
+  BOOL ok = client_socket->RecvData(data);
+  int ret = MCU_LISTENER_WAIT_DATA;
+  if(data.GetLength() != 0)
+    ret = server_entry->listener->OnAccepted(client_socket, data);
+  if(ret == MCU_LISTENER_WAIT_DATA)
+  {
+    if(!ok || data.GetLength() >= MCU_SOCKET_HANDSHAKE_MAX || MCUTime::GetMonoTimestampUsec() / 1000 > deadline ||
+       !AddPending(server_entry, client_socket, data, deadline))
+    {
+      MCUTRACE(1, trace_section << "no request from " << client_socket->GetAddress());
+      delete client_socket;
+    }
+  }
+
+  Release(server_entry, FALSE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::RemovePending(Entry *server_entry, uint64_t before)
+{
+  PWaitAndSignal m(entryMutex);
+
+  for(EntryMap::iterator it = entries.begin(); it != entries.end(); )
+  {
+    Entry *entry = it->second;
+    if(entry->server_entry == NULL || entry->refs > 0 || entry->deadline >= before ||
+       (server_entry && entry->server_entry != server_entry))
+    {
+      ++it;
+      continue;
+    }
+    entries.erase(it++);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, entry->fd, &ev);
+    MCUTRACE(1, trace_section << "no request from " << entry->socket->GetAddress());
+    delete entry->socket;
+    delete entry;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::PollThread(PThread &, INT)
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  struct epoll_event events[256];
+  uint64_t lastSweep = MCUTime::GetMonoTimestampUsec() / 1000;
+  while(running)
+  {
+    // the accepted sockets without a request are closed after the timeout
+    uint64_t now = MCUTime::GetMonoTimestampUsec() / 1000;
+    if(now - lastSweep >= 1000)
+    {
+      RemovePending(NULL, now);
+      lastSweep = now;
+    }
+
+    int count = epoll_wait(epoll_fd, events, PARRAYSIZE(events), 1000);
+    if(count == -1)
+    {
+      if(errno == EINTR)
+        continue;
+      MCUTRACE(1, trace_section << "epoll_wait error " << errno << " " << strerror(errno));
+      break;
+    }
+
+    BOOL accept_error = FALSE;
+    for(int i = 0; i < count && running; i++)
+    {
+      int fd = events[i].data.fd;
+      if(fd == wake_fd[0])
+      {
+        char buffer[16];
+        while(read(wake_fd[0], buffer, sizeof(buffer)) > 0);
+        continue;
+      }
+
+      PWaitAndSignal m(entryMutex);
+      EntryMap::iterator it = entries.find(fd);
+      if(it == entries.end())
+        continue;
+
+      Entry *entry = it->second;
+      if(entry->server)
+      {
+        // level-triggered, the rest is accepted on the next wait
+        for(int n = 0; n < 64; n++)
+        {
+          MCUSocket *client_socket = entry->listener->GetSocket()->Accept();
+          if(client_socket == NULL)
+          {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+              accept_error = TRUE;
+            break;
+          }
+          Job job = { entry, FALSE, FALSE, client_socket };
+          entry->refs++;
+          Queue(job);
+        }
+      }
+      else
+      {
+        // stale event of a reused descriptor, the entry is rearmed on release
+        if(entry->refs > 0)
+          continue;
+        uint32_t flags = events[i].events;
+        Job job = { entry, (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0, (flags & EPOLLOUT) != 0, NULL };
+        entry->refs++;
+        if(entry->server_entry)
+          entry->server_entry->refs++;
+        Queue(job);
+      }
+    }
+
+    // out of descriptors, do not spin on the listening socket
+    if(accept_error)
+      MCUTime::Sleep(10);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUSocketReactor::WorkerThread(PThread &, INT)
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  while(1)
+  {
+    jobSemaphore.Wait();
+    if(!running)
+      break;
+
+    Job job;
+    {
+      PWaitAndSignal m(jobMutex);
+      if(jobs.empty())
+        continue;
+      job = jobs.front();
+      jobs.pop_front();
+    }
+
+    Entry *entry = job.entry;
+    if(entry->server_entry)
+    {
+      OnPending(entry);
+      continue;
+    }
+
+    BOOL removed;
+    {
+      PWaitAndSignal m(entryMutex);
+      removed = entry->removed;
+      if(!removed)
+        runningJobs[PThread::GetCurrentThreadId()] = entry;
+    }
+
+    BOOL closed = FALSE;
+    if(removed)
+    {
+      if(job.client_socket)
+        delete job.client_socket;
+    }
+    else if(job.client_socket)
+    {
+      // the first request is read in the reactor
+      if(entry->listener->OnAccepted(job.client_socket, "") == MCU_LISTENER_WAIT_DATA &&
+         !AddPending(entry, job.client_socket, "", MCUTime::GetMonoTimestampUsec() / 1000 + MCU_SOCKET_HANDSHAKE_TIMEOUT))
+        delete job.client_socket;
+    }
+    else
+    {
+      closed = !entry->listener->OnEvents(job.readable, job.writable);
+      if(closed)
+      {
+        // not if the callback deleted the listener
+        {
+          PWaitAndSignal m(entryMutex);
+          removed = entry->removed;
+        }
+        if(!removed)
+          entry->listener->OnClosed();
+      }
+    }
+
+    Release(entry, closed);
+  }
+}
+
+#endif // MCU_SOCKET_REACTOR
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
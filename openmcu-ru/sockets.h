@@ -35,6 +35,24 @@ enum MCUListenerType
   MCU_LISTENER_TCP_SERVER
 };
 
+// epoll reactor instead of a thread per listener
+#ifdef __linux__
+#  define MCU_SOCKET_REACTOR 1
+#else
+#  define MCU_SOCKET_REACTOR 0
+#endif
+
+#define MCU_SOCKET_REACTOR_WORKERS   4
+// non-blocking sockets: above the mark reading stops until the data is sent,
+// above the limit the sending fails
+#define MCU_SOCKET_WRITE_HIGH_MARK   65536
+#define MCU_SOCKET_WRITE_MAX         4194304
+// the first request of an accepted socket, see MCU_LISTENER_WAIT_DATA
+#define MCU_SOCKET_HANDSHAKE_MAX     65535
+#define MCU_SOCKET_HANDSHAKE_TIMEOUT 10000
+
+class MCUSocketReactor;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 class MCUSocket
@@ -57,6 +75,12 @@ class MCUSocket
     BOOL RecvData(PString & data);
     BOOL ReadData(PString & data);
 
+    // non-blocking mode with the events of the reactor, NULL returns the socket to blocking mode
+    BOOL SetReactor(MCUSocketReactor *reactor);
+    // sends the buffered data of a non-blocking socket
+    BOOL Flush();
+    PINDEX GetWriteBacklog();
+
     static BOOL TestSocket(int fd);
     static BOOL GetSocketAddress(int fd, int & proto, PString & host, int & port);
 
@@ -92,12 +116,22 @@ class MCUSocket
     int socket_timeout_usec;
 
     int socket_fd;
+
+    MCUSocketReactor *reactor;
+    PMutex writeMutex;
+    std::string write_buffer;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// The callback of a server listener is called with the accepted socket and no data, it returns 1
+// when it takes the socket, 0 to close it, or MCU_LISTENER_WAIT_DATA to be called again with the
+// data received so far. The data is read by the reactor without blocking its workers, or by the
+// handler thread of the connection.
 typedef int mcu_listener_cb(void *callback_context, MCUSocket *socket, PString data);
 
+#define MCU_LISTENER_WAIT_DATA 2
+
 class MCUListener
 {
   public:
@@ -124,6 +158,16 @@ class MCUListener
     MCUListenerType GetType()
     { return listener_type; }
 
+    MCUSocket * GetSocket()
+    { return socket; }
+
+    // reactor events: the accepted socket is deleted when the callback returns 0,
+    // OnEvents returns FALSE when the socket is closed, the callback may delete the listener
+    // and nothing of it is used after the callback, OnClosed is called if it still exists
+    int OnAccepted(MCUSocket *client_socket, const PString & data);
+    BOOL OnEvents(BOOL readable, BOOL writable);
+    void OnClosed();
+
   protected:
     BOOL running;
     PString trace_section;
@@ -137,6 +181,8 @@ class MCUListener
     // handler threads count
     int handler_count;
 
+    MCUSocketReactor *reactor;
+
     PThread *tcp_thread;
     PDECLARE_NOTIFIER(PThread, MCUListener, ListenerThread);
 };
@@ -166,4 +212,79 @@ class MCUListenerHandler : public PThread
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#if MCU_SOCKET_REACTOR
+// One epoll thread for the sockets of all listeners and a fixed pool of workers for the callbacks.
+// The events of a connection are one-shot, its callbacks never overlap and keep their order.
+class MCUSocketReactor
+{
+  public:
+    MCUSocketReactor(unsigned workers = MCU_SOCKET_REACTOR_WORKERS);
+    ~MCUSocketReactor();
+
+    BOOL Register(MCUListener *listener);
+    // waits for the running callbacks of the listener, except the calling one
+    void Unregister(MCUListener *listener);
+    void WantWrite(int fd);
+
+    PINDEX GetSocketCount();
+    PINDEX GetQueueSize();
+
+  protected:
+    struct Entry
+    {
+      MCUListener *listener;
+      MCUSocket *socket;
+      int fd;
+      BOOL server;
+      // queued and running jobs
+      int refs;
+      BOOL removed;
+      BOOL closed;
+      PSyncPoint *released;
+      // an accepted socket waiting for its first request, the job holds the server entry
+      Entry *server_entry;
+      PString data;
+      uint64_t deadline;
+    };
+    struct Job
+    {
+      Entry *entry;
+      BOOL readable;
+      BOOL writable;
+      MCUSocket *client_socket;
+    };
+    typedef std::map<int, Entry *> EntryMap;
+
+    BOOL Arm(Entry *entry, int op);
+    void Queue(const Job & job);
+    void Release(Entry *entry, BOOL closed);
+
+    BOOL AddPending(Entry *server_entry, MCUSocket *client_socket, const PString & data, uint64_t deadline);
+    void OnPending(Entry *entry);
+    // the pending sockets of the server entry, of all when NULL, with the deadline before the time
+    void RemovePending(Entry *server_entry, uint64_t before);
+
+    PDECLARE_NOTIFIER(PThread, MCUSocketReactor, PollThread);
+    PDECLARE_NOTIFIER(PThread, MCUSocketReactor, WorkerThread);
+
+    PString trace_section;
+    BOOL running;
+    int epoll_fd;
+    int wake_fd[2];
+
+    PMutex entryMutex;
+    EntryMap entries;
+    std::map<PThreadIdentifier, Entry *> runningJobs;
+
+    PMutex jobMutex;
+    std::deque<Job> jobs;
+    PSemaphore jobSemaphore;
+
+    PThread *pollThread;
+    std::vector<PThread *> workerThreads;
+};
+#endif // MCU_SOCKET_REACTOR
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 #endif // _MCU_SOCKET_H
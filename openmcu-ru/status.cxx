@@ -0,0 +1,212 @@
+/*
+ * status.cxx
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+
+#include "precompile.h"
+#include "mcu.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUStatusCache::MCUStatusCache()
+  : changes(0)
+{
+  epoch = (unsigned)PTime().GetTimeInSeconds();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUStatusCache::OnRoomChanged(const PString & room)
+{
+  PWaitAndSignal m(mutex);
+  changes++;
+  if(!room.IsEmpty())
+    roomChanges[room]++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUStatusCache::OnRoomRemoved(const PString & room)
+{
+  PWaitAndSignal m(mutex);
+  changes++;
+  rooms.erase(room);
+  roomChanges.erase(room);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUStatusCache::GetRoomStatus(const PString & clientTag, PString & text, PString & tag)
+{
+  Get("", text, tag);
+  if(tag == clientTag)
+  {
+    MCUMetrics::statusNotModified.Inc();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString MCUStatusCache::GetMemberList(const PString & room)
+{
+  PString text, tag;
+  if(room.IsEmpty() || !Get(room, text, tag))
+    return "";
+  return text;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUStatusCache::Get(const PString & room, PString & text, PString & tag)
+{
+  MCUMetrics::statusRequests.Inc();
+
+  uint64_t now = MCUTime::GetMonoTimestampUsec();
+  BOOL built;
+  {
+    PWaitAndSignal m(mutex);
+    MCUStatusDocument & doc = GetDocument(room);
+    if(IsFresh(doc, GetChanges(room), now))
+    {
+      text = doc.text;
+      tag = GetTag(doc);
+      return TRUE;
+    }
+    built = (doc.version != 0);
+  }
+
+  // one request builds, the others take the previous document
+  if(built && !buildMutex.Wait(0))
+  {
+    PWaitAndSignal m(mutex);
+    MCUStatusDocument & doc = GetDocument(room);
+    if(doc.version == 0) // removed by the build
+    {
+      rooms.erase(room);
+      return FALSE;
+    }
+    text = doc.text;
+    tag = GetTag(doc);
+    return TRUE;
+  }
+  PWaitAndSignal b(buildMutex, !built);
+
+  unsigned buildChanges;
+  {
+    PWaitAndSignal m(mutex);
+    MCUStatusDocument & doc = GetDocument(room);
+    buildChanges = GetChanges(room);
+    // built while this request waited
+    if(IsFresh(doc, buildChanges, MCUTime::GetMonoTimestampUsec()))
+    {
+      text = doc.text;
+      tag = GetTag(doc);
+      return TRUE;
+    }
+  }
+
+  PString newText;
+  BOOL found = Build(room, newText);
+  MCUMetrics::statusBuilds.Inc();
+
+  PWaitAndSignal m(mutex);
+  if(!found)
+  {
+    rooms.erase(room);
+    roomChanges.erase(room);
+    return FALSE;
+  }
+  MCUStatusDocument & doc = GetDocument(room);
+  if(doc.version == 0 || doc.text != newText)
+  {
+    doc.text = newText;
+    doc.version++;
+  }
+  doc.changes = buildChanges;
+  doc.buildTime = now;
+  text = doc.text;
+  tag = GetTag(doc);
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUStatusCache::Build(const PString & room, PString & text)
+{
+  OpenMCU & app = OpenMCU::Current();
+  if(room.IsEmpty())
+  {
+    text = app.GetEndpoint().GetRoomStatusJS();
+    return TRUE;
+  }
+
+  Conference *conference = app.GetConferenceManager()->FindConferenceWithLock(room);
+  if(conference == NULL)
+    return FALSE;
+  text = app.GetEndpoint().GetMemberListOptsJavascript(*conference);
+  conference->Unlock();
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUStatusCache::IsFresh(const MCUStatusDocument & doc, unsigned docChanges, uint64_t now)
+{
+  if(doc.version == 0)
+    return FALSE;
+  uint64_t age = now - doc.buildTime;
+  if(age < STATUS_CACHE_CHANGED_TICK * 1000)
+    return TRUE;
+  if(doc.changes != docChanges)
+    return FALSE;
+  return (age < STATUS_CACHE_TICK * 1000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUStatusDocument & MCUStatusCache::GetDocument(const PString & room)
+{
+  if(room.IsEmpty())
+    return status;
+  return rooms[room];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+unsigned MCUStatusCache::GetChanges(const PString & room)
+{
+  if(room.IsEmpty())
+    return changes;
+  std::map<PString, unsigned>::iterator it = roomChanges.find(room);
+  if(it == roomChanges.end())
+    return 0;
+  return it->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString MCUStatusCache::GetTag(const MCUStatusDocument & doc)
+{
+  return "\"" + PString(epoch) + "-" + PString(doc.version) + "\"";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
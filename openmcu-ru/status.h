@@ -0,0 +1,96 @@
+/*
+ * status.h
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+
+#include "precompile.h"
+
+#ifndef _MCU_STATUS_H
+#define _MCU_STATUS_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// documents older than the tick are rebuilt, msec
+#define STATUS_CACHE_TICK          1000
+// a document of a changed room is rebuilt sooner, but not more often, msec
+#define STATUS_CACHE_CHANGED_TICK  200
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct MCUStatusDocument
+{
+  MCUStatusDocument() : version(0), changes(0), buildTime(0) { }
+
+  PString text;
+  // incremented when a rebuilt text differs, 0 before the first build
+  unsigned version;
+  // change counter of the room when the document was built
+  unsigned changes;
+  uint64_t buildTime;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Documents of the status page and of the room control pages shared by all clients. A document
+// is built by one request at most once per tick, the other requests take the cached text and,
+// while it is rebuilt, the previous one. The room events (HttpWriteCmdRoom, HttpWriteEventRoom)
+// count the changes of the rooms, a changed room is rebuilt after STATUS_CACHE_CHANGED_TICK.
+// The cache mutex is not held while the conferences are locked by a build.
+class MCUStatusCache
+{
+  public:
+    MCUStatusCache();
+
+    void OnRoomChanged(const PString & room);
+    // drops the document and the change counter of a deleted room
+    void OnRoomRemoved(const PString & room);
+
+    // Status?js; FALSE when the tag of the client (If-None-Match) is the current one
+    BOOL GetRoomStatus(const PString & clientTag, PString & text, PString & tag);
+
+    // member list of the room control page, empty when the room does not exist
+    PString GetMemberList(const PString & room);
+
+  protected:
+    // the status document for an empty room; FALSE when the room does not exist
+    BOOL Get(const PString & room, PString & text, PString & tag);
+    static BOOL Build(const PString & room, PString & text);
+
+    BOOL IsFresh(const MCUStatusDocument & doc, unsigned docChanges, uint64_t now);
+    MCUStatusDocument & GetDocument(const PString & room);
+    unsigned GetChanges(const PString & room);
+    PString GetTag(const MCUStatusDocument & doc);
+
+    PMutex mutex;
+    // one build at a time, the conferences are locked by the build
+    PMutex buildMutex;
+
+    MCUStatusDocument status;
+    std::map<PString, MCUStatusDocument> rooms;
+
+    unsigned changes;
+    std::map<PString, unsigned> roomChanges;
+    // the tags of the documents built before a restart do not match
+    unsigned epoch;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MCU_STATUS_H
@@ -165,6 +165,10 @@ MCUTelnetSession::MCUTelnetSession(MCUTelnetServer *_server, MCUSocket *socket)
   state = 1;
   cur_path = "# ";
   opt_echo = FALSE;
+  last_cr = FALSE;
+  script = FALSE;
+  script_batch = FALSE;
+  script_overflow = FALSE;
 
   MCUConfig cfg("Telnet Server");
   auth.username = cfg.GetString(UserNameKey, "admin");
@@ -215,17 +219,33 @@ int MCUTelnetSession::OnReceived(MCUSocket *socket, PString data)
 
   for(int i = 0; i < data.GetLength(); ++i)
   {
-    switch((unsigned char)data[i])
+    // CR LF of the telnet clients or LF alone of the scripts
+    unsigned char c = data[i];
+    if(c == TEL_LF && last_cr)
+    {
+      last_cr = FALSE;
+      continue;
+    }
+    last_cr = (c == TEL_CR);
+
+    switch(c)
     {
       case(TEL_LF):
-        break;
       case(TEL_CR):
         if(!state) if((databuf*="exit")||(databuf*="logout")||(databuf*="quit"))
         {
           MCUTRACE(1, trace_section << "connection close by user");
-          Sendf("\r\n\r\nBye! :)\r\n");
+          if(!script)
+            Sendf("\r\n\r\nBye! :)\r\n");
           Close(); return 0;
         }
+        if(script)
+        {
+          if(!OnReceivedScriptLine(databuf))
+            return 0;
+          databuf = "";
+          break;
+        }
         echobuf += "\r\n";
         OnReceivedData(databuf);
         databuf = "";
@@ -256,6 +276,10 @@ int MCUTelnetSession::OnReceived(MCUSocket *socket, PString data)
     }
   }
 
+  // the pipelined lines of a script
+  if(script && !script_batch && script_lines.GetSize() != 0 && !RunScript(FALSE))
+    return 0;
+
   if(!SendEcho())
     return 0;
 
@@ -364,6 +388,14 @@ BOOL MCUTelnetSession::OnReceivedData(const PString & data)
   if(state)
     return ProcessState(data);
 
+  if(data == "script")
+  {
+    MCUTRACE(1, trace_section << "script mode");
+    script = TRUE;
+    echobuf = "";
+    return Send("{\"command\":\"script\",\"ok\":1}\r\n");
+  }
+
   PString rdata;
   if(!OpenMCU::Current().OTFControl(data, rdata))
     rdata += "error!";
@@ -379,8 +411,69 @@ BOOL MCUTelnetSession::OnReceivedData(const PString & data)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+BOOL MCUTelnetSession::OnReceivedScriptLine(const PString & data)
+{
+  MCUTRACE(6, trace_section << "script " << data);
+
+  PString line = data.Trim();
+  if(line == "begin")
+  {
+    // the lines received before run first
+    if(script_lines.GetSize() != 0 && !RunScript(FALSE))
+      return FALSE;
+    script_batch = TRUE;
+    return TRUE;
+  }
+  if(line == "end" && script_batch)
+  {
+    script_batch = FALSE;
+    if(script_overflow)
+    {
+      // nothing of the batch is executed
+      script_overflow = FALSE;
+      return Send("{\"command\":\"end\",\"ok\":false,\"error\":\"batch is too long\"}\r\n");
+    }
+    return RunScript(TRUE);
+  }
+  if(script_overflow)
+    return TRUE;
+  if(script_batch && script_lines.GetSize() >= TELNET_SCRIPT_MAX_LINES)
+  {
+    // the lines up to "end" are dropped
+    MCUTRACE(1, trace_section << "script batch is longer than " << TELNET_SCRIPT_MAX_LINES << " lines");
+    script_lines.SetSize(0);
+    script_overflow = TRUE;
+    return TRUE;
+  }
+  script_lines.AppendString(line);
+  return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL MCUTelnetSession::RunScript(BOOL atomic)
+{
+  PStringArray responses;
+  MCUControlEngine::Execute(script_lines, atomic, responses);
+  script_lines.SetSize(0);
+
+  PString rdata;
+  for(PINDEX i = 0; i < responses.GetSize(); i++)
+    rdata += responses[i] + "\r\n";
+  if(rdata.IsEmpty())
+    return TRUE;
+  return Send((const char *)rdata);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 BOOL MCUTelnetSession::SendEcho()
 {
+  if(script)
+  {
+    echobuf = "";
+    return TRUE;
+  }
   if(opt_echo && echobuf.GetLength() != 0)
   {
     if(state != 4 && !Send((const char *)echobuf))
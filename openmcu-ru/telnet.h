@@ -27,6 +27,9 @@
 #include "sockets.h"
 #include "utils.h"
 
+// the lines of a script batch from "begin" to "end"
+#define TELNET_SCRIPT_MAX_LINES 1000
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 const unsigned char TEL_ECHO       = 1;
@@ -76,6 +79,15 @@ class MCUTelnetSession
     PTime start_time;
 
     BOOL opt_echo;
+    BOOL last_cr;
+
+    // non-interactive mode of the scripts, entered with "script": no echo and no prompt,
+    // a JSON object line for every command; the lines received together run as one batch,
+    // the lines from "begin" to "end" run as an atomic batch
+    BOOL script;
+    BOOL script_batch;
+    BOOL script_overflow;
+    PStringArray script_lines;
 
     HTTPAuth auth;
     int state;
@@ -91,6 +103,8 @@ class MCUTelnetSession
     BOOL OnReceivedIAC(const PString & data, int & i);
     BOOL OnReceivedMotion(const PString & data, int & i);
     BOOL OnReceivedData(const PString & data);
+    BOOL OnReceivedScriptLine(const PString & data);
+    BOOL RunScript(BOOL atomic);
 
     static int OnReceived_wrap(void *context, MCUSocket *socket, PString data)
     { return ((MCUTelnetSession *)context)->OnReceived(socket, data); }
@@ -1,4 +1,3 @@
-
 #include "precompile.h"
 #include "conference.h"
 #include "mcu.h"
@@ -7,308 +6,288 @@ extern "C" {
   unsigned char linear2ulaw(int pcm_val);
 }
 
-PString Conference::SaveTemplate(PString tplName)
+PString Conference::GetTemplateFileName()
 {
-  PTRACE(4,"Conference\tSaving template \"" << tplName << "\"");
-  PStringArray previousTemplate = confTpl.Lines();
-  PStringStream t;
-  t << "TEMPLATE " << tplName << "\n"
-    << "{\n"
-    << "  GLOBAL_MUTE " << (muteUnvisible?"on":"off") << "\n"
-    << "  CONTROL_TYPE " << (moderated?"manual":"auto") << "\n"
-    << "  VAD_VALUES " << VAdelay << ", " << VAtimeout << ", " << VAlevel << "\n";
+#ifdef SYS_CONFIG_DIR
+  return PString(SYS_CONFIG_DIR) + PATH_SEPARATOR + "members_" + number + ".conf";
+#else
+  return "members_"+number+".conf";
+#endif
+}
 
+MCUConferenceTemplate Conference::BuildTemplate(PString tplName)
+{
+  PTRACE(4,"Conference\tSaving template \"" << tplName << "\"");
+  MCUConferenceTemplate t;
+  t.name = tplName;
+  t.globalMute = muteUnvisible ? 1 : 0;
+  t.manualControl = moderated ? 1 : 0;
+  t.hasVAD = TRUE;
+  t.vadDelay = VAdelay;
+  t.vadTimeout = VAtimeout;
+  t.vadLevel = VAlevel;
+
+  // names of the members, for the positions kept from the current template
+  std::set<PString> memberNames;
+  for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+  {
+    if(!it->IsSystem())
+      memberNames.insert(it->GetName());
+  }
 
   for(MCUVideoMixerList::shared_iterator it = videoMixerList.begin(); it != videoMixerList.end(); ++it)
   {
     MCUSimpleVideoMixer & m = *it.GetObject();
-    int mixer_number = it.GetIndex();
+    MCUTemplateMixer tm;
+    tm.number = it.GetIndex();
+    tm.layoutNumber = m.GetPositionSet();
+    VMPCfgSplitOptions & o = OpenMCU::vmcfg.vmconf[tm.layoutNumber].splitcfg;
+    tm.layoutId = o.Id;
+
+    const MCUTemplateMixer * previous = confTpl.FindMixer(tm.number);
+    if(previous && (previous->layoutNumber != tm.layoutNumber || previous->layoutId != tm.layoutId))
+      previous = NULL;
 
-    t << "  MIXER " << mixer_number << "\n"
-      << "  {\n";
-    unsigned n=m.GetPositionSet();
-    VMPCfgSplitOptions & o = OpenMCU::vmcfg.vmconf[n].splitcfg;
-    PString newLayout=PString(n) + ", " + o.Id;
-    t << "    LAYOUT " << newLayout << "\n";
-    unsigned skipCounter=0;
     for(unsigned i=0; i<o.vidnum; i++)             // video mix position will be set here:
-    { PStringStream vmpText;
+    {
+      MCUTemplatePosition p;
       int type=m.GetPositionType((int)i);
       if(type)
       {
         ConferenceMemberId id=m.GetPositionId(i);
-        vmpText << "VMP " << type; // 2=VAD or 3=VAD2
-        for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+        p.type = type; // 2=VAD or 3=VAD2
+        for(MCUMemberList::shared_iterator mit = memberList.begin(); mit != memberList.end(); ++mit)
         {
-          ConferenceMember * member = *it;
-          if(member->GetID() == id)
+          if(mit->GetID() == id)
           {
-            vmpText << ", " << member->GetName();
+            p.memberName = mit->GetName();
             break;
           }
         }
       }
-      else                                         // - nothing: trying get the value from current template:
-      { int previous_level=0;
-        int previous_mixer=32767;
-        unsigned prev_vmpN=32767;
-        BOOL mixMatch=FALSE;
-        for(PINDEX previous_i=0; previous_i<previousTemplate.GetSize(); previous_i++)
-        { PString prev_l=previousTemplate[previous_i].Trim();
-          if     (prev_l=="{") previous_level++;
-          else if(prev_l=="}") previous_level--;
-          else
-          { PINDEX space=prev_l.Find(" ");
-            if(space!=P_MAX_INDEX)
-            { PString cmd=prev_l.Left(space);
-              PString value=prev_l.Mid(space+1,P_MAX_INDEX).LeftTrim();
-              if     (cmd=="MIXER")
-              { previous_mixer=value.AsInteger();
-                mixMatch=(previous_mixer==mixer_number);
-                prev_vmpN=0;
-              }
-              else if(cmd=="LAYOUT") { if(mixMatch) mixMatch=(value==newLayout); }
-              else if(cmd=="SKIP") prev_vmpN+=value.AsInteger();
-              else if(cmd=="VMP")
-              {
-                if(mixMatch) if(prev_vmpN == i) if(value.Mid(1,2)==", ")
-                {
-                  PString memberName=value.Mid(3,P_MAX_INDEX);
-                  for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
-                  {
-                    ConferenceMember * member = *it;
-                    if(member->IsSystem())
-                      continue;
-                    if(member->GetName() == memberName)
-                    {
-                      vmpText << "VMP " << value;
-                      break;
-                    }
-                  }
-                }
-                prev_vmpN++;
-              }
-            } // if(space!=P_MAX_INDEX)
-          } // if "{" else "if" } else ...
-        } // for(i=0; i<lines.GetSize()
-      }
-      if(vmpText=="") skipCounter++;
-      else if(skipCounter>0)
-      { if(skipCounter==1) t << "    VMP -\n";
-        else t << "    SKIP " << skipCounter << "\n";
-        skipCounter=0;
+      else if(previous && i < previous->positions.size()) // - nothing: trying get the value from current template
+      {
+        const MCUTemplatePosition & prev = previous->positions[i];
+        if(prev.type && prev.memberName != "" && memberNames.find(prev.memberName) != memberNames.end())
+          p = prev;
       }
-      if(vmpText!="") t << "    " << vmpText << "\n";
+      tm.positions.push_back(p);
     }
-    if(skipCounter==1) t << "    VMP -\n";
-    else if(skipCounter>1) t << "    SKIP " << skipCounter << "\n";
-    t << "  }\n";
+    t.mixers.push_back(tm);
   }
+
   for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
   {
     ConferenceMember *member = *it;
     if(member->IsSystem())
       continue;
-    unsigned value3 = member->resizerRule << 1;
-    if(member->disableVAD) value3++;
-    t << "  MEMBER "
-      << (member->autoDial?"1":"0") << ", "
-      << member->muteMask << ", "
-      << value3 << ", "
-      << (member->chosenVan?"1":"0") << ", "
-      << member->GetVideoMixerNumber() << ", "
-      << member->GetName() << "\n";
+    MCUTemplateMember tm;
+    tm.autoDial = member->autoDial;
+    tm.muteMask = PString(member->muteMask);
+    tm.options = member->resizerRule << 1;
+    if(member->disableVAD) tm.options++;
+    tm.chosenVan = member->chosenVan;
+    tm.mixerNumber = member->GetVideoMixerNumber();
+    tm.name = member->GetName();
+    t.members.push_back(tm);
   }
-  t << "}\n\n";
-
-  LoadTemplate(t); // temp fix
 
   return t;
 }
 
-void Conference::LoadTemplate(PString tpl)
+BOOL Conference::SaveTemplate(PString tplName)
+{
+  PWaitAndSignal m(templateMutex);
+  MCUConferenceTemplate tpl = BuildTemplate(tplName);
+  templateStore.SetTemplate(tpl);
+  templateStore.SetLastUsed(tplName);
+  BOOL result = templateStore.Save();
+  LoadTemplate(tpl);
+  return result;
+}
+
+BOOL Conference::ApplyTemplate(PString tplName, BOOL remember)
+{
+  PWaitAndSignal m(templateMutex);
+  MCUConferenceTemplate tpl;
+  if(templateStore.GetTemplate(tplName, tpl))
+    LoadTemplate(tpl);
+  if(!remember)
+    return TRUE;
+  templateStore.SetLastUsed(tplName);
+  return templateStore.Save();
+}
+
+void Conference::DeleteTemplate(PString tplName)
+{
+  PTRACE(6,"Conference\tDeleteTemplate: " << tplName);
+  PWaitAndSignal m(templateMutex);
+  templateStore.RemoveTemplate(tplName);
+  templateStore.SetLastUsed("");
+  if(confTpl.name == tplName)
+    confTpl = MCUConferenceTemplate();
+  templateStore.Save();
+}
+
+// the names of the members by URL and by name id, the template members are found without scanning the list
+class MCUTemplateMemberIndex
+{
+  public:
+    MCUTemplateMemberIndex(MCUMemberList & _memberList)
+      : memberList(_memberList)
+    {
+      for(MCUMemberList::shared_iterator it = memberList.begin(); it != memberList.end(); ++it)
+        Add(it->GetName());
+    }
+    void Add(const PString & name)
+    {
+      MCUURL url(name);
+      urls.insert(std::map<PString, PString>::value_type(url.GetUrl(), name));
+      ids.insert(std::map<PString, PString>::value_type(url.GetMemberNameId(), name));
+    }
+    // captured as by FindMemberSimilarWithLock()
+    ConferenceMember * FindWithLock(const PString & name)
+    {
+      ConferenceMember *member = memberList(name);
+      if(member)
+        return member;
+      MCUURL url(name);
+      std::map<PString, PString>::iterator r = urls.find(url.GetUrl());
+      if(r != urls.end() && (member = memberList(r->second)) != NULL)
+        return member;
+      r = ids.find(url.GetMemberNameId());
+      if(r != ids.end() && (member = memberList(r->second)) != NULL)
+        return member;
+      return NULL;
+    }
+
+  protected:
+    MCUMemberList & memberList;
+    std::map<PString, PString> urls;
+    std::map<PString, PString> ids;
+};
+
+ConferenceMember * Conference::FindTemplateMemberWithLock(MCUTemplateMemberIndex & index, const PString & name)
+{
+  ConferenceMember *member = index.FindWithLock(name);
+  if(member)
+    return member;
+  member = new MCUConnection_ConferenceMember(this, name, "");
+  MCUMemberList::shared_iterator it = AddMemberToList(member);
+  if(it == memberList.end())
+  {
+    delete member;
+    return NULL;
+  }
+  index.Add(name);
+  return it.GetCapturedObject();
+}
+
+void Conference::LoadTemplate(const MCUConferenceTemplate & tpl)
 {
-  PTRACE(3,"Conference\tLoadtemplate");
-  if(tpl.IsEmpty()) return;
+  PTRACE(3,"Conference\tLoadtemplate " << tpl.name);
+  if(tpl.name.IsEmpty()) return;
   confTpl=tpl;
-  PStringArray lines=tpl.Lines();
-  int level=0;
-  unsigned mixerId=0;
+
+  if(tpl.globalMute >= 0) muteUnvisible=(tpl.globalMute == 1);
+  if(tpl.manualControl >= 0) moderated=(tpl.manualControl == 1);
+  if(tpl.hasVAD)
+  {
+    VAdelay  =(unsigned short int)tpl.vadDelay;
+    VAtimeout=(unsigned short int)tpl.vadTimeout;
+    VAlevel  =(unsigned short int)tpl.vadLevel;
+    if(VAlevel>99) VAlevel=linear2ulaw(VAlevel) ^ 0xff;
+  }
+
+  MCUTemplateMemberIndex index(memberList);
+  // the names of the members kept by the template
+  std::set<PString> validatedMembers;
   unsigned maxMixerId=0;
-  int vmpN=0;
-  MCUSimpleVideoMixer * mixer = NULL;
-  PStringArray validatedMembers;
-  for(PINDEX i=0; i<lines.GetSize(); i++)
+
+  for(std::vector<MCUTemplateMixer>::const_iterator mit = tpl.mixers.begin(); mit != tpl.mixers.end(); ++mit)
   {
-    PString l=lines[i].Trim();
-    if(l=="{") level++; else if(l=="}") level--;
-    else
+    unsigned mixerId = mit->number;
+    MCUSimpleVideoMixer * mixer = NULL;
+    while(true)
     {
-      PINDEX space=l.Find(" ");
-      if(space!=P_MAX_INDEX)
+      mixer = manager.FindVideoMixerWithLock(this, mixerId);
+      if(mixer)
       {
-        PString cmd=l.Left(space);
-        PString value=l.Mid(space+1,P_MAX_INDEX).LeftTrim();
-        if(cmd=="GLOBAL_MUTE") muteUnvisible=(value=="on");
-        else if(cmd=="CONTROL_TYPE") moderated=(value=="manual");
-        else if(cmd=="VAD_VALUES")
-        {
-          PStringArray v=value.Tokenise(",");
-          if(v.GetSize()==3)
-          {
-            VAdelay  =(unsigned short int)(v[0].Trim().AsInteger());
-            VAtimeout=(unsigned short int)(v[1].Trim().AsInteger());
-            VAlevel  =(unsigned short int)(v[2].Trim().AsInteger());
-            if(VAlevel>99) VAlevel=linear2ulaw(VAlevel) ^ 0xff;
-          }
-        }
-        else if(cmd=="MIXER")
-        {
-          mixerId = value.AsInteger();
-          while(true)
-          {
-            mixer = manager.FindVideoMixerWithLock(this, mixerId);
-            if(mixer)
-            {
-              mixer->Unlock();
-              break;
-            }
-            manager.AddVideoMixer(this);
-          }
-          if(maxMixerId<mixerId) maxMixerId=mixerId;
-          vmpN=0;
-        }
-        else if(cmd=="LAYOUT")
+        mixer->Unlock();
+        break;
+      }
+      manager.AddVideoMixer(this);
+    }
+    if(maxMixerId<mixerId) maxMixerId=mixerId;
+
+    // the layout by the number when the id matches, otherwise by the id
+    if(!mit->layoutId.IsEmpty())
+    {
+      int layout = -1;
+      if(mit->layoutNumber < OpenMCU::vmcfg.vmconfs && mit->layoutId == OpenMCU::vmcfg.vmconf[mit->layoutNumber].splitcfg.Id)
+        layout = mit->layoutNumber;
+      else
+      {
+        for(unsigned i=0;i<OpenMCU::vmcfg.vmconfs;i++)
         {
-          if(mixer)
+          if(!strcmp((const char*)OpenMCU::vmcfg.vmconf[i].splitcfg.Id,(const char*)mit->layoutId))
           {
-            PStringArray v=value.Tokenise(",");
-            if(v.GetSize()==2)
-            { 
-              PString layoutName = v[1].Trim();
-              if(!layoutName.IsEmpty())
-              {
-                unsigned layoutNumber = v[0].Trim().AsInteger();
-                PString layoutNameRef;
-                if(layoutNumber < OpenMCU::vmcfg.vmconfs)
-                  layoutNameRef = OpenMCU::vmcfg.vmconf[layoutNumber].splitcfg.Id;
-                if((layoutName == layoutNameRef) && (layoutNumber < OpenMCU::vmcfg.vmconfs))
-                  mixer->MyChangeLayout(layoutNumber);
-                else
-                {
-                  for(unsigned i=0;i<OpenMCU::vmcfg.vmconfs;i++)
-                  {
-                    if(!strcmp((const char*)OpenMCU::vmcfg.vmconf[i].splitcfg.Id,(const char*)layoutName))
-                    {
-                      mixer->MyChangeLayout(i);
-                      break;
-                    }
-                  }
-                }
-              }
-            }
-          }
-        }
-        else if(cmd=="SKIP")
-        { unsigned skipping=value.AsInteger();
-          while(skipping>0)
-          { if(mixer!=NULL) mixer->MyRemoveVideoSource(vmpN,TRUE);
-            vmpN++;
-            skipping--;
+            layout = i;
+            break;
           }
         }
-        else if(cmd=="VMP")
+      }
+      if(layout >= 0 && layout != mixer->GetPositionSet())
+        mixer->MyChangeLayout(layout);
+    }
+
+    for(unsigned vmpN = 0; vmpN < mit->positions.size(); vmpN++)
+    {
+      const MCUTemplatePosition & p = mit->positions[vmpN];
+      if(p.type == 0)
+        mixer->MyRemoveVideoSource(vmpN,TRUE);
+      else if(p.memberName.IsEmpty())
+        mixer->SetPositionType(vmpN, p.type);
+      else
+      {
+        ConferenceMember *member = FindTemplateMemberWithLock(index, p.memberName);
+        if(member!=NULL)
         {
-          if (value=="-")
-          {
-            if(mixer!=NULL) mixer->MyRemoveVideoSource(vmpN,TRUE);
-          }
-          else
+          // the position is set up again only when it has changed
+          if(member->IsVisible() && (mixer->GetPositionId(vmpN) != member->GetID() || mixer->GetPositionType((int)vmpN) != p.type))
           {
-            int type=1; if(value.Left(1)=="2") type=2; else if(value.Left(1)=="3") type=3;
-            PINDEX commaPosition = value.Find(',');
-            if(commaPosition == P_MAX_INDEX) mixer->SetPositionType(vmpN, type);
-            else
-            {
-              PString name=value.Mid(commaPosition+1,P_MAX_INDEX).LeftTrim();
-              ConferenceMember *member = manager.FindMemberSimilarWithLock(this, name);
-              if(member==NULL)
-              {
-                member = new MCUConnection_ConferenceMember(this, name, "");
-                MCUMemberList::shared_iterator it = AddMemberToList(member);
-                if(it == memberList.end()) { delete member; member = NULL; }
-                else member = it.GetCapturedObject();
-              }
-              if(member!=NULL)
-              {
-                if(mixer && member->IsVisible())
-                {
-                  mixer->PositionSetup(vmpN, type, member);
-                  member->SetFreezeVideo(FALSE);
-                }
-                member->Unlock();
-              }
-            }
+            mixer->PositionSetup(vmpN, p.type, member);
+            member->SetFreezeVideo(FALSE);
           }
-          vmpN++;
+          member->Unlock();
         }
-        else if(cmd=="MEMBER")
-        {
-          PStringArray v=value.Tokenise(",");
-          if(v.GetSize()>4) for(int i=0; i<=4;i++) v[i]=v[i].Trim();
-
-          PString memberInternalName = v[5].Trim();
-          for(int i=6; i<v.GetSize(); i++) memberInternalName += "," + v[i];
-
-          ConferenceMember *member = manager.FindMemberSimilarWithLock(this, memberInternalName);
-          if(member == NULL)
-          {
-            member = new MCUConnection_ConferenceMember(this, memberInternalName, "");
-            MCUMemberList::shared_iterator it = AddMemberToList(member);
-            if(it == memberList.end())
-            {
-              delete member;
-              member = NULL;
-            }
-            else
-              member = it.GetCapturedObject();
-          }
-          if(member)
-          {
-            int oldResizerRule = member->resizerRule;
-            PStringArray maskAndGain = v[1].Tokenise("/");
-            BOOL hasGainOptions = (maskAndGain.GetSize() > 1);
-            if(hasGainOptions)
-            { // stay compatible with temp. style templates:
-              member->SetChannelState(maskAndGain[0].AsInteger());
-//              member->kManualGainDB = maskAndGain[1].AsInteger()-20;
-//              member->kOutputGainDB = maskAndGain[2].AsInteger()-20;
-//              member->kManualGain=(float)pow(10.0,((float)member->kManualGainDB)/20.0);
-//              member->kOutputGain=(float)pow(10.0,((float)member->kOutputGainDB)/20.0);
-            }
-            else 
-            {
-              member->muteMask      = v[1].AsInteger();
-            }
-            unsigned value3=(unsigned)(v[2].AsInteger());
-            member->disableVAD      = value3&1;
-            member->resizerRule     = (value3>>1)&127;
-            member->disableVAD      = (v[2]=="1");
-            member->chosenVan       = (v[3]=="1");
-            OpenMCU::Current().GetEndpoint().SetMemberVideoMixer(*this, member, v[4].AsInteger());
-            member->SetAutoDial((v[0]=="1"));
-            if(member->resizerRule != oldResizerRule) UpdateVideoMixOptions(member);
-            member->Unlock();
-          }
-          validatedMembers.AppendString(memberInternalName);
-
-        } // else if(cmd=="MEMBER")
-
-      } // if(space!=P_MAX_INDEX)
+      }
+    }
+  }
 
-    } // if "{" else "if" } else ...
+  for(std::vector<MCUTemplateMember>::const_iterator it = tpl.members.begin(); it != tpl.members.end(); ++it)
+  {
+    validatedMembers.insert(it->name);
+    ConferenceMember *member = FindTemplateMemberWithLock(index, it->name);
+    if(member == NULL)
+      continue;
+    validatedMembers.insert(member->GetName());
 
-  } // for(i=0; i<lines.GetSize()
+    int oldResizerRule = member->resizerRule;
+    PStringArray maskAndGain = it->muteMask.Tokenise("/");
+    if(maskAndGain.GetSize() > 1) // stay compatible with temp. style templates:
+      member->SetChannelState(maskAndGain[0].AsInteger());
+    else
+      member->muteMask = it->muteMask.AsInteger();
+    member->disableVAD      = it->options&1;
+    member->resizerRule     = (it->options>>1)&127;
+    member->chosenVan       = it->chosenVan;
+    OpenMCU::Current().GetEndpoint().SetMemberVideoMixer(*this, member, it->mixerNumber);
+    if(member->autoDial != it->autoDial)
+      member->SetAutoDial(it->autoDial);
+    if(member->resizerRule != oldResizerRule) UpdateVideoMixOptions(member);
+    member->Unlock();
+  }
 
   BOOL tracingFirst=FALSE;
   int videoMixerCount = videoMixerList.GetSize();
@@ -332,7 +311,7 @@ void Conference::LoadTemplate(PString tpl)
       ConferenceMember *member = *it;
       if(member->IsSystem()) continue;
       PString name = member->GetName();
-      if(validatedMembers.GetStringsIndex(name) == P_MAX_INDEX) // remove unwanted members
+      if(validatedMembers.find(name) == validatedMembers.end()) // remove unwanted members
       {
         PTRACE(6,"Conference\tLoading template - closing connection with " << name << " (id " << member->GetID() << ")" << flush);
         member->SetAutoDial(FALSE);
@@ -351,25 +330,21 @@ void Conference::LoadTemplate(PString tpl)
       }
     }
   }
-  
+
 }
 
 PString Conference::GetTemplateList()
 {
-  PStringArray lines=membersConf.Lines();
+  PStringArray names = templateStore.GetNames();
   PStringStream result;
   result << "(";
-  for(PINDEX i=0; i<lines.GetSize(); i++)
+  for(PINDEX i=0; i<names.GetSize(); i++)
   {
-    PString l = lines[i];
-    if(l.Find("TEMPLATE ")==0)
-    {
-      PString tName = l.Mid(9,P_MAX_INDEX).Trim();
-      tName.Replace("\\","\\x5c",TRUE,0);
-      tName.Replace("\"","\\x22",TRUE,0);
-      if(result.GetLength()>1) result << ",";
-      result << "\"" << tName << "\"";
-    }
+    PString tName = names[i];
+    tName.Replace("\\","\\x5c",TRUE,0);
+    tName.Replace("\"","\\x22",TRUE,0);
+    if(result.GetLength()>1) result << ",";
+    result << "\"" << tName << "\"";
   }
   result << ")";
   return result;
@@ -377,195 +352,382 @@ PString Conference::GetTemplateList()
 
 PString Conference::GetSelectedTemplateName()
 {
-  if(confTpl.Trim()=="") return "";
-  PINDEX tp, lfp;
-  tp = confTpl.Find("TEMPLATE ");
-  if (tp == P_MAX_INDEX) return "";
-  lfp = confTpl.Find('\n',tp+9);
-  if(lfp == P_MAX_INDEX) return "";
-  PString result=confTpl.Mid(tp+9,lfp-tp-9);
-  result = result.Trim();
+  PString result = confTpl.name;
   result.Replace("\\","\\x5c",TRUE,0);
   result.Replace("\"","\\x22",TRUE,0);
   return result;
 }
 
-PString Conference::ExtractTemplate(PString tplName) // returns single template extracted from membersConf
-{ if(tplName=="") return "";
-  PStringArray lines=membersConf.Lines();
-  PINDEX i;
-  for(i=0;i<lines.GetSize();i++)
-  { PString s=lines[i].LeftTrim();
-    PINDEX sp=s.Find(" ");
-    if(sp==P_MAX_INDEX) continue;
-    if(s.Left(sp)=="TEMPLATE") if(s.Mid(sp+1,P_MAX_INDEX).Trim()==tplName)
-    { PStringStream result;
-      result << s << "\n";
-      PINDEX j;
-      int level=-1;
-      for(j=i+1; j<lines.GetSize(); j++)
-      { result << lines[j] << "\n";
-        PString s=lines[j].Trim();
-        if(s=="{")
-        { if(level==-1)level++; level++; }
-        else if(s=="}") level--;
-        if(level==0) return result;
-      }
-    }
-  }
-  return "";
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int TemplateLevel(const PString & line, int level)
+{
+  if(line=="{") return level+1;
+  if(line=="}") return level-1;
+  return level;
+}
+
+static BOOL TemplateCommand(const PString & line, PString & cmd, PString & value)
+{
+  PINDEX space=line.Find(" ");
+  if(space==P_MAX_INDEX)
+    return FALSE;
+  cmd=line.Left(space);
+  value=line.Mid(space+1,P_MAX_INDEX).LeftTrim();
+  return TRUE;
 }
 
-void Conference::TemplateInsertAndRewrite(PString tplName, PString tpl)
+BOOL MCUConferenceTemplate::Parse(const PStringArray & lines, PINDEX & i)
 {
-  PTRACE(6,"Conference\tTemplateInsertAndRewrite");
-  PStringArray lines=membersConf.Lines();
-  PINDEX i, start, stop, lastUsed;
-  start=P_MAX_INDEX;
-  stop=P_MAX_INDEX;
-  lastUsed=P_MAX_INDEX;
-
-  for(i=0;i<lines.GetSize();i++)
+  PString cmd, value;
+  if(!TemplateCommand(lines[i].Trim(), cmd, value) || cmd != "TEMPLATE")
+    return FALSE;
+  name = value.Trim();
+
+  MCUTemplateMixer * mixer = NULL;
+  int level=0;
+  for(i++; i<lines.GetSize(); i++)
   {
-    PString s=lines[i].LeftTrim();
-    PINDEX sp=s.Find(' ');
-    if(sp==P_MAX_INDEX) continue;
-    PString cmd=s.Left(sp);
-    if(cmd=="LAST_USED") lastUsed=i;
-    if(start==P_MAX_INDEX) if(cmd=="TEMPLATE") if(s.Mid(sp+1,P_MAX_INDEX).Trim()==tplName)
+    PString l=lines[i].Trim();
+    level = TemplateLevel(l, level);
+    if(level == 0 && l == "}")
+    {
+      i++;
+      return TRUE;
+    }
+    if(!TemplateCommand(l, cmd, value))
+      continue;
+
+    if(cmd=="GLOBAL_MUTE") globalMute=(value=="on");
+    else if(cmd=="CONTROL_TYPE") manualControl=(value=="manual");
+    else if(cmd=="VAD_VALUES")
+    {
+      PStringArray v=value.Tokenise(",");
+      if(v.GetSize()==3)
+      {
+        hasVAD = TRUE;
+        vadDelay  =v[0].Trim().AsUnsigned();
+        vadTimeout=v[1].Trim().AsUnsigned();
+        vadLevel  =v[2].Trim().AsUnsigned();
+      }
+    }
+    else if(cmd=="MIXER")
+    {
+      mixers.push_back(MCUTemplateMixer());
+      mixer = &mixers.back();
+      mixer->number = value.AsUnsigned();
+    }
+    else if(cmd=="LAYOUT" && mixer)
+    {
+      PStringArray v=value.Tokenise(",");
+      if(v.GetSize()==2)
+      {
+        mixer->layoutNumber = v[0].Trim().AsUnsigned();
+        mixer->layoutId = v[1].Trim();
+      }
+    }
+    else if(cmd=="SKIP" && mixer)
+      mixer->positions.resize(mixer->positions.size() + value.AsUnsigned());
+    else if(cmd=="VMP" && mixer)
+    {
+      MCUTemplatePosition p;
+      if(value != "-")
+      {
+        p.type=1; if(value.Left(1)=="2") p.type=2; else if(value.Left(1)=="3") p.type=3;
+        PINDEX commaPosition = value.Find(',');
+        if(commaPosition != P_MAX_INDEX)
+          p.memberName = value.Mid(commaPosition+1,P_MAX_INDEX).LeftTrim();
+      }
+      mixer->positions.push_back(p);
+    }
+    else if(cmd=="MEMBER")
     {
-      start = i;
-      PINDEX j;
-      int level=-1;
-      for(j=i+1; j<lines.GetSize(); j++)
+      // the first five fields, the rest of the line is the name with its own commas
+      PStringArray v;
+      PINDEX pos = 0;
+      for(PINDEX j = 0; j < 5; j++)
       {
-        PString s=lines[j].Trim();
-        if(s=="{")
-        { if(level==-1)level++; level++; }
-        else if(s=="}") level--;
-        if(level==0) { stop=j+1; break; }
+        PINDEX commaPosition = value.Find(',', pos);
+        if(commaPosition == P_MAX_INDEX)
+          break;
+        v.AppendString(value(pos, commaPosition-1));
+        pos = commaPosition + 1;
       }
+      if(v.GetSize()<5 || value.Mid(pos).Trim().IsEmpty())
+        continue;
+      MCUTemplateMember m;
+      m.autoDial = (v[0].Trim()=="1");
+      m.muteMask = v[1].Trim();
+      m.options = v[2].Trim().AsUnsigned();
+      m.chosenVan = (v[3].Trim()=="1");
+      m.mixerNumber = v[4].Trim().AsInteger();
+      m.name = value.Mid(pos).Trim();
+      members.push_back(m);
     }
   }
+  // not closed at the end of the file
+  return TRUE;
+}
 
-  PStringStream result;
-  i = 0;
-  int lfc=0;
-
-  if(start!=P_MAX_INDEX)
+void MCUConferenceTemplate::PrintOn(PStringStream & t) const
+{
+  t << "TEMPLATE " << name << "\n"
+    << "{\n";
+  if(globalMute >= 0)
+    t << "  GLOBAL_MUTE " << (globalMute?"on":"off") << "\n";
+  if(manualControl >= 0)
+    t << "  CONTROL_TYPE " << (manualControl?"manual":"auto") << "\n";
+  if(hasVAD)
+    t << "  VAD_VALUES " << vadDelay << ", " << vadTimeout << ", " << vadLevel << "\n";
+
+  for(std::vector<MCUTemplateMixer>::const_iterator it = mixers.begin(); it != mixers.end(); ++it)
   {
-    while (i < start)
+    t << "  MIXER " << it->number << "\n"
+      << "  {\n";
+    if(!it->layoutId.IsEmpty())
+      t << "    LAYOUT " << it->layoutNumber << ", " << it->layoutId << "\n";
+    unsigned skipCounter=0;
+    for(std::vector<MCUTemplatePosition>::const_iterator p = it->positions.begin(); p != it->positions.end(); ++p)
     {
-      if(lines[i]=="") lfc++; else lfc=0;
-      if(lfc<2) if(i!=lastUsed) result << lines[i] << "\n";
-      i++;
+      if(p->type == 0)
+      {
+        skipCounter++;
+        continue;
+      }
+      if(skipCounter==1) t << "    VMP -\n";
+      else if(skipCounter>1) t << "    SKIP " << skipCounter << "\n";
+      skipCounter=0;
+      t << "    VMP " << p->type;
+      if(!p->memberName.IsEmpty()) t << ", " << p->memberName;
+      t << "\n";
     }
-    if(lfc == 0) { result << "\n"; lfc=1; }
-    i=stop;
+    if(skipCounter==1) t << "    VMP -\n";
+    else if(skipCounter>1) t << "    SKIP " << skipCounter << "\n";
+    t << "  }\n";
   }
 
-  while (i < lines.GetSize())
+  for(std::vector<MCUTemplateMember>::const_iterator it = members.begin(); it != members.end(); ++it)
   {
-    PString s = lines[i].LeftTrim();
-    if(s=="") lfc++; else lfc=0;
-    if(lfc<2) if(lastUsed!=i) result << lines[i] << "\n";
-    i++;
+    t << "  MEMBER "
+      << (it->autoDial?"1":"0") << ", "
+      << it->muteMask << ", "
+      << it->options << ", "
+      << (it->chosenVan?"1":"0") << ", "
+      << it->mixerNumber << ", "
+      << it->name << "\n";
   }
-  membersConf = result;
+  t << "}\n";
+}
 
-  while (membersConf.Right(2)!="\n\n") membersConf+="\n";
+PString MCUConferenceTemplate::AsString() const
+{
+  PStringStream t;
+  PrintOn(t);
+  return t;
+}
 
-  while (membersConf.Left(1)=="\n") membersConf=membersConf.Right(membersConf.GetLength()-1);
+bool MCUConferenceTemplate::operator==(const MCUConferenceTemplate & t) const
+{
+  return name == t.name && globalMute == t.globalMute && manualControl == t.manualControl && hasVAD == t.hasVAD
+         && (!hasVAD || (vadDelay == t.vadDelay && vadTimeout == t.vadTimeout && vadLevel == t.vadLevel))
+         && mixers == t.mixers && members == t.members;
+}
 
-  membersConf += tpl;
+const MCUTemplateMixer * MCUConferenceTemplate::FindMixer(unsigned number) const
+{
+  for(std::vector<MCUTemplateMixer>::const_iterator it = mixers.begin(); it != mixers.end(); ++it)
+  {
+    if(it->number == number)
+      return &(*it);
+  }
+  return NULL;
+}
 
-  while (membersConf.Right(2)!="\n\n") membersConf+="\n";
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  membersConf+="LAST_USED "+tplName+"\n";
+MCUTemplateStore::MCUTemplateStore()
+{
+  version = 0;
+  savedVersion = 0;
+}
 
-  RewriteMembersConf();
+BOOL MCUTemplateStore::Load(const PString & _fileName)
+{
+  PWaitAndSignal m(mutex);
+  fileName = _fileName;
+
+  PStringStream text;
+  FILE *membLst = fopen(fileName, "rt");
+  if(membLst!=NULL)
+  { char buf [1024];
+    while(fgets(buf, sizeof(buf), membLst)!=NULL) text << buf;
+    fclose(membLst);
+  }
+  BOOL result = Parse(text);
+  savedVersion = version;
+  return result;
 }
 
-void Conference::SetLastUsedTemplate(PString tplName)
+BOOL MCUTemplateStore::Parse(const PString & text)
 {
-  PTRACE(6,"Conference\tSetLastUsedTemplate");
-  PStringArray lines=membersConf.Lines();
-  BOOL set=FALSE;
-  PStringStream result;
-  for (PINDEX i=0; i<lines.GetSize(); i++)
+  PWaitAndSignal m(mutex);
+  templates.clear();
+  lastUsed = "";
+
+  PStringArray lines = text.Lines();
+  PINDEX i = 0;
+  while(i < lines.GetSize())
   {
-    PString s=lines[i].LeftTrim();
-    PINDEX sp=s.Find(' ');
-    if(sp!=P_MAX_INDEX)
+    PString cmd, value;
+    if(!TemplateCommand(lines[i].Trim(), cmd, value))
     {
-      PString cmd=s.Left(sp);
-      if(cmd=="LAST_USED")
-      {
-        if(!set)
-        {
-          result << "LAST_USED " << tplName << "\n";
-          set=TRUE;
-        }
-      } else
-      {
-        result << lines[i] << "\n";
-      }
-    } else
+      i++;
+      continue;
+    }
+    if(cmd == "TEMPLATE")
     {
-      result << lines[i] << "\n";
+      MCUConferenceTemplate tpl;
+      tpl.Parse(lines, i);
+      // the names are unique, the last one wins as with the text search
+      std::vector<MCUConferenceTemplate>::iterator it = Find(tpl.name);
+      if(it != templates.end())
+        templates.erase(it);
+      templates.push_back(tpl);
+      continue;
     }
+    if(cmd == "LAST_USED")
+      lastUsed = value.Trim();
+    else if(cmd == "VERSION")
+      version = value.AsUnsigned();
+    i++;
   }
-  if(!set)
+  return TRUE;
+}
+
+void MCUTemplateStore::PrintOn(PStringStream & t)
+{
+  t << "VERSION " << version << "\n\n";
+  for(std::vector<MCUConferenceTemplate>::iterator it = templates.begin(); it != templates.end(); ++it)
   {
-    while(result.Right(2)!="\n\n") result << "\n";
-    result << "LAST_USED " << tplName << "\n";
+    it->PrintOn(t);
+    t << "\n";
   }
-  membersConf = result;
-  RewriteMembersConf();
+  if(!lastUsed.IsEmpty())
+    t << "LAST_USED " << lastUsed << "\n";
 }
 
-void Conference::DeleteTemplate(PString tplName)
+PString MCUTemplateStore::AsString()
 {
-  PTRACE(6,"Conference\tDeleteTemplate: " << tplName);
-  PStringArray lines=membersConf.Lines();
-  PStringStream result;
-  int inside=0;
-  int level=0;
-  for(PINDEX i=0; i<lines.GetSize(); i++)
+  PWaitAndSignal m(mutex);
+  PStringStream t;
+  PrintOn(t);
+  return t;
+}
+
+BOOL MCUTemplateStore::Save()
+{
+  PWaitAndSignal m(mutex);
+  if(version == savedVersion)
+    return TRUE;
+  if(fileName.IsEmpty())
+    return FALSE;
+
+  PTRACE(6,"Conference\tSave templates " << fileName << " version " << version);
+  PStringStream text;
+  PrintOn(text);
+
+  // a reader or a crash sees the old file or the new one, never a part
+  PString tmpName = fileName + ".tmp";
+  FILE *membLst = fopen(tmpName, "w");
+  if(membLst == NULL)
+    return FALSE;
+  BOOL result = (fputs(text, membLst) >= 0 && fflush(membLst) == 0);
+#ifndef _WIN32
+  if(result) result = (fsync(fileno(membLst)) == 0);
+#endif
+  if(fclose(membLst) != 0) result = FALSE;
+#ifdef _WIN32
+  if(result) remove(fileName);
+#endif
+  if(result) result = (rename(tmpName, fileName) == 0);
+  if(!result)
   {
-    PString s=lines[i].Trim();
-    PString cmd="";
-    PINDEX sp = s.Find(' ');
-    if(sp!=P_MAX_INDEX) cmd=s.Left(sp);
-    if(s=="{") level++;
-    if(s=="}") if(level>0) level--;
-    if(cmd=="TEMPLATE") if(s.Mid(sp+1,P_MAX_INDEX).Trim()==tplName) inside=2;
+    PTRACE(1,"Conference\tCould not save templates " << fileName << ", error " << errno);
+    remove(tmpName);
+    return FALSE;
+  }
+  savedVersion = version;
+  return TRUE;
+}
 
-    if(inside==1) if(s!="") inside=0;
+std::vector<MCUConferenceTemplate>::iterator MCUTemplateStore::Find(const PString & name)
+{
+  for(std::vector<MCUConferenceTemplate>::iterator it = templates.begin(); it != templates.end(); ++it)
+  {
+    if(it->name == name)
+      return it;
+  }
+  return templates.end();
+}
 
-    if(!inside) result << lines[i] << "\n";
+BOOL MCUTemplateStore::GetTemplate(const PString & name, MCUConferenceTemplate & tpl)
+{
+  PWaitAndSignal m(mutex);
+  if(name.IsEmpty())
+    return FALSE;
+  std::vector<MCUConferenceTemplate>::iterator it = Find(name);
+  if(it == templates.end())
+    return FALSE;
+  tpl = *it;
+  return TRUE;
+}
 
-    if(inside==1) inside=0;
-    if(inside) if(s=="}") if(level==0) inside=1;
+void MCUTemplateStore::SetTemplate(const MCUConferenceTemplate & tpl)
+{
+  PWaitAndSignal m(mutex);
+  std::vector<MCUConferenceTemplate>::iterator it = Find(tpl.name);
+  if(it != templates.end())
+  {
+    // saved again without changes
+    if(*it == tpl && it + 1 == templates.end())
+      return;
+    templates.erase(it);
   }
-  membersConf=result;
-  RewriteMembersConf();
+  templates.push_back(tpl);
+  version++;
 }
 
-BOOL Conference::RewriteMembersConf()
+BOOL MCUTemplateStore::RemoveTemplate(const PString & name)
 {
-  PTRACE(6,"Conference\tRewriteMembersConf");
-  FILE *membLst;
-#ifdef SYS_CONFIG_DIR
-  PString name=PString(SYS_CONFIG_DIR) + PATH_SEPARATOR + "members_" + number + ".conf";
-#else
-  PString name="members_"+number+".conf";
-#endif
-  PWaitAndSignal m(membersConfMutex);
-  membLst = fopen(name,"w");
-  if (membLst==NULL) return FALSE;
-  int result = fputs(membersConf,membLst);
-  fclose(membLst);
-  return (result >= 0);
+  PWaitAndSignal m(mutex);
+  std::vector<MCUConferenceTemplate>::iterator it = Find(name);
+  if(it == templates.end())
+    return FALSE;
+  templates.erase(it);
+  version++;
+  return TRUE;
+}
+
+PStringArray MCUTemplateStore::GetNames()
+{
+  PWaitAndSignal m(mutex);
+  PStringArray names;
+  for(std::vector<MCUConferenceTemplate>::iterator it = templates.begin(); it != templates.end(); ++it)
+    names.AppendString(it->name);
+  return names;
+}
+
+void MCUTemplateStore::SetLastUsed(const PString & name)
+{
+  PWaitAndSignal m(mutex);
+  if(lastUsed == name)
+    return;
+  lastUsed = name;
+  version++;
 }
 
+PString MCUTemplateStore::GetLastUsed()
+{
+  PWaitAndSignal m(mutex);
+  return lastUsed;
+}
@@ -0,0 +1,157 @@
+/*
+ * template.h
+ *
+ * Copyright (C) 2015 Andrey Burbovskiy, OpenMCU-ru, All Rights Reserved
+ *
+ * The Initial Developer of the Original Code is Andrey Burbovskiy (andrewb@yandex.ru), All Rights Reserved
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * Contributor(s):  Andrey Burbovskiy (andrewb@yandex.ru)
+ *
+ */
+
+#include "precompile.h"
+
+#ifndef _MCU_TEMPLATE_H
+#define _MCU_TEMPLATE_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// video position of a template mixer: "VMP -" or SKIP is type 0,
+// "VMP <type>" has no member, "VMP <type>, <name>" is a member position
+struct MCUTemplatePosition
+{
+  MCUTemplatePosition() : type(0) { }
+  MCUTemplatePosition(int _type, const PString & _memberName) : type(_type), memberName(_memberName) { }
+
+  bool operator==(const MCUTemplatePosition & p) const
+  { return type == p.type && memberName == p.memberName; }
+
+  int type;
+  PString memberName;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct MCUTemplateMixer
+{
+  MCUTemplateMixer() : number(0), layoutNumber(0) { }
+
+  bool operator==(const MCUTemplateMixer & m) const
+  { return number == m.number && layoutNumber == m.layoutNumber && layoutId == m.layoutId && positions == m.positions; }
+
+  unsigned number;
+  // the number is checked by the id, the layouts can be reordered in layouts.conf
+  unsigned layoutNumber;
+  PString layoutId;
+  std::vector<MCUTemplatePosition> positions;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct MCUTemplateMember
+{
+  MCUTemplateMember() : autoDial(FALSE), options(0), chosenVan(FALSE), mixerNumber(0) { }
+
+  bool operator==(const MCUTemplateMember & m) const
+  { return autoDial == m.autoDial && muteMask == m.muteMask && options == m.options && chosenVan == m.chosenVan
+           && mixerNumber == m.mixerNumber && name == m.name; }
+
+  BOOL autoDial;
+  // "<mask>" or "<mask>/<gain>/<gain>" of the old templates, kept as it was read
+  PString muteMask;
+  // resizer rule << 1 | disable VAD
+  unsigned options;
+  BOOL chosenVan;
+  int mixerNumber;
+  PString name;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// one TEMPLATE block of members_<room>.conf
+class MCUConferenceTemplate
+{
+  public:
+    MCUConferenceTemplate() : globalMute(-1), manualControl(-1), hasVAD(FALSE), vadDelay(0), vadTimeout(0), vadLevel(0) { }
+
+    // the lines from the TEMPLATE line to the closing brace
+    BOOL Parse(const PStringArray & lines, PINDEX & i);
+    void PrintOn(PStringStream & t) const;
+    PString AsString() const;
+
+    bool operator==(const MCUConferenceTemplate & t) const;
+
+    const MCUTemplateMixer * FindMixer(unsigned number) const;
+
+    PString name;
+    // -1 when the line is missing
+    int globalMute;
+    int manualControl;
+    BOOL hasVAD;
+    unsigned vadDelay;
+    unsigned vadTimeout;
+    unsigned vadLevel;
+    std::vector<MCUTemplateMixer> mixers;
+    std::vector<MCUTemplateMember> members;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the templates of a room, parsed once when the room is created; every change increments the version
+// and Save() writes a changed store to a temporary file renamed over members_<room>.conf
+class MCUTemplateStore
+{
+  public:
+    MCUTemplateStore();
+
+    // a missing file is an empty store
+    BOOL Load(const PString & fileName);
+    BOOL Save();
+
+    BOOL Parse(const PString & text);
+    PString AsString();
+
+    BOOL GetTemplate(const PString & name, MCUConferenceTemplate & tpl);
+    // a saved template replaces the one with the same name and goes to the end, as the last saved
+    void SetTemplate(const MCUConferenceTemplate & tpl);
+    BOOL RemoveTemplate(const PString & name);
+    PStringArray GetNames();
+
+    void SetLastUsed(const PString & name);
+    PString GetLastUsed();
+
+    unsigned GetVersion()
+    { return version; }
+    unsigned GetSavedVersion()
+    { return savedVersion; }
+
+  protected:
+    std::vector<MCUConferenceTemplate>::iterator Find(const PString & name);
+    void PrintOn(PStringStream & t);
+
+    PMutex mutex;
+    PString fileName;
+    std::vector<MCUConferenceTemplate> templates;
+    PString lastUsed;
+    unsigned version;
+    unsigned savedVersion;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// the members of a room by name, URL and name id while a template is loaded
+class MCUTemplateMemberIndex;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _MCU_TEMPLATE_H
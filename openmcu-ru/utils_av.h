@@ -29,6 +29,9 @@
 #  endif
 #endif
 
+#ifndef AV_INPUT_BUFFER_PADDING_SIZE
+  #define AV_INPUT_BUFFER_PADDING_SIZE FF_INPUT_BUFFER_PADDING_SIZE
+#endif
 
 #define AV_ALIGN 1
 
@@ -23,6 +23,8 @@
 #include "precompile.h"
 #include "mcu.h"
 
+#include <new>
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 std::string JsQuoteScreen(const std::string &str)
@@ -78,34 +80,145 @@ std::string & JsQuoteScreen(const std::string &str, std::string &r)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MCUJSON::MCUJSON(JsonTypes type, const std::string &key, int size)
-  : value_bool(false), value_int(0), value_double(0), value_array(NULL)
+// Nodes of one document: the children inserted into the root and into the containers taken
+// from it. No lock, a document is built and read by one thread. Free nodes are linked
+// through their first bytes, the blocks through their headers.
+#define JSON_ARENA_FIRST_NODES 16
+#define JSON_ARENA_MAX_NODES   256
+#define JSON_ARENA_HEADER      16
+
+static volatile int64_t jsonArenaNodes = 0;
+static volatile int64_t jsonArenaBlocks = 0;
+
+class MCUJSONArena
+{
+  public:
+    MCUJSONArena()
+      : free_nodes(NULL), blocks(NULL), block_used(0), block_size(0), nodes(0), block_count(0)
+    { }
+
+    ~MCUJSONArena()
+    {
+      while(blocks)
+      {
+        char *next = *(char **)blocks;
+        ::operator delete(blocks);
+        blocks = next;
+      }
+      // the counters are shared, updated once for a document
+      sync_fetch_and_add64(&jsonArenaNodes, nodes);
+      sync_fetch_and_add64(&jsonArenaBlocks, block_count);
+    }
+
+    void * Take()
+    {
+      ++nodes;
+      if(free_nodes)
+      {
+        void *ptr = free_nodes;
+        free_nodes = *(void **)ptr;
+        return ptr;
+      }
+      if(block_used == block_size)
+      {
+        // small documents take a small block
+        block_size = block_size ? PMIN(block_size * 2, JSON_ARENA_MAX_NODES) : JSON_ARENA_FIRST_NODES;
+        char *block = (char *)::operator new(JSON_ARENA_HEADER + block_size * sizeof(MCUJSON));
+        *(char **)block = blocks;
+        blocks = block;
+        block_used = 0;
+        ++block_count;
+      }
+      return blocks + JSON_ARENA_HEADER + sizeof(MCUJSON) * block_used++;
+    }
+
+    void Give(void *ptr)
+    {
+      *(void **)ptr = free_nodes;
+      free_nodes = ptr;
+    }
+
+  protected:
+    void *free_nodes;
+    char *blocks;
+    unsigned block_used;
+    unsigned block_size;
+    int64_t nodes;
+    int64_t block_count;
+};
+
+uint64_t MCUJSON::GetNodeAllocations()
+{
+  return (uint64_t)sync_fetch_and_add64(&jsonArenaNodes, 0);
+}
+
+uint64_t MCUJSON::GetBlockAllocations()
+{
+  return (uint64_t)sync_fetch_and_add64(&jsonArenaBlocks, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUJSON * MCUJSON::NewChild(JsonTypes type, const std::string &key)
+{
+  if(json_type != JSON_ARRAY && json_type != JSON_OBJECT)
+    return NULL;
+  if(arena == NULL)
+  {
+    arena = new MCUJSONArena;
+    arena_owner = true;
+  }
+  MCUJSON *json = ::new(arena->Take()) MCUJSON(type, key);
+  json->arena = arena;
+  json->in_arena = true;
+  return json;
+}
+
+void MCUJSON::Delete(MCUJSON *json)
 {
-  if(type == JSON_ARRAY || type == JSON_OBJECT)
+  if(json == NULL)
+    return;
+  if(!json->in_arena)
   {
-    json_key = key;
-    json_type = type;
-    value_array = new MCUJSONList(size);
-  } else {
-    json_key = key;
-    json_type = type;
+    delete json;
+    return;
   }
+  MCUJSONArena *arena = json->arena;
+  json->~MCUJSON();
+  arena->Give(json);
+}
+
+////
+
+MCUJSON::MCUJSON(JsonTypes type, const std::string &key)
+  : json_key(key), json_type(type), value_bool(false), value_int(0), value_double(0),
+    child_first(NULL), child_last(NULL), next(NULL), arena(NULL), arena_owner(false), in_arena(false)
+{
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 MCUJSON::~MCUJSON()
 {
-  if(value_array)
+  // the children taken from the arena go first
+  Clear();
+  if(arena_owner)
+    delete arena;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUJSON::Clear()
+{
+  MCUJSON *json = child_first;
+  while(json)
   {
-    for(shared_iterator it = value_array->begin(); it != value_array->end(); ++it)
-    {
-      MCUJSON *json = *it;
-      if(value_array->Erase(it))
-        delete json;
-    }
-    delete value_array;
+    MCUJSON *json_next = json->next;
+    Delete(json);
+    json = json_next;
   }
+  child_first = NULL;
+  child_last = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -222,167 +335,246 @@ MCUJSON * MCUJSON::String(const std::string &value)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MCUJSON * MCUJSON::Array(const std::string &key, int size)
+MCUJSON * MCUJSON::Array(const std::string &key)
 {
-  return new MCUJSON(JSON_ARRAY, key, size);
+  return new MCUJSON(JSON_ARRAY, key);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MCUJSON * MCUJSON::Object(const std::string &key, int size)
+MCUJSON * MCUJSON::Object(const std::string &key)
+{
+  return new MCUJSON(JSON_OBJECT, key);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUJSON * MCUJSON::InsertArray(const std::string &key)
+{
+  MCUJSON *json = NewChild(JSON_ARRAY, key);
+  Insert(json);
+  return json;
+}
+
+MCUJSON * MCUJSON::InsertObject(const std::string &key)
 {
-  return new MCUJSON(JSON_OBJECT, key, size);
+  MCUJSON *json = NewChild(JSON_OBJECT, key);
+  Insert(json);
+  return json;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool MCUJSON::Insert(MCUJSON *json)
 {
-  if(json_type != JSON_ARRAY && json_type != JSON_OBJECT)
-  {
-    delete json;
+  if(json == NULL)
     return false;
-  }
-  shared_iterator it = value_array->Pushback(json, value_array->GetNextID(), json->json_key);
-  if(it == value_array->end())
+  if(json_type != JSON_ARRAY && json_type != JSON_OBJECT)
   {
-    delete json;
+    Delete(json);
     return false;
   }
+  json->next = NULL;
+  if(child_last)
+    child_last->next = json;
+  else
+    child_first = json;
+  child_last = json;
   return true;
 }
 
 bool MCUJSON::Insert(const std::string &key, bool value)
 {
-  return Insert(MCUJSON::Bool(key, value));
+  MCUJSON *json = NewChild(JSON_BOOL, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(bool value)
 {
-  return Insert(MCUJSON::Bool("", value));
+  MCUJSON *json = NewChild(JSON_BOOL, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, int value)
 {
-  return Insert(MCUJSON::Int(key, value));
+  MCUJSON *json = NewChild(JSON_INT, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(int value)
 {
-  return Insert(MCUJSON::Int("", value));
+  MCUJSON *json = NewChild(JSON_INT, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, unsigned int value)
 {
-  return Insert(MCUJSON::Int(key, value));
+  MCUJSON *json = NewChild(JSON_INT, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(unsigned int value)
 {
-  return Insert(MCUJSON::Int("", value));
+  MCUJSON *json = NewChild(JSON_INT, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, long value)
 {
-  return Insert(MCUJSON::Int(key, value));
+  MCUJSON *json = NewChild(JSON_INT, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(long value)
 {
-  return Insert(MCUJSON::Int("", value));
+  MCUJSON *json = NewChild(JSON_INT, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, unsigned long value)
 {
-  return Insert(MCUJSON::Int(key, value));
+  MCUJSON *json = NewChild(JSON_INT, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(unsigned long value)
 {
-  return Insert(MCUJSON::Int("", value));
+  MCUJSON *json = NewChild(JSON_INT, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, long long value)
 {
-  return Insert(MCUJSON::Int(key, value));
+  MCUJSON *json = NewChild(JSON_INT, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(long long value)
 {
-  return Insert(MCUJSON::Int("", value));
+  MCUJSON *json = NewChild(JSON_INT, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, double value)
 {
-  return Insert(MCUJSON::Double(key, value));
+  MCUJSON *json = NewChild(JSON_DOUBLE, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(double value)
 {
-  return Insert(MCUJSON::Double("", value));
+  MCUJSON *json = NewChild(JSON_DOUBLE, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, const char *value)
 {
-  return Insert(MCUJSON::String(key, value));
+  MCUJSON *json = NewChild(JSON_STRING, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(const char *value)
 {
-  return Insert(MCUJSON::String("", value));
+  MCUJSON *json = NewChild(JSON_STRING, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, const std::string &value)
 {
-  return Insert(MCUJSON::String(key, value));
+  MCUJSON *json = NewChild(JSON_STRING, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(const std::string &value)
 {
-  return Insert(MCUJSON::String("", value));
+  MCUJSON *json = NewChild(JSON_STRING, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 bool MCUJSON::Insert(const std::string &key, const PString &value)
 {
-  return Insert(MCUJSON::String(key, value));
+  MCUJSON *json = NewChild(JSON_STRING, key);
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 bool MCUJSON::Insert(const PString &value)
 {
-  return Insert(MCUJSON::String("", value));
+  MCUJSON *json = NewChild(JSON_STRING, "");
+  if(json)
+    *json = value;
+  return Insert(json);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool MCUJSON::Replace(const std::string &key, const std::string &value)
 {
-  if(value_array)
-  {
-    shared_iterator it = value_array->Find(key);
-    if(it == value_array->end())
-      return false;
-    **it = value;
-  }
-  return false;
+  MCUJSON *json = Find(key);
+  if(json == NULL)
+    return false;
+  *json = value;
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 bool MCUJSON::Remove(const std::string &key)
 {
-  if(value_array)
+  MCUJSON *prev = NULL;
+  for(MCUJSON *json = child_first; json != NULL; prev = json, json = json->next)
   {
-    shared_iterator it = value_array->Find(key);
-    if(it != value_array->end())
-    {
-      MCUJSON *json = *it;
-      if(value_array->Erase(it))
-      {
-        delete json;
-        return true;
-      }
-    }
+    if(json->json_key != key)
+      continue;
+    if(prev)
+      prev->next = json->next;
+    else
+      child_first = json->next;
+    if(child_last == json)
+      child_last = prev;
+    Delete(json);
+    return true;
   }
   return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MCUSharedListSharedIterator<MCUJSONList, MCUJSON> MCUJSON::Find(const std::string &key)
+MCUJSON * MCUJSON::Find(const std::string &key)
 {
-  if(value_array)
-    return value_array->Find(key);
-  return iterator_end;
+  for(MCUJSON *json = child_first; json != NULL; json = json->next)
+  {
+    if(json->json_key == key)
+      return json;
+  }
+  return NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -458,26 +650,6 @@ MCUJSON & MCUJSON::operator = (const PString &value)
   return *this;
 }
 
-MCUJSON & MCUJSON::operator = (MCUJSONList *value)
-{
-  if(value_array)
-  {
-    for(shared_iterator it = value_array->begin(); it != value_array->end(); ++it)
-    {
-      MCUJSON *json = *it;
-      if(value_array->Erase(it))
-        delete json;
-    }
-    for(shared_iterator it = value->begin(); it != value->end(); ++it)
-    {
-      MCUJSON *json = new MCUJSON(it->json_type, it->json_key);
-      *json = **it;
-      Insert(json);
-    }
-  }
-  return *this;
-}
-
 MCUJSON & MCUJSON::operator = (MCUJSON &json)
 {
   switch(json.json_type)
@@ -496,7 +668,18 @@ MCUJSON & MCUJSON::operator = (MCUJSON &json)
       break;
     case(JSON_ARRAY):
     case(JSON_OBJECT):
-      return (*this)=json.value_array;
+      if(json_type == JSON_ARRAY || json_type == JSON_OBJECT)
+      {
+        if(&json == this)
+          break;
+        Clear();
+        for(MCUJSON *child = json.child_first; child != NULL; child = child->next)
+        {
+          MCUJSON *copy = NewChild(child->json_type, child->json_key);
+          *copy = *child;
+          Insert(copy);
+        }
+      }
       break;
     default:
       break;
@@ -564,13 +747,12 @@ std::string & MCUJSON::ToString(std::string &str, bool print_keys, bool print_es
       else
         str.push_back('[');
 
-      int i = 0;
-      for(shared_iterator it = value_array->begin(); it != value_array->end(); ++it, ++i)
+      for(MCUJSON *json = child_first; json != NULL; json = json->next)
       {
-        if(i > 0)
+        if(json != child_first)
           str.push_back(',');
         PrintEsc(str, print_esc, esc_level+1);
-        it->ToString(str, print_keys, print_esc, esc_level+1);
+        json->ToString(str, print_keys, print_esc, esc_level+1);
       }
 
       PrintEsc(str, print_esc, esc_level);
@@ -601,3 +783,168 @@ void MCUJSON::PrintEsc(std::string &str, bool print_esc, int esc_level)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+MCUJSONWriter::MCUJSONWriter(std::string &_str, bool _print_keys)
+  : str(_str), print_keys(_print_keys), separator(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUJSONWriter::Key(const std::string &key)
+{
+  if(separator)
+    str.push_back(',');
+  separator = true;
+  if(print_keys && !key.empty())
+  {
+    JsQuoteScreen(key, str);
+    str.push_back(':');
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUJSONWriter & MCUJSONWriter::BeginArray(const std::string &key)
+{
+  Key(key);
+  str.push_back('[');
+  stack.push_back(']');
+  separator = false;
+  return *this;
+}
+
+MCUJSONWriter & MCUJSONWriter::BeginObject(const std::string &key)
+{
+  Key(key);
+  str.push_back('{');
+  stack.push_back('}');
+  separator = false;
+  return *this;
+}
+
+MCUJSONWriter & MCUJSONWriter::End()
+{
+  if(stack.empty())
+    return *this;
+  str.push_back(stack[stack.size() - 1]);
+  stack.erase(stack.size() - 1);
+  separator = true;
+  return *this;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUJSONWriter & MCUJSONWriter::Null(const std::string &key)
+{
+  Key(key);
+  str.push_back('n'); str.push_back('u'); str.push_back('l'); str.push_back('l');
+  return *this;
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, bool value)
+{
+  Key(key);
+  str.push_back(value ? '1' : '0');
+  return *this;
+}
+MCUJSONWriter & MCUJSONWriter::Insert(bool value)
+{
+  return Insert("", value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, int value)
+{
+  return Insert(key, (long long)value);
+}
+MCUJSONWriter & MCUJSONWriter::Insert(int value)
+{
+  return Insert("", (long long)value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, unsigned int value)
+{
+  return Insert(key, (long long)value);
+}
+MCUJSONWriter & MCUJSONWriter::Insert(unsigned int value)
+{
+  return Insert("", (long long)value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, long value)
+{
+  return Insert(key, (long long)value);
+}
+MCUJSONWriter & MCUJSONWriter::Insert(long value)
+{
+  return Insert("", (long long)value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, unsigned long value)
+{
+  return Insert(key, (long long)value);
+}
+MCUJSONWriter & MCUJSONWriter::Insert(unsigned long value)
+{
+  return Insert("", (long long)value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, long long value)
+{
+  Key(key);
+  char buffer[32];
+  int digits = snprintf(buffer, 32, "%lld", value);
+  str.append(buffer, digits);
+  return *this;
+}
+MCUJSONWriter & MCUJSONWriter::Insert(long long value)
+{
+  return Insert("", value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, double value)
+{
+  Key(key);
+  char buffer[32];
+  int digits = snprintf(buffer, 32, "%f", value);
+  str.append(buffer, PMIN(digits, 31));
+  return *this;
+}
+MCUJSONWriter & MCUJSONWriter::Insert(double value)
+{
+  return Insert("", value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, const char *value)
+{
+  Key(key);
+  JsQuoteScreen(value ? value : "", str);
+  return *this;
+}
+MCUJSONWriter & MCUJSONWriter::Insert(const char *value)
+{
+  return Insert("", value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, const std::string &value)
+{
+  Key(key);
+  JsQuoteScreen(value, str);
+  return *this;
+}
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &value)
+{
+  return Insert("", value);
+}
+
+MCUJSONWriter & MCUJSONWriter::Insert(const std::string &key, const PString &value)
+{
+  Key(key);
+  JsQuoteScreen((const char *)value, str);
+  return *this;
+}
+MCUJSONWriter & MCUJSONWriter::Insert(const PString &value)
+{
+  return Insert("", value);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
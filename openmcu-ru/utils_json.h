@@ -34,13 +34,15 @@ std::string & JsQuoteScreen(const std::string &str, std::string &r);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+class MCUJSONArena;
+
+// Document tree, the children are linked to the parent. The values inserted into a node and
+// the containers of InsertArray() and InsertObject() are taken from the arena of the document,
+// a node created by new or by the static functions starts a document of its own.
 class MCUJSON
 {
   public:
 
-    typedef MCUSharedListSharedIterator<MCUJSONList, MCUJSON> shared_iterator;
-    const shared_iterator & end() const { return iterator_end; }
-
     enum JsonTypes
     {
       JSON_NULL = 0,
@@ -52,9 +54,13 @@ class MCUJSON
       JSON_OBJECT
     };
 
-    MCUJSON(JsonTypes type = JSON_OBJECT, const std::string &key = "", int size = MCU_SHARED_LIST_SIZE);
+    MCUJSON(JsonTypes type = JSON_OBJECT, const std::string &key = "");
     ~MCUJSON();
 
+    // nodes taken from the arenas and blocks taken from the heap by the documents freed since the start
+    static uint64_t GetNodeAllocations();
+    static uint64_t GetBlockAllocations();
+
     static MCUJSON * Null();
     static MCUJSON * Bool(const std::string &key, bool value);
     static MCUJSON * Bool(bool value);
@@ -72,10 +78,13 @@ class MCUJSON
     static MCUJSON * Double(const double value);
     static MCUJSON * String(const std::string &key, const std::string &value);
     static MCUJSON * String(const std::string &value);
-    static MCUJSON * Array(const std::string &key = "", int size = MCU_SHARED_LIST_SIZE);
-    static MCUJSON * Object(const std::string &key = "", int size = MCU_SHARED_LIST_SIZE);
+    static MCUJSON * Array(const std::string &key = "");
+    static MCUJSON * Object(const std::string &key = "");
 
     bool Insert(MCUJSON *json);
+    // returns the container inserted, it belongs to the node
+    MCUJSON * InsertArray(const std::string &key = "");
+    MCUJSON * InsertObject(const std::string &key = "");
     bool Insert(const std::string &key, bool value);
     bool Insert(bool value);
     bool Insert(const std::string &key, int value);
@@ -99,7 +108,8 @@ class MCUJSON
 
     bool Replace(const std::string &key, const std::string &value);
     bool Remove(const std::string &key);
-    shared_iterator Find(const std::string &key);
+    // returns the child or NULL, the child belongs to the node
+    MCUJSON * Find(const std::string &key);
 
     MCUJSON & operator = (bool value);
     MCUJSON & operator = (int value);
@@ -111,7 +121,6 @@ class MCUJSON
     MCUJSON & operator = (const char *value);
     MCUJSON & operator = (const std::string &value);
     MCUJSON & operator = (const PString &value);
-    MCUJSON & operator = (MCUJSONList *value);
     MCUJSON & operator = (MCUJSON &json);
 
     bool operator == (MCUJSON &json)
@@ -126,18 +135,79 @@ class MCUJSON
     std::string   AsString();
     std::string & ToString(std::string &str, bool print_keys = true, bool print_esc = false, int esc_level = 0);
 
-    void PrintEsc(std::string &str, bool print_esc, int esc_level);
+    static void PrintEsc(std::string &str, bool print_esc, int esc_level);
 
   protected:
+    void Clear();
+    // a node of the arena for a child, NULL if the node is not a container
+    MCUJSON * NewChild(JsonTypes type, const std::string &key);
+    static void Delete(MCUJSON *json);
+
     std::string json_key;
     JsonTypes json_type;
-    shared_iterator iterator_end;
 
     bool value_bool;
     long long value_int;
     double value_double;
     std::string value_string;
-    MCUJSONList * value_array;
+
+    MCUJSON * child_first;
+    MCUJSON * child_last;
+    MCUJSON * next;
+
+    // the arena of the children, shared with the containers taken from it
+    MCUJSONArena * arena;
+    bool arena_owner;
+    bool in_arena;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Writes the same text as MCUJSON::ToString() without building the tree,
+// for the documents that are only sent: status pages, room and address book events.
+class MCUJSONWriter
+{
+  public:
+    MCUJSONWriter(std::string &str, bool print_keys = true);
+
+    MCUJSONWriter & BeginArray(const std::string &key = "");
+    MCUJSONWriter & BeginObject(const std::string &key = "");
+    MCUJSONWriter & End();
+
+    MCUJSONWriter & Null(const std::string &key = "");
+    MCUJSONWriter & Insert(const std::string &key, bool value);
+    MCUJSONWriter & Insert(bool value);
+    MCUJSONWriter & Insert(const std::string &key, int value);
+    MCUJSONWriter & Insert(int value);
+    MCUJSONWriter & Insert(const std::string &key, unsigned int value);
+    MCUJSONWriter & Insert(unsigned int value);
+    MCUJSONWriter & Insert(const std::string &key, long value);
+    MCUJSONWriter & Insert(long value);
+    MCUJSONWriter & Insert(const std::string &key, unsigned long value);
+    MCUJSONWriter & Insert(unsigned long value);
+    MCUJSONWriter & Insert(const std::string &key, long long value);
+    MCUJSONWriter & Insert(long long value);
+    MCUJSONWriter & Insert(const std::string &key, double value);
+    MCUJSONWriter & Insert(double value);
+    MCUJSONWriter & Insert(const std::string &key, const char *value);
+    MCUJSONWriter & Insert(const char *value);
+    MCUJSONWriter & Insert(const std::string &key, const std::string &value);
+    MCUJSONWriter & Insert(const std::string &value);
+    MCUJSONWriter & Insert(const std::string &key, const PString &value);
+    MCUJSONWriter & Insert(const PString &value);
+
+    std::string & GetString()
+    { return str; }
+
+  protected:
+    void Key(const std::string &key);
+
+    std::string &str;
+    bool print_keys;
+    // closing brackets of the open arrays and objects
+    std::string stack;
+    // an element was written at the current level
+    bool separator;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -211,7 +211,9 @@ class MCUSharedList
     template<class _T_list, class _T_obj> friend class MCUSharedListSharedIterator;
 
   public:
-    MCUSharedList(long init_size = list_size);
+    // indexed - поиск по id и имени через индекс вместо перебора списка,
+    // для больших списков, индекс изменяется вместе с Insert/Erase
+    MCUSharedList(long init_size = list_size, bool indexed = false);
     ~MCUSharedList();
 
     // В новом итераторе объект захвачен
@@ -282,6 +284,11 @@ class MCUSharedList
     bool EraseInternal(long index);
     void UpdatePushbackIndex(long new_index);
 
+    typedef std::map<long, long> IdIndex;
+    typedef std::multimap<std::string, long> NameIndex;
+    void IndexInsert(long index);
+    void IndexErase(long index);
+
     const long size;
     long volatile current_size;
     long volatile id_counter;
@@ -297,13 +304,18 @@ class MCUSharedList
     long * volatile captures;
     sync_bool * volatile locks;
     const shared_iterator iterator_end;
+
+    const bool indexed;
+    IdIndex idIndex;
+    NameIndex nameIndex;
+    PMutex indexMutex;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 template <class T_obj, long list_size>
-MCUSharedList<T_obj, list_size>::MCUSharedList(long _size)
-  : size(_size), current_size(0), id_counter(0), pushback_index(0)
+MCUSharedList<T_obj, list_size>::MCUSharedList(long _size, bool _indexed)
+  : size(_size), current_size(0), id_counter(0), pushback_index(0), indexed(_indexed)
 {
   states = new sync_bool [size];
   states_end = states + size;
@@ -393,6 +405,7 @@ bool MCUSharedList<T_obj, list_size>::Insert(long index, T_obj * obj, long id, c
         else
           names[index] = new std::string(name);
       }
+      IndexInsert(index);
       // разрешить получение объекта
       states[index] = true;
       sync_increment(&current_size);
@@ -495,8 +508,10 @@ bool MCUSharedList<T_obj, list_size>::EraseInternal(long index)
     // запретить получение объекта
     states[index] = false;
     sync_decrement(&current_size);
-    // ждать освобождения объекта
+    // ждать освобождения объекта,
+    // Release(id) держателей находит индекс до удаления из idIndex
     ReleaseWait(index, 1);
+    IndexErase(index);
     // запись объекта
     ids[index] = LONG_MAX;
     if(names[index])
@@ -539,6 +554,23 @@ void MCUSharedList<T_obj, list_size>::ReleaseWait(long index, long threshold)
 template <class T_obj, long list_size>
 void MCUSharedList<T_obj, list_size>::Release(long id)
 {
+  if(indexed)
+  {
+    long index = LONG_MAX;
+    {
+      PWaitAndSignal m(indexMutex);
+      IdIndex::iterator it = idIndex.find(id);
+      if(it != idIndex.end())
+        index = it->second;
+    }
+    // объект захвачен, id не может измениться
+    if(index != LONG_MAX && ids[index] == id)
+    {
+      ReleaseInternal(index);
+      return;
+    }
+    // нет в индексе, поиск как без индекса
+  }
   long *it = find(ids, ids_end, id);
   if(it != ids_end)
   {
@@ -590,9 +622,64 @@ void MCUSharedList<T_obj, list_size>::CaptureInternal(long index)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+template <class T_obj, long list_size>
+void MCUSharedList<T_obj, list_size>::IndexInsert(long index)
+{
+  if(!indexed)
+    return;
+  PWaitAndSignal m(indexMutex);
+  idIndex[ids[index]] = index;
+  if(names[index] && !names[index]->empty())
+    nameIndex.insert(NameIndex::value_type(*names[index], index));
+}
+
+template <class T_obj, long list_size>
+void MCUSharedList<T_obj, list_size>::IndexErase(long index)
+{
+  if(!indexed)
+    return;
+  PWaitAndSignal m(indexMutex);
+  IdIndex::iterator it = idIndex.find(ids[index]);
+  if(it != idIndex.end() && it->second == index)
+    idIndex.erase(it);
+  if(names[index] && !names[index]->empty())
+  {
+    std::pair<NameIndex::iterator, NameIndex::iterator> range = nameIndex.equal_range(*names[index]);
+    for(NameIndex::iterator r = range.first; r != range.second; ++r)
+    {
+      if(r->second == index)
+      {
+        nameIndex.erase(r);
+        break;
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 template <class T_obj, long list_size>
 long MCUSharedList<T_obj, list_size>::GetIndex(const long id)
 {
+  if(indexed)
+  {
+    long index = LONG_MAX;
+    {
+      PWaitAndSignal m(indexMutex);
+      IdIndex::iterator it = idIndex.find(id);
+      if(it != idIndex.end())
+        index = it->second;
+    }
+    if(index == LONG_MAX)
+      return LONG_MAX;
+    CaptureInternal(index);
+    // повторная проверка после захвата
+    if(ids[index] == id && states[index] == true)
+      return index;
+    // освободить если нет объекта
+    ReleaseInternal(index);
+    return LONG_MAX;
+  }
   long *it = find(ids, ids_end, id);
   if(it != ids_end)
   {
@@ -620,6 +707,22 @@ struct string_equal_pointers
 template <class T_obj, long list_size>
 long MCUSharedList<T_obj, list_size>::GetIndex(const std::string &name)
 {
+  if(indexed)
+  {
+    PWaitAndSignal m(indexMutex);
+    std::pair<NameIndex::iterator, NameIndex::iterator> range = nameIndex.equal_range(name);
+    for(NameIndex::iterator r = range.first; r != range.second; ++r)
+    {
+      long index = r->second;
+      CaptureInternal(index);
+      // повторная проверка после захвата
+      if(names[index] && *names[index] == name && states[index] == true)
+        return index;
+      // освободить если нет объекта
+      ReleaseInternal(index);
+    }
+    return LONG_MAX;
+  }
   std::string **it = find_if(names, names_end, string_equal_pointers(&name));
   if(it != names_end)
   {
@@ -769,6 +872,9 @@ class MCUQueue
       return NULL;
     }
 
+    long GetSize()
+    { return list.GetSize(); }
+
   protected:
     typedef MCUSharedList<T_obj> MCUQueueList;
     MCUQueueList list;
@@ -876,6 +982,7 @@ typedef MCUSharedList<AbookAccount> MCUAbookList;
 
 typedef MCUSharedList<MCUListener, 64> MCUListenerList;
 typedef MCUSharedList<MCUTelnetSession, 64> MCUTelnetSessionList;
+typedef MCUSharedList<MCURtspViewer, 2048> MCURtspViewerList;
 
 typedef MCUSharedList<VideoMixPosition, 256> MCUVMPList;
 typedef MCUSharedList<VideoFrameStore, 256> MCUFrameStoreList;
@@ -884,8 +991,6 @@ typedef MCUSharedList<MCUSubtitles, 256> MCUSubtitlesList;
 
 typedef MCUSharedList<CacheRTP, 256> MCUCacheRTPList;
 
-typedef MCUSharedList<MCUJSON> MCUJSONList;
-
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #endif // _MCU_UTILS_LIST_H
@@ -98,3 +98,439 @@ BOOL MCUURL::Parse(const PString & str)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MCUTraceStreamBuf : public streambuf
+{
+  public:
+    MCUTraceStreamBuf()
+      : spill(NULL), truncated(false)
+    { }
+
+    ~MCUTraceStreamBuf()
+    { free(spill); }
+
+    void Open(char * buffer, size_t size)
+    {
+      spill = NULL;
+      truncated = false;
+      setp(buffer, buffer + size - 1);
+    }
+
+    size_t GetLength() const
+    { return pptr() - pbase(); }
+
+    // the heap buffer of a record that outgrew its slot, the record takes it over
+    char * TakeSpill()
+    {
+      char * buffer = spill;
+      spill = NULL;
+      return buffer;
+    }
+
+    bool IsTruncated() const
+    { return truncated; }
+
+  protected:
+    // the record is full, the text moves to a heap buffer twice as large,
+    // past TRACE_RECORD_MAX_SIZE the rest is truncated
+    virtual int overflow(int c)
+    {
+      if(c == EOF)
+        return 0;
+      size_t length = pptr() - pbase();
+      size_t size = PMIN((size_t)(epptr() - pbase() + 1) * 2, (size_t)TRACE_RECORD_MAX_SIZE);
+      char * buffer = (length + 2 <= size) ? (char *)malloc(size) : NULL;
+      if(buffer == NULL)
+      {
+        truncated = true;
+        return c;
+      }
+      memcpy(buffer, pbase(), length);
+      free(spill);
+      spill = buffer;
+      setp(buffer, buffer + size - 1);
+      pbump((int)length);
+      *pptr() = (char)c;
+      pbump(1);
+      return c;
+    }
+
+    char * spill;
+    bool truncated;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct MCUTraceRecord
+{
+  uint64_t time; // usec from the process start
+  const char * file;
+  int line;
+  int level;
+  char text[TRACE_RECORD_SIZE];
+  // the text of a record longer than the slot, freed by the trace thread
+  char * spill;
+  bool truncated;
+
+  const char * GetText() const
+  { return spill ? spill : text; }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MCUTraceRing
+{
+  public:
+    MCUTraceRing()
+    {
+      head = 0;
+      tail = 0;
+      dropped = 0;
+      orphaned = false;
+      depth = 0;
+      pending = 0;
+      for(int i = 0; i < TRACE_NEST_DEPTH; i++)
+      {
+        strm[i] = new ostream(&sbuf[i]);
+        slot[i] = 0;
+      }
+    }
+
+    ~MCUTraceRing()
+    {
+      for(int i = 0; i < TRACE_NEST_DEPTH; i++)
+        delete strm[i];
+    }
+
+    MCUTraceRecord records[TRACE_RING_RECORDS];
+    volatile long head;    // written by the owner thread only
+    volatile long tail;    // written by the draining thread only
+    volatile long dropped; // written by the owner thread only
+    volatile bool orphaned;
+    // open records of the owner thread, the nested ones are written from the arguments
+    // of the outer one, all of them are published when the outer one ends
+    int depth;
+    long pending;
+    long slot[TRACE_NEST_DEPTH];
+    PString threadName;
+    MCUTraceStreamBuf sbuf[TRACE_NEST_DEPTH];
+    ostream * strm[TRACE_NEST_DEPTH];
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class MCUTraceThread : public PThread
+{
+  PCLASSINFO(MCUTraceThread, PThread);
+  public:
+    MCUTraceThread()
+      : PThread(10000, NoAutoDeleteThread, NormalPriority, "trace")
+    { Resume(); }
+
+    void Main()
+    { MCUTracer::ThreadMain(); }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct MCUTraceEntry
+{
+  MCUTraceRecord * record;
+  const MCUTraceRing * ring;
+};
+
+struct MCUTraceLine
+{
+  uint64_t time;
+  std::string text;
+};
+
+static PMutex traceRingsMutex;
+static std::vector<MCUTraceRing *> traceRings;
+static PMutex traceDrainMutex;
+static PMutex traceHistoryMutex;
+static std::deque<MCUTraceLine> traceHistory;
+static MCUTraceThread * traceThread = NULL;
+static volatile bool traceRunning = false;
+static bool traceStopped = false;
+static unsigned traceDroppedReported = 0;
+
+// the thread is gone, the ring is reused by a new thread after it is drained
+#ifdef _WIN32
+static VOID WINAPI OnTraceThreadExit(PVOID ring)
+#else
+static void OnTraceThreadExit(void * ring)
+#endif
+{
+  if(ring)
+    ((MCUTraceRing *)ring)->orphaned = true;
+}
+
+#ifdef _WIN32
+// the callback of a fiber local slot is called when the thread exits, as the pthread key destructor
+static DWORD traceRingKey = FlsAlloc(OnTraceThreadExit);
+#else
+static pthread_key_t traceRingKey;
+#endif
+
+static inline long TraceLoad(volatile long * value)
+{
+  return sync_val_compare_and_swap(value, 0, 0);
+}
+
+static bool TraceEntryLess(const MCUTraceEntry & e1, const MCUTraceEntry & e2)
+{
+  return e1.record->time < e2.record->time;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MCUTraceRing * MCUTracer::GetRing()
+{
+#ifdef _WIN32
+  MCUTraceRing * ring = (MCUTraceRing *)FlsGetValue(traceRingKey);
+  if(ring)
+    return ring;
+#else
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  struct Key { static void Create() { pthread_key_create(&traceRingKey, OnTraceThreadExit); } };
+  pthread_once(&once, Key::Create);
+  MCUTraceRing * ring = (MCUTraceRing *)pthread_getspecific(traceRingKey);
+  if(ring)
+    return ring;
+#endif
+
+  PWaitAndSignal m(traceRingsMutex);
+
+  MCUTraceRing * newRing = NULL;
+  for(std::vector<MCUTraceRing *>::iterator it = traceRings.begin(); it != traceRings.end(); ++it)
+  {
+    if((*it)->orphaned && TraceLoad(&(*it)->tail) == (*it)->head)
+    {
+      newRing = *it;
+      newRing->orphaned = false;
+      break;
+    }
+  }
+  if(newRing == NULL)
+  {
+    newRing = new MCUTraceRing;
+    traceRings.push_back(newRing);
+  }
+
+  PThread * thread = PThread::Current();
+  newRing->threadName = (thread ? thread->GetThreadName() : PString("unknown"));
+
+#ifdef _WIN32
+  FlsSetValue(traceRingKey, newRing);
+#else
+  pthread_setspecific(traceRingKey, newRing);
+#endif
+
+  if(traceThread == NULL && !traceStopped)
+  {
+    traceRunning = true;
+    traceThread = new MCUTraceThread;
+  }
+
+  return newRing;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ostream * MCUTracer::Begin(int level, const char * file, int line)
+{
+  MCUTraceRing * ring = GetRing();
+
+  // a record from inside the arguments of another record takes the next slot
+  if(ring->depth >= TRACE_NEST_DEPTH || ring->head + ring->pending - TraceLoad(&ring->tail) >= TRACE_RING_RECORDS)
+  {
+    ring->dropped++;
+    return NULL;
+  }
+
+  long slot = ring->head + ring->pending;
+  MCUTraceRecord & record = ring->records[slot & (TRACE_RING_RECORDS-1)];
+  record.time = MCUTime::GetRealTimestampUsec() - PProcess::Current().GetStartTime().GetTimestamp();
+  record.file = file;
+  record.line = line;
+  record.level = level;
+  record.spill = NULL;
+  record.truncated = false;
+
+  int depth = ring->depth++;
+  ring->pending++;
+  ring->slot[depth] = slot;
+  ring->sbuf[depth].Open(record.text, sizeof(record.text));
+  ring->strm[depth]->clear();
+  return ring->strm[depth];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUTracer::End()
+{
+  MCUTraceRing * ring = GetRing();
+
+  int depth = --ring->depth;
+  MCUTraceRecord & record = ring->records[ring->slot[depth] & (TRACE_RING_RECORDS-1)];
+  MCUTraceStreamBuf & sbuf = ring->sbuf[depth];
+  size_t length = sbuf.GetLength();
+  record.spill = sbuf.TakeSpill();
+  if(record.spill)
+    record.spill[length] = 0;
+  else
+    record.text[length] = 0;
+  record.truncated = sbuf.IsTruncated();
+  if(depth != 0)
+    return;
+
+  // publish the record with the nested ones
+  sync_fetch_and_add(&ring->head, ring->pending);
+  ring->pending = 0;
+
+  if(!traceRunning)
+    Drain();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUTracer::Drain()
+{
+  PWaitAndSignal m(traceDrainMutex);
+
+  std::vector<MCUTraceRing *> rings;
+  {
+    PWaitAndSignal m(traceRingsMutex);
+    rings = traceRings;
+  }
+
+  std::vector<MCUTraceEntry> records;
+  std::vector<long> heads(rings.size());
+  unsigned dropped = 0;
+  for(size_t i = 0; i < rings.size(); i++)
+  {
+    MCUTraceRing * ring = rings[i];
+    heads[i] = TraceLoad(&ring->head);
+    for(long n = ring->tail; n != heads[i]; n++)
+    {
+      MCUTraceEntry entry = { &ring->records[n & (TRACE_RING_RECORDS-1)], ring };
+      records.push_back(entry);
+    }
+    dropped += ring->dropped;
+  }
+  std::stable_sort(records.begin(), records.end(), TraceEntryLess);
+
+  // the output is written without the history lock, Dump() does not wait for the console
+  std::vector<MCUTraceLine> lines(records.size());
+  for(size_t i = 0; i < records.size(); i++)
+  {
+    MCUTraceRecord & record = *records[i].record;
+    const char * truncated = record.truncated ? " [truncated]" : "";
+    // PTrace sees the trace thread, keep the name of the writer
+    if(record.level > 0)
+      PTrace::Begin(record.level, record.file, record.line) << "[" << records[i].ring->threadName << "] " << record.GetText() << truncated << PTrace::End;
+    cout << setw(8) << PTimeInterval((PInt64)(record.time/1000)) << " " << record.GetText() << truncated << "\n";
+    lines[i].time = record.time;
+    lines[i].text = record.GetText();
+    lines[i].text += truncated;
+    free(record.spill);
+    record.spill = NULL;
+  }
+
+  // the records are copied, return the slots to the writers
+  for(size_t i = 0; i < rings.size(); i++)
+    sync_fetch_and_add(&rings[i]->tail, heads[i] - rings[i]->tail);
+
+  if(dropped != traceDroppedReported)
+  {
+    cout << setw(8) << PTime() - PProcess::Current().GetStartTime() << " MCUTrace: " << dropped - traceDroppedReported << " records dropped, total " << dropped << "\n";
+    PTRACE(1, "MCUTrace\t" << dropped - traceDroppedReported << " records dropped, total " << dropped);
+    traceDroppedReported = dropped;
+  }
+  if(records.size())
+    cout.flush();
+  if(lines.empty())
+    return;
+
+  PWaitAndSignal h(traceHistoryMutex);
+  traceHistory.insert(traceHistory.end(), lines.begin(), lines.end());
+  uint64_t historyLimit = lines.back().time;
+  if(historyLimit > (uint64_t)TRACE_HISTORY_SEC*1000000)
+    historyLimit -= (uint64_t)TRACE_HISTORY_SEC*1000000;
+  else
+    historyLimit = 0;
+  while(traceHistory.size() && (traceHistory.front().time < historyLimit || traceHistory.size() > TRACE_HISTORY_RECORDS))
+    traceHistory.pop_front();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUTracer::ThreadMain()
+{
+  while(traceRunning)
+  {
+    Drain();
+    MCUTime::Sleep(TRACE_DRAIN_INTERVAL);
+  }
+  Drain();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MCUTracer::Stop()
+{
+  MCUTraceThread * thread;
+  {
+    PWaitAndSignal m(traceRingsMutex);
+    traceStopped = true;
+    traceRunning = false;
+    thread = traceThread;
+    traceThread = NULL;
+  }
+  if(thread)
+  {
+    thread->WaitForTermination();
+    delete thread;
+  }
+  Drain();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PString MCUTracer::Dump(unsigned seconds)
+{
+  uint64_t now = MCUTime::GetRealTimestampUsec() - PProcess::Current().GetStartTime().GetTimestamp();
+  uint64_t from = (now > (uint64_t)seconds*1000000 ? now - (uint64_t)seconds*1000000 : 0);
+
+  PStringStream s;
+  s << "Trace dump, last " << seconds << " seconds, " << GetDroppedRecords() << " records dropped\n";
+
+  PWaitAndSignal m(traceHistoryMutex);
+  std::deque<MCUTraceLine>::const_iterator it = traceHistory.end();
+  while(it != traceHistory.begin())
+  {
+    --it;
+    if(it->time < from)
+    {
+      ++it;
+      break;
+    }
+  }
+  for(; it != traceHistory.end(); ++it)
+    s << setw(8) << PTimeInterval((PInt64)(it->time/1000)) << " " << it->text << "\n";
+  return s;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+unsigned MCUTracer::GetDroppedRecords()
+{
+  PWaitAndSignal m(traceRingsMutex);
+  unsigned dropped = 0;
+  for(std::vector<MCUTraceRing *>::iterator it = traceRings.begin(); it != traceRings.end(); ++it)
+    dropped += (*it)->dropped;
+  return dropped;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
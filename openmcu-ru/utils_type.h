@@ -54,6 +54,7 @@ class MCUSIP_RTP_UDP;
 class MCUSocket;
 class MCUListener;
 class MCUTelnetSession;
+class MCURtspViewer;
 class MCUJSON;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -98,6 +99,7 @@ inline bool sync_bool_compare_and_swap(volatile long *ptr, long oldval, long new
 #define sync_fetch_and_sub(value, subvalue) InterlockedExchangeAdd(value, subvalue*(-1))
 #define sync_increment(value) InterlockedIncrement(value)
 #define sync_decrement(value) InterlockedDecrement(value)
+#define sync_fetch_and_add64(value, addvalue) InterlockedExchangeAdd64(value, addvalue)
 #else
 #define sync_bool bool
 // returns the contents of *ptr before the operation
@@ -108,15 +110,18 @@ inline bool sync_bool_compare_and_swap(volatile long *ptr, long oldval, long new
 #define sync_fetch_and_sub(value, subvalue) __sync_fetch_and_sub(value, subvalue)
 #define sync_increment(value) __sync_fetch_and_add(value, 1)
 #define sync_decrement(value) __sync_fetch_and_sub(value, 1)
+#define sync_fetch_and_add64(value, addvalue) __sync_fetch_and_add(value, addvalue)
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// The record is formatted into the ring of the calling thread and written out
+// by the trace thread, see MCUTracer
 #define MCUTRACE(level, args) \
   if(PTrace::CanTrace(level)) \
   { \
-    if(level > 0) PTrace::Begin(level, __FILE__, __LINE__) << args << PTrace::End; \
-    cout << setw(8) << PTime() - PProcess::Current().GetStartTime() << " " << args << endl; \
+    ostream * mcu_trace_strm = MCUTracer::Begin(level, __FILE__, __LINE__); \
+    if(mcu_trace_strm) { *mcu_trace_strm << args; MCUTracer::End(); } \
   }
 
 #define MCUTRACE_IF(level, cond, args) \
@@ -318,16 +323,22 @@ class MCUDelay
     }
 
     void DelayUsec(uint32_t delay_usec)
+    {
+      uint32_t interval = NextIntervalUsec(delay_usec);
+      if(interval)
+        MCUTime::SleepUsec(interval);
+    }
+
+    // Advance by delay_usec, returns the time left to wait (the caller waits)
+    uint32_t NextIntervalUsec(uint32_t delay_usec)
     {
       delay_time += delay_usec;
       now = MCUTime::GetMonoTimestampUsec();
       if(now < delay_time)
-      {
-        uint32_t interval = (uint32_t)(delay_time - now);
-        MCUTime::SleepUsec(interval);
-      }
+        return (uint32_t)(delay_time - now);
       //else // restart
       //  delay_time = now;
+      return 0;
     }
 
     // Для канала чтения RTP, последний timestamp или перезапуск
@@ -353,6 +364,101 @@ class MCUDelay
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Output clock for video grabbers. The frame rate is rounded down to a rate class
+// dividing VIDEO_CLOCK_RATE and all grabbers of a class wake on the same ticks of the
+// monotonic clock. There is no composer thread: the first reader of a mixer at a tick
+// composes the damaged positions and the others copy the frame. Lower classes decimate
+// higher ones (15 fps ticks are every other 30 fps tick). A late grabber skips ticks,
+// no bursts. The statistics are the wake-up lateness of the grabber only, the latency
+// of the pictures through the mixer is the mcu_mixer_frame_latency_seconds metric.
+#define VIDEO_CLOCK_RATE 300
+
+class MCUVideoClock
+{
+  public:
+    MCUVideoClock()
+    {
+      SetFrameRate(25);
+    }
+
+    unsigned SetFrameRate(unsigned rate)
+    {
+      if(rate < 1)
+        rate = 1;
+      else if(rate > VIDEO_CLOCK_RATE)
+        rate = VIDEO_CLOCK_RATE;
+      // never faster than configured, the encoder gets no more frames than it asked for
+      while(VIDEO_CLOCK_RATE % rate)
+        rate--;
+      units = VIDEO_CLOCK_RATE / rate;
+      Restart();
+      return rate;
+    }
+
+    void Restart()
+    {
+      tick = 0;
+      ResetStatistics();
+    }
+
+    void ResetStatistics()
+    {
+      ticks = 0;
+      skipped = 0;
+      late_sum = 0;
+      late_max = 0;
+    }
+
+    // sleep until the next tick of the rate class
+    void WaitNextTick()
+    {
+      uint64_t now = MCUTime::GetMonoTimestampUsec();
+      uint64_t next = now * VIDEO_CLOCK_RATE / (units * 1000000ULL) + 1;
+      if(tick != 0 && next > tick + 1)
+        skipped += next - tick - 1;
+      if(next <= tick)
+        next = tick + 1;
+      tick = next;
+
+      uint64_t tick_time = tick * units * 1000000ULL / VIDEO_CLOCK_RATE;
+      if(now < tick_time)
+        MCUTime::SleepUsec((uint32_t)(tick_time - now));
+
+      now = MCUTime::GetMonoTimestampUsec();
+      uint64_t late = (now > tick_time ? now - tick_time : 0);
+      late_sum += late;
+      if(late > late_max)
+        late_max = late;
+      ticks++;
+    }
+
+    unsigned GetRate() const
+    { return VIDEO_CLOCK_RATE / units; }
+
+    uint64_t GetTicks() const
+    { return ticks; }
+
+    uint64_t GetSkippedTicks() const
+    { return skipped; }
+
+    // wake-up latency relative to the tick
+    uint64_t GetAverageLateUsec() const
+    { return ticks ? late_sum / ticks : 0; }
+
+    uint64_t GetMaxLateUsec() const
+    { return late_max; }
+
+  protected:
+    unsigned units; // clock units per tick
+    uint64_t tick;
+    uint64_t ticks;
+    uint64_t skipped;
+    uint64_t late_sum;
+    uint64_t late_max;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 class MCUReadWriteMutex : public PObject
 {
   public:
@@ -540,4 +646,45 @@ class MCUURL : public PURL
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Every thread writes MCUTRACE records into its own single-producer ring,
+// a single trace thread drains all rings to PTrace and stdout in time order.
+// A full ring drops the record and counts it, the caller never waits for I/O.
+// Records written from the arguments of another record take the next slots,
+// up to TRACE_NEST_DEPTH open records, and are published with the outer one.
+// The trace thread keeps the last TRACE_HISTORY_SEC seconds for Dump().
+// A record longer than its slot continues on the heap up to TRACE_RECORD_MAX_SIZE,
+// the text past it is cut and the record is marked as truncated.
+#define TRACE_RECORD_SIZE     256
+#define TRACE_RECORD_MAX_SIZE 65536
+#define TRACE_RING_RECORDS    256 // power of 2
+#define TRACE_NEST_DEPTH      4
+#define TRACE_DRAIN_INTERVAL  10  // ms
+#define TRACE_HISTORY_SEC     60
+#define TRACE_HISTORY_RECORDS 100000
+
+class MCUTraceRing;
+
+class MCUTracer
+{
+  public:
+    // stream of a new record of the calling thread, NULL if the record is dropped
+    static ostream * Begin(int level, const char * file, int line);
+    static void End();
+
+    // flush the rings and stop the trace thread, the records are written synchronously after it
+    static void Stop();
+
+    static PString Dump(unsigned seconds);
+    static unsigned GetDroppedRecords();
+
+  protected:
+    static MCUTraceRing * GetRing();
+    static void Drain();
+    static void ThreadMain();
+
+    friend class MCUTraceThread;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 #endif // _MCU_UTILS_TYPE_H
@@ -24,8 +24,12 @@ BOOL ft_subtitles=FALSE;
 #define FT_P_DISABLED    0x0020
 #define FT_P_SUBTITLES   0x0040
 int ft_error=FT_INITIAL_ERROR;
+MCUGlyphAtlas ft_atlas;
 #endif // #if USE_FREETYPE
 
+// source of VideoMixPosition::writeSerial, shared by all mixers
+static volatile long vmpWriteSerial = 1; // 0 = no picture
+
 ///////////////////////////////////////////////////////////////////////////////////////
 //
 //  declare a video capture (input) device for use with MCU
@@ -37,10 +41,23 @@ MCUPVideoInputDevice::MCUPVideoInputDevice(MCUH323Connection & _mcuConnection)
   SetColourFormat("YUV420P");
   channelNumber = 0; 
   grabCount = 0;
+  damage = new MCUVideoDamage;
   SetFrameRate(25);
 }
 
 
+MCUPVideoInputDevice::~MCUPVideoInputDevice()
+{
+  delete damage;
+}
+
+
+const PString & MCUPVideoInputDevice::GetDamagedRegions() const
+{
+  return damage->regions;
+}
+
+
 BOOL MCUPVideoInputDevice::Open(const PString & devName, BOOL /*startImmediate*/)
 {
   //file.SetWidth(frameWidth);
@@ -125,6 +142,7 @@ BOOL MCUPVideoInputDevice::SetFrameRate(unsigned rate)
   else if (rate > 999)
     rate = 999;
 
+  grabClock.SetFrameRate(rate);
   return PVideoDevice::SetFrameRate(rate);
 }
 
@@ -163,7 +181,14 @@ PINDEX MCUPVideoInputDevice::GetMaxFrameBytes()
 
 BOOL MCUPVideoInputDevice::GetFrameData(BYTE * buffer, PINDEX * bytesReturned)
 {    
-  grabDelay.Delay(1000/GetFrameRate());
+  grabClock.WaitNextTick();
+  if(grabClock.GetTicks() >= grabClock.GetRate() * 60)
+  {
+    MCUTRACE(4, "MCUPVideoInputDevice\t" << deviceName << " clock " << grabClock.GetRate() << " fps (requested " << GetFrameRate() << ")"
+                << ", wake-up late avg " << grabClock.GetAverageLateUsec() << " max " << grabClock.GetMaxLateUsec() << " us"
+                << ", skipped " << grabClock.GetSkippedTicks() << " of " << grabClock.GetTicks() << " ticks");
+    grabClock.ResetStatistics();
+  }
   return GetFrameDataNoDelay(buffer, bytesReturned);
 }
 
@@ -172,7 +197,7 @@ BOOL MCUPVideoInputDevice::GetFrameDataNoDelay(BYTE *destFrame, PINDEX * bytesRe
 {
   grabCount++;
 
-  if (!mcuConnection.OnOutgoingVideo(destFrame, frameWidth, frameHeight, *bytesReturned))
+  if (!mcuConnection.OnOutgoingVideo(destFrame, frameWidth, frameHeight, *bytesReturned, damage))
     return FALSE;
 
   if (converter != NULL) {
@@ -254,7 +279,19 @@ BOOL MCUPVideoOutputDevice::SetFrameData(unsigned x, unsigned y,
     return FALSE;
   }
 
-  return mcuConnection.OnIncomingVideo(data, width, height);
+  return mcuConnection.OnIncomingVideo(MCUPlanesYUV(data, width, height), width, height);
+}
+
+
+BOOL MCUPVideoOutputDevice::SetFramePlanes(unsigned width, unsigned height, const MCUPlanesYUV & planes)
+{
+  if (width != frameWidth || height != frameHeight)
+  {
+    PTRACE(1, "OpenMCU only supports full frame writes");
+    return FALSE;
+  }
+
+  return mcuConnection.OnIncomingVideo(planes, width, height);
 }
 
 
@@ -306,6 +343,10 @@ VideoFrameStore::VideoFrameStore(int _w, int _h)
   else
     FillYUVFrame(bg_frame.GetPointer(), 0, 0, 0, width, height);
 
+  mixed_frame.SetSize(frame_size);
+  mixed_layout = -1;
+  memset(mixed_serial, 0, sizeof(mixed_serial));
+
   logo_frame.SetSize(frame_size);
   unsigned logo_width, logo_height;
   void *logo = OpenMCU::Current().GetLogoFramePointer(logo_width, logo_height);
@@ -337,6 +378,8 @@ VideoMixPosition::VideoMixPosition(ConferenceMemberId _id)
   offline = FALSE; //dont show offline banner for 1st time
   lastWrite = 0;
   vmpbuf_index = -1;
+  writeSerial = 0;
+  writeTime = 0;
   shows_logo = FALSE;
 }
 
@@ -436,32 +479,182 @@ void InitializeSubtitles()
   PTRACE_IF(1,ft_error,"FreeType\tCould not load truetype font: " << OpenMCU::vmcfg.fontfile);
 }
 
+MCUGlyphAtlas::MCUGlyphAtlas()
+  : useCounter(0)
+{
+}
+
+MCUGlyphAtlas::~MCUGlyphAtlas()
+{
+  for(GlyphMapType::iterator it = glyphMap.begin(); it != glyphMap.end(); ++it)
+  {
+    delete [] it->second->b;
+    delete it->second;
+  }
+}
+
+const MCUGlyph * MCUGlyphAtlas::GetGlyph(unsigned size, unsigned c)
+{
+  uint64_t key = ((uint64_t)size << 32) | c;
+  {
+    PWaitAndSignal m(mutex);
+    GlyphMapType::iterator it = glyphMap.find(key);
+    if(it != glyphMap.end())
+    {
+      it->second->refs++;
+      it->second->lastUse = ++useCounter;
+      return it->second;
+    }
+  }
+
+  // rendered without the atlas mutex, the hits of the other labels do not wait for FreeType
+  MCUGlyph * glyph;
+  {
+    PWaitAndSignal mf(ft_mutex);
+    if(ft_error) return NULL;
+    if((ft_error = FT_Set_Pixel_Sizes(ft_face,0,size))) return NULL;
+    FT_UInt index = FT_Get_Char_Index(ft_face, c);
+    if((ft_error = FT_Load_Glyph(ft_face, index, FT_LOAD_RENDER))) return NULL;
+
+    FT_GlyphSlot ft_slot = ft_face->glyph;
+    glyph = new MCUGlyph;
+    glyph->index   = index;
+    glyph->l       = ft_slot->bitmap_left;
+    glyph->t       = ft_slot->bitmap_top;
+    glyph->w       = ft_slot->bitmap.width;
+    glyph->h       = ft_slot->bitmap.rows;
+    glyph->advance = ft_slot->advance.x>>6;
+    size_t bmpSize = glyph->w * glyph->h;
+    glyph->b       = new BYTE[bmpSize+1];
+    memcpy(glyph->b, ft_slot->bitmap.buffer, bmpSize);
+    glyph->refs    = 1;
+  }
+
+  PWaitAndSignal m(mutex);
+  std::pair<GlyphMapType::iterator, bool> res = glyphMap.insert(GlyphMapType::value_type(key, glyph));
+  if(!res.second)
+  {
+    // rendered by another thread meanwhile
+    delete [] glyph->b;
+    delete glyph;
+    res.first->second->refs++;
+    res.first->second->lastUse = ++useCounter;
+    return res.first->second;
+  }
+  glyph->lastUse = ++useCounter;
+  PTRACE(6,"FreeType\tGlyph " << c << " size " << size << " added to atlas, " << glyphMap.size() << " total");
+  if(glyphMap.size() > FT_ATLAS_MAX_GLYPHS)
+    Evict();
+  return glyph;
+}
+
+void MCUGlyphAtlas::ReleaseGlyph(const MCUGlyph * glyph)
+{
+  PWaitAndSignal m(mutex);
+  ((MCUGlyph *)glyph)->refs--;
+}
+
+void MCUGlyphAtlas::Evict()
+{
+  // called under the mutex: drop the least recently used unreferenced glyphs down
+  // to 3/4 of the limit, so the scan runs once per FT_ATLAS_MAX_GLYPHS/4 misses
+  std::vector<std::pair<unsigned, uint64_t> > idle;
+  for(GlyphMapType::iterator it = glyphMap.begin(); it != glyphMap.end(); ++it)
+    if(it->second->refs == 0)
+      idle.push_back(std::make_pair(useCounter - it->second->lastUse, it->first));
+
+  size_t target = FT_ATLAS_MAX_GLYPHS - FT_ATLAS_MAX_GLYPHS/4;
+  size_t count = std::min(idle.size(), glyphMap.size() - target);
+  if(count == 0)
+    return;
+  // oldest first (largest age), the age is wrap-safe for the unsigned counter
+  std::nth_element(idle.begin(), idle.begin() + (count - 1), idle.end(), std::greater<std::pair<unsigned, uint64_t> >());
+  for(size_t i = 0; i < count; ++i)
+  {
+    GlyphMapType::iterator it = glyphMap.find(idle[i].second);
+    delete [] it->second->b;
+    delete it->second;
+    glyphMap.erase(it);
+  }
+  PTRACE(5,"FreeType\tGlyph atlas: " << count << " glyphs evicted, " << glyphMap.size() << " left");
+}
+
+int MCUGlyphAtlas::GetKerning(unsigned size, unsigned left, unsigned right)
+{
+  if(!ft_use_kerning || !left || !right) return 0;
+  uint64_t key = ((uint64_t)size << 40) | ((uint64_t)(left & 0xfffff) << 20) | (right & 0xfffff);
+  {
+    PWaitAndSignal m(mutex);
+    KerningMapType::iterator it = kerningMap.find(key);
+    if(it != kerningMap.end())
+      return it->second;
+  }
+
+  FT_Vector delta;
+  delta.x = 0;
+  {
+    PWaitAndSignal mf(ft_mutex);
+    if(FT_Set_Pixel_Sizes(ft_face,0,size) == 0)
+      FT_Get_Kerning(ft_face, left, right, FT_KERNING_DEFAULT, &delta);
+  }
+
+  PWaitAndSignal m(mutex);
+  if(kerningMap.size() >= FT_ATLAS_MAX_KERNING)
+    kerningMap.clear(); // cheap to recompute, no LRU bookkeeping for plain ints
+  kerningMap.insert(KerningMapType::value_type(key, (int)(delta.x>>6)));
+  return delta.x>>6;
+}
+
 void SubtitlesDropShadow(void * s, unsigned w, unsigned h, unsigned l, unsigned t, unsigned r, unsigned b)
 {
+  // Every glyph pixel (>50) marks empty pixels in [x-l,x+r]x[y-t,y+b] with 1.
+  // Done as a separable dilation with running window counts, rows first, then columns.
+  if(w == 0 || h == 0)
+    return;
+  BYTE * p = (BYTE *)s;
+  MCUBuffer maskBuffer(w*h);
+  MCUBuffer countBuffer(w*sizeof(int));
+  BYTE * mask = maskBuffer.GetPointer();
+  int * count = (int *)countBuffer.GetPointer();
   int x, y;
-  for (y=0; y<(int)h; y++)
+
+  // horizontal: target x0 is covered by glyph pixels in [x0-r,x0+l]
+  for(y=0; y<(int)h; y++)
   {
-    long ob=y*w;
+    BYTE * row = p + y*w;
+    BYTE * mrow = mask + y*w;
+    int n = 0;
+    for(x=0; x<=(int)l && x<(int)w; x++)
+      if(row[x]>50) n++;
     for(x=0; x<(int)w; x++)
     {
-      BYTE c=*((BYTE*)s+ob+x);
-      if(c>50)
-      {
-        int x0, y0;
-        for (y0=(int)(y-t); y0<=(int)(y+b); y0++)
-        {
-          if((y0<0)||(y0>=(int)h)) continue;
-          long ob0=y0*w;
-          for(x0=x-l; x0<=(int)(x+r); x0++)
-          {
-            if((x0<0)||(x0>=(int)w)) continue;
-            BYTE c0=*((BYTE*)s+ob0+x0);
-            if(c0==0) *((BYTE*)s+ob0+x0)=1;
-          }
-        }
-      }
+      mrow[x] = (n != 0);
+      int xin = x+(int)l+1;
+      int xout = x-(int)r;
+      if(xin<(int)w && row[xin]>50) n++;
+      if(xout>=0 && row[xout]>50) n--;
     }
   }
+
+  // vertical: target y0 is covered by masked rows in [y0-b,y0+t]
+  memset(count, 0, w*sizeof(int));
+  for(y=0; y<=(int)t && y<(int)h; y++)
+    for(x=0; x<(int)w; x++)
+      count[x] += mask[y*w+x];
+  for(y=0; y<(int)h; y++)
+  {
+    BYTE * row = p + y*w;
+    for(x=0; x<(int)w; x++)
+      if(count[x] && row[x]==0) row[x]=1;
+    int yin = y+(int)t+1;
+    int yout = y-(int)b;
+    if(yin<(int)h)
+      for(x=0; x<(int)w; x++)
+        count[x] += mask[yin*w+x];
+    if(yout>=0)
+      for(x=0; x<(int)w; x++)
+        count[x] -= mask[yout*w+x];
+  }
 }
 
 MCUSubtitles * MCURenderSubtitles(VideoMixPosition & vmp, unsigned fw, unsigned fh, unsigned ft_properties, unsigned layout)
@@ -509,14 +702,10 @@ MCUSubtitles * MCURenderSubtitles(VideoMixPosition & vmp, unsigned fw, unsigned
   unsigned w = (unsigned)wi;
   unsigned h = (unsigned)hi;
 
-  PWaitAndSignal m(ft_mutex);
-
-  if((ft_error = FT_Set_Pixel_Sizes(ft_face,0,fontsizepix))) return st;
-
   PINDEX len = st->text.GetLength();
   if(len==0) return st;
 
-  struct MyBMP{ PBYTEArray *bmp; int l, t, w, h, x; };
+  struct MyBMP{ const MCUGlyph *g; int x; };
   MyBMP *bmps=NULL;
   PINDEX slotCounter=0;
 
@@ -532,40 +721,27 @@ MCUSubtitles * MCURenderSubtitles(VideoMixPosition & vmp, unsigned fw, unsigned
     else if(((c&240)==224)&&(i+2<len)){/* 1110__ 10__ 10__ */ c = ((c&15)<<12) + ((c2&63)<<6) + ((BYTE)st->text[i+2]&63); i+=2; }
     else if(((c&248)==240)&&(i+3<len)){/* 11110__ 10__ 10__ 10__ */ c = ((c&7)<<18) + ((c2&63)<<12) + (((unsigned)((BYTE)st->text[i+2]&63))<<6) + ((BYTE)st->text[i+3]&63); i+=3; }
 
-    bmps = (MyBMP*)realloc((void *)bmps, (slotCounter + 1) * sizeof(MyBMP));
-    FT_GlyphSlot ft_slot = ft_face->glyph;
-    ft_glyph_index = FT_Get_Char_Index(ft_face, c);
-
-    if(ft_use_kerning && ft_previous && ft_glyph_index)
-    {
-      FT_Vector delta;
-      FT_Get_Kerning(ft_face, ft_previous, ft_glyph_index, FT_KERNING_DEFAULT, &delta);
-      pen_x += delta.x>>6;
-    }
+    const MCUGlyph *glyph = ft_atlas.GetGlyph(fontsizepix, c);
+    if(glyph == NULL) break;
 
-    if( (ft_error = FT_Load_Glyph(ft_face, ft_glyph_index, FT_LOAD_RENDER)) ) break;
+    pen_x += ft_atlas.GetKerning(fontsizepix, ft_previous, glyph->index);
 
-    MyBMP & bmp = bmps[slotCounter];
-    if(pen_x + (ft_slot->advance.x>>6) >= w)
+    if(pen_x + glyph->advance >= w)
     { // horizontal overflow: make new line
       if(pen_x_max < pen_x) pen_x_max = pen_x; // store max. h. pos in pen_x_max
       pen_x = 0; // CR
       pen_y += fontsizepix+1; // LF
-      if(pen_y + fontsizepix+1 >= h) break; // vertical overflow: no more place, stopping
+      if(pen_y + fontsizepix+1 >= h) { ft_atlas.ReleaseGlyph(glyph); break; } // vertical overflow: no more place, stopping
     }
 
+    bmps = (MyBMP*)realloc((void *)bmps, (slotCounter + 1) * sizeof(MyBMP));
+    MyBMP & bmp = bmps[slotCounter];
     bmp.x          = pen_x;
-    bmp.l          = ft_slot->bitmap_left;
-    bmp.t          = ft_slot->bitmap_top;
-    bmp.w          = (&ft_slot->bitmap)->width;
-    bmp.h          = (&ft_slot->bitmap)->rows;
-    if(bmp.h>(int)hMax) hMax=(unsigned)bmp.h;
-    size_t bmpSize = bmp.w * bmp.h;
-    bmp.bmp        = new PBYTEArray(bmpSize);
-    memcpy(bmp.bmp->GetPointer(bmpSize), (&ft_slot->bitmap)->buffer, bmpSize);
-
-    pen_x += ft_slot->advance.x>>6;
-    ft_previous = ft_glyph_index;
+    bmp.g          = glyph;
+    if(glyph->h>(int)hMax) hMax=(unsigned)glyph->h;
+
+    pen_x += glyph->advance;
+    ft_previous = glyph->index;
     slotCounter++;
   }
 
@@ -597,27 +773,25 @@ MCUSubtitles * MCURenderSubtitles(VideoMixPosition & vmp, unsigned fw, unsigned
     for(PINDEX i=0;i<slotCounter;i++)
     {
       if(i>0) if(bmps[i].x < bmps[i-1].x) pen_y+=(fontsizepix+1); //lf
-//      int y=pen_y+fontsizepix-bmps[i].t-1;
-      int y=pen_y+fontsizepix-bmps[i].t;
-      int h=bmps[i].h;
+//      int y=pen_y+fontsizepix-bmps[i].g->t-1;
+      int y=pen_y+fontsizepix-bmps[i].g->t;
+      int h=bmps[i].g->h;
       if((int)(y+h) > (int)(lh+(bb>>1))) h=fontsizepix+1+(bb>>1)-y; //allow to use 1/2 of bottom border
 
- int x = bmps[i].l + bmps[i].x + bl;
+ int x = bmps[i].g->l + bmps[i].x + bl;
  if(x < 0 || y < 0) continue;     //  
- if(x + bmps[i].w > (int)lw) continue; //   ,    ???
+ if(x + bmps[i].g->w > (int)lw) continue; //   ,    ???
 
-      CopyGrayscaleIntoFrame( bmps[i].bmp->GetPointer(), st->b,
-       bmps[i].l + bmps[i].x + bl, y,
-       bmps[i].w, h, lw, lh );
+      CopyGrayscaleIntoFrame( bmps[i].g->b, st->b,
+       bmps[i].g->l + bmps[i].x + bl, y,
+       bmps[i].g->w, h, lw, lh );
     }
 
     if(ft_properties & FT_P_SUBTITLES) SubtitlesDropShadow(st->b, lw, lh, dsl, dst, dsr, dsb);
   }
 
-  for(PINDEX i=slotCounter-1;i>=0;i--)
-  {
-    delete bmps[i].bmp;
-  }
+  for(PINDEX i=0;i<slotCounter;i++)
+    ft_atlas.ReleaseGlyph(bmps[i].g);
   free(bmps);
 
   return st;
@@ -647,13 +821,7 @@ void MCUVideoMixer::SplitLine(BYTE *d, unsigned x, unsigned y, unsigned w, unsig
   d = d + (y * fw) + x;
   for(unsigned i = 0; i < h; ++i)
   {
-    for(unsigned j = 0; j < w; ++j)
-    {
-      if(d[j] == 16)
-        d[j] = 63;
-      else if(d[j] != 63)
-        d[j] = 0;
-    }
+    SplitLineRow(d, w);
     d += fw;
   }
 }
@@ -689,7 +857,7 @@ MCUSimpleVideoMixer::~MCUSimpleVideoMixer()
 {
 }
 
-BOOL MCUSimpleVideoMixer::ReadFrame(ConferenceMember & member, void * buffer, int width, int height, PINDEX & amount)
+BOOL MCUSimpleVideoMixer::ReadFrame(ConferenceMember & member, void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage)
 {
   if(member.GetType() != MEMBER_TYPE_CACHE && PTime()-member.firstFrameSendTime < 3000)
   {
@@ -697,9 +865,14 @@ BOOL MCUSimpleVideoMixer::ReadFrame(ConferenceMember & member, void * buffer, in
     VideoFrameStore & fs = **fsit;
     if(fs.logo_frame.GetSize() != 0)
       memcpy(buffer, fs.logo_frame.GetPointer(), fs.frame_size);
+    if(damage != NULL)
+    {
+      damage->regions = "";
+      damage->layout = -1;
+    }
     return TRUE;
   }
-  return ReadMixedFrame(frameStores, buffer, width, height, amount);
+  return ReadMixedFrame(frameStores, buffer, width, height, amount, damage);
 }
 
 BOOL MCUSimpleVideoMixer::ReadMixedFrame(void * buffer, int width, int height, PINDEX & amount)
@@ -707,16 +880,51 @@ BOOL MCUSimpleVideoMixer::ReadMixedFrame(void * buffer, int width, int height, P
   return ReadMixedFrame(frameStores, buffer, width, height, amount);
 }
 
-BOOL MCUSimpleVideoMixer::ReadMixedFrame(VideoFrameStoreList & srcFrameStores, void * buffer, int width, int height, PINDEX & amount)
+long MCUSimpleVideoMixer::GetPositionSerial(int n)
+{
+  MCUVMPList::shared_iterator vmp_it = VMPFind(n);
+  if(vmp_it == vmpList.end())
+    return 0;
+  // read the serial before the buffer index, WriteSubFrame sets them in the opposite order
+  long serial = vmp_it->writeSerial;
+  if(vmp_it->vmpbuf_index < 0)
+    return 0;
+  return serial;
+}
+
+BOOL MCUSimpleVideoMixer::ReadMixedFrame(VideoFrameStoreList & srcFrameStores, void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage)
 {
   VideoFrameStoreList::shared_iterator fsit = srcFrameStores.GetFrameStore(width, height);
   VideoFrameStore & fs = **fsit;
 
+  PWaitAndSignal m(fs.mixed_mutex);
+  uint64_t composeStart = MCUTime::GetMonoTimestampUsec();
+
+  BYTE * mixed = fs.mixed_frame.GetPointer();
+  unsigned vidnum = OpenMCU::vmcfg.vmconf[specialLayout].splitcfg.vidnum;
+  if(vidnum > MAX_SUBFRAMES)
+    vidnum = MAX_SUBFRAMES;
+
+  // damage: a position is dirty when its content serial differs from the composed one.
+  // Full composition on layout change, when a position loses its picture (background
+  // shows through) or when a dirty position is split into blocks (overlapping layouts).
+  BOOL full = (fs.mixed_layout != specialLayout);
+  for(unsigned i = 0; i < vidnum && !full; i++)
+  {
+    long serial = GetPositionSerial((int)i);
+    if(serial != fs.mixed_serial[i] && (serial == 0 || OpenMCU::vmcfg.vmconf[specialLayout].vmpcfg[i].blks != 1))
+      full = TRUE;
+  }
+
   // background
-  if(fs.bg_frame.GetSize() != 0)
-    memcpy(buffer, fs.bg_frame.GetPointer(), fs.frame_size);
+  if(full)
+  {
+    if(fs.bg_frame.GetSize() != 0)
+      memcpy(mixed, fs.bg_frame.GetPointer(), fs.frame_size);
+    fs.mixed_layout = specialLayout;
+  }
 
-  for(unsigned i = 0; i < OpenMCU::vmcfg.vmconf[specialLayout].splitcfg.vidnum; i++)
+  for(unsigned i = 0; i < vidnum; i++)
   {
     VMPCfgOptions & vmpcfg = OpenMCU::vmcfg.vmconf[specialLayout].vmpcfg[i];
     int px = (float)vmpcfg.posx  *width/CIF4_WIDTH; // pixel x&y of vmp-->fs
@@ -725,7 +933,23 @@ BOOL MCUSimpleVideoMixer::ReadMixedFrame(VideoFrameStoreList & srcFrameStores, v
     int ph = (float)vmpcfg.height*height/CIF4_HEIGHT;
     if(pw<2 || ph<2) continue;
 
+    long serial = 0;
     MCUVMPList::shared_iterator vmp_it = VMPFind((int)i);
+    if(vmp_it != vmpList.end())
+      serial = vmp_it->writeSerial;
+
+    if(!full)
+    {
+      if(serial == fs.mixed_serial[i])
+        continue; // clean
+      if(vmpcfg.blks != 1)
+      { // changed since the check above, leave it to the next read
+        fs.mixed_layout = -1;
+        continue;
+      }
+    }
+
+    BOOL copied = FALSE;
     if(vmp_it != vmpList.end())
     {
       VideoMixPosition *vmp = *vmp_it;
@@ -738,13 +962,21 @@ BOOL MCUSimpleVideoMixer::ReadMixedFrame(VideoFrameStoreList & srcFrameStores, v
           if(vmpbuf->GetWidth() == pw && vmpbuf->GetHeight() == ph)
           {
             if(vmpcfg.blks == 1)
-              CopyRectIntoFrame(vmpbuf->GetPointer(), buffer, px, py, pw, ph, width, height);
+              CopyRectIntoFrame(vmpbuf->GetPointer(), mixed, px, py, pw, ph, width, height);
             else
               for(unsigned i = 0; i < vmpcfg.blks; i++)
-                CopyRFromRIntoR(vmpbuf->GetPointer(), buffer, px, py, pw, ph,
+                CopyRFromRIntoR(vmpbuf->GetPointer(), mixed, px, py, pw, ph,
                   AlignUp2(vmpcfg.blk[i].posx*width/CIF4_WIDTH), AlignUp2(vmpcfg.blk[i].posy*height/CIF4_HEIGHT),
                   AlignUp2(vmpcfg.blk[i].width*width/CIF4_WIDTH), AlignUp2(vmpcfg.blk[i].height*height/CIF4_HEIGHT),
                   width, height, pw, ph );
+            copied = TRUE;
+            // a new picture of the member: from its write into the mixer to the first frame composed with it,
+            // the wait for the tick of the output clock included
+            if(serial != fs.mixed_serial[i] && vmp->writeTime != 0)
+            {
+              uint64_t now = MCUTime::GetMonoTimestampUsec();
+              MCUMetrics::mixerFrameLatency.Observe(now > vmp->writeTime ? now - vmp->writeTime : 0);
+            }
           }
           else
             MCUTRACE(6, "VideoMixer: VMP read error0: n=" << vmp->n << " fs=" << width << "x" << height << " pos=" << pw << "x" << ph << " buf=" << vmpbuf->GetWidth() << "x" << vmpbuf->GetHeight());
@@ -752,36 +984,74 @@ BOOL MCUSimpleVideoMixer::ReadMixedFrame(VideoFrameStoreList & srcFrameStores, v
       }
     }
 
+    if(!copied)
+    {
+      if(!full && fs.bg_frame.GetSize() != 0)
+        CopyRectIntoRect(fs.bg_frame.GetPointer(), mixed, px, py, pw, ph, width, height);
+      serial = 0;
+    }
+    fs.mixed_serial[i] = serial;
+
     // grid
     if(OpenMCU::vmcfg.vmconf[specialLayout].vmpcfg[i].border)
     {
       if(px != 0)
-        SplitLineLeft((BYTE *)buffer, px, py, pw, ph, width, height);
+        SplitLineLeft(mixed, px, py, pw, ph, width, height);
       if(py != 0)
-        SplitLineTop((BYTE *)buffer, px, py, pw, ph, width, height);
+        SplitLineTop(mixed, px, py, pw, ph, width, height);
       //if(px+pw != width)
-        //SplitLineRight((BYTE *)buffer, px, py, pw, ph, width, height);
+        //SplitLineRight(mixed, px, py, pw, ph, width, height);
       //if(py+ph != height)
-        //SplitLineBottom((BYTE *)buffer, px, py, pw, ph, width, height);
+        //SplitLineBottom(mixed, px, py, pw, ph, width, height);
+    }
+  }
+
+  memcpy(buffer, mixed, fs.frame_size);
+
+  // the positions composed since the previous read of the reader, other readers
+  // of this size may have composed them
+  if(damage != NULL)
+  {
+    if(damage->width != width || damage->height != height || damage->layout != fs.mixed_layout)
+      damage->regions = "";
+    else
+    {
+      PStringStream regions;
+      for(unsigned i = 0; i < vidnum; i++)
+      {
+        if(fs.mixed_serial[i] == damage->serial[i])
+          continue;
+        VMPCfgOptions & vmpcfg = OpenMCU::vmcfg.vmconf[specialLayout].vmpcfg[i];
+        if(!regions.IsEmpty())
+          regions << ";";
+        regions << (int)((float)vmpcfg.posx*width/CIF4_WIDTH) << "," << (int)((float)vmpcfg.posy*height/CIF4_HEIGHT) << ","
+                << (int)((float)vmpcfg.width*width/CIF4_WIDTH) << "," << (int)((float)vmpcfg.height*height/CIF4_HEIGHT);
+      }
+      damage->regions = (regions.IsEmpty() ? PString("none") : PString(regions));
     }
+    damage->width = width;
+    damage->height = height;
+    damage->layout = fs.mixed_layout;
+    memcpy(damage->serial, fs.mixed_serial, sizeof(damage->serial));
   }
 
   fs.lastRead = time(NULL);
+  MCUMetrics::mixerCompose.Observe(MCUTime::GetMonoTimestampUsec() - composeStart);
   return TRUE;
 }
 
 
-BOOL MCUSimpleVideoMixer::WriteFrame(ConferenceMemberId id, const void * buffer, int width, int height)
+BOOL MCUSimpleVideoMixer::WriteFrame(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height)
 {
   MCUVMPList::shared_iterator it = VMPFind(id);
   if(it == vmpList.end())
     return FALSE;
   VideoMixPosition *vmp = *it;
   vmp->offline = FALSE;
-  return WriteSubFrame(*vmp, buffer, width, height, WSF_VMP_COMMON);
+  return WriteSubFrame(*vmp, planes, width, height, WSF_VMP_COMMON);
 }
 
-BOOL MCUSimpleVideoMixer::WriteSubFrame(VideoMixPosition & vmp, const void * buffer, int width, int height, int options)
+BOOL MCUSimpleVideoMixer::WriteSubFrame(VideoMixPosition & vmp, const MCUPlanesYUV & planes, int width, int height, int options)
 {
   VMPCfgOptions & vmpcfg=OpenMCU::vmcfg.vmconf[specialLayout].vmpcfg[vmp.n];
   time_t now = time(NULL);
@@ -816,7 +1086,7 @@ BOOL MCUSimpleVideoMixer::WriteSubFrame(VideoMixPosition & vmp, const void * buf
 
     if(pw==width && ph==height) //same size
     {
-      memcpy(vmpbuf->GetPointer(), buffer, pw*ph*3/2); //making copy for subtitles & border
+      CopyPlanesIntoFrame(planes, vmpbuf->GetPointer(), pw, ph); //making copy for subtitles & border
     }
     else if(src_aspect_ratio > dst_aspect_ratio+0.05)
     {
@@ -826,19 +1096,15 @@ BOOL MCUSimpleVideoMixer::WriteSubFrame(VideoMixPosition & vmp, const void * buf
       //          +---------+    +--+
       if(rule==0)
       {
-        int dstWidth = (float)ph*width/height; //bigger than we need
-        vmp.tmpbuf.SetFrameSize(dstWidth, ph);
-        ResizeYUV420P((const BYTE *)buffer, vmp.tmpbuf.GetPointer(), width, height, dstWidth, ph);
-        CopyRectFromFrame(vmp.tmpbuf.GetPointer(), vmpbuf->GetPointer(), (dstWidth-pw)/2, 0, pw, ph, dstWidth, ph);
+        int srcWidth = (int)((float)pw*height/ph) & ~1; //the middle of the source is scaled
+        ResizeYUV420P(MCUPlanesYUV(planes, ((width-srcWidth)/2) & ~1, 0), vmpbuf->GetPointer(), srcWidth, height, pw, ph);
       }
       else if(rule==1)
       {
         int dstHeight = (float)pw*height/width; //smaller than we need
-        vmp.tmpbuf.SetFrameSize(pw, dstHeight);
-        ResizeYUV420P((const BYTE *)buffer, vmp.tmpbuf.GetPointer(), width, height, pw, dstHeight);
         FillYUVRect(vmpbuf->GetPointer(),pw,ph,127,127,127, 0,0, pw,(ph-dstHeight)/2);
         FillYUVRect(vmpbuf->GetPointer(),pw,ph,127,127,127, 0,ph-(ph-dstHeight)/2, pw,(ph-dstHeight)/2);
-        CopyRectIntoFrame(vmp.tmpbuf.GetPointer(), vmpbuf->GetPointer(), 0, (ph-dstHeight)/2, pw, dstHeight, pw, ph);
+        ResizeYUV420P(planes, vmpbuf->GetPointer(), width, height, pw, dstHeight, 0, (ph-dstHeight)/2, pw, ph);
       }
     }
     else if(src_aspect_ratio < dst_aspect_ratio-0.05)
@@ -849,24 +1115,20 @@ BOOL MCUSimpleVideoMixer::WriteSubFrame(VideoMixPosition & vmp, const void * buf
       //                   +-+    +----+
       if(rule==0)
       {
-        int dstHeight = (float)pw*height/width; //bigger than we need
-        vmp.tmpbuf.SetFrameSize(pw, dstHeight);
-        ResizeYUV420P((const BYTE *)buffer, vmp.tmpbuf.GetPointer(), width, height, pw, dstHeight);
-        CopyRectFromFrame(vmp.tmpbuf.GetPointer(), vmpbuf->GetPointer(), 0, (dstHeight-ph)/2, pw, ph, pw, dstHeight);
+        int srcHeight = (int)((float)ph*width/pw) & ~1; //the middle of the source is scaled
+        ResizeYUV420P(MCUPlanesYUV(planes, 0, ((height-srcHeight)/2) & ~1), vmpbuf->GetPointer(), width, srcHeight, pw, ph);
       }
       else if(rule==1)
       {
         int dstWidth = (float)ph*width/height; //smaller than we need
-        vmp.tmpbuf.SetFrameSize(dstWidth, ph);
-        ResizeYUV420P((const BYTE *)buffer, vmp.tmpbuf.GetPointer(), width, height, dstWidth, ph);
         FillYUVRect(vmpbuf->GetPointer(),pw,ph,127,127,127, 0,0, (pw-dstWidth)/2, ph);
         FillYUVRect(vmpbuf->GetPointer(),pw,ph,127,127,127, pw-(pw-dstWidth)/2,0, (pw-dstWidth)/2,ph);
-        CopyRectIntoFrame(vmp.tmpbuf.GetPointer(), vmpbuf->GetPointer(), (pw-dstWidth)/2, 0, dstWidth, ph, pw, ph);
+        ResizeYUV420P(planes, vmpbuf->GetPointer(), width, height, dstWidth, ph, (pw-dstWidth)/2, 0, pw, ph);
       }
     }
     else
     { // fit. scale
-      ResizeYUV420P((const BYTE *)buffer, vmpbuf->GetPointer() , width, height, pw, ph);
+      ResizeYUV420P(planes, vmpbuf->GetPointer() , width, height, pw, ph);
     }
 
 #if USE_FREETYPE
@@ -879,6 +1141,8 @@ BOOL MCUSimpleVideoMixer::WriteSubFrame(VideoMixPosition & vmp, const void * buf
   }
 
   vmp.vmpbuf_index = vmpbuf_index;
+  vmp.writeTime = MCUTime::GetMonoTimestampUsec();
+  vmp.writeSerial = sync_increment(&vmpWriteSerial);
   return TRUE;
 }
 
@@ -994,7 +1258,7 @@ void MCUSimpleVideoMixer::Monitor(Conference *conference)
           vmp->shows_logo = TRUE;
           unsigned width, height;
           void *buffer = OpenMCU::Current().GetPreMediaFrame(width, height);
-          WriteSubFrame(*vmp, buffer, width, height, WSF_VMP_BORDER|WSF_VMP_FORCE_CUT);
+          WriteSubFrame(*vmp, MCUPlanesYUV(buffer, width, height), width, height, WSF_VMP_BORDER|WSF_VMP_FORCE_CUT);
         }
         else if(vmp->shows_logo)
         {
@@ -1059,7 +1323,7 @@ void MCUSimpleVideoMixer::WriteEmptyFrame(VideoMixPosition & vmp)
   void * buffer = OpenMCU::Current().GetEmptyFramePointer(width, height);
   if(width==16 && height==16) options=WSF_VMP_BORDER|WSF_VMP_FORCE_CUT;
   else options=WSF_VMP_BORDER;
-  if(buffer) WriteSubFrame(vmp, buffer, width, height, options);
+  if(buffer) WriteSubFrame(vmp, MCUPlanesYUV(buffer, width, height), width, height, options);
 }
 
 void MCUSimpleVideoMixer::WriteOfflineFrame(VideoMixPosition & vmp)
@@ -1069,7 +1333,7 @@ void MCUSimpleVideoMixer::WriteOfflineFrame(VideoMixPosition & vmp)
   void * buffer = OpenMCU::Current().GetOfflineFramePointer(width, height);
   if(width==16 && height==16) options=WSF_VMP_COMMON|WSF_VMP_FORCE_CUT;
   else options=WSF_VMP_COMMON;
-  if(buffer) WriteSubFrame(vmp, buffer, width, height, options);
+  if(buffer) WriteSubFrame(vmp, MCUPlanesYUV(buffer, width, height), width, height, options);
 }
 
 void MCUSimpleVideoMixer::WriteNoVideoFrame(VideoMixPosition & vmp)
@@ -1079,7 +1343,7 @@ void MCUSimpleVideoMixer::WriteNoVideoFrame(VideoMixPosition & vmp)
   void * buffer = OpenMCU::Current().GetNoVideoFramePointer(width, height);
   if(width==16 && height==16) options=WSF_VMP_SUBTITLES|WSF_VMP_BORDER|WSF_VMP_FORCE_CUT;
   else options=WSF_VMP_SUBTITLES|WSF_VMP_BORDER;
-  if(buffer) WriteSubFrame(vmp, buffer, width, height, options);
+  if(buffer) WriteSubFrame(vmp, MCUPlanesYUV(buffer, width, height), width, height, options);
 }
 
 void MCUSimpleVideoMixer::VMPTouch(VideoMixPosition & vmp)
@@ -1845,7 +2109,7 @@ void TestVideoMixer::RemoveVideoSource(ConferenceMemberId id, ConferenceMember &
     allocated = FALSE;
 }
 
-BOOL TestVideoMixer::WriteFrame(ConferenceMemberId id, const void * buffer, int width, int height)
+BOOL TestVideoMixer::WriteFrame(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height)
 {
   if(vmpList.GetSize() == 0) return FALSE;
 
@@ -1859,7 +2123,7 @@ BOOL TestVideoMixer::WriteFrame(ConferenceMemberId id, const void * buffer, int
   for(MCUVMPList::shared_iterator it = vmpList.begin(); it != vmpList.end(); ++it)
   {
     VideoMixPosition * vmp = *it;
-    WriteSubFrame(*vmp, buffer, width, height, WSF_VMP_COMMON);
+    WriteSubFrame(*vmp, planes, width, height, WSF_VMP_COMMON);
   }
 
   return TRUE;
@@ -1912,7 +2176,7 @@ BOOL EchoVideoMixer::AddVideoSource(ConferenceMemberId id, ConferenceMember & mb
   return TRUE;
 }
 
-BOOL EchoVideoMixer::WriteFrame(ConferenceMemberId id, const void * buffer, int width, int height)
+BOOL EchoVideoMixer::WriteFrame(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height)
 {
   if(specialLayout<0) return FALSE;
   MCUVMPList::shared_iterator it = vmpList.begin();
@@ -1921,7 +2185,7 @@ BOOL EchoVideoMixer::WriteFrame(ConferenceMemberId id, const void * buffer, int
   VideoMixPosition *vmp = *it;
   if(vmp->id != id)
     return FALSE;
-  WriteSubFrame(*vmp, buffer, width, height, WSF_VMP_COMMON);
+  WriteSubFrame(*vmp, planes, width, height, WSF_VMP_COMMON);
   return TRUE;
 }
 
@@ -17,6 +17,8 @@
 
 #define MAX_SUBFRAMES        100
 #define FRAMESTORE_TIMEOUT   60 /* s */
+#define FT_ATLAS_MAX_GLYPHS  2048 // least recently used unreferenced glyphs are dropped above it
+#define FT_ATLAS_MAX_KERNING 16384 // kerning pairs, the cache is cleared above it
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -27,6 +29,40 @@
     void* b;
     PString text;
   };
+
+  struct MCUGlyph
+  {
+    unsigned index;   // FreeType glyph index, for kerning
+    int l, t, w, h;   // bitmap left/top bearing and size
+    int advance;      // pixels
+    BYTE * b;
+    unsigned refs;    // renders holding the glyph, guarded by the atlas mutex
+    unsigned lastUse; // atlas use counter at the last lookup
+  };
+
+  // Process-wide cache of rendered glyphs keyed by (pixel size, code point).
+  // A miss is rendered under FreeType's lock (ft_mutex) only, the atlas mutex
+  // guards the maps. GetGlyph() references the glyph until ReleaseGlyph(), the
+  // atlas drops only unreferenced glyphs when it grows over FT_ATLAS_MAX_GLYPHS.
+  class MCUGlyphAtlas
+  {
+    public:
+      MCUGlyphAtlas();
+      ~MCUGlyphAtlas();
+      const MCUGlyph * GetGlyph(unsigned size, unsigned c);
+      void ReleaseGlyph(const MCUGlyph * glyph);
+      int GetKerning(unsigned size, unsigned left, unsigned right);
+
+    protected:
+      void Evict();
+
+      typedef std::map<uint64_t, MCUGlyph *> GlyphMapType;
+      typedef std::map<uint64_t, int> KerningMapType;
+      GlyphMapType glyphMap;
+      KerningMapType kerningMap;
+      unsigned useCounter;
+      PMutex mutex;
+  };
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -41,6 +77,31 @@ class VideoFrameStore
     time_t lastRead;
     MCUBuffer bg_frame;
     MCUBuffer logo_frame;
+
+    // last composed frame, shared by all readers of this size;
+    // only positions whose content serial changed are copied again
+    MCUBuffer mixed_frame;
+    int mixed_layout; // -1 = full composition needed
+    long mixed_serial[MAX_SUBFRAMES];
+    PMutex mixed_mutex;
+};
+
+// regions of the mixed frame changed since the previous read of one reader,
+// the positions composed since then
+class MCUVideoDamage
+{
+  public:
+    MCUVideoDamage()
+      : width(0), height(0), layout(-1)
+    { memset(serial, 0, sizeof(serial)); }
+
+    // value of PLUGINCODEC_OPTION_DAMAGED_REGIONS: "x,y,w,h;..." or "none", empty - the whole frame
+    PString regions;
+
+    int width;
+    int height;
+    int layout;
+    long serial[MAX_SUBFRAMES];
 };
 
 class VideoFrameStoreList {
@@ -195,7 +256,8 @@ class VideoMixPosition {
 
     MCUBufferYUVArrayList bufferList;
     int vmpbuf_index;
-    MCUBufferYUV tmpbuf;
+    volatile long writeSerial; // unique per WriteSubFrame, marks the tile as changed
+    volatile uint64_t writeTime; // monotonic usec of the last WriteSubFrame, for the frame latency
 
     void SetEndpointName(const PString & name)
     {
@@ -221,7 +283,6 @@ class MCUVideoMixer
     MCUVideoMixer()
     {
       conference = NULL;
-      jpegTime=0; jpegSize=0;
     }
 
     virtual ~MCUVideoMixer()
@@ -266,21 +327,21 @@ class MCUVideoMixer
       return vmpList.Insert(vmp, vmp->id);
     }
 
-    MCUJSON * VMPListScanJS() // returns associative javascript "{0:id1, 1:-1, 2:id2, ...}"
+    void VMPListScanJS(MCUJSONWriter & a) // writes associative javascript "{0:id1, 1:-1, 2:id2, ...},{0:type1, ...}"
     {
-      MCUJSON *r=new MCUJSON(MCUJSON::JSON_OBJECT);
-      MCUJSON *q=new MCUJSON(MCUJSON::JSON_OBJECT);
+      // one walk of the list, the types are kept for the second object and match the ids
+      std::vector<std::pair<int, int> > types;
+      a.BeginObject();
       for(MCUVMPList::shared_iterator it = vmpList.begin(); it != vmpList.end(); ++it)
       {
-        VideoMixPosition *vmp = *it;
-        const PString idx = PString(vmp->n);
-        r->Insert(idx, vmp->id);
-        q->Insert(idx, vmp->type);
+        a.Insert(PString(it->n), it->id);
+        types.push_back(std::make_pair((int)it->n, (int)it->type));
       }
-      MCUJSON* a=new MCUJSON(MCUJSON::JSON_ARRAY);
-      a->Insert(r);
-      a->Insert(q);
-      return a;
+      a.End();
+      a.BeginObject();
+      for(size_t i = 0; i < types.size(); i++)
+        a.Insert(PString(types[i].first), types[i].second);
+      a.End();
     }
 
     void VMPListClear()
@@ -314,9 +375,9 @@ class MCUVideoMixer
     }
 
     virtual MCUVideoMixer * Clone() const = 0;
-    virtual BOOL ReadFrame(ConferenceMember & mbr, void * buffer, int width, int height, PINDEX & amount) = 0;
-    virtual BOOL WriteFrame(ConferenceMemberId id, const void * buffer, int width, int height) = 0;
-    virtual BOOL WriteSubFrame(VideoMixPosition & vmp, const void * buffer, int width, int height, int options) = 0;
+    virtual BOOL ReadFrame(ConferenceMember & mbr, void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage = NULL) = 0;
+    virtual BOOL WriteFrame(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height) = 0;
+    virtual BOOL WriteSubFrame(VideoMixPosition & vmp, const MCUPlanesYUV & planes, int width, int height, int options) = 0;
 
     virtual PString GetFrameStoreMonitorList() = 0;
 
@@ -350,10 +411,6 @@ class MCUVideoMixer
     virtual VideoMixPosition * CreateVideoMixPosition(ConferenceMemberId _id)
     { return new VideoMixPosition(_id); }
 
-    PBYTEArray myjpeg;
-    PINDEX jpegSize;
-    unsigned long jpegTime;
-
     MCUVMPList vmpList;
     PMutex vmpListMutex;
 
@@ -388,12 +445,12 @@ class MCUSimpleVideoMixer : public MCUVideoMixer
 
     void Monitor(Conference *conference);
 
-    virtual BOOL ReadFrame(ConferenceMember &, void * buffer, int width, int height, PINDEX & amount);
-    virtual BOOL WriteFrame(ConferenceMemberId id, const void * buffer, int width, int height);
+    virtual BOOL ReadFrame(ConferenceMember &, void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage = NULL);
+    virtual BOOL WriteFrame(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height);
     virtual BOOL SetOffline(ConferenceMemberId id);
     virtual BOOL SetOnline(ConferenceMemberId id);
 
-    virtual BOOL WriteSubFrame(VideoMixPosition & vmp, const void * buffer, int width, int height, int options);
+    virtual BOOL WriteSubFrame(VideoMixPosition & vmp, const MCUPlanesYUV & planes, int width, int height, int options);
 
     virtual void Shuffle();
     virtual void Scroll(BOOL reverse);
@@ -446,7 +503,8 @@ class MCUSimpleVideoMixer : public MCUVideoMixer
 
   protected:
     virtual void ReallocatePositions();
-    BOOL ReadMixedFrame(VideoFrameStoreList & srcFrameStores, void * buffer, int width, int height, PINDEX & amount);
+    BOOL ReadMixedFrame(VideoFrameStoreList & srcFrameStores, void * buffer, int width, int height, PINDEX & amount, MCUVideoDamage * damage = NULL);
+    long GetPositionSerial(int n);
 
     VideoFrameStoreList frameStores;  // list of framestores for data
 
@@ -462,7 +520,7 @@ class TestVideoMixer : public MCUSimpleVideoMixer
   public:
     TestVideoMixer(unsigned frames);
     BOOL AddVideoSource(ConferenceMemberId id, ConferenceMember & mbr);
-    BOOL WriteFrame(ConferenceMemberId id, const void * buffer, int width, int height);
+    BOOL WriteFrame(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height);
     void RemoveVideoSource(ConferenceMemberId id, ConferenceMember & mbr);
     virtual void MyChangeLayout(unsigned newLayout);
     virtual void Shuffle() {};
@@ -493,7 +551,7 @@ class EchoVideoMixer : public MCUSimpleVideoMixer
   public:
     EchoVideoMixer();
     BOOL AddVideoSource(ConferenceMemberId id, ConferenceMember & mbr);
-    BOOL WriteFrame(ConferenceMemberId id, const void * buffer, int width, int height);
+    BOOL WriteFrame(ConferenceMemberId id, const MCUPlanesYUV & planes, int width, int height);
 };
 #endif
 
@@ -4,6 +4,328 @@
 
 #include "mcu.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define YUV_SSE2 1
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  define YUV_NEON 1
+#  include <arm_neon.h>
+#endif
+
+// AVX2 is built for its functions only and chosen at run time when the CPU has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  define YUV_AVX2 1
+#  define YUV_TARGET_AVX2 __attribute__((target("avx2")))
+#  include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64) && _MSC_VER >= 1700
+#  define YUV_AVX2 1
+#  define YUV_TARGET_AVX2
+#  include <immintrin.h>
+#  include <intrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Row kernels for the compositing loops, scalar and 16 or 32 pixels per step with the scalar tail
+
+static void HalveRowC(BYTE * d, int n)
+{
+  for(int x = 0; x < n; x++)
+    d[x] >>= 1;
+}
+
+// d = (s >= d) ? s : d/2
+static void MaxOrHalveRowC(const BYTE * s, BYTE * d, int n)
+{
+  for(int x = 0; x < n; x++)
+  {
+    if(s[x] >= d[x]) d[x] = s[x];
+    else d[x] >>= 1;
+  }
+}
+
+// d = s where s != 0
+static void CopyNonZeroRowC(const BYTE * s, BYTE * d, int n)
+{
+  for(int x = 0; x < n; x++)
+  {
+    if(s[x] != 0) d[x] = s[x];
+  }
+}
+
+// 16 -> 63, 63 stays, anything else -> 0
+static void SplitLineRowC(BYTE * d, int n)
+{
+  for(int x = 0; x < n; x++)
+  {
+    if(d[x] == 16) d[x] = 63;
+    else if(d[x] != 63) d[x] = 0;
+  }
+}
+
+#if YUV_SSE2
+static void HalveRowSSE2(BYTE * d, int n)
+{
+  int x = 0;
+  const __m128i mask7f = _mm_set1_epi8(0x7f);
+  for(; x + 16 <= n; x += 16)
+  {
+    __m128i vd = _mm_loadu_si128((const __m128i *)(d + x));
+    _mm_storeu_si128((__m128i *)(d + x), _mm_and_si128(_mm_srli_epi16(vd, 1), mask7f));
+  }
+  HalveRowC(d + x, n - x);
+}
+
+static void MaxOrHalveRowSSE2(const BYTE * s, BYTE * d, int n)
+{
+  int x = 0;
+  const __m128i mask7f = _mm_set1_epi8(0x7f);
+  for(; x + 16 <= n; x += 16)
+  {
+    __m128i vs = _mm_loadu_si128((const __m128i *)(s + x));
+    __m128i vd = _mm_loadu_si128((const __m128i *)(d + x));
+    __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(vs, vd), vs);
+    __m128i half = _mm_and_si128(_mm_srli_epi16(vd, 1), mask7f);
+    _mm_storeu_si128((__m128i *)(d + x), _mm_or_si128(_mm_and_si128(ge, vs), _mm_andnot_si128(ge, half)));
+  }
+  MaxOrHalveRowC(s + x, d + x, n - x);
+}
+
+static void CopyNonZeroRowSSE2(const BYTE * s, BYTE * d, int n)
+{
+  int x = 0;
+  const __m128i zero = _mm_setzero_si128();
+  for(; x + 16 <= n; x += 16)
+  {
+    __m128i vs = _mm_loadu_si128((const __m128i *)(s + x));
+    __m128i vd = _mm_loadu_si128((const __m128i *)(d + x));
+    __m128i z = _mm_cmpeq_epi8(vs, zero);
+    _mm_storeu_si128((__m128i *)(d + x), _mm_or_si128(_mm_and_si128(z, vd), vs));
+  }
+  CopyNonZeroRowC(s + x, d + x, n - x);
+}
+
+static void SplitLineRowSSE2(BYTE * d, int n)
+{
+  int x = 0;
+  const __m128i v16 = _mm_set1_epi8(16);
+  const __m128i v63 = _mm_set1_epi8(63);
+  for(; x + 16 <= n; x += 16)
+  {
+    __m128i vd = _mm_loadu_si128((const __m128i *)(d + x));
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(vd, v16), _mm_cmpeq_epi8(vd, v63));
+    _mm_storeu_si128((__m128i *)(d + x), _mm_and_si128(m, v63));
+  }
+  SplitLineRowC(d + x, n - x);
+}
+#endif
+
+#if YUV_AVX2
+YUV_TARGET_AVX2 static void HalveRowAVX2(BYTE * d, int n)
+{
+  int x = 0;
+  const __m256i mask7f = _mm256_set1_epi8(0x7f);
+  for(; x + 32 <= n; x += 32)
+  {
+    __m256i vd = _mm256_loadu_si256((const __m256i *)(d + x));
+    _mm256_storeu_si256((__m256i *)(d + x), _mm256_and_si256(_mm256_srli_epi16(vd, 1), mask7f));
+  }
+  HalveRowC(d + x, n - x);
+}
+
+YUV_TARGET_AVX2 static void MaxOrHalveRowAVX2(const BYTE * s, BYTE * d, int n)
+{
+  int x = 0;
+  const __m256i mask7f = _mm256_set1_epi8(0x7f);
+  for(; x + 32 <= n; x += 32)
+  {
+    __m256i vs = _mm256_loadu_si256((const __m256i *)(s + x));
+    __m256i vd = _mm256_loadu_si256((const __m256i *)(d + x));
+    __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(vs, vd), vs);
+    __m256i half = _mm256_and_si256(_mm256_srli_epi16(vd, 1), mask7f);
+    _mm256_storeu_si256((__m256i *)(d + x), _mm256_blendv_epi8(half, vs, ge));
+  }
+  MaxOrHalveRowC(s + x, d + x, n - x);
+}
+
+YUV_TARGET_AVX2 static void CopyNonZeroRowAVX2(const BYTE * s, BYTE * d, int n)
+{
+  int x = 0;
+  const __m256i zero = _mm256_setzero_si256();
+  for(; x + 32 <= n; x += 32)
+  {
+    __m256i vs = _mm256_loadu_si256((const __m256i *)(s + x));
+    __m256i vd = _mm256_loadu_si256((const __m256i *)(d + x));
+    _mm256_storeu_si256((__m256i *)(d + x), _mm256_blendv_epi8(vs, vd, _mm256_cmpeq_epi8(vs, zero)));
+  }
+  CopyNonZeroRowC(s + x, d + x, n - x);
+}
+
+YUV_TARGET_AVX2 static void SplitLineRowAVX2(BYTE * d, int n)
+{
+  int x = 0;
+  const __m256i v16 = _mm256_set1_epi8(16);
+  const __m256i v63 = _mm256_set1_epi8(63);
+  for(; x + 32 <= n; x += 32)
+  {
+    __m256i vd = _mm256_loadu_si256((const __m256i *)(d + x));
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(vd, v16), _mm256_cmpeq_epi8(vd, v63));
+    _mm256_storeu_si256((__m256i *)(d + x), _mm256_and_si256(m, v63));
+  }
+  SplitLineRowC(d + x, n - x);
+}
+
+static bool CPUHasAVX2()
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  // the OS saves the YMM registers
+  if((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#if YUV_NEON
+static void HalveRowNEON(BYTE * d, int n)
+{
+  int x = 0;
+  for(; x + 16 <= n; x += 16)
+    vst1q_u8(d + x, vshrq_n_u8(vld1q_u8(d + x), 1));
+  HalveRowC(d + x, n - x);
+}
+
+static void MaxOrHalveRowNEON(const BYTE * s, BYTE * d, int n)
+{
+  int x = 0;
+  for(; x + 16 <= n; x += 16)
+  {
+    uint8x16_t vs = vld1q_u8(s + x);
+    uint8x16_t vd = vld1q_u8(d + x);
+    vst1q_u8(d + x, vbslq_u8(vcgeq_u8(vs, vd), vs, vshrq_n_u8(vd, 1)));
+  }
+  MaxOrHalveRowC(s + x, d + x, n - x);
+}
+
+static void CopyNonZeroRowNEON(const BYTE * s, BYTE * d, int n)
+{
+  int x = 0;
+  for(; x + 16 <= n; x += 16)
+  {
+    uint8x16_t vs = vld1q_u8(s + x);
+    uint8x16_t vd = vld1q_u8(d + x);
+    vst1q_u8(d + x, vbslq_u8(vceqq_u8(vs, vdupq_n_u8(0)), vd, vs));
+  }
+  CopyNonZeroRowC(s + x, d + x, n - x);
+}
+
+static void SplitLineRowNEON(BYTE * d, int n)
+{
+  int x = 0;
+  const uint8x16_t v16 = vdupq_n_u8(16);
+  const uint8x16_t v63 = vdupq_n_u8(63);
+  for(; x + 16 <= n; x += 16)
+  {
+    uint8x16_t vd = vld1q_u8(d + x);
+    uint8x16_t m = vorrq_u8(vceqq_u8(vd, v16), vceqq_u8(vd, v63));
+    vst1q_u8(d + x, vandq_u8(m, v63));
+  }
+  SplitLineRowC(d + x, n - x);
+}
+#endif
+
+struct YUVKernels
+{
+  const char * name;
+  void (*HalveRow)(BYTE * d, int n);
+  void (*MaxOrHalveRow)(const BYTE * s, BYTE * d, int n);
+  void (*CopyNonZeroRow)(const BYTE * s, BYTE * d, int n);
+  void (*SplitLineRow)(BYTE * d, int n);
+};
+
+// from the slowest to the fastest, the scalar ones are the reference
+static const YUVKernels yuvKernelsList[] =
+{
+  { "scalar", HalveRowC, MaxOrHalveRowC, CopyNonZeroRowC, SplitLineRowC },
+#if YUV_SSE2
+  { "sse2", HalveRowSSE2, MaxOrHalveRowSSE2, CopyNonZeroRowSSE2, SplitLineRowSSE2 },
+#endif
+#if YUV_NEON
+  { "neon", HalveRowNEON, MaxOrHalveRowNEON, CopyNonZeroRowNEON, SplitLineRowNEON },
+#endif
+#if YUV_AVX2
+  { "avx2", HalveRowAVX2, MaxOrHalveRowAVX2, CopyNonZeroRowAVX2, SplitLineRowAVX2 },
+#endif
+};
+
+static bool YUVKernelsSupported(const YUVKernels & kernels)
+{
+#if YUV_AVX2
+  if(strcmp(kernels.name, "avx2") == 0)
+    return CPUHasAVX2();
+#endif
+  return true;
+}
+
+static long SelectYUVKernels()
+{
+  long index = 0;
+  for(unsigned i = 1; i < PARRAYSIZE(yuvKernelsList); i++)
+    if(YUVKernelsSupported(yuvKernelsList[i]))
+      index = i;
+  return index;
+}
+
+// chosen at the start of the process, the benchmark switches the sets while the mixers run:
+// the index is swapped atomically and the functions read it once per call
+static volatile long yuvKernelsIndex = SelectYUVKernels();
+
+static inline const YUVKernels * GetKernels()
+{
+  return &yuvKernelsList[yuvKernelsIndex];
+}
+
+const char * GetYUVKernels()
+{
+  return GetKernels()->name;
+}
+
+PStringArray GetYUVKernelsList()
+{
+  PStringArray list;
+  for(unsigned i = 0; i < PARRAYSIZE(yuvKernelsList); i++)
+    if(YUVKernelsSupported(yuvKernelsList[i]))
+      list.AppendString(yuvKernelsList[i].name);
+  return list;
+}
+
+BOOL SetYUVKernels(const PString & name)
+{
+  for(unsigned i = 0; i < PARRAYSIZE(yuvKernelsList); i++)
+  {
+    if(name == yuvKernelsList[i].name && YUVKernelsSupported(yuvKernelsList[i]))
+    {
+      long index = yuvKernelsIndex;
+      while(!sync_bool_compare_and_swap(&yuvKernelsIndex, index, (long)i))
+        index = yuvKernelsIndex;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+void SplitLineRow(BYTE * d, int n)
+{
+  GetKernels()->SplitLineRow(d, n);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void ConvertRGBToYUV(BYTE R, BYTE G, BYTE B, BYTE & Y, BYTE & U, BYTE & V)
 {
   Y = (BYTE)PMIN(ABS(R *  2104 + G *  4130 + B *  802 + 4096 +  131072) / 8192, 235);
@@ -104,12 +426,22 @@ void FillYUVRect(void * frame, int frameWidth, int frameHeight, BYTE R, BYTE G,
 
   int rr;
 
+  // full width rows are one block
+  if(rectWidth == frameWidth)
+    memset(Yptr, Y, rectWidth * rectHeight);
+  else
   for (rr = 0; rr < rectHeight;rr++)
   {
     memset(Yptr, Y, rectWidth);
     Yptr += frameWidth;
   }
 
+  if(halfRectWidth == halfFrameWidth)
+  {
+    memset(UPtr, U, halfRectWidth * halfRectHeight);
+    memset(VPtr, V, halfRectWidth * halfRectHeight);
+  }
+  else
   for (rr = 0; rr < halfRectHeight;rr++)
   {
     memset(UPtr, U, halfRectWidth);
@@ -130,6 +462,11 @@ void ReplaceUV_Rect(void * frame, int frameWidth, int frameHeight, BYTE U, BYTE
   unsigned int offsetV=cw*ch+offsetU;
   BYTE * UPtr = (BYTE*)frame + offsetU;
   BYTE * VPtr = (BYTE*)frame + offsetV;
+  if(rcw == cw) { // full width rows are one block
+    memset(UPtr, U, rcw*rch);
+    memset(VPtr, V, rcw*rch);
+    return;
+  }
   for (unsigned int rr=0;rr<rch;rr++) {
     memset(UPtr, U, rcw);
     memset(VPtr, V, rcw);
@@ -332,20 +669,26 @@ void CopyRectIntoCIF16(const void * _src, void * _dst, int xpos, int ypos, int w
 
 
 void CopyRFromRIntoR(const void *_s, void * _d, int xp, int yp, int w, int h, int rx_abs, int ry_abs, int rw, int rh, int fw, int fh, int lim_w, int lim_h)
+{
+  CopyRFromRIntoR(MCUPlanesYUV(_s, w, h), _d, xp, yp, w, h, rx_abs, ry_abs, rw, rh, fw, fh, lim_w, lim_h);
+}
+
+void CopyRFromRIntoR(const MCUPlanesYUV & src, void * _d, int xp, int yp, int w, int h, int rx_abs, int ry_abs, int rw, int rh, int fw, int fh, int lim_w, int lim_h)
 {
  int rx=rx_abs-xp;
  int ry=ry_abs-yp;
- int w0=w/2;
  int ry0=ry/2;
  int rx0=rx/2;
  int fw0=fw/2;
  int rh0=rh/2;
  int rw0=rw/2;
- BYTE * s = (BYTE *)_s + w*ry + rx;
+ int sw=src.linesize[0];
+ int sw0=src.linesize[1];
+ const BYTE * s = src.data[0] + sw*ry + rx;
  BYTE * d = (BYTE *)_d + (yp+ry)*fw + xp + rx;
- BYTE * sU = (BYTE *)_s + w*h + ry0*w0 + rx0;
+ const BYTE * sU = src.data[1] + ry0*sw0 + rx0;
  BYTE * dU = (BYTE *)_d + fw*fh + (yp/2+ry0)*fw0 + xp/2 + rx0;
- BYTE * sV = sU + w0*(h/2);
+ const BYTE * sV = src.data[2] + ry0*src.linesize[2] + rx0;
  BYTE * dV = dU + fw0*(fh/2);
 
  if(rx+rw>lim_w)rw=lim_w-rx;
@@ -354,55 +697,65 @@ void CopyRFromRIntoR(const void *_s, void * _d, int xp, int yp, int w, int h, in
  if(ry0+rh0>lim_h/2)rh0=lim_h/2-ry0;
 
  if(rx&1){ dU++; sU++; dV++; sV++; }
- for(int i=ry;i<ry+rh;i++){
-   memcpy(d,s,rw); s+=w; d+=fw;
-   if(!(i&1)){
-     memcpy(dU,sU,rw0); sU+=w0; dU+=fw0;
-     memcpy(dV,sV,rw0); sV+=w0; dV+=fw0;
-   }
+ if(rh<=0) return;
+
+ // the rows of the full width are one block, the chroma row goes with the even luma row
+ if(rw==sw && sw==fw) memcpy(d,s,rw*rh);
+ else for(int i=0;i<rh;i++){ memcpy(d,s,rw); s+=sw; d+=fw; }
+
+ int ch=(ry+rh+1)/2-(ry+1)/2;
+ if(rw0==sw0 && sw0==fw0 && src.linesize[2]==sw0){
+   memcpy(dU,sU,rw0*ch);
+   memcpy(dV,sV,rw0*ch);
+ }
+ else for(int i=0;i<ch;i++){
+   memcpy(dU,sU,rw0); sU+=sw0; dU+=fw0;
+   memcpy(dV,sV,rw0); sV+=src.linesize[2]; dV+=fw0;
  }
 }
 
 void CopyRectIntoFrame(const void * _src, void * _dst, int xpos, int ypos, int width, int height, int fw, int fh)
 {
- if(xpos+width > fw || ypos+height > fh) return;
- 
- BYTE * src = (BYTE *)_src;
- BYTE * dst = (BYTE *)_dst + (ypos * fw) + xpos;
-
- int y;
-
-  // copy Y
-  for (y = 0; y < height; ++y) 
-   { memcpy(dst, src, width); src += width; dst += fw; }
+  CopyRectIntoFrame(MCUPlanesYUV(_src, width, height), _dst, xpos, ypos, width, height, fw, fh);
+}
 
-  // copy U
-  dst = (BYTE *)_dst + (fw * fh) + ((ypos>>1) * (fw>>1)) + (xpos >> 1);
-  for (y = 0; y < height/2; ++y) 
-   { memcpy(dst, src, width/2); src += width/2; dst += fw/2; }
+void CopyRectIntoFrame(const MCUPlanesYUV & src, void * _dst, int xpos, int ypos, int width, int height, int fw, int fh)
+{
+  if(xpos+width > fw || ypos+height > fh) return;
 
-  // copy V
-  dst = (BYTE *)_dst + (fw * fh) + ((fw>>1) * (fh>>1)) + ((ypos>>1) * (fw>>1)) + (xpos >> 1);
-  for (y = 0; y < height/2; ++y) 
-   { memcpy(dst, src, width/2); src += width/2; dst += fw/2; }
+  BYTE * dst[3];
+  dst[0] = (BYTE *)_dst + (ypos * fw) + xpos;
+  dst[1] = (BYTE *)_dst + (fw * fh) + ((ypos>>1) * (fw>>1)) + (xpos >> 1);
+  dst[2] = dst[1] + ((fw>>1) * (fh>>1));
+  for(int i = 0; i < 3; i++)
+  {
+    int w = (i ? width/2 : width);
+    int h = (i ? height/2 : height);
+    int stride = (i ? fw/2 : fw);
+    const BYTE * s = src.data[i];
+    BYTE * d = dst[i];
+    for(int y = 0; y < h; y++)
+    {
+      memcpy(d, s, w);
+      s += src.linesize[i];
+      d += stride;
+    }
+  }
 }
 
 void MixRectIntoFrameGrayscale(const void * _src, void * _dst, int xpos, int ypos, int width, int height, int fw, int fh, BYTE wide)
 {
  if(xpos+width > fw || ypos+height > fh) return;
  BYTE * src = (BYTE *)_src;
- BYTE * dst = (BYTE *)_dst + (ypos * fw) + xpos*(1-wide);
- int y,x;
+ BYTE * dst = (BYTE *)_dst + (ypos * fw);
+ const YUVKernels * kernels = GetKernels();
+ int y;
  for(y=0;y<height;y++)
  {
-  if(wide)for(x=0;x<xpos;x++){ *dst>>=1; dst++; }
-  for(x=0;x<width;x++) {
-   if(*src>=*dst)*dst=*src; else
-   *dst>>=1;
-   src++; dst++;
-  }
-  if(wide)for(x=0;x<fw-width-xpos;x++){ *dst>>=1; dst++; }
-  else dst+=(fw-width);
+  if(wide) kernels->HalveRow(dst, xpos);
+  kernels->MaxOrHalveRow(src, dst + xpos, width);
+  if(wide) kernels->HalveRow(dst + xpos + width, fw - width - xpos);
+  src += width; dst += fw;
  }
 }
 
@@ -412,15 +765,12 @@ void MixRectIntoFrameSubsMode(const void * _src, void * _dst, int xpos, int ypos
   if(xpos+width > fw || ypos+height > fh) return;
   BYTE * src = (BYTE *)_src;
   BYTE * dst = (BYTE *)_dst + (ypos * fw) + xpos;
-  int y,x;
+  const YUVKernels * kernels = GetKernels();
+  int y;
   for(y=0;y<height;y++)
   {
-    for(x=0;x<width;x++)
-    {
-      if(*src!=0)*dst=*src;
-      src++; dst++;
-    }
-    dst+=(fw-width);
+    kernels->CopyNonZeroRow(src, dst, width);
+    src += width; dst += fw;
   }
 }
 #endif
@@ -493,55 +843,32 @@ extern __inline__ uint64_t rdtsc()
 }
 #endif
 
-void ResizeYUV420P(const void * _src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh)
+void CopyPlanesIntoFrame(const MCUPlanesYUV & src, void * _dst, int w, int h)
 {
-  uint64_t TSC0=rdtsc();
-  int scaleFilterType = OpenMCU::Current().GetScaleFilterType();
-
-  if(sw==dw && sh==dh) // same size
-    memcpy(_dst,_src,dw*dh*3/2);
-#if USE_LIBYUV
-  else if(scaleFilterType >= 1 && scaleFilterType <= 3)
-  {
-    libyuv::I420Scale(
-    /* src_y */     (const uint8*)_src,                         /* src_stride_y */ sw,
-    /* src_u */     (const uint8*)((long)_src+sw*sh),           /* src_stride_u */ (int)(sw >> 1),
-    /* src_v */     (const uint8*)((long)_src+sw*sh*5/4),       /* src_stride_v */ (int)(sw >> 1),
-    /* src_width */ (int)sw,                                    /* src_height */   (int)sh,
-    /* dst_y */     (uint8*)_dst,                               /* dst_stride_y */ (int)dw,
-    /* dst_u */     (uint8*)((long)_dst+dw*dh),                 /* dst_stride_u */ (int)(dw >> 1),
-    /* dst_v */     (uint8*)((long)_dst+dw*dh+(dw>>1)*(dh>>1)), /* dst_stride_v */ (int)(dw >> 1),
-    /* dst_width */ (int)dw,                                    /* dst_height */   (int)dh,
-    /* filtering */ (libyuv::FilterMode)OpenMCU::GetScaleFilter(scaleFilterType)
-    );
-  }
-#endif
-#if USE_SWSCALE
-  else if(scaleFilterType >= 4 && scaleFilterType <= 14)
+  BYTE * dst = (BYTE *)_dst;
+  for(int i = 0; i < 3; i++)
   {
-    struct SwsContext *sws_ctx = sws_getContext(sw, sh, AV_PIX_FMT_YUV420P,
-                                                dw, dh, AV_PIX_FMT_YUV420P,
-                                                OpenMCU::GetScaleFilter(scaleFilterType), NULL, NULL, NULL);
-    if(sws_ctx == NULL)
+    int pw = (i ? w/2 : w);
+    int ph = (i ? h/2 : h);
+    const BYTE * s = src.data[i];
+    if(src.linesize[i] == pw)
     {
-      MCUTRACE(1, "MCUVideoMixer\tImpossible to create scale context for the conversion "
-                  << sw << "x" << sh << "->" << dw << "x" << dh);
-      return;
+      memcpy(dst, s, pw*ph);
+      dst += pw*ph;
+      continue;
+    }
+    for(int y = 0; y < ph; y++)
+    {
+      memcpy(dst, s, pw);
+      dst += pw;
+      s += src.linesize[i];
     }
-
-    // initialize linesize
-    AVPicture src_picture;
-    avpicture_fill(&src_picture, (uint8_t *)_src, AV_PIX_FMT_YUV420P, sw, sh);
-    AVPicture dst_picture;
-    avpicture_fill(&dst_picture, (uint8_t *)_dst, AV_PIX_FMT_YUV420P, dw, dh);
-
-    sws_scale(sws_ctx, src_picture.data, src_picture.linesize, 0, sh,
-                       dst_picture.data, dst_picture.linesize);
-
-    sws_freeContext(sws_ctx);
   }
-#endif
-  else if(sw==CIF16_WIDTH && sh==CIF16_HEIGHT && dw==TCIF_WIDTH    && dh==TCIF_HEIGHT)   // CIF16 -> TCIF
+}
+
+static void ConvertYUV420P(const void * _src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh)
+{
+  if(sw==CIF16_WIDTH && sh==CIF16_HEIGHT && dw==TCIF_WIDTH    && dh==TCIF_HEIGHT)   // CIF16 -> TCIF
     ConvertCIF16ToTCIF(_src,_dst);
   else if(sw==CIF16_WIDTH && sh==CIF16_HEIGHT && dw==Q3CIF16_WIDTH && dh==Q3CIF16_HEIGHT)// CIF16 -> Q3CIF16
     ConvertCIF16ToQ3CIF16(_src,_dst);
@@ -593,6 +920,88 @@ void ResizeYUV420P(const void * _src, void * _dst, unsigned int sw, unsigned int
     Convert2To1(_src, _dst, sw, sh);
 
   else ConvertFRAMEToCUSTOM_FRAME(_src,_dst,sw,sh,dw,dh);
+}
+
+void ResizeYUV420P(const MCUPlanesYUV & src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh)
+{
+  ResizeYUV420P(src, _dst, sw, sh, dw, dh, 0, 0, dw, dh);
+}
+
+void ResizeYUV420P(const MCUPlanesYUV & src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh, int xpos, int ypos, int fw, int fh)
+{
+  if(xpos+(int)dw > fw || ypos+(int)dh > fh) return;
+
+  uint64_t TSC0=rdtsc();
+  int scaleFilterType = OpenMCU::Current().GetScaleFilterType();
+
+  // the planes of the rect in the destination frame
+  uint8_t * dst[3];
+  int dstStride[3] = { fw, fw >> 1, fw >> 1 };
+  dst[0] = (uint8_t *)_dst + ypos*fw + xpos;
+  dst[1] = (uint8_t *)_dst + fw*fh + (ypos>>1)*(fw>>1) + (xpos>>1);
+  dst[2] = dst[1] + (fw>>1)*(fh>>1);
+  BOOL packed = (xpos == 0 && ypos == 0 && (int)dw == fw && (int)dh == fh);
+
+  if(sw==dw && sh==dh) // same size
+    CopyRectIntoFrame(src, _dst, xpos, ypos, dw, dh, fw, fh);
+#if USE_LIBYUV
+  else if(scaleFilterType >= 1 && scaleFilterType <= 3)
+  {
+    libyuv::I420Scale(
+    /* src_y */     (const uint8*)src.data[0],                  /* src_stride_y */ src.linesize[0],
+    /* src_u */     (const uint8*)src.data[1],                  /* src_stride_u */ src.linesize[1],
+    /* src_v */     (const uint8*)src.data[2],                  /* src_stride_v */ src.linesize[2],
+    /* src_width */ (int)sw,                                    /* src_height */   (int)sh,
+    /* dst_y */     (uint8*)dst[0],                             /* dst_stride_y */ dstStride[0],
+    /* dst_u */     (uint8*)dst[1],                             /* dst_stride_u */ dstStride[1],
+    /* dst_v */     (uint8*)dst[2],                             /* dst_stride_v */ dstStride[2],
+    /* dst_width */ (int)dw,                                    /* dst_height */   (int)dh,
+    /* filtering */ (libyuv::FilterMode)OpenMCU::GetScaleFilter(scaleFilterType)
+    );
+  }
+#endif
+#if USE_SWSCALE
+  else if(scaleFilterType >= 4 && scaleFilterType <= 14)
+  {
+    struct SwsContext *sws_ctx = sws_getContext(sw, sh, AV_PIX_FMT_YUV420P,
+                                                dw, dh, AV_PIX_FMT_YUV420P,
+                                                OpenMCU::GetScaleFilter(scaleFilterType), NULL, NULL, NULL);
+    if(sws_ctx == NULL)
+    {
+      MCUTRACE(1, "MCUVideoMixer\tImpossible to create scale context for the conversion "
+                  << sw << "x" << sh << "->" << dw << "x" << dh);
+      return;
+    }
+
+    sws_scale(sws_ctx, (const uint8_t * const *)src.data, src.linesize, 0, sh,
+                       dst, dstStride);
+
+    sws_freeContext(sws_ctx);
+  }
+#endif
+  else if(packed && src.IsPacked(sw, sh))
+    ConvertYUV420P(src.data[0], _dst, sw, sh, dw, dh);
+  else
+  {
+    // fixed-size converters expect a packed source and destination
+    MCUBufferYUV srcbuf, dstbuf;
+    const void * s = src.data[0];
+    void * d = _dst;
+    if(!src.IsPacked(sw, sh))
+    {
+      srcbuf.SetFrameSize(sw, sh);
+      CopyPlanesIntoFrame(src, srcbuf.GetPointer(), sw, sh);
+      s = srcbuf.GetPointer();
+    }
+    if(!packed)
+    {
+      dstbuf.SetFrameSize(dw, dh);
+      d = dstbuf.GetPointer();
+    }
+    ConvertYUV420P(s, d, sw, sh, dw, dh);
+    if(!packed)
+      CopyRectIntoFrame(d, _dst, xpos, ypos, dw, dh, fw, fh);
+  }
 
   {
     PWaitAndSignal m(OpenMCU::Current().videoResizeDeltaTSCMutex);
@@ -614,6 +1023,11 @@ void ResizeYUV420P(const void * _src, void * _dst, unsigned int sw, unsigned int
 
 }
 
+void ResizeYUV420P(const void * _src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh)
+{
+  ResizeYUV420P(MCUPlanesYUV(_src, sw, sh), _dst, sw, sh, dw, dh);
+}
+
 //#if !USE_LIBYUV && !USE_SWSCALE
 void ConvertCIF4ToCIF(const void * _src, void * _dst)
 {
@@ -30,6 +30,11 @@ void MixRectIntoFrameGrayscale(const void * _src, void * _dst, int xpos, int ypo
 void MixRectIntoFrameSubsMode(const void * _src, void * _dst, int xpos, int ypos, int width, int height, int fw, int fh, BYTE wide);
 #endif
 void CopyRectIntoRect(const void * _src, void * _dst, int xpos, int ypos, int width, int height, int fw, int fh);
+void SplitLineRow(BYTE * d, int n);
+// the row kernels: "scalar" and the SIMD sets of the build and the CPU, the fastest is chosen at start
+const char * GetYUVKernels();
+PStringArray GetYUVKernelsList();
+BOOL SetYUVKernels(const PString & name);
 void CopyRectFromFrame(const void * _src, void * _dst, int xpos, int ypos, int width, int height, int fw, int fh);
 void ResizeYUV420P(const void * _src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh);
 void ConvertQCIFToCIF(const void * _src, void * _dst);
@@ -59,6 +64,59 @@ void ConvertCIFToSQCIF(const void * _src, void * _dst);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Read-only view of a YUV420P picture, either packed or with arbitrary strides
+// (decoder output passed by reference)
+class MCUPlanesYUV
+{
+  public:
+    MCUPlanesYUV(const void * buffer, int w, int h)
+    {
+      data[0] = (const BYTE *)buffer;
+      data[1] = data[0] + w*h;
+      data[2] = data[1] + (w/2)*(h/2);
+      linesize[0] = w;
+      linesize[1] = w/2;
+      linesize[2] = w/2;
+    }
+
+    MCUPlanesYUV(const BYTE * const _data[3], const int _linesize[3])
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        data[i] = _data[i];
+        linesize[i] = _linesize[i];
+      }
+    }
+
+    // view of the part of the picture from x,y (even)
+    MCUPlanesYUV(const MCUPlanesYUV & src, int x, int y)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        data[i] = src.data[i] + (i ? (y/2)*src.linesize[i] + x/2 : y*src.linesize[i] + x);
+        linesize[i] = src.linesize[i];
+      }
+    }
+
+    BOOL IsPacked(int w, int h) const
+    {
+      return linesize[0] == w && linesize[1] == w/2 && linesize[2] == w/2 &&
+             data[1] == data[0] + w*h && data[2] == data[1] + (w/2)*(h/2);
+    }
+
+    const BYTE * data[3];
+    int linesize[3];
+};
+
+void CopyPlanesIntoFrame(const MCUPlanesYUV & src, void * _dst, int w, int h);
+void CopyRectIntoFrame(const MCUPlanesYUV & src, void * _dst, int xpos, int ypos, int width, int height, int fw, int fh);
+void CopyRFromRIntoR(const MCUPlanesYUV & src, void * _d, int xp, int yp, int w, int h, int rx_abs, int ry_abs, int rw, int rh, int fw, int fh, int lim_w, int lim_h);
+void ResizeYUV420P(const MCUPlanesYUV & src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh);
+// resize into the rect xpos,ypos,dw,dh of the frame fw*fh
+void ResizeYUV420P(const MCUPlanesYUV & src, void * _dst, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh, int xpos, int ypos, int fw, int fh);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 class MCUBufferYUV : public MCUBuffer
 {
   public:
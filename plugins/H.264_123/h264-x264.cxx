@@ -56,6 +56,7 @@
   #define STRCMPI  _strcmpi
 #else
   #include <semaphore.h>
+  #include <unistd.h>
   #define STRCMPI  strcasecmp
 #endif
 #include <string.h>
@@ -198,12 +199,64 @@ void H264EncoderContext::Unlock ()
 
 #define	SQN_CHECK_INTERVAL	31 
 
+// Upper limit of decoding threads for a single decoder in auto mode
+#define DECODER_AUTO_THREADS	4
+
+// Decoding threads above the caller's own are shared by all decoders of the
+// process, so that many HD participants don't start more threads than cores
+static CriticalSection decoderThreadsMutex;
+static unsigned decoderThreadsBudget = 0;
+static unsigned decoderThreadsInUse = 0;
+
+unsigned H264DecoderContext::ReserveThreads(unsigned threads)
+{
+  WaitAndSignal m(decoderThreadsMutex);
+
+  if(decoderThreadsBudget == 0)
+  {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    decoderThreadsBudget = info.dwNumberOfProcessors;
+#else
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    decoderThreadsBudget = (cpus > 0 ? cpus : 1);
+#endif
+  }
+
+  if(threads <= 1)
+    return 1;
+
+  unsigned extra = threads - 1;
+  if(decoderThreadsInUse + extra > decoderThreadsBudget)
+    extra = (decoderThreadsInUse < decoderThreadsBudget ? decoderThreadsBudget - decoderThreadsInUse : 0);
+  decoderThreadsInUse += extra;
+  return extra + 1;
+}
+
+void H264DecoderContext::ReleaseThreads(unsigned threads)
+{
+  WaitAndSignal m(decoderThreadsMutex);
+
+  if(threads <= 1)
+    return;
+  if(decoderThreadsInUse >= threads - 1)
+    decoderThreadsInUse -= threads - 1;
+  else
+    decoderThreadsInUse = 0;
+}
+
 H264DecoderContext::H264DecoderContext()
 {
   _lastSQN = 0;
   _lostFrameCounter = 0;
+  _copiedFrameCounter = 0;
+  _threads = 1;
+  _frameThreads = false;
+  _pendingFrames = 0;
 
   freezeVideo = false;
+  _outputPlanes = false;
   _gotIFrame = false;
   _gotAGoodFrame = false;
   _frameCounter = 0; 
@@ -237,6 +290,9 @@ H264DecoderContext::H264DecoderContext()
 
   av_init_packet(&_pkt);
 
+  // single thread until the options say otherwise
+  _context->thread_count = 1;
+
 #if LIBAVCODEC_VERSION_INT > AV_VERSION_INT(53,8,0)
   if (avcodec_open2(_context, _codec, NULL) < 0) {
 #else
@@ -251,6 +307,45 @@ H264DecoderContext::H264DecoderContext()
   }
 }
 
+void H264DecoderContext::OpenCodec()
+{
+  // the frames in the pipeline of the frame threads are dropped with the codec
+  _pendingFrames = 0;
+  avcodec_close(_context);
+#if LIBAVCODEC_VERSION_INT > AV_VERSION_INT(53,8,0)
+  avcodec_open2(_context, _codec, NULL);
+#else
+  avcodec_open(_context, _codec);
+#endif
+}
+
+void H264DecoderContext::SetThreads(unsigned threads, bool frameThreads)
+{
+  if (_context == NULL)
+    return;
+
+  // 0 - auto, slice threads add no delay and are the default,
+  // frame threads delay the output by one frame per thread
+  if (threads == 0)
+    threads = DECODER_AUTO_THREADS;
+
+  ReleaseThreads(_threads);
+  threads = ReserveThreads(threads);
+  if (threads == _threads && frameThreads == _frameThreads)
+    return;
+
+  _threads = threads;
+  _frameThreads = frameThreads;
+
+  _context->thread_count = _threads;
+#ifdef FF_THREAD_SLICE
+  _context->thread_type = (_frameThreads ? FF_THREAD_FRAME : FF_THREAD_SLICE);
+#endif
+  OpenCodec();
+
+  TRACE(3, "H264\tDecoder\tUsing " << _threads << (_frameThreads ? " frame" : " slice") << " thread(s)");
+}
+
 H264DecoderContext::~H264DecoderContext()
 {
  if (_context != NULL)
@@ -258,9 +353,10 @@ H264DecoderContext::~H264DecoderContext()
   if (_context->codec != NULL)
   {
    avcodec_close(_context);
-   cout << "H264\tDecoder\tClosed H.264 decoder, decoded " << _frameCounter << " Frames, skipped " << _skippedFrameCounter << " Frames\n";
+   cout << "H264\tDecoder\tClosed H.264 decoder, decoded " << _frameCounter << " Frames, skipped " << _skippedFrameCounter << " Frames, copied " << _copiedFrameCounter << " Frames\n";
   }
  }
+ ReleaseThreads(_threads);
  if (_context != NULL) av_free(_context);
  if (_outputFrame != NULL) av_free(_outputFrame);
  if (_rxH264Frame) delete _rxH264Frame;
@@ -321,12 +417,7 @@ void H264DecoderContext::SetSpropParameter(const char *value)
   }
   av_log(_context, AV_LOG_INFO, "Decoder extradata set to %p (size: %d)!\n", _context->extradata, _context->extradata_size);
 
-  avcodec_close(_context);
-#if LIBAVCODEC_VERSION_INT > AV_VERSION_INT(53,8,0)
-  avcodec_open2(_context, _codec, NULL);
-#else
-  avcodec_open(_context, _codec);
-#endif
+  OpenCodec();
 }
 
 int H264DecoderContext::DecodeFrames(const u_char * src, unsigned & srcLen, u_char * dst, unsigned & dstLen, unsigned int & flags)
@@ -412,6 +503,12 @@ int H264DecoderContext::DecodeFrames(const u_char * src, unsigned & srcLen, u_ch
   }
 
   _rxH264Frame->BeginNewFrame();
+  if (!gotPicture && bytesDecoded >= 0 && _frameThreads && _pendingFrames + 1 < _threads)
+  {
+    // frame threads are filling up, the picture comes out later
+    _pendingFrames++;
+    return 1;
+  }
   if (!gotPicture) 
   {
     TRACE(1, "H264\tDecoder\tDecoded "<< bytesDecoded << " bytes without getting a Picture..."); 
@@ -428,34 +525,50 @@ int H264DecoderContext::DecodeFrames(const u_char * src, unsigned & srcLen, u_ch
   header->width = _context->width;
   header->height = _context->height;
 
-  int size = _context->width * _context->height;
-  if (_outputFrame->data[1] == _outputFrame->data[0] + size
-      && _outputFrame->data[2] == _outputFrame->data[1] + (size >> 2))
+  if (_outputPlanes)
   {
-    memcpy(OPAL_VIDEO_FRAME_DATA_PTR(header), _outputFrame->data[0], frameBytes);
+    // pass the decoded picture by reference, valid until the next call
+    PluginCodec_Video_FramePlanes * planes = (PluginCodec_Video_FramePlanes *)OPAL_VIDEO_FRAME_DATA_PTR(header);
+    for (int i=0; i<3; i ++)
+    {
+      planes->data[i] = _outputFrame->data[i];
+      planes->linesize[i] = _outputFrame->linesize[i];
+    }
+    frameBytes = sizeof(PluginCodec_Video_FramePlanes);
+    flags |= PluginCodec_ReturnCoderPlanes;
   }
-  else 
+  else
   {
-    unsigned char *dstData = OPAL_VIDEO_FRAME_DATA_PTR(header);
-    for (int i=0; i<3; i ++)
+    _copiedFrameCounter++;
+    int size = _context->width * _context->height;
+    if (_outputFrame->data[1] == _outputFrame->data[0] + size
+        && _outputFrame->data[2] == _outputFrame->data[1] + (size >> 2))
     {
-      unsigned char *srcData = _outputFrame->data[i];
-      int dst_stride = i ? _context->width >> 1 : _context->width;
-      int src_stride = _outputFrame->linesize[i];
-      int h = i ? _context->height >> 1 : _context->height;
-
-      if (src_stride==dst_stride)
-      {
-        memcpy(dstData, srcData, dst_stride*h);
-        dstData += dst_stride*h;
-      }
-      else
+      memcpy(OPAL_VIDEO_FRAME_DATA_PTR(header), _outputFrame->data[0], frameBytes);
+    }
+    else 
+    {
+      unsigned char *dstData = OPAL_VIDEO_FRAME_DATA_PTR(header);
+      for (int i=0; i<3; i ++)
       {
-        while (h--)
+        unsigned char *srcData = _outputFrame->data[i];
+        int dst_stride = i ? _context->width >> 1 : _context->width;
+        int src_stride = _outputFrame->linesize[i];
+        int h = i ? _context->height >> 1 : _context->height;
+
+        if (src_stride==dst_stride)
+        {
+          memcpy(dstData, srcData, dst_stride*h);
+          dstData += dst_stride*h;
+        }
+        else
         {
-          memcpy(dstData, srcData, dst_stride);
-          dstData += dst_stride;
-          srcData += src_stride;
+          while (h--)
+          {
+            memcpy(dstData, srcData, dst_stride);
+            dstData += dst_stride;
+            srcData += src_stride;
+          }
         }
       }
     }
@@ -873,6 +986,9 @@ static int decoder_set_options(const struct PluginCodec_Definition *, void * _co
 
   context->Lock();
 
+  unsigned threads = 0;
+  bool frameThreads = false;
+  bool setThreads = false;
   const char ** options = (const char **)parm;
   for(int i = 0; options[i] != NULL; i += 2)
   {
@@ -884,7 +1000,22 @@ static int decoder_set_options(const struct PluginCodec_Definition *, void * _co
       if(strcasecmp(s.c_str(), "") != 0)
         context->SetSpropParameter(s.c_str());
     }
+    else if(STRCMPI(options[i], PLUGINCODEC_OPTION_OUTPUT_PLANES) == 0)
+      context->SetOutputPlanes(atoi(options[i+1]) != 0);
+    else if(STRCMPI(options[i], "Decoding Threads") == 0)
+    {
+      threads = atoi(options[i+1]);
+      setThreads = true;
+    }
+    else if(STRCMPI(options[i], "Decoding Thread Type") == 0)
+    {
+      frameThreads = (STRCMPI(options[i+1], "frame") == 0);
+      setThreads = true;
+    }
   }
+  // the codec is reopened only for the threading options
+  if(setThreads)
+    context->SetThreads(threads, frameThreads);
 
   context->Unlock();
   return 1;
@@ -132,11 +132,17 @@ class H264DecoderContext
     int DecodeFrames(const u_char * src, unsigned & srcLen, u_char * dst, unsigned & dstLen, unsigned int & flags);
 
     void SetSpropParameter(const char *value);
+    void SetOutputPlanes(bool outputPlanes) { _outputPlanes = outputPlanes; }
+    void SetThreads(unsigned threads, bool frameThreads);
 
     void Lock() { _mutex.Wait(); }
     void Unlock() { _mutex.Signal(); }
 
   protected:
+    void OpenCodec();
+    static unsigned ReserveThreads(unsigned threads);
+    static void ReleaseThreads(unsigned threads);
+
     CriticalSection _mutex;
 
     AVCodec* _codec;
@@ -146,12 +152,19 @@ class H264DecoderContext
     H264Frame* _rxH264Frame;
 
     bool freezeVideo;
+    bool _outputPlanes;
     bool _gotIFrame;
     bool _gotAGoodFrame;
     int _frameCounter;
     int _skippedFrameCounter;
     int _lastSQN;
     int _lostFrameCounter;
+    int _copiedFrameCounter;
+
+    // extra decoding threads taken from the process-wide budget
+    unsigned _threads;
+    bool _frameThreads;
+    unsigned _pendingFrames;
 };
 
 static int valid_for_protocol    ( const struct PluginCodec_Definition *, void *, const char *,
@@ -165,13 +165,20 @@ enum PluginCodec_Flags {
 
 enum PluginCodec_CoderFlags {
   PluginCodec_CoderSilenceFrame      = 1,    // request audio codec to create silence frame
-  PluginCodec_CoderForceIFrame       = 2     // request video codec to force I frame
+  PluginCodec_CoderForceIFrame       = 2,    // request video codec to force I frame
+  PluginCodec_CoderPacketLoss        = 4,    // indicate to video codec packets were lost
+  PluginCodec_CoderLostFramesPos     = 8,    // audio decoder: number of frames lost just before this packet
+  PluginCodec_CoderLostFramesMask    = 0xff00
 };
 
 enum PluginCodec_ReturnCoderFlags {
   PluginCodec_ReturnCoderLastFrame     = 1,    // indicates when video codec returns last data for frame
   PluginCodec_ReturnCoderIFrame        = 2,    // indicates when video returns I frame
-  PluginCodec_ReturnCoderRequestIFrame = 4     // indicates when video decoder request I frame for resync
+  PluginCodec_ReturnCoderRequestIFrame = 4,    // indicates when video decoder request I frame for resync
+  PluginCodec_ReturnCoderPlanes        = 16,   // indicates when video decoder returns PluginCodec_Video_FramePlanes
+  PluginCodec_ReturnCoderLostFrames    = 32,   // indicates when audio decoder output the lost frames (count in
+                                               // PluginCodec_CoderLostFramesMask) ahead of the packet
+  PluginCodec_ReturnCoderRecovered     = 64    // indicates when the newest lost frame was recovered from in-band FEC
 };
 
 struct PluginCodec_Definition;
@@ -569,6 +576,17 @@ struct PluginCodec_Video_FrameHeader {
   unsigned int  height;
 };
 
+// Decoder option: instead of copying the picture into the packed frame after
+// PluginCodec_Video_FrameHeader, store plane references to the decoder's own
+// picture there and set PluginCodec_ReturnCoderPlanes. The planes are valid
+// until the next call of the decoder.
+#define PLUGINCODEC_OPTION_OUTPUT_PLANES "Output Planes"
+
+struct PluginCodec_Video_FramePlanes {
+  unsigned char * data[3];
+  int             linesize[3];
+};
+
 #ifdef __cplusplus
 };
 
@@ -239,6 +239,7 @@ class Decoder : public PluginCodec<CODEC>
     unsigned m_bytesPerFrame;
     unsigned m_sampleRate;
     unsigned m_channels;
+    unsigned m_lastSamples; // duration of the last decoded packet, used for the lost frames
 
   public:
     Decoder(const PluginCodec_Definition * defn)
@@ -249,6 +250,7 @@ class Decoder : public PluginCodec<CODEC>
       , m_bytesPerFrame(m_definition->parm.audio.bytesPerFrame)
       , m_sampleRate(m_definition->sampleRate)
       , m_channels(1)
+      , m_lastSamples(0)
     {
     }
 
@@ -280,9 +282,42 @@ class Decoder : public PluginCodec<CODEC>
         PTRACE(1, m_description, "decoder error: " << error << " " << opus_strerror(error));
         return false;
       }
+      m_lastSamples = 0;
       return true;
     }
 
+    // Check the LBRR (in-band FEC) flag of the first SILK frame, the FEC data
+    // for the previous packet is always carried there. CELT-only packets have none.
+    static bool PacketHasFEC(const unsigned char * data, unsigned len)
+    {
+      if(data == NULL || len < 2 || (data[0] & 0x80) != 0)
+        return false;
+
+      int silkFrames;
+      switch(opus_packet_get_samples_per_frame(data, 48000))
+      {
+        case 480:  // 10 ms
+        case 960:  silkFrames = 1; break;
+        case 1920: silkFrames = 2; break;
+        case 2880: silkFrames = 3; break;
+        default:   return false;
+      }
+
+      const unsigned char * frames[48];
+      opus_int16 sizes[48];
+      if(opus_packet_parse(data, len, NULL, frames, sizes, NULL) <= 0 || sizes[0] <= 1)
+        return false;
+
+      // VAD flags of the channel followed by its LBRR flag
+      int channels = opus_packet_get_nb_channels(data);
+      for(int n = 0; n < channels; n++)
+      {
+        if(frames[0][0] & (0x80 >> ((n + 1) * (silkFrames + 1) - 1)))
+          return true;
+      }
+      return false;
+    }
+
     virtual void GetInitOptions()
     {
       for (PluginCodec_Option ** options = (PluginCodec_Option **)((MediaFormat *)m_definition->userData)->GetOptionsTable(); *options != NULL; ++options) {
@@ -308,25 +343,108 @@ class Decoder : public PluginCodec<CODEC>
     {
       if(toLen < m_samplesPerFrame*m_channels*2)
       {
-        PTRACE(1, m_description, "decoder eror: toLen too small, " << toLen << " bytes");
+        PTRACE(1, m_description, "decoder error: toLen too small, " << toLen << " bytes");
         return false;
       }
 
-      int samples = opus_decoder_get_nb_samples(m_state, (const unsigned char *)fromPtr, fromLen);
+      const unsigned char * data = (const unsigned char *)fromPtr;
+      unsigned maxSamples = toLen/(m_channels*2);
+
+      // The slot of a lost packet: decoded from the FEC data of the next packet
+      // when it is already here and carries it, concealed by PLC otherwise.
+      if(flags & PluginCodec_CoderConcealFrame)
+      {
+        flags = 0;
+        if(m_lastSamples == 0)
+        {
+          toLen = 0;
+          return true;
+        }
+        unsigned samples = m_lastSamples < maxSamples ? m_lastSamples : maxSamples;
+        bool fec = PacketHasFEC(data, fromLen);
+        int ret;
+        if(fec)
+          ret = opus_decode(m_state, data, fromLen, (opus_int16 *)toPtr, samples, 1);
+        else
+          ret = opus_decode(m_state, NULL, 0, (opus_int16 *)toPtr, samples, 0);
+        fromLen = 0;
+        if(ret < 0)
+        {
+          PTRACE(3, m_description, "decoder " << (fec ? "FEC" : "PLC") << " error: " << ret << " " << opus_strerror(ret));
+          toLen = 0;
+          return true;
+        }
+        flags = PluginCodec_ReturnCoderLostFrames | (1 << PluginCodec_CoderLostFramesPos);
+        if(fec)
+          flags |= PluginCodec_ReturnCoderRecovered;
+        toLen = ret*m_channels*2;
+        return true;
+      }
+
+      int samples = opus_decoder_get_nb_samples(m_state, data, fromLen);
       if(samples < 0)
       {
         PTRACE(1, m_description, "decoder error: " << samples << " " << opus_strerror(samples));
         return false;
       }
+      if((unsigned)samples > maxSamples)
+      {
+        PTRACE(1, m_description, "decoder error: toLen too small for " << samples << " samples, " << toLen << " bytes");
+        return false;
+      }
+
+      unsigned lost = (flags & PluginCodec_CoderLostFramesMask) >> PluginCodec_CoderLostFramesPos;
+      flags = 0;
+
+      opus_int16 * out = (opus_int16 *)toPtr;
+
+      // Fill in the frames lost before this packet, as many as fit in front of it.
+      // The newest one is decoded from the FEC data of this packet when present,
+      // the others (and the newest one without FEC) are concealed by PLC.
+      if(lost > 0 && m_lastSamples > 0)
+      {
+        unsigned fill = (maxSamples - samples) / m_lastSamples;
+        if(fill > lost)
+          fill = lost;
+
+        unsigned filled = 0;
+        bool recovered = false;
+        for(unsigned i = 0; i < fill; i++)
+        {
+          bool fec = (i == fill - 1 && PacketHasFEC(data, fromLen));
+          int ret;
+          if(fec)
+            ret = opus_decode(m_state, data, fromLen, out, m_lastSamples, 1);
+          else
+            ret = opus_decode(m_state, NULL, 0, out, m_lastSamples, 0);
+          if(ret < 0)
+          {
+            PTRACE(3, m_description, "decoder " << (fec ? "FEC" : "PLC") << " error: " << ret << " " << opus_strerror(ret));
+            break;
+          }
+          out += ret*m_channels;
+          recovered = fec;
+          filled++;
+        }
+
+        if(filled > 0)
+        {
+          flags |= PluginCodec_ReturnCoderLostFrames | (filled << PluginCodec_CoderLostFramesPos);
+          if(recovered)
+            flags |= PluginCodec_ReturnCoderRecovered;
+        }
+      }
 
-      int frame_size = opus_decode(m_state, (const unsigned char *)fromPtr, fromLen, (opus_int16 *)toPtr, m_bytesPerFrame, 0);
+      unsigned offset = (out - (opus_int16 *)toPtr) / m_channels;
+      int frame_size = opus_decode(m_state, data, fromLen, out, maxSamples - offset, 0);
       if(frame_size < 0)
       {
         PTRACE(1, m_description, "decoder error: " << frame_size << " " << opus_strerror(frame_size));
         return false;
       }
+      m_lastSamples = frame_size;
 
-      toLen = frame_size*m_channels*2;
+      toLen = (offset + frame_size)*m_channels*2;
       return true;
     }
 };
@@ -542,6 +660,7 @@ class prefix##_AudioFormat : public AudioFormat \
       m_maxFramesPerPacket = prefix##_MaxFramesPerPacket; \
       m_h323CapabilityType = PluginCodec_H323Codec_generic; \
       m_h323CapabilityData = (struct PluginCodec_H323GenericCodecData *)&prefix##_Cap; \
+      m_flags |= PluginCodec_DecodeLost; \
     } \
 }; \
 static prefix##_AudioFormat prefix##_AudioFormatInfo;
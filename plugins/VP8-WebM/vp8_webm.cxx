@@ -48,6 +48,7 @@
 #include "../common/opalplugin.hpp"
 
 #include <vector>
+#include <algorithm>
 
 #ifdef _MSC_VER
 #pragma warning(disable:4505)
@@ -214,15 +215,43 @@ static struct PluginCodec_Option const OutputPartition =
   0                                   // H.245 generic capability code and bit mask
 };
 
+static struct PluginCodec_Option const TemporalLayers =
+{
+  PluginCodec_IntegerOption,          // Option type
+  "Temporal Layers",                  // User visible name
+  false,                              // User Read/Only flag
+  PluginCodec_AlwaysMerge,            // Merge mode
+  "1",                                // Initial value
+  NULL,                               // FMTP option name
+  NULL,                               // FMTP default value
+  0,                                  // H.245 generic capability code and bit mask
+  "1",                                // Minimum value
+  "3"                                 // Maximum value
+};
+
+static struct PluginCodec_Option const DamagedRegions =
+{
+  PluginCodec_StringOption,           // Option type
+  PLUGINCODEC_OPTION_DAMAGED_REGIONS, // User visible name
+  true,                               // User Read/Only flag
+  PluginCodec_NoMerge,                // Merge mode
+  "",                                 // Initial value
+  NULL,                               // FMTP option name
+  NULL,                               // FMTP default value
+  0                                   // H.245 generic capability code and bit mask
+};
+
 static struct PluginCodec_Option const * OptionTableRFC[] = {
   &MaxFR,
   &MaxFS,
   &PictureID,
   &OutputPartition,
+  &TemporalLayers,
   &TemporalSpatialTradeOff,
   &SpatialResampling,
   &SpatialResamplingUp,
   &SpatialResamplingDown,
+  &DamagedRegions,
   NULL
 };
 
@@ -349,6 +378,15 @@ class VP8Encoder : public PluginVideoEncoder<CODEC>
     unsigned                   m_encodingQuality;
     unsigned                   m_encodingThreads;
     unsigned                   m_encodingCPUUsed;
+    unsigned                   m_temporalLayers;
+    unsigned                   m_patternIndex;
+    unsigned                   m_framesSinceKey;
+    unsigned                   m_layerId;
+    bool                       m_layerSync;
+    bool                       m_newFrame;
+    std::vector<unsigned char> m_activeMap;
+    bool                       m_damageFull;
+    unsigned                   m_damageFrames;
 
   public:
     VP8Encoder(const PluginCodec_Definition * defn)
@@ -361,6 +399,14 @@ class VP8Encoder : public PluginVideoEncoder<CODEC>
       , m_encodingQuality(31)
       , m_encodingThreads(0)
       , m_encodingCPUUsed(0)
+      , m_temporalLayers(1)
+      , m_patternIndex(0)
+      , m_framesSinceKey(0)
+      , m_layerId(0)
+      , m_layerSync(false)
+      , m_newFrame(false)
+      , m_damageFull(true)
+      , m_damageFrames(0)
     {
       memset(&m_codec, 0, sizeof(m_codec));
     }
@@ -407,6 +453,9 @@ class VP8Encoder : public PluginVideoEncoder<CODEC>
       if (strcasecmp(optionName, "Encoding Threads") == 0)
         return SetOptionUnsigned(m_encodingThreads, optionValue, 0, 64);
 
+      if (strcasecmp(optionName, TemporalLayers.m_name) == 0)
+        return SetOptionUnsigned(m_temporalLayers, optionValue, 1, 3);
+
       if (strcasecmp(optionName, PLUGINCODEC_OPTION_MAX_BIT_RATE) == 0)
         return SetOptionUnsigned(m_maxBitRate, optionValue, 1, m_definition->bitsPerSec);
 
@@ -422,13 +471,74 @@ class VP8Encoder : public PluginVideoEncoder<CODEC>
       if (strcasecmp(optionName, SpatialResamplingDown.m_name) == 0)
         return SetOptionUnsigned(m_config.rc_resize_down_thresh, optionValue, 0, 100);
 
+      if (strcasecmp(optionName, DamagedRegions.m_name) == 0)
+        return SetDamagedRegions(optionValue);
+
       return BaseClass::SetOption(optionName, optionValue);
     }
 
 
+    /* The regions of the picture changed since the previous frame, set before
+       each frame. They are collected until a frame is coded, so a dropped frame
+       keeps them for the next one. */
+    bool SetDamagedRegions(const char * value)
+    {
+      size_t size = ((m_width+15)/16) * ((m_height+15)/16);
+      if (m_activeMap.size() != size) {
+        m_activeMap.assign(size, 0);
+        m_damageFull = true;
+      }
+
+      if (value == NULL || *value == '\0') {
+        m_damageFull = true;
+        return true;
+      }
+      if (strcasecmp(value, "none") == 0)
+        return true;
+
+      unsigned cols = (m_width+15)/16;
+      unsigned rows = (m_height+15)/16;
+      for (const char * region = value; region != NULL; region = strchr(region, ';')) {
+        if (*region == ';')
+          ++region;
+        unsigned x, y, w, h;
+        if (sscanf(region, "%u,%u,%u,%u", &x, &y, &w, &h) != 4) {
+          m_damageFull = true;
+          return true;
+        }
+        unsigned col1 = std::min((x+w+15)/16, cols);
+        unsigned row1 = std::min((y+h+15)/16, rows);
+        for (unsigned row = y/16; row < row1; ++row)
+          for (unsigned col = x/16; col < col1; ++col)
+            m_activeMap[row*cols + col] = 1;
+      }
+      return true;
+    }
+
+
+    /* Macroblocks outside the damaged regions are coded as not changed. The whole
+       picture is coded for key frames, with temporal layers (the reference is older
+       than the previous frame) and once a second, so the rate control refines the
+       static regions too. */
+    void SetActiveMap(int encodeFlags)
+    {
+      unsigned cols = (m_width+15)/16;
+      unsigned rows = (m_height+15)/16;
+      bool full = m_damageFull || m_temporalLayers > 1 || (encodeFlags & VPX_EFLAG_FORCE_KF) != 0 ||
+                  m_activeMap.size() != cols*rows || ++m_damageFrames >= PLUGINCODEC_VIDEO_CLOCK/m_frameTime;
+      if (full)
+        m_damageFrames = 0;
+
+      vpx_active_map_t map;
+      map.active_map = full ? NULL : &m_activeMap[0];
+      map.rows = rows;
+      map.cols = cols;
+      vpx_codec_control(&m_codec, VP8E_SET_ACTIVEMAP, &map);
+    }
+
+
     virtual bool OnChangedOptions()
     {
-      m_config.kf_mode = VPX_KF_AUTO;
       if (m_keyFramePeriod != 0)
         m_config.kf_min_dist = m_config.kf_max_dist = m_keyFramePeriod;
       else {
@@ -438,23 +548,115 @@ class VP8Encoder : public PluginVideoEncoder<CODEC>
 
       m_config.rc_target_bitrate = m_maxBitRate/1000;
 
-      // Take simple temporal/spatial trade off and set multiple variables
-      m_config.rc_dropframe_thresh = (31-m_tsto)*2; // m_tsto==31 is maintain frame rate, so threshold is zero
+      // Take simple temporal/spatial trade off and set multiple variables,
+      // the frame dropping and the key frame mode depend on the temporal layers
       m_config.rc_resize_allowed = m_tsto < 16;
       m_config.rc_max_quantizer = 32 + m_tsto;
 
-      if (m_config.g_w == m_width && m_config.g_h == m_height)
+      bool layersChanged = SetTemporalLayers();
+
+      if (m_config.g_w == m_width && m_config.g_h == m_height && !layersChanged)
         return !IS_ERROR(vpx_codec_enc_config_set, (&m_codec, &m_config));
 
       m_config.g_w = m_width;
       m_config.g_h = m_height;
       m_config.g_threads = m_encodingThreads;
+      m_patternIndex = 0;
 
       vpx_codec_destroy(&m_codec);
       return !IS_ERROR(vpx_codec_enc_init, (&m_codec, vpx_codec_vp8_cx(), &m_config, m_initFlags));
     }
 
 
+    /* Temporal scalability: TL0 predicts only from the previous TL0 frame,
+       so a reader may drop every frame above its own layer and still decode.
+       Key frames are issued by us at the start of the pattern so that they
+       always land on TL0. */
+    bool SetTemporalLayers()
+    {
+      // One layer: libvpx places the key frames and may drop frames,
+      // set again here so a pattern left by more layers does not stay
+      m_config.kf_mode = VPX_KF_AUTO;
+      m_config.rc_dropframe_thresh = (31-m_tsto)*2; // m_tsto==31 is maintain frame rate, so threshold is zero
+
+#ifdef VPX_TS_MAX_LAYERS
+      if (m_temporalLayers < 1 || m_temporalLayers > VPX_TS_MAX_LAYERS)
+        m_temporalLayers = 1;
+
+      bool changed = m_config.ts_number_layers != m_temporalLayers;
+      m_config.ts_number_layers = m_temporalLayers;
+
+      if (m_temporalLayers == 1) {
+        m_config.ts_periodicity = 1;
+        m_config.ts_layer_id[0] = 0;
+        m_config.ts_rate_decimator[0] = 1;
+        m_config.ts_target_bitrate[0] = m_config.rc_target_bitrate;
+        return changed;
+      }
+
+      static const unsigned LayerId[3][4] = { { 0 }, { 0, 1 }, { 0, 2, 1, 2 } };
+      static const unsigned Decimator[3][3] = { { 1 }, { 2, 1 }, { 4, 2, 1 } };
+      static const unsigned RatePercent[3][3] = { { 100 }, { 60, 100 }, { 40, 60, 100 } };
+
+      unsigned index = m_temporalLayers - 1;
+      m_config.ts_periodicity = 1 << index;
+      for (unsigned i = 0; i < m_config.ts_periodicity; ++i)
+        m_config.ts_layer_id[i] = LayerId[index][i];
+      for (unsigned i = 0; i < m_temporalLayers; ++i) {
+        m_config.ts_rate_decimator[i] = Decimator[index][i];
+        m_config.ts_target_bitrate[i] = m_config.rc_target_bitrate*RatePercent[index][i]/100;
+      }
+
+      // A dropped frame or a key frame chosen by libvpx would break the pattern
+      m_config.rc_dropframe_thresh = 0;
+      m_config.kf_mode = VPX_KF_DISABLED;
+      return changed;
+#else
+      m_temporalLayers = 1;
+      return false;
+#endif
+    }
+
+
+    int GetLayerFlags(unsigned & flags)
+    {
+      int encodeFlags = 0;
+
+      if (m_temporalLayers == 1) {
+        m_layerId = 0;
+        m_layerSync = false;
+        if ((flags&PluginCodec_CoderForceIFrame) != 0)
+          encodeFlags |= VPX_EFLAG_FORCE_KF;
+        return encodeFlags;
+      }
+
+      if ((flags&PluginCodec_CoderForceIFrame) != 0 || m_framesSinceKey >= m_config.kf_max_dist) {
+        m_patternIndex = 0;
+        m_framesSinceKey = 0;
+        encodeFlags |= VPX_EFLAG_FORCE_KF;
+      }
+
+      m_layerId = m_config.ts_layer_id[m_patternIndex];
+      m_layerSync = m_layerId == m_temporalLayers-1;
+      if (++m_patternIndex >= m_config.ts_periodicity)
+        m_patternIndex = 0;
+      ++m_framesSinceKey;
+
+      if (m_layerId == 0) // Base layer: reference and update LAST only
+        encodeFlags |= VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF;
+      else if (m_layerSync) // Top layer: reference LAST only, update nothing
+        encodeFlags |= VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF |
+                       VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF | VP8_EFLAG_NO_UPD_ENTROPY;
+      else // Middle layer: reference LAST and GF, keep its own chain in GF
+        encodeFlags |= VP8_EFLAG_NO_REF_ARF | VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_ARF;
+
+#ifdef VPX_CTRL_VP8E_SET_TEMPORAL_LAYER_ID
+      vpx_codec_control(&m_codec, VP8E_SET_TEMPORAL_LAYER_ID, m_layerId);
+#endif
+      return encodeFlags;
+    }
+
+
     bool NeedEncode()
     {
       if (m_packet != NULL)
@@ -472,6 +674,7 @@ class VP8Encoder : public PluginVideoEncoder<CODEC>
 
     virtual bool Transcode(const void * fromPtr, unsigned & fromLen, void * toPtr, unsigned & toLen, unsigned & flags)
     {
+      bool encoded = false;
       while (NeedEncode()) {
         PluginCodec_RTP srcRTP(fromPtr, fromLen);
         PluginCodec_Video_FrameHeader * video = srcRTP.GetVideoHeader();
@@ -488,13 +691,24 @@ class VP8Encoder : public PluginVideoEncoder<CODEC>
 
         vpx_codec_control(&m_codec, VP8E_SET_CPUUSED, m_encodingCPUUsed);
 
+        int encodeFlags = GetLayerFlags(flags);
+        SetActiveMap(encodeFlags);
+
         _WITH_ALIGNED_STACK( \
         if (IS_ERROR(vpx_codec_encode, (&m_codec, &image, \
                                         srcRTP.GetTimestamp(), m_frameTime, \
-                                        (flags&PluginCodec_CoderForceIFrame) != 0 ? VPX_EFLAG_FORCE_KF : 0, \
+                                        encodeFlags, \
                                         VPX_DL_REALTIME))) \
           return false; \
         );
+        m_newFrame = true;
+        encoded = true;
+      }
+
+      // the frame is coded, the next one collects its own regions
+      if (encoded) {
+        std::fill(m_activeMap.begin(), m_activeMap.end(), 0);
+        m_damageFull = false;
       }
 
       flags = 0;
@@ -527,12 +741,14 @@ class VP8EncoderRFC : public VP8Encoder
   protected:
     unsigned m_pictureId;
     unsigned m_pictureIdSize;
+    unsigned m_tl0PicIdx;
 
   public:
     VP8EncoderRFC(const PluginCodec_Definition * defn)
       : VP8Encoder(defn)
       , m_pictureId(rand()&0x7fff)
       , m_pictureIdSize(0)
+      , m_tl0PicIdx(rand()&0xff)
     {
     }
 
@@ -581,6 +797,15 @@ class VP8EncoderRFC : public VP8Encoder
     {
       size_t headerSize = 1;
 
+      // Every packet of a frame carries the same picture ID and TL0PICIDX
+      if (m_newFrame) {
+        m_newFrame = false;
+        if (m_pictureIdSize > 0 && ++m_pictureId >= m_pictureIdSize)
+          m_pictureId = 0;
+        if (m_temporalLayers > 1 && m_layerId == 0)
+          m_tl0PicIdx = (m_tl0PicIdx+1)&0xff;
+      }
+
       rtp[0] = 0;
 
       if (m_offset == 0)
@@ -594,20 +819,26 @@ class VP8EncoderRFC : public VP8Encoder
       if ((m_packet->data.frame.flags&VPX_FRAME_IS_DROPPABLE) != 0)
         rtp[0] |= 0x20; // Add N bit for non-reference frame
 
-      if (m_pictureIdSize > 0) {
-        headerSize += 2;
+      if (m_pictureIdSize > 0 || m_temporalLayers > 1) {
+        ++headerSize;
         rtp[0] |= 0x80; // Add X bit for X (extension) bit mask byte
+        rtp[1] = 0;
+      }
+
+      if (m_pictureIdSize > 0) {
         rtp[1] |= 0x80; // Add I bit for picture ID
-        if (m_pictureId < 128)
-          rtp[2] = (uint8_t)m_pictureId;
+        if (m_pictureIdSize == 0x80)
+          rtp[headerSize++] = (uint8_t)m_pictureId;
         else {
-          ++headerSize;
-          rtp[2] = (uint8_t)(0x80 | (m_pictureId >> 8));
-          rtp[3] = (uint8_t)m_pictureId;
+          rtp[headerSize++] = (uint8_t)(0x80 | (m_pictureId >> 8));
+          rtp[headerSize++] = (uint8_t)m_pictureId;
         }
+      }
 
-        if (m_offset == 0 && ++m_pictureId >= m_pictureIdSize)
-          m_pictureId = 0;
+      if (m_temporalLayers > 1) {
+        rtp[1] |= 0x60; // Add L bit for TL0PICIDX and T bit for TID
+        rtp[headerSize++] = (uint8_t)m_tl0PicIdx;
+        rtp[headerSize++] = (uint8_t)((m_layerId << 6) | (m_layerSync ? 0x20 : 0));
       }
 
       size_t fragmentSize = GetPacketSpace(rtp, m_packet->data.frame.sz - m_offset + headerSize) - headerSize;
@@ -1094,10 +1325,12 @@ static struct PluginCodec_Option const * prefix##_OptionTable[] = \
   &MaxFS, \
   &PictureID, \
   &OutputPartition, \
+  &TemporalLayers, \
   &TemporalSpatialTradeOff, \
   &SpatialResampling, \
   &SpatialResamplingUp, \
   &SpatialResamplingDown, \
+  &DamagedRegions, \
   NULL \
 }; \
 class prefix##_Format : public VP8Format \
@@ -194,7 +194,11 @@ enum PluginCodec_Flags {
   PluginCodec_BitsPerSampleMask      = 0xf000,
 
   PluginCodec_ChannelsPos            = 16,
-  PluginCodec_ChannelsMask           = 0x003f0000
+  PluginCodec_ChannelsMask           = 0x003f0000,
+
+  PluginCodec_DecodeLostMask         = 0x00400000,
+  PluginCodec_NoDecodeLost           = 0x00000000,
+  PluginCodec_DecodeLost             = 0x00400000  // audio decoder conceals lost frames, PluginCodec_CoderConcealFrame
 };
 
 #define PluginCodec_SetChannels(n) (((n-1)<<PluginCodec_ChannelsPos)&PluginCodec_ChannelsMask)
@@ -203,15 +207,25 @@ enum PluginCodec_Flags {
 enum PluginCodec_CoderFlags {
   PluginCodec_CoderSilenceFrame      = 1,    // request audio codec to create silence frame
   PluginCodec_CoderForceIFrame       = 2,    // request video codec to force I frame
-  PluginCodec_CoderPacketLoss        = 4     // indicate to video codec packets were lost
+  PluginCodec_CoderPacketLoss        = 4,    // indicate to video codec packets were lost
+  PluginCodec_CoderConcealFrame      = 8,    // audio decoder: conceal the frame of a lost packet, the input is
+                                             // the next packet for its in-band FEC, or empty
+  PluginCodec_CoderLostFramesMask    = 0xff00 // audio decoder: number of frames lost just before this packet
 };
 
+// shift of the frame count in PluginCodec_CoderLostFramesMask
+#define PluginCodec_CoderLostFramesPos 8
+
 enum PluginCodec_ReturnCoderFlags {
   PluginCodec_ReturnCoderLastFrame      = 1,    // indicates when video codec returns last data for frame
   PluginCodec_ReturnCoderIFrame         = 2,    // indicates when video returns I frame
   PluginCodec_ReturnCoderRequestIFrame  = 4,    // indicates when video decoder request I frame for resync
-  PluginCodec_ReturnCoderBufferTooSmall = 8     // indicates when output buffer is not large enough to receive
+  PluginCodec_ReturnCoderBufferTooSmall = 8,    // indicates when output buffer is not large enough to receive
                                                 // the data, another call to get_output_data_size is required
+  PluginCodec_ReturnCoderPlanes         = 16,   // indicates when video decoder returns PluginCodec_Video_FramePlanes
+  PluginCodec_ReturnCoderLostFrames     = 32,   // indicates when audio decoder output the lost frames (count in
+                                                // PluginCodec_CoderLostFramesMask) ahead of the packet
+  PluginCodec_ReturnCoderRecovered      = 64    // indicates when the newest lost frame was recovered from in-band FEC
 };
 
 struct PluginCodec_Definition;
@@ -898,6 +912,22 @@ struct PluginCodec_Video_FrameHeader {
   unsigned int  height;
 };
 
+// Decoder option: instead of copying the picture into the packed frame after
+// PluginCodec_Video_FrameHeader, store plane references to the decoder's own
+// picture there and set PluginCodec_ReturnCoderPlanes. The planes are valid
+// until the next call of the decoder.
+#define PLUGINCODEC_OPTION_OUTPUT_PLANES "Output Planes"
+
+// Encoder option, set before each frame: the regions "x,y,w,h;..." of the picture
+// changed since the previous frame, "none" when nothing changed, empty for the
+// whole picture. The encoders that may skip the other regions declare the option.
+#define PLUGINCODEC_OPTION_DAMAGED_REGIONS "Damaged Regions"
+
+struct PluginCodec_Video_FramePlanes {
+  unsigned char * data[3];
+  int             linesize[3];
+};
+
 #ifdef __cplusplus
 };
 
@@ -1037,15 +1037,26 @@ class PluginVideoDecoder : public PluginVideoCodec<NAME>
 
   protected:
     size_t m_outputSize;
+    bool   m_outputPlanes;
 
   public:
     PluginVideoDecoder(const PluginCodec_Definition * defn)
       : BaseClass(defn)
       , m_outputSize(BaseClass::DefaultWidth*BaseClass::DefaultHeight*3/2 + sizeof(PluginCodec_Video_FrameHeader) + PluginCodec_RTP_MinHeaderSize)
+      , m_outputPlanes(false)
     {
     }
 
 
+    virtual bool SetOption(const char * optionName, const char * optionValue)
+    {
+      if (strcasecmp(optionName, PLUGINCODEC_OPTION_OUTPUT_PLANES) == 0)
+        return this->SetOptionBoolean(this->m_outputPlanes, optionValue);
+
+      return BaseClass::SetOption(optionName, optionValue);
+    }
+
+
     virtual size_t GetOutputDataSize()
     {
       return this->m_outputSize;
@@ -1054,7 +1065,8 @@ class PluginVideoDecoder : public PluginVideoCodec<NAME>
 
     virtual bool CanOutputImage(unsigned width, unsigned height, PluginCodec_RTP & rtp, unsigned & flags)
     {
-      size_t newSize = this->GetRawFrameSize(width, height) + sizeof(PluginCodec_Video_FrameHeader) + rtp.GetHeaderSize();
+      size_t newSize = (m_outputPlanes ? sizeof(PluginCodec_Video_FramePlanes) : this->GetRawFrameSize(width, height))
+                     + sizeof(PluginCodec_Video_FrameHeader) + rtp.GetHeaderSize();
       if (newSize > rtp.GetMaxSize() || !rtp.SetPayloadSize(newSize)) {
         m_outputSize = newSize;
         flags |= PluginCodec_ReturnCoderBufferTooSmall;
@@ -1097,6 +1109,17 @@ class PluginVideoDecoder : public PluginVideoCodec<NAME>
       if (!CanOutputImage(width, height, rtp, flags))
         return 0;
 
+      if (m_outputPlanes) {
+        // hand over the decoder's picture, the receiver reads it with strides
+        PluginCodec_Video_FramePlanes * framePlanes = (PluginCodec_Video_FramePlanes *)rtp.GetVideoFrameData();
+        for (unsigned plane = 0; plane < 3; ++plane) {
+          framePlanes->data[plane] = planes[plane];
+          framePlanes->linesize[plane] = raster[plane];
+        }
+        flags |= PluginCodec_ReturnCoderPlanes;
+        return rtp.GetPacketSize();
+      }
+
       size_t ySize = width*height;
       size_t uvSize = ySize/4;
       if (planes[1] == planes[0]+ySize && planes[2] == planes[1]+uvSize)